@@ -11,6 +11,7 @@
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "Materials/Material.h"
 #include "Engine/World.h"
+#include "FastDcTestPlayerController.h"
 
 AFastDcTestCharacter::AFastDcTestCharacter()
 {
@@ -82,8 +83,20 @@ void AFastDcTestCharacter::Tick(float DeltaSeconds)
 			FHitResult TraceHitResult;
 			PC->GetHitResultUnderCursor(ECC_Visibility, true, TraceHitResult);
 			FVector CursorFV = TraceHitResult.ImpactNormal;
+			FVector CursorLocation = TraceHitResult.Location;
+
+			// Voxel terrain can be targeted before its mesh collision is cooked
+			FVector VoxelLocation, VoxelNormal;
+			AFastDcTestPlayerController* VoxelPC = Cast<AFastDcTestPlayerController>(PC);
+			if (VoxelPC && VoxelPC->GetVoxelHitUnderCursor(VoxelLocation, VoxelNormal) &&
+				(!TraceHitResult.bBlockingHit || FVector::Dist(TraceHitResult.TraceStart, VoxelLocation) < TraceHitResult.Distance))
+			{
+				CursorFV = VoxelNormal;
+				CursorLocation = VoxelLocation;
+			}
+
 			FRotator CursorR = CursorFV.Rotation();
-			CursorToWorld->SetWorldLocation(TraceHitResult.Location);
+			CursorToWorld->SetWorldLocation(CursorLocation);
 			CursorToWorld->SetWorldRotation(CursorR);
 		}
 	}
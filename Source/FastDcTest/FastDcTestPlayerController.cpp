@@ -5,6 +5,8 @@
 #include "Runtime/Engine/Classes/Components/DecalComponent.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "FastDcTestCharacter.h"
+#include "FastDualContouringActor.h"
+#include "EngineUtils.h"
 #include "Engine/World.h"
 
 AFastDcTestPlayerController::AFastDcTestPlayerController()
@@ -37,6 +39,9 @@ void AFastDcTestPlayerController::SetupInputComponent()
 	InputComponent->BindTouch(EInputEvent::IE_Repeat, this, &AFastDcTestPlayerController::MoveToTouchLocation);
 
 	InputComponent->BindAction("ResetVR", IE_Pressed, this, &AFastDcTestPlayerController::OnResetVR);
+
+	InputComponent->BindAction("DigVoxels", IE_Pressed, this, &AFastDcTestPlayerController::OnDigVoxelsPressed);
+	InputComponent->BindAction("FillVoxels", IE_Pressed, this, &AFastDcTestPlayerController::OnFillVoxelsPressed);
 }
 
 void AFastDcTestPlayerController::OnResetVR()
@@ -62,7 +67,13 @@ void AFastDcTestPlayerController::MoveToMouseCursor()
 		FHitResult Hit;
 		GetHitResultUnderCursor(ECC_Visibility, false, Hit);
 
-		if (Hit.bBlockingHit)
+		// Voxel terrain is picked from its density data, so it works before mesh collision is cooked
+		FVector VoxelLocation, VoxelNormal;
+		if (GetVoxelHitUnderCursor(VoxelLocation, VoxelNormal) && (!Hit.bBlockingHit || FVector::Dist(Hit.TraceStart, VoxelLocation) < Hit.Distance))
+		{
+			SetNewMoveDestination(VoxelLocation);
+		}
+		else if (Hit.bBlockingHit)
 		{
 			// We hit something, move there
 			SetNewMoveDestination(Hit.ImpactPoint);
@@ -77,13 +88,93 @@ void AFastDcTestPlayerController::MoveToTouchLocation(const ETouchIndex::Type Fi
 	// Trace to see what is under the touch location
 	FHitResult HitResult;
 	GetHitResultAtScreenPosition(ScreenSpaceLocation, CurrentClickTraceChannel, true, HitResult);
-	if (HitResult.bBlockingHit)
+
+	FVector VoxelLocation, VoxelNormal;
+	if (GetVoxelHitAtScreenPosition(ScreenSpaceLocation, VoxelLocation, VoxelNormal) && (!HitResult.bBlockingHit || FVector::Dist(HitResult.TraceStart, VoxelLocation) < HitResult.Distance))
+	{
+		SetNewMoveDestination(VoxelLocation);
+	}
+	else if (HitResult.bBlockingHit)
 	{
 		// We hit something, move there
 		SetNewMoveDestination(HitResult.ImpactPoint);
 	}
 }
 
+bool AFastDcTestPlayerController::GetVoxelHitUnderCursor(FVector& OutLocation, FVector& OutNormal) const
+{
+	FVector WorldOrigin, WorldDirection;
+	if (!DeprojectMousePositionToWorld(WorldOrigin, WorldDirection))
+	{
+		return false;
+	}
+
+	return VoxelRayCast(WorldOrigin, WorldDirection, OutLocation, OutNormal);
+}
+
+bool AFastDcTestPlayerController::GetVoxelHitAtScreenPosition(const FVector2D& ScreenPosition, FVector& OutLocation, FVector& OutNormal) const
+{
+	FVector WorldOrigin, WorldDirection;
+	if (!DeprojectScreenPositionToWorld(ScreenPosition.X, ScreenPosition.Y, WorldOrigin, WorldDirection))
+	{
+		return false;
+	}
+
+	return VoxelRayCast(WorldOrigin, WorldDirection, OutLocation, OutNormal);
+}
+
+bool AFastDcTestPlayerController::VoxelRayCast(const FVector& WorldOrigin, const FVector& WorldDirection, FVector& OutLocation, FVector& OutNormal, AFastDualContouringActor** OutActor) const
+{
+	bool bHit = false;
+	float BestDistance = HitResultTraceDistance;
+
+	for (TActorIterator<AFastDualContouringActor> It(GetWorld()); It; ++It)
+	{
+		FVector Location, Normal;
+		if (It->VoxelRayCast(WorldOrigin, WorldDirection, BestDistance, Location, Normal))
+		{
+			// the ray is clipped to the best distance so far, any new hit is closer
+			BestDistance = FVector::Dist(WorldOrigin, Location);
+			OutLocation = Location;
+			OutNormal = Normal;
+			bHit = true;
+
+			if (OutActor)
+			{
+				*OutActor = *It;
+			}
+		}
+	}
+
+	return bHit;
+}
+
+void AFastDcTestPlayerController::EditVoxelsUnderCursor(bool bDig)
+{
+	FVector WorldOrigin, WorldDirection;
+	if (!DeprojectMousePositionToWorld(WorldOrigin, WorldDirection))
+	{
+		return;
+	}
+
+	// the edit goes to the terrain actor that was hit, the sphere is centered on the surface
+	AFastDualContouringActor* Terrain = nullptr;
+	FVector Location, Normal;
+	if (!VoxelRayCast(WorldOrigin, WorldDirection, Location, Normal, &Terrain))
+	{
+		return;
+	}
+
+	if (bDig)
+	{
+		Terrain->DigSphere(Location, EditRadius);
+	}
+	else
+	{
+		Terrain->FillSphere(Location, EditRadius, (unsigned short)FMath::Clamp(FillMaterialId, 0, 65535));
+	}
+}
+
 void AFastDcTestPlayerController::SetNewMoveDestination(const FVector DestLocation)
 {
 	APawn* const MyPawn = GetPawn();
@@ -110,3 +201,13 @@ void AFastDcTestPlayerController::OnSetDestinationReleased()
 	// clear flag to indicate we should stop updating the destination
 	bMoveToMouseCursor = false;
 }
+
+void AFastDcTestPlayerController::OnDigVoxelsPressed()
+{
+	EditVoxelsUnderCursor(true);
+}
+
+void AFastDcTestPlayerController::OnFillVoxelsPressed()
+{
+	EditVoxelsUnderCursor(false);
+}
@@ -6,6 +6,8 @@
 #include "GameFramework/PlayerController.h"
 #include "FastDcTestPlayerController.generated.h"
 
+class AFastDualContouringActor;
+
 UCLASS()
 class AFastDcTestPlayerController : public APlayerController
 {
@@ -14,6 +16,20 @@ class AFastDcTestPlayerController : public APlayerController
 public:
 	AFastDcTestPlayerController();
 
+	/** Finds the voxel terrain surface under the mouse cursor directly from the density field. */
+	bool GetVoxelHitUnderCursor(FVector& OutLocation, FVector& OutNormal) const;
+
+	/** Finds the voxel terrain surface under the given screen position directly from the density field. */
+	bool GetVoxelHitAtScreenPosition(const FVector2D& ScreenPosition, FVector& OutLocation, FVector& OutNormal) const;
+
+	/** Radius of the sphere the DigVoxels and FillVoxels actions remove or add at the cursor. */
+	UPROPERTY(EditAnywhere, Category = "Voxel Edit")
+	float EditRadius = 200.f;
+
+	/** Material the FillVoxels action paints the added volume with. */
+	UPROPERTY(EditAnywhere, Category = "Voxel Edit", meta = (ClampMin = "0", ClampMax = "65535"))
+	int32 FillMaterialId = 0;
+
 protected:
 	/** True if the controlled character should navigate to the mouse cursor. */
 	uint32 bMoveToMouseCursor : 1;
@@ -38,6 +54,17 @@ protected:
 	/** Input handlers for SetDestination action. */
 	void OnSetDestinationPressed();
 	void OnSetDestinationReleased();
+
+	/** Input handlers for the DigVoxels and FillVoxels actions. */
+	void OnDigVoxelsPressed();
+	void OnFillVoxelsPressed();
+
+private:
+	/** Ray casts every voxel terrain actor and returns the nearest hit, and the actor hit if OutActor is given. */
+	bool VoxelRayCast(const FVector& WorldOrigin, const FVector& WorldDirection, FVector& OutLocation, FVector& OutNormal, AFastDualContouringActor** OutActor = nullptr) const;
+
+	/** Digs or fills a sphere of EditRadius at the voxel surface under the mouse cursor. */
+	void EditVoxelsUnderCursor(bool bDig);
 };
 
 
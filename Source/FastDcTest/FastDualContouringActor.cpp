@@ -2,21 +2,16 @@
 
 #include "FastDualContouringActor.h"
 #include "DrawDebugHelpers.h"
+#include "VoxelQuery.h"
+#include "VoxelGenerator.h"
+#include "VoxelHeightmap.h"
+#include "Misc/Paths.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "GameFramework/PlayerController.h"
 #include <algorithm>
 #include <unordered_set>
-#include <unordered_map>
-#include "qef_simd.h"
-#include "VoxelIndex.h"
-
-struct EdgeInfo {
-	FVector4 pos;
-	FVector4 normal;
-	bool winding = false;
-};
-
-using EdgeInfoMap = std::unordered_map<uint32_t, EdgeInfo>;
-using VoxelIDSet = std::unordered_set<uint32_t>;
-using VoxelIndexMap = std::unordered_map<uint32_t, int>;
 
 
 AFastDualContouringActor::AFastDualContouringActor() {
@@ -24,304 +19,184 @@ AFastDualContouringActor::AFastDualContouringActor() {
 
 	Mesh = CreateDefaultSubobject<UProceduralMeshComponent>(TEXT("GeneratedMesh"));
 	RootComponent = Mesh;
-	Mesh->bUseAsyncCooking = true;
-}
-
-static const TVoxelIndex4 AXIS_OFFSET[3] = {
-	TVoxelIndex4(1, 0, 0, 0),
-	TVoxelIndex4(0, 1, 0, 0),
-	TVoxelIndex4(0, 0, 1, 0)
-};
-
-static const TVoxelIndex4 EDGE_NODE_OFFSETS[3][4] = {
-	{ TVoxelIndex4(0), TVoxelIndex4(0, 0, 1, 0), TVoxelIndex4(0, 1, 0, 0), TVoxelIndex4(0, 1, 1, 0) },
-	{ TVoxelIndex4(0), TVoxelIndex4(1, 0, 0, 0), TVoxelIndex4(0, 0, 1, 0), TVoxelIndex4(1, 0, 1, 0) },
-	{ TVoxelIndex4(0), TVoxelIndex4(0, 1, 0, 0), TVoxelIndex4(1, 0, 0, 0), TVoxelIndex4(1, 1, 0, 0) },
-};
-
-const uint32 ENCODED_EDGE_OFFSETS[12] = {
-	0x00000000,
-	0x00100000,
-	0x00000400,
-	0x00100400,
-	0x40000000,
-	0x40100000,
-	0x40000001,
-	0x40100001,
-	0x80000000,
-	0x80000400,
-	0x80000001,
-	0x80000401,
-};
-
-const uint32_t ENCODED_EDGE_NODE_OFFSETS[12] = {
-	0x00000000,
-	0x00100000,
-	0x00000400,
-	0x00100400,
-	0x00000000,
-	0x00000001,
-	0x00100000,
-	0x00100001,
-	0x00000000,
-	0x00000400,
-	0x00000001,
-	0x00000401,
-};
-
-
-float Density(const TVoxelData* VoxelData, const TVoxelIndex4& Index) {
-	return VoxelData->getDensity(Index.X, Index.Y, Index.Z);
-}
-
-// returns x * (1.0 - a) + y * a 
-// the linear blend of x and y using the floating-point value a
-FVector4 mix(const FVector4& x, const FVector4& y, float a) {
-	return x * (1.f - a) + y * a;
-}
-
-FVector vertexInterpolation(FVector p1, FVector p2, float valp1, float valp2) {
-	static const float isolevel = 0.5f;
-
-	if (std::abs(isolevel - valp1) < 0.00001) {
-		return p1;
+	Mesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+
+	CollisionMesh = CreateDefaultSubobject<UProceduralMeshComponent>(TEXT("CollisionMesh"));
+	CollisionMesh->SetupAttachment(Mesh);
+	CollisionMesh->SetVisibility(false);
+	CollisionMesh->bUseAsyncCooking = true;
+}
+
+void AFastDualContouringActor::ApplyMesh(int32 Section, const TVoxelMeshData& MeshData) {
+	// UpdateMeshSection keeps the index buffer, only sections with the very same triangles qualify
+	const FProcMeshSection* Existing = Mesh->GetProcMeshSection(Section);
+	const bool bSameTopology = Existing != nullptr && MeshData.Vertices.Num() > 0 &&
+		Existing->ProcVertexBuffer.Num() == MeshData.Vertices.Num() &&
+		Existing->ProcIndexBuffer.Num() == MeshData.Triangles.Num() &&
+		FMemory::Memcmp(Existing->ProcIndexBuffer.GetData(), MeshData.Triangles.GetData(), MeshData.Triangles.Num() * sizeof(int32)) == 0;
+
+	if (bSameTopology) {
+		Mesh->UpdateMeshSection_LinearColor(Section, MeshData.Vertices, MeshData.Normals, MeshData.UVs, MeshData.Colors, MeshData.Tangents);
+	} else {
+		Mesh->CreateMeshSection_LinearColor(Section, MeshData.Vertices, MeshData.Triangles, MeshData.Normals, MeshData.UVs, MeshData.Colors, MeshData.Tangents, false);
+		Mesh->SetMaterial(Section, Material);
 	}
 
-	if (std::abs(isolevel - valp2) < 0.00001) {
-		return p2;
-	}
-
-	if (std::abs(valp1 - valp2) < 0.00001) {
-		return p1;
-	}
+	FVoxelPendingCollision& Collision = PendingCollision.FindOrAdd(Section);
+	Collision.Vertices = MeshData.Vertices;
+	Collision.Triangles = MeshData.Triangles;
+	Collision.Center = FBox(MeshData.Vertices).GetCenter();
+}
 
-	if (valp1 == valp2) {
-		return p1;
+void AFastDualContouringActor::QueueMesh(int32 Section, const TVoxelMeshData& MeshData) {
+	if (!PendingMeshes.Contains(Section)) {
+		PendingMeshOrder.Add(Section);
 	}
 
-	float mu = (isolevel - valp1) / (valp2 - valp1);
-	return p1 + (p2 - p1) *mu;
+	PendingMeshes.Add(Section, MeshData);
 }
 
-uint32 EncodeAxisUniqueID(const int axis, const int x, const int y, const int z) {
-	return (x << 0) | (y << 10) | (z << 20) | (axis << 30);
-}
+void AFastDualContouringActor::RemoveMesh(int32 Section) {
+	// a stale entry in the order is skipped on upload
+	PendingMeshes.Remove(Section);
+	Mesh->ClearMeshSection(Section);
 
-uint32 EncodeVoxelUniqueID(const TVoxelIndex4& idxPos) {
-	return idxPos.X | (idxPos.Y << 10) | (idxPos.Z << 20);
+	PendingCollision.Add(Section, FVoxelPendingCollision());
 }
 
-TVoxelIndex4 DecodeVoxelUniqueID(const uint32_t id) {
-	return TVoxelIndex4(id & 0x3ff, (id >> 10) & 0x3ff,	(id >> 20) & 0x3ff,	0);
-}
-
-void FindActiveVoxels(const TVoxelData* voxelData, VoxelIDSet& activeVoxels, EdgeInfoMap& activeEdges) {
-	for (int x = 0; x < voxelData->num(); x++) {
-		for (int y = 0; y < voxelData->num(); y++) {
-			for (int z = 0; z < voxelData->num(); z++) {
-				const TVoxelIndex4 p(x, y, z, 0);
-
-				for (int axis = 0; axis < 3; axis++) {
-					const TVoxelIndex4 q = p + AXIS_OFFSET[axis];
-
-					const float pDensity = Density(voxelData, p);
-					const float qDensity = Density(voxelData, q);
+void AFastDualContouringActor::UploadPendingMeshes() {
+	const double RenderStart = FPlatformTime::Seconds();
+	int32 Processed = 0;
 
-					const bool zeroCrossing = (pDensity >= 0.5f && qDensity < 0.5f) || (pDensity < 0.5f && qDensity >= 0.5f);
-
-					if (!zeroCrossing) continue;
-
-					//UE_LOG(LogTemp, Warning, TEXT("x, y, z - pDensity, qDensity  --> %d %d %d - %f %f"), x, y, z, pDensity, qDensity);
-
-					const FVector p1 = voxelData->voxelIndexToVector(p.X, p.Y, p.Z);
-					const FVector q1 = voxelData->voxelIndexToVector(q.X, q.Y, q.Z);
-					const FVector4 pos = vertexInterpolation(p1, q1, pDensity, qDensity);
-
-					FVector4 tmp(
-						Density(voxelData, p + TVoxelIndex4(1, 0, 0, 0)) - Density(voxelData, p - TVoxelIndex4(1, 0, 0, 0)),
-						Density(voxelData, p + TVoxelIndex4(0, 1, 0, 0)) - Density(voxelData, p - TVoxelIndex4(0, 1, 0, 0)),
-						Density(voxelData, p + TVoxelIndex4(0, 0, 1, 0)) - Density(voxelData, p - TVoxelIndex4(0, 0, 1, 0)),
-						0.f);
-
-					auto normal = -tmp.GetSafeNormal(0.000001f);
-
-					EdgeInfo info;
-					info.pos = pos;
-					info.normal = normal;
-					info.winding = pDensity >= 0.5f;
-
-					const auto code = EncodeAxisUniqueID(axis, x, y, z);
-
-					//UE_LOG(LogTemp, Warning, TEXT("code  --> %d"), code);
+	while (Processed < PendingMeshOrder.Num()) {
+		if (Processed > 0 && (FPlatformTime::Seconds() - RenderStart) * 1000.0 >= MeshUploadBudgetMs) {
+			break;
+		}
 
-					activeEdges[code] = info;
+		const int32 Section = PendingMeshOrder[Processed++];
 
-					const auto edgeNodes = EDGE_NODE_OFFSETS[axis];
-					for (int i = 0; i < 4; i++) {
-						const auto nodeIdxPos = p - edgeNodes[i];
-						const auto nodeID = EncodeVoxelUniqueID(nodeIdxPos);
-						activeVoxels.insert(nodeID);
-					}
-				}
-			}
+		TVoxelMeshData* MeshData = PendingMeshes.Find(Section);
+		if (MeshData != nullptr) {
+			ApplyMesh(Section, *MeshData);
+			PendingMeshes.Remove(Section);
 		}
 	}
-}
-
-static void GenerateVertexData(const VoxelIDSet& voxels, const EdgeInfoMap& edges, VoxelIndexMap& vertexIndices, TArray<FVector>& varray, TArray<FVector>& narray) {
-	int idxCounter = 0;
-	for (const auto& voxelID : voxels) {
-		FVector4 p[12];
-		FVector4 n[12];
-
-		int idx = 0;
-		for (int i = 0; i < 12; i++) {
-			const auto edgeID = voxelID + ENCODED_EDGE_OFFSETS[i];
-			const auto iter = edges.find(edgeID);
-
-			if (iter != end(edges)) {
-				const auto& info = iter->second;
-				const FVector4 pos = info.pos;
-				const FVector4 normal = info.normal;
-
-				p[idx] = pos;
-				n[idx] = normal;
-				idx++;
-			}
-		}
-
-		FVector4 nodePos;
-		qef_solve_from_points_4d(&p[0].X, &n[0].X, idx, &nodePos.X);
 
-		FVector4 nodeNormal;
-		for (int i = 0; i < idx; i++) {
-			nodeNormal += n[i];
-		}
+	PendingMeshOrder.RemoveAt(0, Processed, false);
 
-		nodeNormal *= (1.f / (float)idx);
+	if (PendingCollision.Num() == 0) {
+		return;
+	}
 
-		vertexIndices[voxelID] = idxCounter++;
-		varray.Add(FVector(nodePos.X, nodePos.Y, nodePos.Z));
-		narray.Add(FVector(nodeNormal.X, nodeNormal.Y, nodeNormal.Z));
+	FVector Viewer = GetActorLocation();
+	APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	if (PlayerController != nullptr && PlayerController->GetPawn() != nullptr) {
+		Viewer = PlayerController->GetPawn()->GetActorLocation();
 	}
 
-}
+	const FVector LocalViewer = GetActorTransform().InverseTransformPosition(Viewer);
+	const int32 Count = FMath::Min(PendingCollision.Num(), FMath::Max(CollisionSectionsPerFrame, 1));
+
+	// creating or clearing a section cooks the collision of the whole component again, so the
+	// sections are set without it and cooked together below
+	for (int32 Batched = 0; Batched < Count; Batched++) {
+		int32 Nearest = 0;
+		float NearestDistance = MAX_flt;
 
-static void GenerateTriangles(const EdgeInfoMap& edges, const VoxelIndexMap& vertexIndices, TArray<int32>& triarray) {
-	for (const auto& pair : edges) {
-		const auto& edge = pair.first;
-		const auto& info = pair.second;
-
-		const TVoxelIndex4 basePos = DecodeVoxelUniqueID(edge);
-		const int axis = (edge >> 30) & 0xff;
-
-		const int nodeID = edge & ~0xc0000000;
-		const uint32_t voxelIDs[4] = {
-			nodeID - ENCODED_EDGE_NODE_OFFSETS[axis * 4 + 0],
-			nodeID - ENCODED_EDGE_NODE_OFFSETS[axis * 4 + 1],
-			nodeID - ENCODED_EDGE_NODE_OFFSETS[axis * 4 + 2],
-			nodeID - ENCODED_EDGE_NODE_OFFSETS[axis * 4 + 3],
-		};
-
-		// attempt to find the 4 voxels which share this edge
-		int edgeVoxels[4];
-		int numFoundVoxels = 0;
-		for (int i = 0; i < 4; i++) {
-			const auto iter = vertexIndices.find(voxelIDs[i]);
-			if (iter != end(vertexIndices)) {
-				edgeVoxels[numFoundVoxels++] = iter->second;
+		for (const auto& Pair : PendingCollision) {
+			const float Distance = FVector::DistSquared(Pair.Value.Center, LocalViewer);
+			if (Distance < NearestDistance) {
+				Nearest = Pair.Key;
+				NearestDistance = Distance;
 			}
 		}
 
-		// we can only generate a quad (or two triangles) if all 4 are found
-		if (numFoundVoxels < 4) {
-			continue;
+		const FVoxelPendingCollision Collision = MoveTemp(PendingCollision.FindChecked(Nearest));
+		PendingCollision.Remove(Nearest);
+
+		// no vertices leaves the section empty, which clears it
+		FProcMeshSection Section;
+		Section.ProcVertexBuffer.SetNum(Collision.Vertices.Num());
+		for (int32 i = 0; i < Collision.Vertices.Num(); i++) {
+			Section.ProcVertexBuffer[i].Position = Collision.Vertices[i];
+			Section.SectionLocalBox += Collision.Vertices[i];
 		}
 
-		if (info.winding) {
-			triarray.Add(edgeVoxels[0]);
-			triarray.Add(edgeVoxels[1]);
-			triarray.Add(edgeVoxels[3]);
-
-			triarray.Add(edgeVoxels[0]);
-			triarray.Add(edgeVoxels[3]);
-			triarray.Add(edgeVoxels[2]);
-		} else {
-			triarray.Add(edgeVoxels[0]);
-			triarray.Add(edgeVoxels[3]);
-			triarray.Add(edgeVoxels[1]);
-
-			triarray.Add(edgeVoxels[0]);
-			triarray.Add(edgeVoxels[2]);
-			triarray.Add(edgeVoxels[3]);
+		Section.ProcIndexBuffer.SetNum(Collision.Triangles.Num());
+		for (int32 i = 0; i < Collision.Triangles.Num(); i++) {
+			Section.ProcIndexBuffer[i] = Collision.Triangles[i];
 		}
+
+		Section.bEnableCollision = Collision.Vertices.Num() > 0;
+		CollisionMesh->SetProcMeshSection(Nearest, Section);
 	}
-}
 
+	// the component has no convex elements, clearing them is only for the one cook of the frame
+	CollisionMesh->ClearCollisionConvexMeshes();
+}
 
 void AFastDualContouringActor::BeginPlay() {
 	Super::BeginPlay();
 
-	VoxelData = new TVoxelData(256, 500);
-
-	static const float Extend = 100.f;
-
-	VoxelData->forEach([&](int x, int y, int z) {
-		FVector Pos = VoxelData->voxelIndexToVector(x, y, z);
-		if (Pos.X < Extend && Pos.X > -Extend && Pos.Y < Extend && Pos.Y > -Extend && Pos.Z < Extend && Pos.Z > -Extend) {
-			VoxelData->setDensity(x, y, z, 1);
-			//DrawDebugPoint(GetWorld(), Pos + GetActorLocation(), 3, FColor(255, 0, 0), true, 10000000);
-		}
-	});
-
-	FVector Pos(100, 100, 100);
-	static const float R = 50.f;
-	static const float Extend2 = R * 5.f;
-
-	VoxelData->forEach([&](int x, int y, int z) {
-		float density = VoxelData->getDensity(x, y, z);
-		FVector o = VoxelData->voxelIndexToVector(x, y, z);
-		o -= Pos;
-
-		float rl = std::sqrt(o.X * o.X + o.Y * o.Y + o.Z * o.Z);
-		if (rl < Extend2) {
-			float d = density + 1 / rl * R;
-			VoxelData->setDensity(x, y, z, d);
+	if (bStreamWorld) {
+		TVoxelChunkStreamerSettings Settings;
+		Settings.chunkVoxelNum = StreamChunkVoxels;
+		Settings.chunkSize = StreamChunkSize;
+		Settings.loadRadius = StreamRadius;
+		Settings.maxVoxelMemory = (size_t)StreamVoxelMemoryMB * 1024 * 1024;
+		Settings.maxMeshMemory = (size_t)StreamMeshMemoryMB * 1024 * 1024;
+		Settings.workerNum = StreamWorkers;
+		Settings.lodDistance = StreamLodDistance;
+		Settings.saveDirectory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("VoxelChunks"));
+		Settings.bSimplifyMeshes = bSimplifyMesh;
+		Settings.simplify = GetSimplifySettings();
+		Settings.surface = GetSurfaceSettings();
+
+		TVoxelChunkGenerator Generator = &VoxelGenerateDefaultTerrain;
+
+		if (!StreamHeightmap.IsEmpty()) {
+			std::shared_ptr<TVoxelHeightmap> Heightmap = std::make_shared<TVoxelHeightmap>();
+			Heightmap->spacing = StreamHeightmapSpacing;
+			Heightmap->heightRange = StreamHeightmapRange;
+			Heightmap->baseHeight = StreamHeightmapBase;
+
+			// centered on the actor's world origin
+			if (VoxelLoadHeightmapR16(FPaths::Combine(FPaths::ProjectDir(), StreamHeightmap), StreamHeightmapSizeX, StreamHeightmapSizeY, *Heightmap)) {
+				Heightmap->origin = FVector2D(Heightmap->sizeX - 1, Heightmap->sizeY - 1) * (StreamHeightmapSpacing * -0.5f);
+				Generator = [Heightmap](TVoxelData& Data, const FVector& Origin) {
+					VoxelImportHeightmap(Data, Origin, *Heightmap, true);
+				};
+			}
 		}
-
-	});
-
-	VoxelIDSet activeVoxels;
-	EdgeInfoMap activeEdges;
-
-	FindActiveVoxels(VoxelData, activeVoxels, activeEdges);
-
-	UE_LOG(LogTemp, Warning, TEXT("activeVoxels --> %d"), activeVoxels.size());
-	UE_LOG(LogTemp, Warning, TEXT("activeEdges  --> %d"), activeEdges.size());
 
+		ChunkStreamer.reset(new TVoxelChunkStreamer(Settings, Generator));
+		return;
+	}
 
-	TArray<FVector> varray;
-	TArray<FVector> narray;
-	TArray<int32> triarray;
-	VoxelIndexMap vertexIndices;
+	VoxelData = new TVoxelData(256, 500);
 
-	GenerateVertexData(activeVoxels, activeEdges, vertexIndices, varray, narray);
+	// cube with a ball stuck on its corner
+	static const float Extend = 100.f;
+	const TVoxelSdfGenerator Generator(VoxelSdfUnion(
+		VoxelSdfBox(FVector::ZeroVector, FVector(Extend, Extend, Extend)),
+		VoxelSdfSphere(FVector(100, 100, 100), 100.f)));
 
-	UE_LOG(LogTemp, Warning, TEXT("varray --> %d"), varray.Num());
-	UE_LOG(LogTemp, Warning, TEXT("narray  --> %d"), narray.Num());
-	UE_LOG(LogTemp, Warning, TEXT("vertexIndices  --> %d"), vertexIndices.size());
+	VoxelGenerate(*VoxelData, FVector::ZeroVector, Generator, true);
 
-	GenerateTriangles(activeEdges, vertexIndices, triarray);
+	VoxelSnapshot = TVoxelSnapshot::capture(*VoxelData, nullptr);
 
-	UE_LOG(LogTemp, Warning, TEXT("triarray  --> %d"), triarray.Num());
+	UndoHistory = TVoxelUndoHistory(UndoSteps);
+	UndoHistory.reset(VoxelSnapshot);
 
-	TArray<FVector2D> UV0;
-	TArray<FLinearColor> vertexColors;
-	TArray<FProcMeshTangent> tangents;
+	TVoxelMeshingContext* Context = TVoxelMeshingContextPool::get().acquire();
+	Context->surface = GetSurfaceSettings();
+	PolygonizeVolume(VoxelData, *Context);
+	if (bSimplifyMesh) {
+		VoxelSimplifyMesh(*Context, GetSimplifySettings());
+	}
 
-	Mesh->CreateMeshSection_LinearColor(0, varray, triarray, narray, UV0, vertexColors, tangents, true);
-	Mesh->bUseAsyncCooking = true;
-	Mesh->SetMaterial(0, Material);
+	QueueMesh(0, Context->mesh);
+	TVoxelMeshingContextPool::get().release(Context);
 
 	/*
 	TArray<FVector> vertices;
@@ -363,357 +238,365 @@ void AFastDualContouringActor::BeginPlay() {
 }
 
 
-void AFastDualContouringActor::Tick(float DeltaTime) {
-	Super::Tick(DeltaTime);
+void AFastDualContouringActor::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+	if (MeshTask.IsValid()) {
+		MeshTask.Wait();
+		TVoxelMeshingContextPool::get().release(MeshTask.Get());
+		MeshTask.Reset();
+	}
 
-}
+	// waits for chunk tasks and saves modified chunks
+	ChunkStreamer.reset();
 
+	Super::EndPlay(EndPlayReason);
+}
 
+void AFastDualContouringActor::Tick(float DeltaTime) {
+	Super::Tick(DeltaTime);
 
-//====================================================================================
-// Voxel data impl
-//====================================================================================
+	if (ChunkStreamer) {
+		TickStreaming();
+	} else if (VoxelData != nullptr) {
+		TickVolume();
+	}
 
-TVoxelData::TVoxelData(int num, float size) {
-	// int s = num*num*num;
+	UploadPendingMeshes();
+}
 
-	density_data = NULL;
-	density_state = TVoxelDataFillState::ZERO;
+void AFastDualContouringActor::TickVolume() {
+	ApplyPendingEdits();
 
-	material_data = NULL;
+	if (MeshTask.IsValid() && MeshTask.IsReady()) {
+		TVoxelMeshingContext* Context = MeshTask.Get();
+		MeshTask.Reset();
 
-	voxel_num = num;
-	volume_size = size;
+		QueueMesh(0, Context->mesh);
+		TVoxelMeshingContextPool::get().release(Context);
+		VoxelData->resetLastMeshRegenerationTime();
+	}
 
-	UE_LOG(LogTemp, Warning, TEXT("num  --> %d "), num);
-}
+	// the background rebuild reads only the snapshot, edits keep being applied meanwhile
+	if (bMeshDirty && !MeshTask.IsValid()) {
+		bMeshDirty = false;
+
+		const std::shared_ptr<const TVoxelSnapshot> Snapshot = VoxelSnapshot;
+		const bool bSimplify = bSimplifyMesh;
+		const TVoxelSimplifySettings SimplifySettings = GetSimplifySettings();
+		const TVoxelSurfaceSettings SurfaceSettings = GetSurfaceSettings();
+
+		MeshTask = Async<TVoxelMeshingContext*>(EAsyncExecution::ThreadPool, [Snapshot, bSimplify, SimplifySettings, SurfaceSettings]() {
+			// the context goes back to the pool once the game thread has uploaded its mesh
+			TVoxelMeshingContext* Context = TVoxelMeshingContextPool::get().acquire();
+			Context->surface = SurfaceSettings;
+			PolygonizeVolume(Snapshot.get(), *Context);
+			if (bSimplify) {
+				VoxelSimplifyMesh(*Context, SimplifySettings);
+			}
 
-TVoxelData::~TVoxelData() {
-	delete[] density_data;
-	delete[] material_data;
+			return Context;
+		});
+	}
 }
 
-FORCEINLINE void TVoxelData::initializeDensity() {
-	int s = voxel_num * voxel_num * voxel_num;
-	density_data = new unsigned char[s];
-	for (auto x = 0; x < voxel_num; x++) {
-		for (auto y = 0; y < voxel_num; y++) {
-			for (auto z = 0; z < voxel_num; z++) {
-				if (density_state == TVoxelDataFillState::ALL) {
-					setDensity(x, y, z, 1);
-				}
-
-				if (density_state == TVoxelDataFillState::ZERO) {
-					setDensity(x, y, z, 0);
-				}
-			}
-		}
+// the only point in the frame where queued edits reach the live volume, besides undo and redo
+void AFastDualContouringActor::ApplyPendingEdits() {
+	if (EditQueue.applyPending(*VoxelData) > 0) {
+		std::atomic_store(&VoxelSnapshot, TVoxelSnapshot::capture(*VoxelData, VoxelSnapshot));
+		UndoHistory.push(VoxelSnapshot);
+		bMeshDirty = true;
 	}
 }
 
-FORCEINLINE void TVoxelData::initializeMaterial() {
-	int s = voxel_num * voxel_num * voxel_num;
-	material_data = new unsigned short[s];
-	for (auto x = 0; x < voxel_num; x++) {
-		for (auto y = 0; y < voxel_num; y++) {
-			for (auto z = 0; z < voxel_num; z++) {
-				setMaterial(x, y, z, base_fill_mat);
-			}
-		}
+void AFastDualContouringActor::Undo() {
+	if (VoxelData == nullptr) {
+		return;
 	}
-}
 
-FORCEINLINE void TVoxelData::setDensity(int x, int y, int z, float density) {
-	if (density_data == NULL) {
-		if (density_state == TVoxelDataFillState::ZERO && density == 0) {
-			return;
-		}
+	ApplyPendingEdits();
 
-		if (density_state == TVoxelDataFillState::ALL && density == 1) {
-			return;
-		}
+	const std::shared_ptr<const TVoxelSnapshot> Restored = UndoHistory.undo(*VoxelData);
+	if (Restored) {
+		std::atomic_store(&VoxelSnapshot, Restored);
+		VoxelData->setChanged();
+		bMeshDirty = true;
+	}
+}
 
-		initializeDensity();
-		density_state = TVoxelDataFillState::MIX;
+void AFastDualContouringActor::Redo() {
+	if (VoxelData == nullptr) {
+		return;
 	}
 
-	if (x < voxel_num && y < voxel_num && z < voxel_num) {
-		int index = x * voxel_num * voxel_num + y * voxel_num + z;
+	ApplyPendingEdits();
 
-		if (density < 0) density = 0;
-		if (density > 1) density = 1;
+	const std::shared_ptr<const TVoxelSnapshot> Restored = UndoHistory.redo(*VoxelData);
+	if (Restored) {
+		std::atomic_store(&VoxelSnapshot, Restored);
+		VoxelData->setChanged();
+		bMeshDirty = true;
+	}
+}
 
-		unsigned char d = 255 * density;
+bool AFastDualContouringActor::GetMeshJobStats(TVoxelJobStats& OutStats, bool bReset) {
+	if (!ChunkStreamer) {
+		return false;
+	}
 
-		density_data[index] = d;
+	OutStats = ChunkStreamer->getJobStats();
+	if (bReset) {
+		ChunkStreamer->resetJobStats();
 	}
+
+	return true;
 }
 
-FORCEINLINE float TVoxelData::getDensity(int x, int y, int z) const {
-	if (density_data == NULL) {
-		if (density_state == TVoxelDataFillState::ALL) {
-			return 1;
-		}
+void AFastDualContouringActor::TickStreaming() {
+	EditQueue.applyPending([this](const TVoxelEdit& Edit) {
+		ChunkStreamer->applyEdit(Edit);
+	});
 
-		return 0;
+	APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	if (PlayerController == nullptr) {
+		return;
 	}
 
-	if (x < voxel_num && y < voxel_num && z < voxel_num) {
-		int index = x * voxel_num * voxel_num + y * voxel_num + z;
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
 
-		float d = (float)density_data[index] / 255.0f;
-		return d;
-	}
-	else {
-		return 0;
+	// page around the character, the top-down camera only decides what is in view
+	if (PlayerController->GetPawn() != nullptr) {
+		ViewLocation = PlayerController->GetPawn()->GetActorLocation();
 	}
+
+	const FTransform& Transform = GetActorTransform();
+	ChunkStreamer->update(Transform.InverseTransformPosition(ViewLocation), Transform.InverseTransformVectorNoScale(ViewRotation.Vector()),
+		[this](int32 Section, const TVoxelMeshData& MeshData) {
+			QueueMesh(Section, MeshData);
+		},
+		[this](int32 Section) {
+			RemoveMesh(Section);
+		});
+}
+
+TVoxelSimplifySettings AFastDualContouringActor::GetSimplifySettings() const {
+	TVoxelSimplifySettings Settings;
+	Settings.maxTriangles = SimplifyTriangleBudget;
+	Settings.maxError = SimplifyMaxError;
+	Settings.weldDistance = SimplifyMaxError * 0.01f;
+	return Settings;
 }
 
-FORCEINLINE unsigned char TVoxelData::getRawDensity(int x, int y, int z) const {
-	auto index = x * voxel_num * voxel_num + y * voxel_num + z;
-	return density_data[index];
+TVoxelSurfaceSettings AFastDualContouringActor::GetSurfaceSettings() const {
+	TVoxelSurfaceSettings Settings;
+	Settings.uvScale = TextureWorldSize > 0.f ? 1.f / TextureWorldSize : 0.f;
+	return Settings;
 }
 
-FORCEINLINE void TVoxelData::setMaterial(const int x, const int y, const int z, const unsigned short material) {
-	if (material_data == NULL) {
-		initializeMaterial();
+void AFastDualContouringActor::SubmitVoxelEdit(const TVoxelEdit& Edit) {
+	EditQueue.submit(Edit);
+}
+
+void AFastDualContouringActor::DigSphere(const FVector& Center, float Radius) {
+	const FTransform& Transform = GetActorTransform();
+	SubmitVoxelEdit(TVoxelEdit::digSphere(Transform.InverseTransformPosition(Center), Radius / Transform.GetMaximumAxisScale()));
+}
+
+void AFastDualContouringActor::FillSphere(const FVector& Center, float Radius, unsigned short MaterialId) {
+	const FTransform& Transform = GetActorTransform();
+	SubmitVoxelEdit(TVoxelEdit::fillSphere(Transform.InverseTransformPosition(Center), Radius / Transform.GetMaximumAxisScale(), MaterialId));
+}
+
+void AFastDualContouringActor::FilterSphere(const FVector& Center, float Radius, const TVoxelFilterSettings& Filter) {
+	const FTransform& Transform = GetActorTransform();
+	SubmitVoxelEdit(TVoxelEdit::filterSphere(Transform.InverseTransformPosition(Center), Radius / Transform.GetMaximumAxisScale(), Filter));
+}
+
+std::shared_ptr<const TVoxelSnapshot> AFastDualContouringActor::GetVoxelSnapshot() const {
+	return std::atomic_load(&VoxelSnapshot);
+}
+
+bool AFastDualContouringActor::VoxelRayCast(const FVector& Start, const FVector& Direction, float MaxDistance, FVector& OutLocation, FVector& OutNormal) const {
+	if (VoxelData == nullptr && ChunkStreamer == nullptr) {
+		return false;
 	}
 
-	if (x < voxel_num && y < voxel_num && z < voxel_num) {
-		int index = x * voxel_num * voxel_num + y * voxel_num + z;
-		material_data[index] = material;
+	const FTransform& Transform = GetActorTransform();
+	const FVector LocalStart = Transform.InverseTransformPosition(Start);
+	const FVector LocalRay = Transform.InverseTransformVector(Direction.GetSafeNormal() * MaxDistance);
+
+	TVoxelRayHit Hit;
+	const bool bHit = ChunkStreamer
+		? ChunkStreamer->rayCast(LocalStart, LocalRay, LocalRay.Size(), Hit)
+		: ::VoxelRayCast(*VoxelData, LocalStart, LocalRay, LocalRay.Size(), Hit);
+	if (!bHit) {
+		return false;
 	}
+
+	OutLocation = Transform.TransformPosition(Hit.Location);
+	OutNormal = Transform.TransformVectorNoScale(Hit.Normal);
+	return true;
 }
 
-FORCEINLINE unsigned short TVoxelData::getMaterial(int x, int y, int z) const {
-	if (material_data == NULL) {
-		return base_fill_mat;
+float AFastDualContouringActor::GetDensityAt(const FVector& Location) const {
+	if (ChunkStreamer) {
+		return ChunkStreamer->sampleDensity(GetActorTransform().InverseTransformPosition(Location));
 	}
 
-	if (x < voxel_num && y < voxel_num && z < voxel_num) {
-		int index = x * voxel_num * voxel_num + y * voxel_num + z;
-		return material_data[index];
-	}
-	else {
+	if (VoxelData == nullptr) {
 		return 0;
 	}
-}
 
-FORCEINLINE FVector TVoxelData::voxelIndexToVector(int x, int y, int z) const {
-	static const float step = size() / (num() - 1);
-	static const float s = -size() / 2;
-	FVector v(s, s, s);
-	FVector a(x * step, y * step, z * step);
-	v = v + a;
-	return v;
+	return VoxelSampleDensity(*VoxelData, GetActorTransform().InverseTransformPosition(Location));
 }
 
-void TVoxelData::vectorToVoxelIndex(const FVector& v, int& x, int& y, int& z) const {
-	static const float step = size() / (num() - 1);
+bool AFastDualContouringActor::VoxelSphereOverlap(const FVector& Center, float Radius) const {
+	const FTransform& Transform = GetActorTransform();
+	if (ChunkStreamer) {
+		return ChunkStreamer->sphereOverlap(Transform.InverseTransformPosition(Center), Radius / Transform.GetMaximumAxisScale());
+	}
 
-	x = (int)(v.X / step) + num() / 2 - 1;
-	y = (int)(v.Y / step) + num() / 2 - 1;
-	z = (int)(v.Z / step) + num() / 2 - 1;
-}
+	if (VoxelData == nullptr) {
+		return false;
+	}
 
-void TVoxelData::setOrigin(FVector o) {
-	origin = o;
-	lower = FVector(o.X - volume_size, o.Y - volume_size, o.Z - volume_size);
-	upper = FVector(o.X + volume_size, o.Y + volume_size, o.Z + volume_size);
+	return ::VoxelSphereOverlap(*VoxelData, Transform.InverseTransformPosition(Center), Radius / Transform.GetMaximumAxisScale());
 }
 
-FORCEINLINE FVector TVoxelData::getOrigin() const {
-	return origin;
+static void LogVoxelMemory(const TCHAR* Name, const TVoxelMemoryStats& Stats) {
+	UE_LOG(LogTemp, Log, TEXT("  %s: %d KB in %d blocks (density %d, material %d, pyramid %d, substance cache %d, brick stamps %d KB)"), Name,
+		(int)(Stats.getTotal() / 1024), Stats.allocations, (int)(Stats.density / 1024), (int)(Stats.material / 1024),
+		(int)(Stats.pyramid / 1024), (int)(Stats.substanceCache / 1024), (int)(Stats.brickVersions / 1024));
 }
 
-FORCEINLINE float TVoxelData::size() const {
-	return volume_size;
-}
+void AFastDualContouringActor::LogMemoryReport(int32 TopChunks) const {
+	UE_LOG(LogTemp, Log, TEXT("%s memory:"), *GetName());
 
-FORCEINLINE int TVoxelData::num() const {
-	return voxel_num;
-}
+	if (VoxelData != nullptr) {
+		LogVoxelMemory(TEXT("volume"), VoxelData->getMemoryStats());
 
-FORCEINLINE TVoxelPoint TVoxelData::getVoxelPoint(int x, int y, int z) const {
-	TVoxelPoint vp;
-	int index = x * voxel_num * voxel_num + y * voxel_num + z;
+		// each counts only what the ones before it don't hold already
+		std::unordered_set<const void*> Counted;
+		VoxelData->getDensityPyramid().getAllocatedSize(Counted);
 
-	vp.material = base_fill_mat;
-	vp.density = 0;
+		const std::shared_ptr<const TVoxelSnapshot> Snapshot = GetVoxelSnapshot();
+		const size_t SnapshotBytes = Snapshot ? Snapshot->getAllocatedSize(&Counted) : 0;
+		const size_t HistoryBytes = UndoHistory.getAllocatedSize(&Counted);
 
-	if (density_data != NULL) {
-		vp.density = density_data[index];
+		UE_LOG(LogTemp, Log, TEXT("  snapshot: %d KB beyond the volume, undo history: %d KB beyond both, %d steps"),
+			(int)(SnapshotBytes / 1024), (int)(HistoryBytes / 1024), UndoHistory.stepNum());
 	}
 
-	if (material_data != NULL) {
-		vp.material = material_data[index];
-	}
+	if (ChunkStreamer) {
+		std::vector<TVoxelChunkMemory> Chunks;
+		ChunkStreamer->getChunkMemory(Chunks);
 
-	return vp;
-}
+		TVoxelMemoryStats Voxels;
+		size_t SnapshotBytes = 0;
+		size_t MeshBytes = 0;
+		int32 Resident = 0;
+
+		for (const TVoxelChunkMemory& Chunk : Chunks) {
+			Voxels += Chunk.voxels;
+			SnapshotBytes += Chunk.snapshotBytes;
+			MeshBytes += Chunk.meshBytes + Chunk.boundaryBytes;
+			Resident += Chunk.bResident ? 1 : 0;
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("  %d chunks, %d resident; voxels %d of %d KB, meshes %d of %d KB"), (int32)Chunks.size(), Resident,
+			(int)(ChunkStreamer->getVoxelMemory() / 1024), StreamVoxelMemoryMB * 1024, (int)(ChunkStreamer->getMeshMemory() / 1024), StreamMeshMemoryMB * 1024);
+		LogVoxelMemory(TEXT("chunk volumes"), Voxels);
+		UE_LOG(LogTemp, Log, TEXT("  snapshots %d KB, meshes and boundaries %d KB"), (int)(SnapshotBytes / 1024), (int)(MeshBytes / 1024));
+
+		const int32 Top = FMath::Clamp(TopChunks, 0, (int32)Chunks.size());
+		std::partial_sort(Chunks.begin(), Chunks.begin() + Top, Chunks.end(), [](const TVoxelChunkMemory& A, const TVoxelChunkMemory& B) {
+			return A.getTotal() > B.getTotal();
+		});
+
+		for (int32 i = 0; i < Top; i++) {
+			const TVoxelChunkMemory& Chunk = Chunks[i];
+			UE_LOG(LogTemp, Log, TEXT("  chunk (%d, %d, %d)%s: %d KB, voxels %d, snapshot %d, mesh %d, boundary %d KB"),
+				Chunk.index.X, Chunk.index.Y, Chunk.index.Z, Chunk.bResident ? TEXT("") : TEXT(" loading"), (int)(Chunk.getTotal() / 1024),
+				(int)(Chunk.voxels.getTotal() / 1024), (int)(Chunk.snapshotBytes / 1024), (int)(Chunk.meshBytes / 1024), (int)(Chunk.boundaryBytes / 1024));
+		}
+	}
 
-FORCEINLINE void TVoxelData::setVoxelPoint(int x, int y, int z, unsigned char density, unsigned short material) {
-	if (density_data == NULL) {
-		initializeDensity();
-		density_state = TVoxelDataFillState::MIX;
+	const TVoxelMeshingPoolStats Pool = TVoxelMeshingContextPool::get().getStats();
+	UE_LOG(LogTemp, Log, TEXT("  meshing contexts: %d, %d in use; %d KB in %d allocations (hash maps %d, sweep %d, materials %d, mesh %d, simplifier %d KB), largest build %d KB"),
+		Pool.contexts, Pool.inUse, (int)(Pool.memory.getTotal() / 1024), Pool.memory.allocations, (int)(Pool.memory.hashMaps / 1024),
+		(int)(Pool.memory.sweep / 1024), (int)(Pool.memory.materials / 1024), (int)(Pool.memory.mesh / 1024), (int)(Pool.memory.simplifier / 1024), (int)(Pool.largestBuild / 1024));
+	UE_LOG(LogTemp, Log, TEXT("  simplified meshes: %d, %lld -> %lld triangles"),
+		Pool.simplify.runs, (long long)Pool.simplify.inputTriangles, (long long)Pool.simplify.outputTriangles);
+
+	size_t PendingBytes = 0;
+	for (const auto& Pair : PendingMeshes) {
+		const TVoxelMeshData& MeshData = Pair.Value;
+		PendingBytes += MeshData.Vertices.GetAllocatedSize() + MeshData.Normals.GetAllocatedSize() + MeshData.Materials.GetAllocatedSize() +
+			MeshData.Triangles.GetAllocatedSize() + MeshData.UVs.GetAllocatedSize() + MeshData.Colors.GetAllocatedSize() + MeshData.Tangents.GetAllocatedSize();
 	}
 
-	if (material_data == NULL) {
-		initializeMaterial();
+	for (const auto& Pair : PendingCollision) {
+		PendingBytes += Pair.Value.Vertices.GetAllocatedSize() + Pair.Value.Triangles.GetAllocatedSize();
 	}
 
-	int index = x * voxel_num * voxel_num + y * voxel_num + z;
-	material_data[index] = material;
-	density_data[index] = density;
+	UE_LOG(LogTemp, Log, TEXT("  pending uploads: %d meshes, %d collision, %d KB"), PendingMeshes.Num(), PendingCollision.Num(), (int)(PendingBytes / 1024));
+
+	const TVoxelLiveMemory Live = TVoxelData::getLiveMemory();
+	UE_LOG(LogTemp, Log, TEXT("  process: %lld volumes, %lld density arrays, %lld KB"), (long long)Live.volumes, (long long)Live.densityArrays, (long long)(Live.densityBytes / 1024));
 }
 
-FORCEINLINE void TVoxelData::setVoxelPointDensity(int x, int y, int z, unsigned char density) {
-	if (density_data == NULL) {
-		initializeDensity();
-		density_state = TVoxelDataFillState::MIX;
-	}
+#if !UE_BUILD_SHIPPING
 
-	int index = x * voxel_num * voxel_num + y * voxel_num + z;
-	density_data[index] = density;
+static void UndoVoxelEditsCommand(UWorld* World) {
+	for (TActorIterator<AFastDualContouringActor> It(World); It; ++It) {
+		It->Undo();
+	}
 }
 
-FORCEINLINE void TVoxelData::setVoxelPointMaterial(int x, int y, int z, unsigned short material) {
-	if (material_data == NULL) {
-		initializeMaterial();
+static void RedoVoxelEditsCommand(UWorld* World) {
+	for (TActorIterator<AFastDualContouringActor> It(World); It; ++It) {
+		It->Redo();
 	}
+}
 
-	int index = x * voxel_num * voxel_num + y * voxel_num + z;
-	material_data[index] = material;
+static void DumpMeshJobsCommand(UWorld* World) {
+	for (TActorIterator<AFastDualContouringActor> It(World); It; ++It) {
+		TVoxelJobStats Stats;
+		if (!It->GetMeshJobStats(Stats, true)) {
+			continue;
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("%s: %d workers, %d queued, %d running, %llu completed, %llu cancelled, %llu stolen"), *It->GetName(),
+			Stats.workerNum, Stats.queued, Stats.running, (unsigned long long)Stats.completed, (unsigned long long)Stats.cancelled, (unsigned long long)Stats.stolen);
+		UE_LOG(LogTemp, Log, TEXT("  wait %.2f ms mean, %.2f ms max; latency %.2f ms mean, %.2f ms max"),
+			Stats.meanWait * 1000.0, Stats.maxWait * 1000.0, Stats.meanLatency * 1000.0, Stats.maxLatency * 1000.0);
+	}
 }
 
-FORCEINLINE void TVoxelData::deinitializeDensity(TVoxelDataFillState State) {
-	if (State == TVoxelDataFillState::MIX) {
-		return;
-	}
-
-	density_state = State;
-	if (density_data != NULL) {
-		delete density_data;
-	}
-
-	density_data = NULL;
-}
-
-FORCEINLINE void TVoxelData::deinitializeMaterial(unsigned short base_mat) {
-	base_fill_mat = base_mat;
-
-	if (material_data != NULL) {
-		delete material_data;
-	}
-
-	material_data = NULL;
+static void DumpVoxelMemoryCommand(UWorld* World) {
+	for (TActorIterator<AFastDualContouringActor> It(World); It; ++It) {
+		It->LogMemoryReport();
+	}
 }
 
-FORCEINLINE TVoxelDataFillState TVoxelData::getDensityFillState()	const {
-	return density_state;
-}
-
-FORCEINLINE bool TVoxelData::performCellSubstanceCaching(int x, int y, int z, int lod, int step) {
-	if (x <= 0 || y <= 0 || z <= 0) {
-		return false;
-	}
-
-	if (x < step || y < step || z < step) {
-		return false;
-	}
-
-	unsigned char density[8];
-	static unsigned char isolevel = 127;
-
-	const int rx = x - step;
-	const int ry = y - step;
-	const int rz = z - step;
-
-	density[0] = getRawDensity(x, y - step, z);
-	density[1] = getRawDensity(x, y, z);
-	density[2] = getRawDensity(x - step, y - step, z);
-	density[3] = getRawDensity(x - step, y, z);
-	density[4] = getRawDensity(x, y - step, z - step);
-	density[5] = getRawDensity(x, y, z - step);
-	density[6] = getRawDensity(rx, ry, rz);
-	density[7] = getRawDensity(x - step, y, z - step);
-
-	if (density[0] > isolevel &&
-		density[1] > isolevel &&
-		density[2] > isolevel &&
-		density[3] > isolevel &&
-		density[4] > isolevel &&
-		density[5] > isolevel &&
-		density[6] > isolevel &&
-		density[7] > isolevel) {
-		return false;
-	}
-
-	if (density[0] <= isolevel &&
-		density[1] <= isolevel &&
-		density[2] <= isolevel &&
-		density[3] <= isolevel &&
-		density[4] <= isolevel &&
-		density[5] <= isolevel &&
-		density[6] <= isolevel &&
-		density[7] <= isolevel) {
-		return false;
-	}
-
-	int index = clcLinearIndex(rx, ry, rz);
-	TSubstanceCache& lodCache = substanceCacheLOD[lod];
-	lodCache.cellList.push_back(index);
-	return true;
-}
-
-
-FORCEINLINE void TVoxelData::performSubstanceCacheNoLOD(int x, int y, int z) {
-	if (density_data == NULL) {
-		return;
-	}
-
-	performCellSubstanceCaching(x, y, z, 0, 1);
-}
-
-FORCEINLINE void TVoxelData::performSubstanceCacheLOD(int x, int y, int z) {
-	if (density_data == NULL) {
-		return;
-	}
-
-	for (auto lod = 0; lod < LOD_ARRAY_SIZE; lod++) {
-		int s = 1 << lod;
-		if (x >= s && y >= s && z >= s) {
-			if (x % s == 0 && y % s == 0 && z % s == 0) {
-				performCellSubstanceCaching(x, y, z, lod, s);
-			}
-		}
-	}
-}
-
-void TVoxelData::forEach(std::function<void(int x, int y, int z)> func) {
-	for (int x = 0; x < num(); x++)
-		for (int y = 0; y < num(); y++)
-			for (int z = 0; z < num(); z++)
-				func(x, y, z);
-}
-
-void TVoxelData::forEachWithCache(std::function<void(int x, int y, int z)> func, bool LOD) {
-	clearSubstanceCache();
-
-	for (int x = 0; x < num(); x++) {
-		for (int y = 0; y < num(); y++) {
-			for (int z = 0; z < num(); z++) {
-				func(x, y, z);
-
-				if (LOD) {
-					performSubstanceCacheLOD(x, y, z);
-				}
-				else {
-					performSubstanceCacheNoLOD(x, y, z);
-				}
+static FAutoConsoleCommandWithWorld UndoVoxelEditsCmd(
+	TEXT("fastdc.Undo"),
+	TEXT("Undoes the last edit step of every voxel volume in the world."),
+	FConsoleCommandWithWorldDelegate::CreateStatic(&UndoVoxelEditsCommand));
 
-			}
-		}
-	}
-}
-
+static FAutoConsoleCommandWithWorld RedoVoxelEditsCmd(
+	TEXT("fastdc.Redo"),
+	TEXT("Redoes the last undone edit step of every voxel volume in the world."),
+	FConsoleCommandWithWorldDelegate::CreateStatic(&RedoVoxelEditsCommand));
+
+static FAutoConsoleCommandWithWorld DumpMeshJobsCmd(
+	TEXT("fastdc.MeshJobs"),
+	TEXT("Logs queue length, wait and latency of the chunk meshing jobs since the last call."),
+	FConsoleCommandWithWorldDelegate::CreateStatic(&DumpMeshJobsCommand));
+
+static FAutoConsoleCommandWithWorld DumpVoxelMemoryCmd(
+	TEXT("fastdc.MemoryReport"),
+	TEXT("Logs the memory held by the voxel volumes, chunks, meshing contexts and pending uploads."),
+	FConsoleCommandWithWorldDelegate::CreateStatic(&DumpVoxelMemoryCommand));
+
+#endif
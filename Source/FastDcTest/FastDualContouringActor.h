@@ -5,124 +5,23 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "ProceduralMeshComponent.h"
+#include "VoxelData.h"
+#include "VoxelEditQueue.h"
+#include "VoxelSnapshot.h"
+#include "VoxelUndoHistory.h"
+#include "VoxelMesher.h"
+#include "VoxelMeshSimplifier.h"
+#include "VoxelChunkStreamer.h"
+#include "Async/Async.h"
 #include <memory>
-#include <list>
-#include <array>
-#include <functional>
 #include "FastDualContouringActor.generated.h"
 
-
-#define LOD_ARRAY_SIZE 7
-
-typedef struct TVoxelPoint {
-	unsigned char density;
-	unsigned short material;
-} TVoxelPoint;
-
-
-typedef struct TVoxelCell {
-	TVoxelPoint point[8];
-} TVoxelCell;
-
-
-enum TVoxelDataFillState {
-	ZERO, ALL, MIX
-};
-
-typedef struct TSubstanceCache {
-	std::list<int> cellList;
-} TSubstanceCache;
-
-class TVoxelData {
-
-private:
-	TVoxelDataFillState density_state;
-	unsigned short base_fill_mat = 0;
-
-	int voxel_num;
-	float volume_size;
-	unsigned char* density_data;
-	unsigned short* material_data;
-
-	volatile double last_change;
-	volatile double last_save;
-	volatile double last_mesh_generation;
-	volatile double last_cache_check;
-
-	FVector origin = FVector(0.0f, 0.0f, 0.0f);
-	FVector lower = FVector(0.0f, 0.0f, 0.0f);
-	FVector upper = FVector(0.0f, 0.0f, 0.0f);
-
-	void initializeDensity();
-	void initializeMaterial();
-
-	bool performCellSubstanceCaching(int x, int y, int z, int lod, int step);
-
-public:
-	std::array<TSubstanceCache, LOD_ARRAY_SIZE> substanceCacheLOD;
-
-	TVoxelData(int, float);
-	~TVoxelData();
-
-	FORCEINLINE int clcLinearIndex(int x, int y, int z) const {
-		return x * voxel_num * voxel_num + y * voxel_num + z;
-	};
-
-	void forEach(std::function<void(int x, int y, int z)> func);
-	void forEachWithCache(std::function<void(int x, int y, int z)> func, bool enableLOD);
-
-	void setDensity(int x, int y, int z, float density);
-	float getDensity(int x, int y, int z) const;
-	unsigned char getRawDensity(int x, int y, int z) const;
-
-	void setMaterial(const int x, const int y, const int z, unsigned short material);
-	unsigned short getMaterial(int x, int y, int z) const;
-
-	float size() const;
-	int num() const;
-
-	FVector voxelIndexToVector(int x, int y, int z) const;
-	void vectorToVoxelIndex(const FVector& v, int& x, int& y, int& z) const;
-
-	void setOrigin(FVector o);
-	FVector getOrigin() const;
-
-	FVector getLower() const { return lower; };
-	FVector getUpper() const { return upper; };
-
-	TVoxelPoint getVoxelPoint(int x, int y, int z) const;
-	void setVoxelPoint(int x, int y, int z, unsigned char density, unsigned short material);
-	void setVoxelPointDensity(int x, int y, int z, unsigned char density);
-	void setVoxelPointMaterial(int x, int y, int z, unsigned short material);
-
-	void performSubstanceCacheNoLOD(int x, int y, int z);
-	void performSubstanceCacheLOD(int x, int y, int z);
-
-	TVoxelDataFillState getDensityFillState() const;
-	//VoxelDataFillState getMaterialFillState() const; 
-
-	void deinitializeDensity(TVoxelDataFillState density_state);
-	void deinitializeMaterial(unsigned short base_mat);
-
-	void setChanged() { last_change = FPlatformTime::Seconds(); }
-	bool isChanged() { return last_change > last_save; }
-	void resetLastSave() { last_save = FPlatformTime::Seconds(); }
-	bool needToRegenerateMesh() { return last_change > last_mesh_generation; }
-	void resetLastMeshRegenerationTime() { last_mesh_generation = FPlatformTime::Seconds(); }
-
-	bool isSubstanceCacheValid() const { return last_change <= last_cache_check; }
-	void setCacheToValid() { last_cache_check = FPlatformTime::Seconds(); }
-
-	void clearSubstanceCache() {
-		for (TSubstanceCache& lodCache : substanceCacheLOD) {
-			lodCache.cellList.clear();
-		}
-
-		last_cache_check = -1;
-	};
-
-};
-
+// positions and triangles of a section waiting for its collision, no vertices clears it
+struct FVoxelPendingCollision {
+	FVector Center = FVector::ZeroVector;
+	TArray<FVector> Vertices;
+	TArray<int32> Triangles;
+};
 
 UCLASS()
 class FASTDCTEST_API AFastDualContouringActor : public AActor
@@ -137,20 +36,168 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
+	// Voxel queries in world space. These read the density field directly,
+	// so they work before the procedural mesh collision has been cooked.
+	bool VoxelRayCast(const FVector& Start, const FVector& Direction, float MaxDistance, FVector& OutLocation, FVector& OutNormal) const;
+	float GetDensityAt(const FVector& Location) const;
+	bool VoxelSphereOverlap(const FVector& Center, float Radius) const;
+
+	// Thread-safe edit submission. Edits are applied at the start of the next Tick,
+	// then a new snapshot is published and the mesh is rebuilt from it in the background.
+	void SubmitVoxelEdit(const TVoxelEdit& Edit);
+	void DigSphere(const FVector& Center, float Radius);
+	void FillSphere(const FVector& Center, float Radius, unsigned short MaterialId = 0);
+	void FilterSphere(const FVector& Center, float Radius, const TVoxelFilterSettings& Filter);
+
+	// Latest consistent view of the volume, can be held and read on any thread
+	std::shared_ptr<const TVoxelSnapshot> GetVoxelSnapshot() const;
+
+	// Game thread only. Every frame that applied edits is one step, queued edits are applied
+	// first. Not available while streaming.
+	void Undo();
+	void Redo();
+
+	// Chunk job statistics since the last reset, false when not streaming.
+	bool GetMeshJobStats(TVoxelJobStats& OutStats, bool bReset = false);
+
+	// Logs the bytes held by the volume or every chunk, the largest TopChunks of them, the
+	// meshing contexts and the meshes waiting for upload.
+	void LogMemoryReport(int32 TopChunks = 8) const;
+
 	
 private:
 
 	UPROPERTY(VisibleAnywhere)
 	UProceduralMeshComponent* Mesh;
 
+	// Hidden copy of the sections that only holds collision, so that render updates of Mesh don't
+	// cook collision for every section again.
+	UPROPERTY(VisibleAnywhere)
+	UProceduralMeshComponent* CollisionMesh;
+
 	UPROPERTY(EditAnywhere)
 	UMaterial* Material;
 
+	void ApplyMesh(int32 Section, const TVoxelMeshData& MeshData);
+
+	// Finished meshes wait here and are uploaded within the frame budgets
+	void QueueMesh(int32 Section, const TVoxelMeshData& MeshData);
+	void RemoveMesh(int32 Section);
+	void UploadPendingMeshes();
+
+	void TickVolume();
+	void TickStreaming();
+
+	void ApplyPendingEdits();
+
 protected:
-	TVoxelData* VoxelData;
+	TVoxelData* VoxelData = nullptr;
+
+	TVoxelEditQueue EditQueue;
+	std::shared_ptr<const TVoxelSnapshot> VoxelSnapshot;
+
+	TVoxelUndoHistory UndoHistory;
+
+	// Edit steps kept for undo, they share the bricks nothing edited in between.
+	UPROPERTY(EditAnywhere, Category = "Voxel Edit")
+	int32 UndoSteps = 64;
+
+	TFuture<TVoxelMeshingContext*> MeshTask;
+	bool bMeshDirty = false;
+
+	// a newer mesh of a section replaces the one still waiting, the order keeps its first place
+	TMap<int32, TVoxelMeshData> PendingMeshes;
+	TArray<int32> PendingMeshOrder;
+	TMap<int32, FVoxelPendingCollision> PendingCollision;
+
+	// Game thread time per frame spent handing finished meshes to the renderer. At least one mesh
+	// is uploaded every frame.
+	UPROPERTY(EditAnywhere, Category = "Voxel Mesh")
+	float MeshUploadBudgetMs = 2.f;
+
+	// Collision sections handed over per frame after the render update, nearest to the player
+	// first. However many there are, a frame starts a single cook of the component's collision.
+	UPROPERTY(EditAnywhere, Category = "Voxel Mesh")
+	int32 CollisionSectionsPerFrame = 8;
+
+	// Quadric error simplification after contouring, on the meshing task.
+	// Material borders and, while streaming, the faces shared between chunks are kept.
+	UPROPERTY(EditAnywhere, Category = "Voxel Mesh")
+	bool bSimplifyMesh = false;
+
+	// Collapses stop at this many triangles per mesh section, 0 for no limit.
+	UPROPERTY(EditAnywhere, Category = "Voxel Mesh")
+	int32 SimplifyTriangleBudget = 0;
+
+	// Largest distance a vertex may move away from the original surface, in local units.
+	UPROPERTY(EditAnywhere, Category = "Voxel Mesh")
+	float SimplifyMaxError = 2.f;
+
+	TVoxelSimplifySettings GetSimplifySettings() const;
+
+	// Length one texture repeat covers with the triplanar UVs the mesher writes, along with
+	// tangents and projection weights. 0 leaves them to the material.
+	UPROPERTY(EditAnywhere, Category = "Voxel Mesh")
+	float TextureWorldSize = 400.f;
+
+	TVoxelSurfaceSettings GetSurfaceSettings() const;
+
+	// Page chunks around the player pawn instead of building the single demo volume.
+	// Voxel queries then read the resident chunks, the ones still loading read as air.
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	bool bStreamWorld = false;
+
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	int32 StreamChunkVoxels = 64;
+
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	float StreamChunkSize = 1000.f;
+
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	float StreamRadius = 4000.f;
+
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	int32 StreamVoxelMemoryMB = 512;
+
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	int32 StreamMeshMemoryMB = 256;
+
+	// Threads loading and meshing chunks, 0 leaves one core to the game thread.
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	int32 StreamWorkers = 0;
+
+	// Chunks beyond this distance mesh at half resolution, beyond twice of it at a quarter, joined
+	// to their neighbours by seams. 0 disables. Use 65 chunk voxels so that strides 2 and 4 fit.
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	float StreamLodDistance = 0.f;
+
+	// Raw 16 bit heightmap (.r16) streamed instead of the generated hills, relative to the project
+	// directory. Square unless both sizes are set.
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	FString StreamHeightmap;
+
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	int32 StreamHeightmapSizeX = 0;
+
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	int32 StreamHeightmapSizeY = 0;
+
+	// distance between heightmap samples and the height of the full 16 bit range
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	float StreamHeightmapSpacing = 100.f;
+
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	float StreamHeightmapRange = 25600.f;
+
+	UPROPERTY(EditAnywhere, Category = "Voxel Streaming")
+	float StreamHeightmapBase = 0.f;
+
+	std::unique_ptr<TVoxelChunkStreamer> ChunkStreamer;
 	
 };
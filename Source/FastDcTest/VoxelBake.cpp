@@ -0,0 +1,213 @@
+#include "VoxelBake.h"
+#include "VoxelMeshExport.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include <atomic>
+
+static FVector BakeChunkOrigin(const TVoxelBakeSettings& settings, const TVoxelIndex& index) {
+	return FVector(index.X, index.Y, index.Z) * settings.chunkSize;
+}
+
+static FString BakeFileName(const TVoxelBakeSettings& settings, const TCHAR* prefix, const TVoxelIndex& index) {
+	return FPaths::Combine(settings.outputDirectory, FString::Printf(TEXT("%s_%d_%d_%d"), prefix, index.X, index.Y, index.Z));
+}
+
+// same file names and fallback as the streamer
+static void LoadOrGenerate(const TVoxelBakeSettings& settings, const TVoxelChunkGenerator& generator, const TVoxelIndex& index, TVoxelData& data) {
+	if (!settings.loadDirectory.IsEmpty()) {
+		const FString fileName = FPaths::Combine(settings.loadDirectory, FString::Printf(TEXT("chunk_%d_%d_%d.vxl"), index.X, index.Y, index.Z));
+
+		TArray<uint8> bytes;
+		if (FPaths::FileExists(fileName) && FFileHelper::LoadFileToArray(bytes, *fileName) && data.load(bytes)) {
+			return;
+		}
+	}
+
+	generator(data, BakeChunkOrigin(settings, index));
+}
+
+// every selected format of one mesh, the number of bytes written or -1 when a file failed
+static int64 WriteMeshFiles(const TVoxelBakeSettings& settings, const FString& baseName, const TVoxelMeshData& mesh) {
+	TArray<uint8> bytes;
+	int64 total = 0;
+
+	auto save = [&](const TCHAR* extension) {
+		const FString fileName = baseName + extension;
+		if (!FFileHelper::SaveArrayToFile(bytes, *fileName)) {
+			UE_LOG(LogTemp, Error, TEXT("Voxel bake could not write %s"), *fileName);
+			return false;
+		}
+
+		total += bytes.Num();
+		return true;
+	};
+
+	if (settings.bWriteBinary) {
+		VoxelWriteMeshBinary(mesh, bytes);
+		if (!save(TEXT(".vmesh"))) return -1;
+	}
+
+	if (settings.bWriteObj) {
+		VoxelWriteMeshObj(mesh, bytes);
+		if (!save(TEXT(".obj"))) return -1;
+	}
+
+	if (settings.bWritePly) {
+		VoxelWriteMeshPly(mesh, bytes);
+		if (!save(TEXT(".ply"))) return -1;
+	}
+
+	return total;
+}
+
+TVoxelBakeStats VoxelBakeRegion(const TVoxelBakeSettings& settings, const TVoxelChunkGenerator& generator) {
+	check(settings.chunkVoxelNum > 1 && settings.stride > 0);
+
+	TVoxelBakeStats stats;
+
+	const bool bSeams = settings.bSeams && (settings.chunkVoxelNum - 1) % settings.stride == 0;
+	if (settings.bSeams && !bSeams) {
+		UE_LOG(LogTemp, Warning, TEXT("Voxel bake: %d voxels per chunk can't be meshed open at stride %d, chunks are closed instead"), settings.chunkVoxelNum, settings.stride);
+	}
+
+	if (!IFileManager::Get().MakeDirectory(*settings.outputDirectory, true)) {
+		UE_LOG(LogTemp, Error, TEXT("Voxel bake could not create %s"), *settings.outputDirectory);
+		stats.bFailed = true;
+		return stats;
+	}
+
+	const TVoxelIndex& lo = settings.minChunk;
+	const TVoxelIndex& hi = settings.maxChunk;
+	const int sizeY = FMath::Max(hi.Y - lo.Y + 1, 0);
+	const int sizeZ = FMath::Max(hi.Z - lo.Z + 1, 0);
+	const int slabChunks = sizeY * sizeZ;
+
+	TVoxelSimplifySettings simplify = settings.simplify;
+	simplify.lockVolumeFaces(settings.chunkSize, settings.chunkVoxelNum, settings.stride);
+
+	// seam boundaries of the slab before the one being meshed and of that one, by y * sizeZ + z
+	std::vector<std::unique_ptr<TVoxelMeshBoundary>> previous(slabChunks);
+	std::vector<std::unique_ptr<TVoxelMeshBoundary>> current(slabChunks);
+
+	std::atomic<int32> chunks(0);
+	std::atomic<int32> emptyChunks(0);
+	std::atomic<int32> seams(0);
+	std::atomic<int64> triangles(0);
+	std::atomic<int64> bytes(0);
+	std::atomic<bool> bFailed(false);
+
+	auto write = [&](const TCHAR* prefix, const TVoxelIndex& index, const TVoxelMeshData& mesh) {
+		const int64 written = WriteMeshFiles(settings, BakeFileName(settings, prefix, index), mesh);
+		if (written < 0) {
+			bFailed = true;
+			return;
+		}
+
+		bytes += written;
+		triangles += mesh.Triangles.Num() / 3;
+	};
+
+	// seams of slab x from the boundaries in previous, their neighbours at x + 1 are in current
+	auto bakeSeams = [&](int x) {
+		ParallelFor(slabChunks, [&](int32 i) {
+			const int y = i / sizeZ;
+			const int z = i % sizeZ;
+			const TVoxelIndex index(x, lo.Y + y, lo.Z + z);
+
+			TVoxelSeamNeighbourhood neighbours;
+			for (int n = 0; n < 8; n++) {
+				const int dx = n >> 2;
+				const int dy = (n >> 1) & 1;
+				const int dz = n & 1;
+
+				const std::vector<std::unique_ptr<TVoxelMeshBoundary>>& slab = dx == 0 ? previous : current;
+				const bool bInside = y + dy < sizeY && z + dz < sizeZ;
+
+				neighbours.boundaries[dx][dy][dz] = bInside ? slab[(y + dy) * sizeZ + z + dz].get() : nullptr;
+				neighbours.origins[dx][dy][dz] = BakeChunkOrigin(settings, index + TVoxelIndex(dx, dy, dz));
+			}
+
+			TVoxelData data(settings.chunkVoxelNum, settings.chunkSize);
+			LoadOrGenerate(settings, generator, index, data);
+
+			TVoxelMeshingContext* context = TVoxelMeshingContextPool::get().acquire();
+			VoxelBuildSeam(&data, neighbours, *context);
+
+			if (context->mesh.Triangles.Num() > 0) {
+				write(TEXT("seam"), index, context->mesh);
+				seams++;
+			}
+
+			TVoxelMeshingContextPool::get().release(context);
+		});
+	};
+
+	const double start = FPlatformTime::Seconds();
+
+	for (int x = lo.X; x <= hi.X && !bFailed; x++) {
+		ParallelFor(slabChunks, [&](int32 i) {
+			const TVoxelIndex index(x, lo.Y + i / sizeZ, lo.Z + i % sizeZ);
+
+			TVoxelData data(settings.chunkVoxelNum, settings.chunkSize);
+			LoadOrGenerate(settings, generator, index, data);
+
+			TVoxelMeshingContext* context = TVoxelMeshingContextPool::get().acquire();
+
+			if (bSeams) {
+				current[i].reset(new TVoxelMeshBoundary());
+				PolygonizeVolume(&data, *context, settings.stride, current[i].get());
+			} else {
+				PolygonizeVolume(&data, *context, settings.stride);
+			}
+
+			if (settings.bSimplify) {
+				VoxelSimplifyMesh(*context, simplify);
+			}
+
+			TVoxelMeshData& mesh = context->mesh;
+			chunks++;
+
+			if (mesh.Triangles.Num() == 0) {
+				emptyChunks++;
+			} else {
+				const FVector origin = BakeChunkOrigin(settings, index);
+				for (FVector& v : mesh.Vertices) {
+					v += origin;
+				}
+
+				write(TEXT("chunk"), index, mesh);
+			}
+
+			TVoxelMeshingContextPool::get().release(context);
+		});
+
+		if (bSeams && x > lo.X) {
+			bakeSeams(x - 1);
+		}
+
+		// the slab just meshed becomes the one whose seams are built next
+		std::swap(previous, current);
+
+		UE_LOG(LogTemp, Display, TEXT("Voxel bake: slab %d of %d, %d chunks, %lld triangles, %lld KB, %.1f s"),
+			x - lo.X + 1, hi.X - lo.X + 1, chunks.load(), (long long)triangles.load(), (long long)(bytes.load() / 1024), FPlatformTime::Seconds() - start);
+	}
+
+	// the last slab has no neighbours beyond it
+	if (bSeams && !bFailed && hi.X >= lo.X) {
+		for (std::unique_ptr<TVoxelMeshBoundary>& boundary : current) {
+			boundary.reset();
+		}
+
+		bakeSeams(hi.X);
+	}
+
+	stats.chunks = chunks;
+	stats.emptyChunks = emptyChunks;
+	stats.seams = seams;
+	stats.triangles = triangles;
+	stats.bytes = bytes;
+	stats.bFailed = bFailed;
+	return stats;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelChunkStreamer.h"
+
+struct TVoxelBakeSettings {
+	// inclusive range of chunk indices, laid out like the chunks of TVoxelChunkStreamer
+	TVoxelIndex minChunk = TVoxelIndex(0, 0, 0);
+	TVoxelIndex maxChunk = TVoxelIndex(0, 0, 0);
+
+	int chunkVoxelNum = 64;
+	float chunkSize = 1000.f;
+	int stride = 1;
+
+	// open chunk faces joined by seam strips instead of every chunk closing itself with walls;
+	// chunkVoxelNum - 1 has to be a multiple of the stride
+	bool bSeams = false;
+
+	bool bSimplify = false;
+	TVoxelSimplifySettings simplify;
+
+	// saved chunks found here are baked instead of generating them, like the streamer does
+	FString loadDirectory;
+
+	FString outputDirectory;
+	bool bWriteBinary = true;
+	bool bWriteObj = false;
+	bool bWritePly = false;
+};
+
+struct TVoxelBakeStats {
+	int32 chunks = 0;
+	int32 emptyChunks = 0;
+	int32 seams = 0;
+	int64 triangles = 0;
+	int64 bytes = 0;
+	bool bFailed = false;
+};
+
+//
+// Meshes a region of chunks into files under settings.outputDirectory: chunk_x_y_z and, with
+// seams, seam_x_y_z, each as .vmesh (VoxelWriteMeshBinary), .obj and .ply as selected.
+// Vertices are in the chunks' common space; meshes without triangles are not written.
+//
+// The region is processed one slab of constant x at a time, the chunks of a slab in parallel
+// on the task pool. Each task holds a single volume, and only the seam boundaries of two slabs
+// outlive it, so memory stays bounded by the slab whatever the size of the region. Seams need
+// the next slab, the chunks they belong to are loaded or generated a second time for them.
+//
+TVoxelBakeStats VoxelBakeRegion(const TVoxelBakeSettings& settings, const TVoxelChunkGenerator& generator);
@@ -0,0 +1,91 @@
+#include "VoxelBakeCommandlet.h"
+#include "VoxelBake.h"
+#include "VoxelGenerator.h"
+#include "VoxelHeightmap.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+
+// "x,y,z"
+static bool ParseChunkIndex(const TCHAR* Params, const TCHAR* Name, TVoxelIndex& Out) {
+	FString Text;
+	if (!FParse::Value(Params, Name, Text, false)) {
+		return false;
+	}
+
+	TArray<FString> Parts;
+	Text.ParseIntoArray(Parts, TEXT(","));
+	if (Parts.Num() != 3) {
+		return false;
+	}
+
+	Out = TVoxelIndex(FCString::Atoi(*Parts[0]), FCString::Atoi(*Parts[1]), FCString::Atoi(*Parts[2]));
+	return true;
+}
+
+UVoxelBakeCommandlet::UVoxelBakeCommandlet() {
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UVoxelBakeCommandlet::Main(const FString& Params) {
+	TVoxelBakeSettings Settings;
+	Settings.outputDirectory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("VoxelBake"));
+
+	if (!ParseChunkIndex(*Params, TEXT("min="), Settings.minChunk) || !ParseChunkIndex(*Params, TEXT("max="), Settings.maxChunk)) {
+		UE_LOG(LogTemp, Error, TEXT("VoxelBake needs the chunk range: -min=x,y,z -max=x,y,z"));
+		return 1;
+	}
+
+	FParse::Value(*Params, TEXT("out="), Settings.outputDirectory);
+	FParse::Value(*Params, TEXT("load="), Settings.loadDirectory);
+	FParse::Value(*Params, TEXT("voxels="), Settings.chunkVoxelNum);
+	FParse::Value(*Params, TEXT("size="), Settings.chunkSize);
+	FParse::Value(*Params, TEXT("stride="), Settings.stride);
+	FParse::Value(*Params, TEXT("maxerror="), Settings.simplify.maxError);
+	Settings.bSeams = FParse::Param(*Params, TEXT("seams"));
+	Settings.bSimplify = FParse::Param(*Params, TEXT("simplify"));
+
+	FString Formats;
+	if (FParse::Value(*Params, TEXT("formats="), Formats, false)) {
+		Settings.bWriteBinary = Formats.Contains(TEXT("bin"));
+		Settings.bWriteObj = Formats.Contains(TEXT("obj"));
+		Settings.bWritePly = Formats.Contains(TEXT("ply"));
+	}
+
+	if (Settings.chunkVoxelNum < 2 || Settings.stride < 1 || Settings.chunkSize <= 0.f) {
+		UE_LOG(LogTemp, Error, TEXT("VoxelBake: invalid chunk settings, voxels %d, size %f, stride %d"), Settings.chunkVoxelNum, Settings.chunkSize, Settings.stride);
+		return 1;
+	}
+
+	// -heightmap=file.r16 bakes the heightmap with sample (0, 0) at the origin instead of the hills
+	TVoxelChunkGenerator Generator = &VoxelGenerateDefaultTerrain;
+
+	FString HeightmapFile;
+	if (FParse::Value(*Params, TEXT("heightmap="), HeightmapFile)) {
+		std::shared_ptr<TVoxelHeightmap> Heightmap = std::make_shared<TVoxelHeightmap>();
+		FParse::Value(*Params, TEXT("hmspacing="), Heightmap->spacing);
+		FParse::Value(*Params, TEXT("hmrange="), Heightmap->heightRange);
+		FParse::Value(*Params, TEXT("hmbase="), Heightmap->baseHeight);
+
+		if (!VoxelLoadHeightmapR16(HeightmapFile, 0, 0, *Heightmap)) {
+			return 1;
+		}
+
+		Generator = [Heightmap](TVoxelData& Data, const FVector& Origin) {
+			VoxelImportHeightmap(Data, Origin, *Heightmap, true);
+		};
+	}
+
+	const double Start = FPlatformTime::Seconds();
+	const TVoxelBakeStats Stats = VoxelBakeRegion(Settings, Generator);
+
+	UE_LOG(LogTemp, Display, TEXT("VoxelBake %s: %d chunks (%d empty), %d seams, %lld triangles, %lld KB written to %s in %.1f s"),
+		Stats.bFailed ? TEXT("FAILED") : TEXT("done"),
+		Stats.chunks, Stats.emptyChunks, Stats.seams, (long long)Stats.triangles, (long long)(Stats.bytes / 1024), *Settings.outputDirectory,
+		FPlatformTime::Seconds() - Start);
+
+	return Stats.bFailed ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "VoxelBakeCommandlet.generated.h"
+
+//
+// Offline bake of streamed world chunks into mesh files, for build machines:
+//
+//   UE4Editor-Cmd FastDcTest.uproject -run=VoxelBake -min=-4,-4,-1 -max=3,3,0
+//       [-out=Dir] [-load=Dir] [-voxels=64] [-size=1000] [-stride=1] [-seams]
+//       [-simplify] [-maxerror=1] [-formats=bin,obj,ply]
+//
+// -min and -max are inclusive chunk indices. Output defaults to Saved/VoxelBake; -load bakes the
+// chunks saved by the streamer found in Dir instead of generating them. See VoxelBakeRegion.
+//
+UCLASS()
+class UVoxelBakeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UVoxelBakeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
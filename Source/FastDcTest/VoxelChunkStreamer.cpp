@@ -0,0 +1,969 @@
+#include "VoxelChunkStreamer.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include <algorithm>
+
+
+static int FloorDiv(int a, int b) {
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static TVoxelSimplifySettings ChunkSimplifySettings(const TVoxelChunkStreamerSettings& settings, int stride) {
+	TVoxelSimplifySettings simplify = settings.simplify;
+	simplify.lockVolumeFaces(settings.chunkSize, settings.chunkVoxelNum, stride);
+	return simplify;
+}
+
+// chunks are meshed around their own center and moved into place afterwards
+static TVoxelSurfaceSettings ChunkSurfaceSettings(const TVoxelChunkStreamerSettings& settings, const FVector& origin) {
+	TVoxelSurfaceSettings surface = settings.surface;
+	surface.uvOrigin += origin;
+	return surface;
+}
+
+static size_t EstimateMeshMemory(const TVoxelMeshData& mesh) {
+	// what the procedural mesh component keeps per section on the CPU and uploads to the GPU
+	return mesh.Vertices.Num() * sizeof(FProcMeshVertex) + mesh.Triangles.Num() * sizeof(uint32);
+}
+
+TVoxelChunkStreamer::TVoxelChunkStreamer(const TVoxelChunkStreamerSettings& settings, TVoxelChunkGenerator generator) : settings(settings), generator(generator), scheduler(settings.workerNum) {
+	check(settings.chunkVoxelNum > 1);
+
+	// coarse chunks have to sample the shared border of their neighbours
+	if (hasSeams()) {
+		while (max_lod_stride * 2 <= settings.maxLodStride && (settings.chunkVoxelNum - 1) % (max_lod_stride * 2) == 0) {
+			max_lod_stride *= 2;
+		}
+
+		if (max_lod_stride < settings.maxLodStride) {
+			UE_LOG(LogTemp, Warning, TEXT("Voxel streaming: %d voxels per chunk allow lod strides up to %d only"), settings.chunkVoxelNum, max_lod_stride);
+		}
+	}
+}
+
+TVoxelChunkStreamer::~TVoxelChunkStreamer() {
+	flush();
+
+	for (auto& pair : chunks) {
+		delete pair.second.data;
+	}
+}
+
+TVoxelIndex TVoxelChunkStreamer::chunkIndexAt(const FVector& local) const {
+	const float s = settings.chunkSize;
+	return TVoxelIndex(
+		FMath::FloorToInt((local.X + s / 2) / s),
+		FMath::FloorToInt((local.Y + s / 2) / s),
+		FMath::FloorToInt((local.Z + s / 2) / s));
+}
+
+FVector TVoxelChunkStreamer::chunkOrigin(const TVoxelIndex& index) const {
+	return FVector(index.X, index.Y, index.Z) * settings.chunkSize;
+}
+
+bool TVoxelChunkStreamer::isInRadius(const TVoxelIndex& index, const FVector& viewer) const {
+	const FVector o = chunkOrigin(index);
+	const float e = settings.chunkSize / 2;
+	const FBox bounds(o - FVector(e, e, e), o + FVector(e, e, e));
+	return bounds.ComputeSquaredDistanceToPoint(viewer) <= settings.loadRadius * settings.loadRadius;
+}
+
+int TVoxelChunkStreamer::lodStride(const TVoxelIndex& index, const FVector& viewer, int current) const {
+	if (!hasSeams()) {
+		return 1;
+	}
+
+	const FVector o = chunkOrigin(index);
+	const float e = settings.chunkSize / 2;
+	const float distance = FMath::Sqrt(FBox(o - FVector(e, e, e), o + FVector(e, e, e)).ComputeSquaredDistanceToPoint(viewer));
+
+	int stride = 1;
+	while (stride < max_lod_stride) {
+		// a margin around each step keeps a chunk right on it from switching every frame
+		const float step = settings.lodDistance * stride * (stride < current ? 0.9f : 1.1f);
+		if (distance < step) {
+			break;
+		}
+
+		stride *= 2;
+	}
+
+	return stride;
+}
+
+void TVoxelChunkStreamer::measureVoxels(const TChunk& chunk, TVoxelMemoryStats& voxels, size_t& snapshotBytes) const {
+	std::unordered_set<const void*> counted;
+	voxels = TVoxelMemoryStats();
+	snapshotBytes = 0;
+
+	if (chunk.data != nullptr) {
+		voxels = chunk.data->getMemoryStats();
+
+		// only marks the pages, the volume stats hold them already
+		chunk.data->getDensityPyramid().getAllocatedSize(counted);
+	}
+
+	if (chunk.snapshot) {
+		snapshotBytes = chunk.snapshot->getAllocatedSize(&counted);
+	}
+}
+
+size_t TVoxelChunkStreamer::chunkVoxelMemory(const TChunk& chunk) const {
+	TVoxelMemoryStats voxels;
+	size_t snapshotBytes;
+	measureVoxels(chunk, voxels, snapshotBytes);
+	return voxels.getTotal() + snapshotBytes;
+}
+
+void TVoxelChunkStreamer::getChunkMemory(std::vector<TVoxelChunkMemory>& out) const {
+	out.clear();
+	out.reserve(chunks.size());
+
+	for (const auto& pair : chunks) {
+		const TChunk& chunk = pair.second;
+
+		TVoxelChunkMemory memory;
+		memory.index = pair.first;
+		memory.bResident = chunk.state == TChunkState::Resident;
+
+		measureVoxels(chunk, memory.voxels, memory.snapshotBytes);
+		memory.meshBytes = chunk.mesh_bytes + chunk.seam_bytes;
+		memory.boundaryBytes = chunk.boundary ? chunk.boundary->getAllocatedSize() : 0;
+		out.push_back(memory);
+	}
+}
+
+FString TVoxelChunkStreamer::chunkFileName(const TVoxelIndex& index) const {
+	if (settings.saveDirectory.IsEmpty()) {
+		return FString();
+	}
+
+	return FPaths::Combine(settings.saveDirectory, FString::Printf(TEXT("chunk_%d_%d_%d.vxl"), index.X, index.Y, index.Z));
+}
+
+int TVoxelChunkStreamer::getResidentChunkCount() const {
+	int count = 0;
+	for (const auto& pair : chunks) {
+		if (pair.second.state == TChunkState::Resident) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+const TVoxelData* TVoxelChunkStreamer::getChunk(const TVoxelIndex& index) const {
+	const auto it = chunks.find(index);
+	if (it == chunks.end() || it->second.state != TChunkState::Resident) {
+		return nullptr;
+	}
+
+	return it->second.data;
+}
+
+float TVoxelChunkStreamer::sampleDensity(const FVector& local) const {
+	const TVoxelIndex index = chunkIndexAt(local);
+	const TVoxelData* data = getChunk(index);
+	if (data == nullptr) {
+		return 0;
+	}
+
+	return VoxelSampleDensity(*data, local - chunkOrigin(index));
+}
+
+bool TVoxelChunkStreamer::rayCast(const FVector& start, const FVector& direction, float maxDistance, TVoxelRayHit& outHit) const {
+	const FVector dir = direction.GetSafeNormal();
+	if (dir.IsZero() || maxDistance <= 0) {
+		return false;
+	}
+
+	// DDA over the chunk grid, chunk i spans [(i - 0.5) * s, (i + 0.5) * s] on each axis
+	const float s = settings.chunkSize;
+	const TVoxelIndex first = chunkIndexAt(start);
+	int cell[3] = { first.X, first.Y, first.Z };
+	int step[3];
+	float tMax[3];
+	float tDelta[3];
+
+	for (int axis = 0; axis < 3; axis++) {
+		const float boundary = (cell[axis] + (dir[axis] > 0 ? 0.5f : -0.5f)) * s;
+
+		if (dir[axis] > 0) {
+			step[axis] = 1;
+			tMax[axis] = (boundary - start[axis]) / dir[axis];
+			tDelta[axis] = s / dir[axis];
+		} else if (dir[axis] < 0) {
+			step[axis] = -1;
+			tMax[axis] = (boundary - start[axis]) / dir[axis];
+			tDelta[axis] = -s / dir[axis];
+		} else {
+			step[axis] = 0;
+			tMax[axis] = MAX_flt;
+			tDelta[axis] = MAX_flt;
+		}
+	}
+
+	float t = 0;
+	while (true) {
+		const int axis = (tMax[0] < tMax[1]) ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+		const float tExit = FMath::Min(tMax[axis], maxDistance);
+
+		const TVoxelIndex index(cell[0], cell[1], cell[2]);
+		const TVoxelData* data = getChunk(index);
+		if (data != nullptr && tExit > t) {
+			const FVector origin = chunkOrigin(index);
+			TVoxelRayHit hit;
+
+			if (VoxelRayCast(*data, start + dir * t - origin, dir, tExit - t, hit)) {
+				// entering solid matter at a chunk face is not a face of the volume, take the
+				// normal from the densities instead
+				if (t > 0 && hit.Distance <= s * 1e-4f) {
+					hit.Normal = VoxelSampleNormal(*data, hit.Location);
+				}
+
+				outHit.Location = hit.Location + origin;
+				outHit.Normal = hit.Normal;
+				outHit.Distance = hit.Distance + t;
+				return true;
+			}
+		}
+
+		if (tMax[axis] >= maxDistance) {
+			return false;
+		}
+
+		t = tMax[axis];
+		cell[axis] += step[axis];
+		tMax[axis] += tDelta[axis];
+	}
+}
+
+bool TVoxelChunkStreamer::sphereOverlap(const FVector& center, float radius) const {
+	const TVoxelIndex lo = chunkIndexAt(center - FVector(radius));
+	const TVoxelIndex hi = chunkIndexAt(center + FVector(radius));
+
+	for (int x = lo.X; x <= hi.X; x++) {
+		for (int y = lo.Y; y <= hi.Y; y++) {
+			for (int z = lo.Z; z <= hi.Z; z++) {
+				const TVoxelIndex index(x, y, z);
+				const TVoxelData* data = getChunk(index);
+
+				if (data != nullptr && VoxelSphereOverlap(*data, center - chunkOrigin(index), radius)) {
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+TVoxelChunkStreamer::TChunkTask TVoxelChunkStreamer::submit(float priority, std::function<void(TVoxelJob& job, TChunkTaskResult& result)> work) {
+	TChunkTask task;
+	task.result = std::make_shared<TChunkTaskResult>();
+
+	const std::shared_ptr<TChunkTaskResult> result = task.result;
+	task.job = scheduler.submit(priority, [result, work](TVoxelJob& job) {
+		work(job, *result);
+	});
+
+	tasks_in_flight++;
+	return task;
+}
+
+TVoxelChunkStreamer::TChunkTaskResult TVoxelChunkStreamer::takeResult(TChunkTask& task) {
+	task.job->wait();
+	TChunkTaskResult result = *task.result;
+
+	task = TChunkTask();
+	tasks_in_flight--;
+	return result;
+}
+
+void TVoxelChunkStreamer::startLoad(const TVoxelIndex& index, TChunk& chunk, float priority) {
+	const int num = settings.chunkVoxelNum;
+	const float size = settings.chunkSize;
+	const FVector origin = chunkOrigin(index);
+	const FString fileName = chunkFileName(index);
+	const TVoxelChunkGenerator chunkGenerator = generator;
+	const int stride = chunk.stride;
+	const bool bSeams = hasSeams();
+	const bool bSimplify = settings.bSimplifyMeshes;
+	const TVoxelSimplifySettings simplify = ChunkSimplifySettings(settings, stride);
+	const TVoxelSurfaceSettings surface = ChunkSurfaceSettings(settings, origin);
+
+	chunk.task = submit(priority, [num, size, origin, fileName, chunkGenerator, stride, bSeams, bSimplify, simplify, surface](TVoxelJob& job, TChunkTaskResult& result) {
+		result.data = new TVoxelData(num, size);
+
+		// a saved chunk replaces generation, a damaged or mismatching file is regenerated
+		TArray<uint8> bytes;
+		const bool bLoaded = !fileName.IsEmpty() && FPaths::FileExists(fileName) && FFileHelper::LoadFileToArray(bytes, *fileName) && result.data->load(bytes);
+
+		if (!bLoaded) {
+			chunkGenerator(*result.data, origin);
+		}
+
+		// the volume is not shared yet, meshing it directly is safe
+		result.snapshot = TVoxelSnapshot::capture(*result.data, nullptr);
+		result.version = result.data->getDataVersion();
+
+		if (job.isCancelled()) {
+			return;
+		}
+
+		result.context = TVoxelMeshingContextPool::get().acquire();
+		result.context->cancelFlag = job.getCancelFlag();
+		result.context->surface = surface;
+
+		if (bSeams) {
+			std::shared_ptr<TVoxelMeshBoundary> boundary = std::make_shared<TVoxelMeshBoundary>();
+			PolygonizeVolume(result.data, *result.context, stride, boundary.get());
+			result.boundary = boundary;
+		} else {
+			PolygonizeVolume(result.data, *result.context, stride);
+		}
+
+		if (bSimplify && !job.isCancelled()) {
+			VoxelSimplifyMesh(*result.context, simplify);
+		}
+
+		for (FVector& v : result.context->mesh.Vertices) {
+			v += origin;
+		}
+	});
+}
+
+void TVoxelChunkStreamer::startRemesh(const TVoxelIndex& index, TChunk& chunk, float priority) {
+	voxel_memory -= chunkVoxelMemory(chunk);
+	chunk.snapshot = TVoxelSnapshot::capture(*chunk.data, chunk.snapshot);
+	voxel_memory += chunkVoxelMemory(chunk);
+
+	chunk.bDirty = false;
+
+	const std::shared_ptr<const TVoxelSnapshot> snapshot = chunk.snapshot;
+	const FVector origin = chunkOrigin(index);
+	const int stride = chunk.stride;
+	const bool bSeams = hasSeams();
+	const bool bSimplify = settings.bSimplifyMeshes;
+	const TVoxelSimplifySettings simplify = ChunkSimplifySettings(settings, stride);
+	const TVoxelSurfaceSettings surface = ChunkSurfaceSettings(settings, origin);
+
+	chunk.task = submit(priority, [snapshot, origin, stride, bSeams, bSimplify, simplify, surface](TVoxelJob& job, TChunkTaskResult& result) {
+		result.version = snapshot->getDataVersion();
+
+		result.context = TVoxelMeshingContextPool::get().acquire();
+		result.context->cancelFlag = job.getCancelFlag();
+		result.context->surface = surface;
+
+		if (bSeams) {
+			std::shared_ptr<TVoxelMeshBoundary> boundary = std::make_shared<TVoxelMeshBoundary>();
+			PolygonizeVolume(snapshot.get(), *result.context, stride, boundary.get());
+			result.boundary = boundary;
+		} else {
+			PolygonizeVolume(snapshot.get(), *result.context, stride);
+		}
+
+		if (bSimplify && !job.isCancelled()) {
+			VoxelSimplifyMesh(*result.context, simplify);
+		}
+
+		for (FVector& v : result.context->mesh.Vertices) {
+			v += origin;
+		}
+	});
+}
+
+void TVoxelChunkStreamer::keepCancelledLoad(const TVoxelIndex& index, TChunk& chunk, const TChunkTaskResult& result) {
+	// a load dropped before it ran starts over, ahead of everything else like the edit itself
+	if (result.data == nullptr) {
+		startLoad(index, chunk, 0);
+		return;
+	}
+
+	// the volume is complete once there is one, only meshing was given up
+	voxel_memory -= chunkVoxelMemory(chunk);
+
+	chunk.data = result.data;
+	chunk.snapshot = result.snapshot;
+	chunk.state = TChunkState::Resident;
+
+	for (const TVoxelEdit& edit : chunk.pending_edits) {
+		applyVoxelEdit(*chunk.data, edit);
+	}
+
+	chunk.data->setChanged();
+	chunk.bDirty = true;
+	chunk.pending_edits.clear();
+
+	voxel_memory += chunkVoxelMemory(chunk);
+}
+
+bool TVoxelChunkStreamer::finishTask(const TVoxelIndex& index, TChunk& chunk, const TMeshReady& onMeshReady, const TMeshRemoved& onMeshRemoved) {
+	const bool bCancelled = chunk.task.job->isCancelled();
+	TChunkTaskResult result = takeResult(chunk.task);
+
+	// an edit left the chunk dirty again, or the viewer moved away from a loading chunk
+	if (bCancelled) {
+		TVoxelMeshingContextPool::get().release(result.context);
+
+		if (chunk.state == TChunkState::Loading && !chunk.pending_edits.empty()) {
+			keepCancelledLoad(index, chunk, result);
+			return true;
+		}
+
+		if (chunk.state == TChunkState::Loading) {
+			delete result.data;
+			return false;
+		}
+
+		return true;
+	}
+
+	voxel_memory -= chunkVoxelMemory(chunk);
+
+	if (result.data != nullptr) {
+		chunk.data = result.data;
+		chunk.snapshot = result.snapshot;
+		chunk.state = TChunkState::Resident;
+
+		for (const TVoxelEdit& edit : chunk.pending_edits) {
+			applyVoxelEdit(*chunk.data, edit);
+		}
+
+		if (!chunk.pending_edits.empty()) {
+			chunk.data->setChanged();
+			chunk.bDirty = true;
+			chunk.pending_edits.clear();
+		}
+	}
+
+	voxel_memory += chunkVoxelMemory(chunk);
+
+	showMesh(chunk.section, chunk.mesh_bytes, result.context->mesh, onMeshReady, onMeshRemoved);
+	chunk.meshed_version = result.version;
+
+	if (hasSeams()) {
+		mesh_memory -= chunk.boundary ? chunk.boundary->getAllocatedSize() : 0;
+		chunk.boundary = result.boundary;
+		mesh_memory += chunk.boundary ? chunk.boundary->getAllocatedSize() : 0;
+
+		invalidateSeams(index);
+	}
+
+	TVoxelMeshingContextPool::get().release(result.context);
+	return true;
+}
+
+void TVoxelChunkStreamer::showMesh(int32& section, size_t& bytes, const TVoxelMeshData& mesh, const TMeshReady& onMeshReady, const TMeshRemoved& onMeshRemoved) {
+	mesh_memory -= bytes;
+
+	if (mesh.Triangles.Num() == 0) {
+		if (section >= 0) {
+			onMeshRemoved(section);
+			free_sections.push_back(section);
+			section = -1;
+		}
+
+		bytes = 0;
+	} else {
+		if (section < 0) {
+			if (free_sections.empty()) {
+				section = section_num++;
+			} else {
+				section = free_sections.back();
+				free_sections.pop_back();
+			}
+		}
+
+		onMeshReady(section, mesh);
+		bytes = EstimateMeshMemory(mesh);
+	}
+
+	mesh_memory += bytes;
+}
+
+void TVoxelChunkStreamer::invalidateSeams(const TVoxelIndex& index) {
+	// every seam that touches the chunk belongs to it or to a chunk up to one step below it on
+	// each axis, the one diagonally below on all three only meets it in a corner
+	for (int i = 0; i < 7; i++) {
+		auto it = chunks.find(TVoxelIndex(index.X - (i >> 2), index.Y - ((i >> 1) & 1), index.Z - (i & 1)));
+		if (it != chunks.end()) {
+			it->second.bSeamDirty = true;
+		}
+	}
+}
+
+void TVoxelChunkStreamer::startSeam(const TVoxelIndex& index, TChunk& chunk, float priority) {
+	chunk.bSeamDirty = false;
+
+	const std::shared_ptr<const TVoxelSnapshot> snapshot = chunk.snapshot;
+
+	// the boundaries are immutable once published, the task keeps the ones it joins alive
+	std::shared_ptr<const TVoxelMeshBoundary> boundaries[8];
+	FVector origins[8];
+
+	for (int i = 0; i < 8; i++) {
+		const TVoxelIndex neighbour(index.X + (i >> 2), index.Y + ((i >> 1) & 1), index.Z + (i & 1));
+		origins[i] = chunkOrigin(neighbour);
+
+		auto it = chunks.find(neighbour);
+		if (it != chunks.end() && it->second.state == TChunkState::Resident) {
+			boundaries[i] = it->second.boundary;
+		}
+	}
+
+	const TVoxelSurfaceSettings surface = settings.surface;
+
+	chunk.seam_task = submit(priority, [snapshot, boundaries, origins, surface](TVoxelJob& job, TChunkTaskResult& result) {
+		result.version = snapshot->getDataVersion();
+
+		TVoxelSeamNeighbourhood neighbours;
+		for (int i = 0; i < 8; i++) {
+			neighbours.boundaries[i >> 2][(i >> 1) & 1][i & 1] = boundaries[i].get();
+			neighbours.origins[i >> 2][(i >> 1) & 1][i & 1] = origins[i];
+		}
+
+		result.context = TVoxelMeshingContextPool::get().acquire();
+		result.context->surface = surface;
+		VoxelBuildSeam(snapshot.get(), neighbours, *result.context);
+	});
+}
+
+void TVoxelChunkStreamer::finishSeam(TChunk& chunk, const TMeshReady& onMeshReady, const TMeshRemoved& onMeshRemoved) {
+	TChunkTaskResult result = takeResult(chunk.seam_task);
+
+	showMesh(chunk.seam_section, chunk.seam_bytes, result.context->mesh, onMeshReady, onMeshRemoved);
+	TVoxelMeshingContextPool::get().release(result.context);
+}
+
+void TVoxelChunkStreamer::saveAsync(const TVoxelIndex& index, TVoxelData* data) {
+	auto it = save_tasks.find(index);
+	if (it != save_tasks.end()) {
+		it->second.Wait();
+		save_tasks.erase(it);
+	}
+
+	const FString fileName = chunkFileName(index);
+
+	// the task owns the evicted volume from here on
+	save_tasks[index] = Async<void>(EAsyncExecution::ThreadPool, [data, fileName]() {
+		TArray<uint8> bytes;
+		data->save(bytes);
+
+		if (!FFileHelper::SaveArrayToFile(bytes, *fileName)) {
+			UE_LOG(LogTemp, Error, TEXT("Voxel chunk save failed: %s"), *fileName);
+		}
+
+		delete data;
+	});
+}
+
+void TVoxelChunkStreamer::evict(const TVoxelIndex& index, const TMeshRemoved& onMeshRemoved) {
+	auto it = chunks.find(index);
+	check(it != chunks.end() && !it->second.task.isValid() && !it->second.seam_task.isValid());
+	TChunk& chunk = it->second;
+
+	if (chunk.section >= 0) {
+		onMeshRemoved(chunk.section);
+		free_sections.push_back(chunk.section);
+	}
+
+	if (chunk.seam_section >= 0) {
+		onMeshRemoved(chunk.seam_section);
+		free_sections.push_back(chunk.seam_section);
+	}
+
+	mesh_memory -= chunk.mesh_bytes + chunk.seam_bytes;
+	mesh_memory -= chunk.boundary ? chunk.boundary->getAllocatedSize() : 0;
+	voxel_memory -= chunkVoxelMemory(chunk);
+
+	if (chunk.data != nullptr && chunk.data->isChanged() && !settings.saveDirectory.IsEmpty()) {
+		saveAsync(index, chunk.data);
+	} else {
+		delete chunk.data;
+	}
+
+	chunks.erase(it);
+
+	// seams of the remaining neighbours leave the faces to this chunk open again
+	if (hasSeams()) {
+		invalidateSeams(index);
+	}
+}
+
+bool TVoxelChunkStreamer::evictLeastRecentlyUsed(const FVector& viewer, const TMeshRemoved& onMeshRemoved) {
+	const TVoxelIndex* victim = nullptr;
+	uint64 oldest = 0;
+	float farthest = 0;
+
+	for (const auto& pair : chunks) {
+		const TChunk& chunk = pair.second;
+
+		// chunks inside the radius were touched this frame and are never victims
+		if (chunk.state != TChunkState::Resident || chunk.task.isValid() || chunk.seam_task.isValid() || chunk.last_used == frame) {
+			continue;
+		}
+
+		const float distance = FVector::DistSquared(chunkOrigin(pair.first), viewer);
+		if (victim == nullptr || chunk.last_used < oldest || (chunk.last_used == oldest && distance > farthest)) {
+			victim = &pair.first;
+			oldest = chunk.last_used;
+			farthest = distance;
+		}
+	}
+
+	if (victim == nullptr) {
+		return false;
+	}
+
+	evict(TVoxelIndex(*victim), onMeshRemoved);
+	return true;
+}
+
+void TVoxelChunkStreamer::update(const FVector& viewer, const FVector& viewDirection, const TMeshReady& onMeshReady, const TMeshRemoved& onMeshRemoved) {
+	frame++;
+
+	for (auto it = chunks.begin(); it != chunks.end();) {
+		TChunk& chunk = it->second;
+
+		// a loading chunk has no seam task
+		if (chunk.task.isValid() && chunk.task.isReady() && !finishTask(it->first, chunk, onMeshReady, onMeshRemoved)) {
+			it = chunks.erase(it);
+			continue;
+		}
+
+		if (chunk.seam_task.isValid() && chunk.seam_task.isReady()) {
+			finishSeam(chunk, onMeshReady, onMeshRemoved);
+		}
+
+		++it;
+	}
+
+	for (auto it = save_tasks.begin(); it != save_tasks.end();) {
+		if (it->second.IsReady()) {
+			it = save_tasks.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	enum class TCandidateKind : uint8 {
+		Load,
+		Remesh,
+		Seam
+	};
+
+	struct TCandidate {
+		TVoxelIndex index;
+		float score;
+		TCandidateKind kind;
+	};
+
+	std::vector<TCandidate> candidates;
+	const FVector direction = viewDirection.GetSafeNormal();
+
+	// lower is sooner: distance, halved for chunks straight ahead
+	auto score = [&](const TVoxelIndex& index) {
+		const FVector toChunk = chunkOrigin(index) - viewer;
+		const float distance = toChunk.Size();
+		const float facing = distance > 0 ? FVector::DotProduct(toChunk / distance, direction) : 1.f;
+		return distance * (1.f - 0.5f * FMath::Max(facing, 0.f));
+	};
+
+	const TVoxelIndex center = chunkIndexAt(viewer);
+	const int r = FMath::CeilToInt(settings.loadRadius / settings.chunkSize);
+
+	for (int x = -r; x <= r; x++) {
+		for (int y = -r; y <= r; y++) {
+			for (int z = -r; z <= r; z++) {
+				const TVoxelIndex index(center.X + x, center.Y + y, center.Z + z);
+				if (!isInRadius(index, viewer)) {
+					continue;
+				}
+
+				auto it = chunks.find(index);
+				if (it != chunks.end()) {
+					TChunk& chunk = it->second;
+					chunk.last_used = frame;
+
+					// a loading chunk picks up the change with its next remesh
+					const int stride = lodStride(index, viewer, chunk.stride);
+					if (stride != chunk.stride && chunk.state == TChunkState::Resident) {
+						chunk.stride = stride;
+						chunk.bDirty = true;
+					}
+					continue;
+				}
+
+				// wait until an earlier eviction of this chunk is on disk
+				if (save_tasks.find(index) != save_tasks.end()) {
+					continue;
+				}
+
+				candidates.push_back({ index, score(index), TCandidateKind::Load });
+			}
+		}
+	}
+
+	// loads the viewer has moved away from are given up, unless edits wait for them
+	for (auto& pair : chunks) {
+		TChunk& chunk = pair.second;
+		if (chunk.state == TChunkState::Loading && chunk.last_used != frame && chunk.pending_edits.empty()) {
+			chunk.task.job->cancel();
+		}
+	}
+
+	// edited chunks go first, what the player changes should show up before new terrain;
+	// seams wait for their own chunk's mesh, neighbours that finish later dirty them again
+	std::vector<std::pair<TVoxelJobPtr, float>> priorities;
+
+	for (auto& pair : chunks) {
+		const TChunk& chunk = pair.second;
+
+		// jobs already queued move with the viewer like the new ones
+		if (chunk.task.isValid()) {
+			priorities.emplace_back(chunk.task.job, score(pair.first) * (chunk.state == TChunkState::Loading ? 1.f : 0.25f));
+		}
+
+		if (chunk.seam_task.isValid()) {
+			priorities.emplace_back(chunk.seam_task.job, score(pair.first) * 0.25f);
+		}
+
+		if (chunk.state != TChunkState::Resident || chunk.task.isValid()) {
+			continue;
+		}
+
+		if (chunk.bDirty) {
+			candidates.push_back({ pair.first, score(pair.first) * 0.25f, TCandidateKind::Remesh });
+		} else if (chunk.bSeamDirty && chunk.boundary && !chunk.seam_task.isValid()) {
+			candidates.push_back({ pair.first, score(pair.first) * 0.25f, TCandidateKind::Seam });
+		}
+	}
+
+	scheduler.reprioritize(priorities);
+	std::sort(candidates.begin(), candidates.end(), [](const TCandidate& a, const TCandidate& b) { return a.score < b.score; });
+
+	while (voxel_memory > settings.maxVoxelMemory || mesh_memory > settings.maxMeshMemory) {
+		if (!evictLeastRecentlyUsed(viewer, onMeshRemoved)) {
+			break;
+		}
+	}
+
+	const int resident = getResidentChunkCount();
+	const size_t voxelEstimate = resident > 0 ? voxel_memory / resident : 0;
+	const size_t meshEstimate = resident > 0 ? mesh_memory / resident : 0;
+
+	for (const TCandidate& candidate : candidates) {
+		if (tasks_in_flight >= settings.maxTasksInFlight) {
+			break;
+		}
+
+		if (candidate.kind != TCandidateKind::Load) {
+			// may have been evicted to make room meanwhile
+			auto it = chunks.find(candidate.index);
+			if (it == chunks.end()) {
+				continue;
+			}
+
+			if (candidate.kind == TCandidateKind::Remesh) {
+				startRemesh(candidate.index, it->second, candidate.score);
+			} else {
+				startSeam(candidate.index, it->second, candidate.score);
+			}
+			continue;
+		}
+
+		// admit a new chunk only if an average one still fits
+		bool bFits = true;
+		while (voxel_memory + voxelEstimate > settings.maxVoxelMemory || mesh_memory + meshEstimate > settings.maxMeshMemory) {
+			if (!evictLeastRecentlyUsed(viewer, onMeshRemoved)) {
+				bFits = false;
+				break;
+			}
+		}
+
+		if (!bFits) {
+			if (!bBudgetWarning) {
+				UE_LOG(LogTemp, Warning, TEXT("Voxel streaming budget exhausted inside the load radius: voxels %d KB, meshes %d KB"), (int)(voxel_memory / 1024), (int)(mesh_memory / 1024));
+				bBudgetWarning = true;
+			}
+			break;
+		}
+
+		TChunk& chunk = chunks[candidate.index];
+		chunk.last_used = frame;
+		chunk.stride = lodStride(candidate.index, viewer, 1);
+		startLoad(candidate.index, chunk, candidate.score);
+	}
+}
+
+void TVoxelChunkStreamer::applyEditToChunk(const TVoxelIndex& index, const TVoxelEdit& edit) {
+	auto it = chunks.find(index);
+	if (it == chunks.end()) {
+		return;
+	}
+
+	TChunk& chunk = it->second;
+
+	// the load may have been given up already when the viewer moved away, finishTask then keeps
+	// or restarts it for the edits instead of dropping the chunk
+	if (chunk.state == TChunkState::Loading) {
+		chunk.pending_edits.push_back(edit);
+		return;
+	}
+
+	voxel_memory -= chunkVoxelMemory(chunk);
+	applyVoxelEdit(*chunk.data, edit);
+	voxel_memory += chunkVoxelMemory(chunk);
+
+	chunk.data->setChanged();
+	chunk.bDirty = true;
+
+	// the mesh being built is stale already, the chunk is queued again with the edit priority
+	if (chunk.task.isValid()) {
+		chunk.task.job->cancel();
+	}
+}
+
+void TVoxelChunkStreamer::applyEdit(const TVoxelEdit& edit) {
+	const int n1 = settings.chunkVoxelNum - 1;
+
+	if (edit.type == TVoxelEditType::DigSphere || edit.type == TVoxelEditType::FillSphere || edit.type == TVoxelEditType::FilterSphere) {
+		// the brush has one voxel of falloff outside its radius
+		const float reach = edit.radius + 2 * settings.chunkSize / n1;
+		const TVoxelIndex lo = chunkIndexAt(edit.center - FVector(reach, reach, reach));
+		const TVoxelIndex hi = chunkIndexAt(edit.center + FVector(reach, reach, reach));
+
+		for (int x = lo.X; x <= hi.X; x++) {
+			for (int y = lo.Y; y <= hi.Y; y++) {
+				for (int z = lo.Z; z <= hi.Z; z++) {
+					const TVoxelIndex index(x, y, z);
+					TVoxelEdit local = edit;
+					local.center = edit.center - chunkOrigin(index);
+
+					// a filter can't see past the chunk, the faces it shares with its neighbours
+					// would come out different on either side
+					local.filter.bKeepBorder = true;
+					applyEditToChunk(index, local);
+				}
+			}
+		}
+
+		return;
+	}
+
+	// a sample on a chunk border belongs to both chunks that share it
+	int chunk[3][2];
+	int local[3][2];
+	int count[3];
+	const int global[3] = { edit.x, edit.y, edit.z };
+
+	for (int axis = 0; axis < 3; axis++) {
+		chunk[axis][0] = FloorDiv(global[axis], n1);
+		local[axis][0] = global[axis] - chunk[axis][0] * n1;
+		count[axis] = 1;
+
+		if (local[axis][0] == 0) {
+			chunk[axis][1] = chunk[axis][0] - 1;
+			local[axis][1] = n1;
+			count[axis] = 2;
+		}
+	}
+
+	for (int i = 0; i < count[0]; i++) {
+		for (int j = 0; j < count[1]; j++) {
+			for (int k = 0; k < count[2]; k++) {
+				TVoxelEdit e = edit;
+				e.x = local[0][i];
+				e.y = local[1][j];
+				e.z = local[2][k];
+				applyEditToChunk(TVoxelIndex(chunk[0][i], chunk[1][j], chunk[2][k]), e);
+			}
+		}
+	}
+}
+
+void TVoxelChunkStreamer::flush() {
+	for (auto& pair : chunks) {
+		TChunk& chunk = pair.second;
+		if (!chunk.seam_task.isValid()) {
+			continue;
+		}
+
+		// the seam mesh is dropped like the chunk meshes below
+		TChunkTaskResult result = takeResult(chunk.seam_task);
+
+		chunk.bSeamDirty = true;
+		TVoxelMeshingContextPool::get().release(result.context);
+	}
+
+	for (auto it = chunks.begin(); it != chunks.end();) {
+		TChunk& chunk = it->second;
+		if (!chunk.task.isValid()) {
+			++it;
+			continue;
+		}
+
+		TChunkTaskResult result = takeResult(chunk.task);
+
+		// a load cancelled before it ran has nothing to keep, unless edits wait for it
+		if (chunk.state == TChunkState::Loading && result.data == nullptr) {
+			if (!chunk.pending_edits.empty()) {
+				startLoad(it->first, chunk, 0);
+				continue;
+			}
+
+			it = chunks.erase(it);
+			continue;
+		}
+
+		voxel_memory -= chunkVoxelMemory(chunk);
+
+		if (result.data != nullptr) {
+			chunk.data = result.data;
+			chunk.snapshot = result.snapshot;
+			chunk.state = TChunkState::Resident;
+
+			for (const TVoxelEdit& edit : chunk.pending_edits) {
+				applyVoxelEdit(*chunk.data, edit);
+			}
+
+			if (!chunk.pending_edits.empty()) {
+				chunk.data->setChanged();
+				chunk.pending_edits.clear();
+			}
+		}
+
+		// the mesh is dropped, the chunk gets meshed again on the next update
+		voxel_memory += chunkVoxelMemory(chunk);
+		chunk.bDirty = true;
+
+		TVoxelMeshingContextPool::get().release(result.context);
+		++it;
+	}
+
+	if (!settings.saveDirectory.IsEmpty()) {
+		for (auto& pair : chunks) {
+			TVoxelData* data = pair.second.data;
+			if (data == nullptr || !data->isChanged()) {
+				continue;
+			}
+
+			TArray<uint8> bytes;
+			data->save(bytes);
+
+			const FString fileName = chunkFileName(pair.first);
+			if (FFileHelper::SaveArrayToFile(bytes, *fileName)) {
+				data->resetLastSave();
+			} else {
+				UE_LOG(LogTemp, Error, TEXT("Voxel chunk save failed: %s"), *fileName);
+			}
+		}
+	}
+
+	for (auto& pair : save_tasks) {
+		pair.second.Wait();
+	}
+
+	save_tasks.clear();
+}
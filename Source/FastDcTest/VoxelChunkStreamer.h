@@ -0,0 +1,239 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Async.h"
+#include "VoxelData.h"
+#include "VoxelSnapshot.h"
+#include "VoxelMesher.h"
+#include "VoxelMeshSimplifier.h"
+#include "VoxelEditQueue.h"
+#include "VoxelIndex.h"
+#include "VoxelJobScheduler.h"
+#include "VoxelQuery.h"
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+struct TVoxelChunkStreamerSettings {
+	// voxels per chunk axis, neighbouring chunks share their border samples
+	int chunkVoxelNum = 64;
+
+	// chunk edge length in local units
+	float chunkSize = 1000.f;
+
+	// chunks whose bounds come closer to the viewer than this are kept resident
+	float loadRadius = 4000.f;
+
+	// hard limits, least recently used chunks outside the radius are evicted to stay below them
+	size_t maxVoxelMemory = 512 * 1024 * 1024;
+	size_t maxMeshMemory = 256 * 1024 * 1024;
+
+	// load, remesh and seam jobs queued or running at once; the queue is kept in priority order
+	// and re-sorted every update, so a few more jobs than workers keep all of them busy
+	int maxTasksInFlight = 16;
+
+	// meshing threads of the streamer's own scheduler, 0 for one per hardware thread but one
+	int workerNum = 0;
+
+	// Chunks farther than this from the viewer mesh at stride 2, twice as far at stride 4 and so
+	// on up to maxLodStride. Chunks are then meshed with open faces and joined by seam strips,
+	// which also replace the walls each chunk otherwise closes itself with at its faces.
+	// 0 keeps every chunk closed and at full resolution. chunkVoxelNum - 1 has to be a multiple
+	// of the strides used, 65 voxels allow stride 4.
+	float lodDistance = 0.f;
+	int maxLodStride = 4;
+
+	// simplify chunk meshes on their task, the faces shared with neighbouring chunks stay untouched
+	bool bSimplifyMeshes = false;
+	TVoxelSimplifySettings simplify;
+
+	// triplanar attributes of chunk and seam meshes, projected in the streamer's space
+	TVoxelSurfaceSettings surface;
+
+	// modified chunks are written here before eviction and read back instead of being regenerated
+	FString saveDirectory;
+};
+
+// bytes one chunk holds, the volume and snapshot as counted against maxVoxelMemory and the mesh
+// and boundary as counted against maxMeshMemory
+struct TVoxelChunkMemory {
+	TVoxelIndex index = TVoxelIndex(0, 0, 0);
+	bool bResident = false;
+
+	TVoxelMemoryStats voxels;
+
+	// what the snapshot holds beyond the volume, the pyramid pages they share count with the volume
+	size_t snapshotBytes = 0;
+	size_t meshBytes = 0;
+	size_t boundaryBytes = 0;
+
+	size_t getTotal() const { return voxels.getTotal() + snapshotBytes + meshBytes + boundaryBytes; }
+};
+
+// fills a freshly created chunk, origin is the chunk center in local space
+using TVoxelChunkGenerator = std::function<void(TVoxelData& data, const FVector& origin)>;
+
+//
+// Pages fixed size chunks in and out around a moving viewer.
+//
+// update() is called once per frame from the owning thread. It requests missing chunks inside
+// the load radius (nearest and in view first), loads or generates and meshes them on its job
+// scheduler, hands finished meshes back through callbacks and evicts chunks by LRU to respect the
+// memory budget. Changed chunks are saved before they are dropped.
+//
+// Queued jobs are re-sorted by distance and view direction every update, edited chunks ahead of
+// new ones. A remesh is cancelled when its chunk is edited again and a load when the viewer has
+// moved away from the chunk before it finished.
+//
+// With a lod distance, chunks are meshed coarser with distance and each one owns a seam strip
+// on its high faces that is rebuilt from the boundary cells of its neighbours whenever one of
+// them is remeshed, so a stride change costs one chunk mesh and a few thin seams.
+//
+class TVoxelChunkStreamer {
+
+public:
+	using TMeshReady = std::function<void(int32 section, const TVoxelMeshData& mesh)>;
+	using TMeshRemoved = std::function<void(int32 section)>;
+
+private:
+	struct TChunkTaskResult {
+		TVoxelData* data = nullptr;
+		std::shared_ptr<const TVoxelSnapshot> snapshot;
+		TVoxelMeshingContext* context = nullptr;
+		std::shared_ptr<const TVoxelMeshBoundary> boundary;
+		uint64 version = 0;
+	};
+
+	// a scheduler job and the result it leaves behind; a cancelled job may leave a partial result
+	// or none at all
+	struct TChunkTask {
+		TVoxelJobPtr job;
+		std::shared_ptr<TChunkTaskResult> result;
+
+		bool isValid() const { return (bool)job; }
+		bool isReady() const { return job->isDone(); }
+	};
+
+	enum class TChunkState : uint8 {
+		Loading,
+		Resident
+	};
+
+	struct TChunk {
+		TChunkState state = TChunkState::Loading;
+
+		TVoxelData* data = nullptr;
+		std::shared_ptr<const TVoxelSnapshot> snapshot;
+
+		TChunkTask task;
+		uint64 meshed_version = 0;
+		bool bDirty = false;
+
+		// stride of the mesh being built or shown, and the cells along its faces for the seams
+		int stride = 1;
+		std::shared_ptr<const TVoxelMeshBoundary> boundary;
+
+		int32 section = -1;
+		size_t mesh_bytes = 0;
+		uint64 last_used = 0;
+
+		// the seam on the chunk's high faces, in a section of its own
+		TChunkTask seam_task;
+		bool bSeamDirty = false;
+		int32 seam_section = -1;
+		size_t seam_bytes = 0;
+
+		// edits that arrived while the chunk was still loading
+		std::vector<TVoxelEdit> pending_edits;
+	};
+
+	TVoxelChunkStreamerSettings settings;
+	TVoxelChunkGenerator generator;
+
+	std::unordered_map<TVoxelIndex, TChunk> chunks;
+	std::unordered_map<TVoxelIndex, TFuture<void>> save_tasks;
+
+	// runs load, remesh and seam jobs; saves stay on the task pool
+	TVoxelJobScheduler scheduler;
+
+	std::vector<int32> free_sections;
+	int32 section_num = 0;
+
+	uint64 frame = 0;
+	int tasks_in_flight = 0;
+	int max_lod_stride = 1;
+	size_t voxel_memory = 0;
+	size_t mesh_memory = 0;
+	bool bBudgetWarning = false;
+
+	bool isInRadius(const TVoxelIndex& index, const FVector& viewer) const;
+	int lodStride(const TVoxelIndex& index, const FVector& viewer, int current) const;
+	bool hasSeams() const { return settings.lodDistance > 0; }
+	// the volume and the snapshot of a chunk, the same numbers for the budget and the reports
+	void measureVoxels(const TChunk& chunk, TVoxelMemoryStats& voxels, size_t& snapshotBytes) const;
+	size_t chunkVoxelMemory(const TChunk& chunk) const;
+	FString chunkFileName(const TVoxelIndex& index) const;
+
+	TChunkTask submit(float priority, std::function<void(TVoxelJob& job, TChunkTaskResult& result)> work);
+	TChunkTaskResult takeResult(TChunkTask& task);
+
+	void startLoad(const TVoxelIndex& index, TChunk& chunk, float priority);
+	void startRemesh(const TVoxelIndex& index, TChunk& chunk, float priority);
+
+	// a load cancelled after edits arrived for it: keeps the volume it produced, or loads again
+	void keepCancelledLoad(const TVoxelIndex& index, TChunk& chunk, const TChunkTaskResult& result);
+
+	// false when the chunk was a cancelled load and has to be dropped
+	bool finishTask(const TVoxelIndex& index, TChunk& chunk, const TMeshReady& onMeshReady, const TMeshRemoved& onMeshRemoved);
+	void showMesh(int32& section, size_t& bytes, const TVoxelMeshData& mesh, const TMeshReady& onMeshReady, const TMeshRemoved& onMeshRemoved);
+
+	// the seams that join the chunk: its own and those of the chunks below it
+	void invalidateSeams(const TVoxelIndex& index);
+	void startSeam(const TVoxelIndex& index, TChunk& chunk, float priority);
+	void finishSeam(TChunk& chunk, const TMeshReady& onMeshReady, const TMeshRemoved& onMeshRemoved);
+
+	void evict(const TVoxelIndex& index, const TMeshRemoved& onMeshRemoved);
+	bool evictLeastRecentlyUsed(const FVector& viewer, const TMeshRemoved& onMeshRemoved);
+	void saveAsync(const TVoxelIndex& index, TVoxelData* data);
+
+	void applyEditToChunk(const TVoxelIndex& index, const TVoxelEdit& edit);
+
+public:
+	TVoxelChunkStreamer(const TVoxelChunkStreamerSettings& settings, TVoxelChunkGenerator generator);
+	~TVoxelChunkStreamer();
+
+	// viewer and viewDirection in local space
+	void update(const FVector& viewer, const FVector& viewDirection, const TMeshReady& onMeshReady, const TMeshRemoved& onMeshRemoved);
+
+	// applies an edit to all chunks it touches; sphere centers are in local space,
+	// voxel edits address the global sample grid that the chunks share
+	void applyEdit(const TVoxelEdit& edit);
+
+	// waits for running tasks and writes every changed chunk
+	void flush();
+
+	TVoxelIndex chunkIndexAt(const FVector& local) const;
+	FVector chunkOrigin(const TVoxelIndex& index) const;
+
+	// resident chunk or nullptr, the returned volume is owned by the streamer
+	const TVoxelData* getChunk(const TVoxelIndex& index) const;
+
+	// the queries of VoxelQuery.h over the resident chunks, in local space; chunks that are not
+	// resident read as air. The ray marches chunk by chunk and each chunk marches its own cells.
+	float sampleDensity(const FVector& local) const;
+	bool rayCast(const FVector& start, const FVector& direction, float maxDistance, TVoxelRayHit& outHit) const;
+	bool sphereOverlap(const FVector& center, float radius) const;
+
+	int getResidentChunkCount() const;
+	size_t getVoxelMemory() const { return voxel_memory; }
+	size_t getMeshMemory() const { return mesh_memory; }
+
+	// what every chunk holds, resident or loading, for memory reports
+	void getChunkMemory(std::vector<TVoxelChunkMemory>& out) const;
+
+	// queue depth and latencies of the load, remesh and seam jobs
+	TVoxelJobStats getJobStats() const { return scheduler.getStats(); }
+	void resetJobStats() { scheduler.resetStats(); }
+};
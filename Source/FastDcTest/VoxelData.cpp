@@ -0,0 +1,1200 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "VoxelData.h"
+#include "Async/ParallelFor.h"
+#include <algorithm>
+#include <emmintrin.h>
+
+static std::atomic<int64> LiveVolumes(0);
+static std::atomic<int64> LiveDensityArrays(0);
+static std::atomic<int64> LiveDensityBytes(0);
+
+TVoxelData::TVoxelData(int num, float size) {
+	// int s = num*num*num;
+
+	density_data = NULL;
+	density_state = TVoxelDataFillState::ZERO;
+
+	voxel_num = num;
+	volume_size = size;
+
+	last_change = 0;
+	last_save = 0;
+	last_mesh_generation = 0;
+	last_cache_check = -1;
+
+	brick_num = (num + VOXEL_BRICK_SIZE - 1) >> VOXEL_BRICK_SHIFT;
+	brick_version.assign(brick_num * brick_num * brick_num, 0);
+
+	density_pyramid.reset(num, 0);
+	LiveVolumes++;
+}
+
+TVoxelData::~TVoxelData() {
+	freeDensityArray();
+	LiveVolumes--;
+}
+
+void TVoxelData::allocateDensityArray() {
+	const size_t s = (size_t)voxel_num * voxel_num * voxel_num;
+
+	density_data = new unsigned char[s];
+	LiveDensityArrays++;
+	LiveDensityBytes += s;
+}
+
+void TVoxelData::freeDensityArray() {
+	if (density_data == NULL) {
+		return;
+	}
+
+	delete[] density_data;
+	density_data = NULL;
+
+	LiveDensityArrays--;
+	LiveDensityBytes -= (size_t)voxel_num * voxel_num * voxel_num;
+}
+
+FORCEINLINE void TVoxelData::initializeDensity(bool bFill) {
+	int s = voxel_num * voxel_num * voxel_num;
+	const unsigned char fill = density_state == TVoxelDataFillState::ALL ? 255 : 0;
+
+	allocateDensityArray();
+	if (bFill) {
+		FMemory::Memset(density_data, fill, s);
+	}
+
+	density_pyramid.allocate(voxel_num, fill);
+	touchAllBricks();
+}
+
+FORCEINLINE void TVoxelData::initializeMaterial() {
+	material_bricks.allocate(voxel_num, base_fill_mat);
+	touchAllBricks();
+}
+
+void TVoxelData::setDensity(int x, int y, int z, float density) {
+	if (density_data == NULL) {
+		if (density_state == TVoxelDataFillState::ZERO && density == 0) {
+			return;
+		}
+
+		if (density_state == TVoxelDataFillState::ALL && density == 1) {
+			return;
+		}
+
+		initializeDensity();
+		density_state = TVoxelDataFillState::MIX;
+	}
+
+	if (isInside(x, y, z)) {
+		int index = x * voxel_num * voxel_num + y * voxel_num + z;
+
+		if (density < 0) density = 0;
+		if (density > 1) density = 1;
+
+		unsigned char d = 255 * density;
+
+		density_data[index] = d;
+		density_pyramid.widen(x, y, z, d);
+		touchBrick(x, y, z);
+	}
+}
+
+void TVoxelData::setMaterial(const int x, const int y, const int z, const unsigned short material) {
+	if (material_bricks.isEmpty()) {
+		if (material == base_fill_mat) {
+			return;
+		}
+
+		initializeMaterial();
+	}
+
+	if (isInside(x, y, z)) {
+		material_bricks.set(x, y, z, material);
+		touchBrick(x, y, z);
+	}
+}
+
+bool TVoxelData::isBrickMaterialUniform(int index, unsigned short& material) const {
+	if (material_bricks.isEmpty()) {
+		material = base_fill_mat;
+		return true;
+	}
+
+	return TVoxelMaterialBricks::isUniform(material_bricks.bricks[index], material);
+}
+
+void TVoxelData::decodeBrickMaterial(int index, unsigned short* out) const {
+	if (material_bricks.isEmpty()) {
+		std::fill(out, out + VOXEL_BRICK_VOLUME, base_fill_mat);
+		return;
+	}
+
+	material_bricks.decodeBrick(index, out);
+}
+
+unsigned short TVoxelData::getMaterial(int x, int y, int z) const {
+	if (material_bricks.isEmpty()) {
+		return base_fill_mat;
+	}
+
+	if (isInside(x, y, z)) {
+		return material_bricks.get(x, y, z);
+	}
+	else {
+		return 0;
+	}
+}
+
+FVector TVoxelData::voxelIndexToVector(int x, int y, int z) const {
+	const float step = size() / (num() - 1);
+	const float s = -size() / 2;
+	FVector v(s, s, s);
+	FVector a(x * step, y * step, z * step);
+	v = v + a;
+	return v;
+}
+
+void TVoxelData::vectorToVoxelIndex(const FVector& v, int& x, int& y, int& z) const {
+	// exact inverse of voxelIndexToVector, rounded to the nearest voxel
+	const float step = size() / (num() - 1);
+	const float s = size() / 2;
+
+	x = FMath::RoundToInt((v.X + s) / step);
+	y = FMath::RoundToInt((v.Y + s) / step);
+	z = FMath::RoundToInt((v.Z + s) / step);
+}
+
+void TVoxelData::setOrigin(FVector o) {
+	origin = o;
+	lower = FVector(o.X - volume_size, o.Y - volume_size, o.Z - volume_size);
+	upper = FVector(o.X + volume_size, o.Y + volume_size, o.Z + volume_size);
+}
+
+FVector TVoxelData::getOrigin() const {
+	return origin;
+}
+
+TVoxelPoint TVoxelData::getVoxelPoint(int x, int y, int z) const {
+	TVoxelPoint vp;
+	int index = x * voxel_num * voxel_num + y * voxel_num + z;
+
+	vp.material = base_fill_mat;
+	vp.density = 0;
+
+	if (density_data != NULL) {
+		vp.density = density_data[index];
+	}
+
+	if (!material_bricks.isEmpty()) {
+		vp.material = material_bricks.get(x, y, z);
+	}
+
+	return vp;
+}
+
+void TVoxelData::setVoxelPoint(int x, int y, int z, unsigned char density, unsigned short material) {
+	if (density_data == NULL) {
+		initializeDensity();
+		density_state = TVoxelDataFillState::MIX;
+	}
+
+	if (material_bricks.isEmpty()) {
+		initializeMaterial();
+	}
+
+	int index = x * voxel_num * voxel_num + y * voxel_num + z;
+	material_bricks.set(x, y, z, material);
+	density_data[index] = density;
+	density_pyramid.widen(x, y, z, density);
+	touchBrick(x, y, z);
+}
+
+void TVoxelData::setVoxelPointDensity(int x, int y, int z, unsigned char density) {
+	if (density_data == NULL) {
+		initializeDensity();
+		density_state = TVoxelDataFillState::MIX;
+	}
+
+	int index = x * voxel_num * voxel_num + y * voxel_num + z;
+	density_data[index] = density;
+	density_pyramid.widen(x, y, z, density);
+	touchBrick(x, y, z);
+}
+
+void TVoxelData::setVoxelPointMaterial(int x, int y, int z, unsigned short material) {
+	if (material_bricks.isEmpty()) {
+		initializeMaterial();
+	}
+
+	material_bricks.set(x, y, z, material);
+	touchBrick(x, y, z);
+}
+
+void TVoxelData::deinitializeDensity(TVoxelDataFillState State) {
+	if (State == TVoxelDataFillState::MIX) {
+		return;
+	}
+
+	density_state = State;
+	freeDensityArray();
+
+	density_pyramid.reset(voxel_num, State == TVoxelDataFillState::ALL ? 255 : 0);
+	touchAllBricks();
+}
+
+unsigned char* TVoxelData::beginBulkDensityWrite(bool bFill) {
+	if (density_data == NULL) {
+		initializeDensity(bFill);
+		density_state = TVoxelDataFillState::MIX;
+	}
+
+	return density_data;
+}
+
+void TVoxelData::endBulkDensityWrite() {
+	density_pyramid.update(density_data, 0, 0, 0, voxel_num - 1, voxel_num - 1, voxel_num - 1);
+	touchAllBricks();
+}
+
+void TVoxelData::endBulkDensityWrite(int x0, int y0, int z0, int x1, int y1, int z1) {
+	density_pyramid.update(density_data, x0, y0, z0, x1, y1, z1);
+
+	++data_version;
+	for (int bx = x0 >> VOXEL_BRICK_SHIFT; bx <= x1 >> VOXEL_BRICK_SHIFT; bx++) {
+		for (int by = y0 >> VOXEL_BRICK_SHIFT; by <= y1 >> VOXEL_BRICK_SHIFT; by++) {
+			for (int bz = z0 >> VOXEL_BRICK_SHIFT; bz <= z1 >> VOXEL_BRICK_SHIFT; bz++) {
+				brick_version[(bx * brick_num + by) * brick_num + bz] = data_version;
+			}
+		}
+	}
+}
+
+void TVoxelData::updateDensityPyramid(int x0, int y0, int z0, int x1, int y1, int z1) {
+	if (density_data != NULL) {
+		density_pyramid.update(density_data, x0, y0, z0, x1, y1, z1);
+	}
+}
+
+void TVoxelData::applyBrickDelta(int bx, int by, int bz, const unsigned char* densityDelta, const unsigned short* materialDelta) {
+	bool bDensity = false;
+	bool bMaterial = false;
+
+	for (int i = 0; i < VOXEL_BRICK_VOLUME; i++) {
+		bDensity |= densityDelta[i] != 0;
+		bMaterial |= materialDelta[i] != 0;
+	}
+
+	if (!bDensity && !bMaterial) {
+		return;
+	}
+
+	if (bDensity && density_data == NULL) {
+		initializeDensity();
+		density_state = TVoxelDataFillState::MIX;
+	}
+
+	if (bMaterial && material_bricks.isEmpty()) {
+		initializeMaterial();
+	}
+
+	const int x0 = bx << VOXEL_BRICK_SHIFT;
+	const int y0 = by << VOXEL_BRICK_SHIFT;
+	const int z0 = bz << VOXEL_BRICK_SHIFT;
+	const int x1 = FMath::Min(x0 + VOXEL_BRICK_SIZE, voxel_num);
+	const int y1 = FMath::Min(y0 + VOXEL_BRICK_SIZE, voxel_num);
+	const int z1 = FMath::Min(z0 + VOXEL_BRICK_SIZE, voxel_num);
+
+	const int brickIndex = (bx * brick_num + by) * brick_num + bz;
+
+	if (bMaterial) {
+		unsigned short samples[VOXEL_BRICK_VOLUME];
+		material_bricks.decodeBrick(brickIndex, samples);
+
+		for (int x = x0; x < x1; x++) {
+			for (int y = y0; y < y1; y++) {
+				const int local = (((x - x0) << VOXEL_BRICK_SHIFT) | (y - y0)) << VOXEL_BRICK_SHIFT;
+
+				for (int z = 0; z < z1 - z0; z++) {
+					samples[local + z] ^= materialDelta[local + z];
+				}
+			}
+		}
+
+		material_bricks.encodeBrick(brickIndex, samples);
+	}
+
+	if (bDensity) {
+		for (int x = x0; x < x1; x++) {
+			for (int y = y0; y < y1; y++) {
+				const int local = (((x - x0) << VOXEL_BRICK_SHIFT) | (y - y0)) << VOXEL_BRICK_SHIFT;
+				const int index = clcLinearIndex(x, y, z0);
+
+				for (int z = 0; z < z1 - z0; z++) {
+					density_data[index + z] ^= densityDelta[local + z];
+				}
+			}
+		}
+
+		density_pyramid.update(density_data, x0, y0, z0, x1 - 1, y1 - 1, z1 - 1);
+	}
+
+	brick_version[brickIndex] = ++data_version;
+}
+
+void TVoxelData::writeBrick(int bx, int by, int bz, const unsigned char* density, const unsigned short* material) {
+	const int x0 = bx << VOXEL_BRICK_SHIFT;
+	const int y0 = by << VOXEL_BRICK_SHIFT;
+	const int z0 = bz << VOXEL_BRICK_SHIFT;
+	const int x1 = FMath::Min(x0 + VOXEL_BRICK_SIZE, voxel_num);
+	const int y1 = FMath::Min(y0 + VOXEL_BRICK_SIZE, voxel_num);
+	const int z1 = FMath::Min(z0 + VOXEL_BRICK_SIZE, voxel_num);
+
+	const unsigned char density_fill = density_state == TVoxelDataFillState::ALL ? 255 : 0;
+	bool bDensity = density_data != NULL;
+	bool bMaterial = !material_bricks.isEmpty();
+
+	for (int x = x0; x < x1 && !(bDensity && bMaterial); x++) {
+		for (int y = y0; y < y1; y++) {
+			const int local = (((x - x0) << VOXEL_BRICK_SHIFT) | (y - y0)) << VOXEL_BRICK_SHIFT;
+
+			for (int z = 0; z < z1 - z0; z++) {
+				bDensity |= density[local + z] != density_fill;
+				bMaterial |= material[local + z] != base_fill_mat;
+			}
+		}
+	}
+
+	if (bDensity && density_data == NULL) {
+		initializeDensity();
+		density_state = TVoxelDataFillState::MIX;
+	}
+
+	if (bMaterial && material_bricks.isEmpty()) {
+		initializeMaterial();
+	}
+
+	const int brickIndex = (bx * brick_num + by) * brick_num + bz;
+
+	if (bMaterial) {
+		unsigned short samples[VOXEL_BRICK_VOLUME];
+		material_bricks.decodeBrick(brickIndex, samples);
+
+		for (int x = x0; x < x1; x++) {
+			for (int y = y0; y < y1; y++) {
+				const int local = (((x - x0) << VOXEL_BRICK_SHIFT) | (y - y0)) << VOXEL_BRICK_SHIFT;
+				FMemory::Memcpy(&samples[local], &material[local], (z1 - z0) * sizeof(unsigned short));
+			}
+		}
+
+		material_bricks.encodeBrick(brickIndex, samples);
+	}
+
+	if (bDensity) {
+		for (int x = x0; x < x1; x++) {
+			for (int y = y0; y < y1; y++) {
+				const int local = (((x - x0) << VOXEL_BRICK_SHIFT) | (y - y0)) << VOXEL_BRICK_SHIFT;
+				FMemory::Memcpy(&density_data[clcLinearIndex(x, y, z0)], &density[local], z1 - z0);
+			}
+		}
+
+		density_pyramid.update(density_data, x0, y0, z0, x1 - 1, y1 - 1, z1 - 1);
+	}
+
+	brick_version[brickIndex] = ++data_version;
+}
+
+void TVoxelData::deinitializeMaterial(unsigned short base_mat) {
+	base_fill_mat = base_mat;
+
+	material_bricks.reset();
+	touchAllBricks();
+}
+
+size_t TVoxelData::getAllocatedSize() const {
+	return getMemoryStats().getTotal();
+}
+
+TVoxelMemoryStats& TVoxelMemoryStats::operator+=(const TVoxelMemoryStats& other) {
+	density += other.density;
+	material += other.material;
+	pyramid += other.pyramid;
+	substanceCache += other.substanceCache;
+	brickVersions += other.brickVersions;
+	allocations += other.allocations;
+	return *this;
+}
+
+TVoxelMemoryStats TVoxelData::getMemoryStats() const {
+	TVoxelMemoryStats stats;
+
+	if (density_data != NULL) {
+		stats.density = (size_t)voxel_num * voxel_num * voxel_num;
+		stats.allocations++;
+	}
+
+	stats.material = material_bricks.getAllocatedSize();
+	stats.allocations += material_bricks.getAllocationCount();
+
+	stats.pyramid = density_pyramid.getAllocatedSize();
+	stats.allocations += density_pyramid.getAllocationCount();
+
+	for (const TSubstanceCache& lodCache : substanceCacheLOD) {
+		stats.substanceCache += lodCache.getAllocatedSize();
+		stats.allocations += lodCache.getAllocationCount();
+	}
+
+	stats.brickVersions = brick_version.capacity() * sizeof(uint64);
+	stats.allocations += brick_version.capacity() > 0 ? 1 : 0;
+
+	return stats;
+}
+
+TVoxelLiveMemory TVoxelData::getLiveMemory() {
+	TVoxelLiveMemory live;
+	live.volumes = LiveVolumes;
+	live.densityArrays = LiveDensityArrays;
+	live.densityBytes = LiveDensityBytes;
+	return live;
+}
+
+// calls func(brickIndex, local, index, rowLen) for the row of each brick that starts at brick
+// position local and volume index index, rows on the far faces are cut short
+template <typename TFunc>
+static void ForEachBrickRow(int voxelNum, int brickNum, TFunc&& func) {
+	int brickIndex = 0;
+
+	for (int bx = 0; bx < brickNum; bx++) {
+		for (int by = 0; by < brickNum; by++) {
+			for (int bz = 0; bz < brickNum; bz++, brickIndex++) {
+				const int x0 = bx << VOXEL_BRICK_SHIFT;
+				const int y0 = by << VOXEL_BRICK_SHIFT;
+				const int z0 = bz << VOXEL_BRICK_SHIFT;
+				const int rowLen = FMath::Min(VOXEL_BRICK_SIZE, voxelNum - z0);
+
+				for (int x = x0; x < FMath::Min(x0 + VOXEL_BRICK_SIZE, voxelNum); x++) {
+					for (int y = y0; y < FMath::Min(y0 + VOXEL_BRICK_SIZE, voxelNum); y++) {
+						const int local = (((x - x0) << VOXEL_BRICK_SHIFT) | (y - y0)) << VOXEL_BRICK_SHIFT;
+						func(brickIndex, local, (x * voxelNum + y) * voxelNum + z0, rowLen);
+					}
+				}
+			}
+		}
+	}
+}
+
+static const uint32 VOXEL_DATA_MAGIC = 0x4c58564d; // "MVXL"
+static const uint32 VOXEL_DATA_FORMAT_VERSION = 1;
+
+struct TVoxelDataHeader {
+	uint32 magic;
+	uint32 version;
+	int32 voxel_num;
+	float volume_size;
+	uint8 density_state;
+	uint8 has_density;
+	uint8 has_material;
+	uint8 reserved;
+	uint16 base_fill_mat;
+	uint16 reserved2;
+};
+
+void TVoxelData::save(TArray<uint8>& out) const {
+	const size_t s = (size_t)voxel_num * voxel_num * voxel_num;
+
+	TVoxelDataHeader header;
+	FMemory::Memzero(&header, sizeof(header));
+	header.magic = VOXEL_DATA_MAGIC;
+	header.version = VOXEL_DATA_FORMAT_VERSION;
+	header.voxel_num = voxel_num;
+	header.volume_size = volume_size;
+	header.density_state = (uint8)density_state;
+	header.has_density = density_data != NULL;
+	header.has_material = !material_bricks.isEmpty();
+	header.base_fill_mat = base_fill_mat;
+
+	out.Reset();
+	out.Append((const uint8*)&header, sizeof(header));
+
+	if (density_data != NULL) {
+		out.Append((const uint8*)density_data, s * sizeof(unsigned char));
+	}
+
+	// the file keeps the flat material array, bricks are expanded on the way out
+	if (!material_bricks.isEmpty()) {
+		const int32 offset = out.AddUninitialized(s * sizeof(unsigned short));
+		unsigned short* material = (unsigned short*)(out.GetData() + offset);
+		unsigned short samples[VOXEL_BRICK_VOLUME];
+		int decoded = -1;
+
+		ForEachBrickRow(voxel_num, brick_num, [&](int brickIndex, int local, int index, int rowLen) {
+			if (brickIndex != decoded) {
+				material_bricks.decodeBrick(brickIndex, samples);
+				decoded = brickIndex;
+			}
+
+			FMemory::Memcpy(&material[index], &samples[local], rowLen * sizeof(unsigned short));
+		});
+	}
+}
+
+bool TVoxelData::load(const TArray<uint8>& in) {
+	const size_t s = (size_t)voxel_num * voxel_num * voxel_num;
+
+	if ((size_t)in.Num() < sizeof(TVoxelDataHeader)) {
+		return false;
+	}
+
+	TVoxelDataHeader header;
+	FMemory::Memcpy(&header, in.GetData(), sizeof(header));
+
+	if (header.magic != VOXEL_DATA_MAGIC || header.version != VOXEL_DATA_FORMAT_VERSION || header.voxel_num != voxel_num || header.density_state > TVoxelDataFillState::MIX) {
+		return false;
+	}
+
+	const size_t expected = sizeof(header) + (header.has_density ? s * sizeof(unsigned char) : 0) + (header.has_material ? s * sizeof(unsigned short) : 0);
+	if ((size_t)in.Num() != expected) {
+		return false;
+	}
+
+	const uint8* src = in.GetData() + sizeof(header);
+
+	freeDensityArray();
+	density_state = (TVoxelDataFillState)header.density_state;
+
+	if (header.has_density) {
+		allocateDensityArray();
+		density_state = TVoxelDataFillState::MIX;
+		FMemory::Memcpy(density_data, src, s * sizeof(unsigned char));
+		src += s * sizeof(unsigned char);
+	} else if (density_state == TVoxelDataFillState::MIX) {
+		density_state = TVoxelDataFillState::ZERO;
+	}
+
+	material_bricks.reset();
+	base_fill_mat = header.base_fill_mat;
+
+	if (header.has_material) {
+		material_bricks.allocate(voxel_num, base_fill_mat);
+
+		// one brick is gathered at a time, its padding keeps the base material
+		unsigned short samples[VOXEL_BRICK_VOLUME];
+		int gathered = -1;
+
+		ForEachBrickRow(voxel_num, brick_num, [&](int brickIndex, int local, int index, int rowLen) {
+			if (brickIndex != gathered) {
+				if (gathered >= 0) {
+					material_bricks.encodeBrick(gathered, samples);
+				}
+
+				std::fill(samples, samples + VOXEL_BRICK_VOLUME, base_fill_mat);
+				gathered = brickIndex;
+			}
+
+			FMemory::Memcpy(&samples[local], src + index * sizeof(unsigned short), rowLen * sizeof(unsigned short));
+		});
+
+		material_bricks.encodeBrick(gathered, samples);
+	}
+
+	volume_size = header.volume_size;
+
+	if (density_data != NULL) {
+		density_pyramid.allocate(voxel_num, 0);
+		density_pyramid.update(density_data, 0, 0, 0, voxel_num - 1, voxel_num - 1, voxel_num - 1);
+	} else {
+		density_pyramid.reset(voxel_num, density_state == TVoxelDataFillState::ALL ? 255 : 0);
+	}
+
+	touchAllBricks();
+	clearSubstanceCache();
+
+	// freshly loaded data matches what is on disk
+	last_change = FPlatformTime::Seconds();
+	last_save = last_change.load();
+	return true;
+}
+
+void TVoxelData::touchAllBricks() {
+	++data_version;
+	for (uint64& version : brick_version) {
+		version = data_version;
+	}
+}
+
+TVoxelDataFillState TVoxelData::getDensityFillState()	const {
+	return density_state;
+}
+
+// raw density above this is solid
+static const unsigned char RAW_ISOLEVEL = 127;
+
+int32 TVoxelDensityPyramid::getAllocationCount() const {
+	return (level_blocks.capacity() > 0 ? 1 : 0) + (level_offset.capacity() > 0 ? 1 : 0) +
+		(pages.capacity() > 0 ? 1 : 0) + (int32)pages.size();
+}
+
+size_t TVoxelDensityPyramid::getAllocatedSize(std::unordered_set<const void*>& counted) const {
+	size_t bytes = (level_blocks.capacity() + level_offset.capacity()) * sizeof(int) + pages.capacity() * sizeof(pages[0]);
+
+	for (const auto& page : pages) {
+		if (counted.insert(page.get()).second) {
+			bytes += sizeof(TPage);
+		}
+	}
+
+	return bytes;
+}
+
+TVoxelDensityPyramid::TPage& TVoxelDensityPyramid::writePage(int index) {
+	std::shared_ptr<TPage>& page = pages[index >> VOXEL_PYRAMID_PAGE_SHIFT];
+	if (page.use_count() > 1) {
+		page = std::make_shared<TPage>(*page);
+	}
+
+	return *page;
+}
+
+void TVoxelDensityPyramid::unsharePages(int first, int last) {
+	for (int page = first >> VOXEL_PYRAMID_PAGE_SHIFT; page <= last >> VOXEL_PYRAMID_PAGE_SHIFT; page++) {
+		writePage(page << VOXEL_PYRAMID_PAGE_SHIFT);
+	}
+}
+
+void TVoxelDensityPyramid::reset(int voxelNum, unsigned char fillDensity) {
+	cell_num = voxelNum - 1;
+	fill = fillDensity;
+	level_blocks.clear();
+	level_offset.clear();
+	pages.clear();
+}
+
+void TVoxelDensityPyramid::allocate(int voxelNum, unsigned char fillDensity) {
+	reset(voxelNum, fillDensity);
+
+	if (cell_num <= 0) {
+		return;
+	}
+
+	int blocks = ((cell_num - 1) >> VOXEL_PYRAMID_SHIFT) + 1;
+	int total = 0;
+
+	while (true) {
+		level_blocks.push_back(blocks);
+		level_offset.push_back(total);
+		total += blocks * blocks * blocks;
+
+		if (blocks == 1) {
+			break;
+		}
+
+		blocks = (blocks + 1) / 2;
+	}
+
+	// every page starts out as the same one and is copied on its first write
+	std::shared_ptr<TPage> filled = std::make_shared<TPage>();
+	FMemory::Memset(filled->min_density, fillDensity, VOXEL_PYRAMID_PAGE_SIZE);
+	FMemory::Memset(filled->max_density, fillDensity, VOXEL_PYRAMID_PAGE_SIZE);
+	pages.assign((total + VOXEL_PYRAMID_PAGE_SIZE - 1) >> VOXEL_PYRAMID_PAGE_SHIFT, filled);
+}
+
+void TVoxelDensityPyramid::update(const unsigned char* density, int x0, int y0, int z0, int x1, int y1, int z1) {
+	if (isEmpty()) {
+		return;
+	}
+
+	const int n = cell_num + 1;
+	const int blockCells = 1 << VOXEL_PYRAMID_SHIFT;
+
+	// a sample is a corner of the cells on both sides of it
+	const int bx0 = FMath::Clamp(x0 - 1, 0, cell_num - 1) >> VOXEL_PYRAMID_SHIFT;
+	const int by0 = FMath::Clamp(y0 - 1, 0, cell_num - 1) >> VOXEL_PYRAMID_SHIFT;
+	const int bz0 = FMath::Clamp(z0 - 1, 0, cell_num - 1) >> VOXEL_PYRAMID_SHIFT;
+	const int bx1 = FMath::Clamp(x1, 0, cell_num - 1) >> VOXEL_PYRAMID_SHIFT;
+	const int by1 = FMath::Clamp(y1, 0, cell_num - 1) >> VOXEL_PYRAMID_SHIFT;
+	const int bz1 = FMath::Clamp(z1, 0, cell_num - 1) >> VOXEL_PYRAMID_SHIFT;
+
+	// the finest level is written in parallel below, its pages are copied beforehand
+	for (int bx = bx0; bx <= bx1; bx++) {
+		for (int by = by0; by <= by1; by++) {
+			unsharePages(blockIndex(0, bx, by, bz0), blockIndex(0, bx, by, bz1));
+		}
+	}
+
+	ParallelFor(bx1 - bx0 + 1, [&](int32 i) {
+		const int bx = bx0 + i;
+		const int sx0 = bx * blockCells;
+		const int sx1 = FMath::Min(sx0 + blockCells, cell_num);
+
+		for (int by = by0; by <= by1; by++) {
+			const int sy0 = by * blockCells;
+			const int sy1 = FMath::Min(sy0 + blockCells, cell_num);
+
+			for (int bz = bz0; bz <= bz1; bz++) {
+				const int sz0 = bz * blockCells;
+				const int sz1 = FMath::Min(sz0 + blockCells, cell_num);
+
+				unsigned char mn = 255;
+				unsigned char mx = 0;
+
+				for (int x = sx0; x <= sx1; x++) {
+					for (int y = sy0; y <= sy1; y++) {
+						const unsigned char* row = density + ((size_t)x * n + y) * n;
+
+						for (int z = sz0; z <= sz1; z++) {
+							mn = FMath::Min(mn, row[z]);
+							mx = FMath::Max(mx, row[z]);
+						}
+					}
+				}
+
+				const int index = blockIndex(0, bx, by, bz);
+				TPage& page = *pages[index >> VOXEL_PYRAMID_PAGE_SHIFT];
+				page.min_density[index & (VOXEL_PYRAMID_PAGE_SIZE - 1)] = mn;
+				page.max_density[index & (VOXEL_PYRAMID_PAGE_SIZE - 1)] = mx;
+			}
+		}
+	}, bx1 - bx0 < 4);
+
+	for (int level = 1; level < levelNum(); level++) {
+		const int children = level_blocks[level - 1];
+
+		for (int bx = bx0 >> level; bx <= bx1 >> level; bx++) {
+			for (int by = by0 >> level; by <= by1 >> level; by++) {
+				for (int bz = bz0 >> level; bz <= bz1 >> level; bz++) {
+					unsigned char mn = 255;
+					unsigned char mx = 0;
+
+					for (int cx = bx * 2; cx < FMath::Min(bx * 2 + 2, children); cx++) {
+						for (int cy = by * 2; cy < FMath::Min(by * 2 + 2, children); cy++) {
+							for (int cz = bz * 2; cz < FMath::Min(bz * 2 + 2, children); cz++) {
+								const int child = blockIndex(level - 1, cx, cy, cz);
+								const TPage& page = readPage(child);
+								mn = FMath::Min(mn, page.min_density[child & (VOXEL_PYRAMID_PAGE_SIZE - 1)]);
+								mx = FMath::Max(mx, page.max_density[child & (VOXEL_PYRAMID_PAGE_SIZE - 1)]);
+							}
+						}
+					}
+
+					const int index = blockIndex(level, bx, by, bz);
+					TPage& page = writePage(index);
+					page.min_density[index & (VOXEL_PYRAMID_PAGE_SIZE - 1)] = mn;
+					page.max_density[index & (VOXEL_PYRAMID_PAGE_SIZE - 1)] = mx;
+				}
+			}
+		}
+	}
+}
+
+void TVoxelDensityPyramid::widen(int x, int y, int z, unsigned char density) {
+	if (isEmpty()) {
+		return;
+	}
+
+	const int bx0 = FMath::Max(x - 1, 0) >> VOXEL_PYRAMID_SHIFT;
+	const int by0 = FMath::Max(y - 1, 0) >> VOXEL_PYRAMID_SHIFT;
+	const int bz0 = FMath::Max(z - 1, 0) >> VOXEL_PYRAMID_SHIFT;
+	const int bx1 = FMath::Min(x, cell_num - 1) >> VOXEL_PYRAMID_SHIFT;
+	const int by1 = FMath::Min(y, cell_num - 1) >> VOXEL_PYRAMID_SHIFT;
+	const int bz1 = FMath::Min(z, cell_num - 1) >> VOXEL_PYRAMID_SHIFT;
+
+	for (int bx = bx0; bx <= bx1; bx++) {
+		for (int by = by0; by <= by1; by++) {
+			for (int bz = bz0; bz <= bz1; bz++) {
+				// coarser blocks contain the finer ones, the first level that holds the value ends the walk
+				for (int level = 0; level < levelNum(); level++) {
+					const int index = blockIndex(level, bx >> level, by >> level, bz >> level);
+					const int local = index & (VOXEL_PYRAMID_PAGE_SIZE - 1);
+					const TPage& current = readPage(index);
+					if (density >= current.min_density[local] && density <= current.max_density[local]) {
+						break;
+					}
+
+					TPage& page = writePage(index);
+					page.min_density[local] = FMath::Min(page.min_density[local], density);
+					page.max_density[local] = FMath::Max(page.max_density[local], density);
+				}
+			}
+		}
+	}
+}
+
+void TVoxelDensityPyramid::getRange(int x0, int y0, int z0, int x1, int y1, int z1, unsigned char& outMin, unsigned char& outMax) const {
+	if (isEmpty()) {
+		outMin = fill;
+		outMax = fill;
+		return;
+	}
+
+	// cells whose corners cover the box, a flat box still needs the cell on one side of it
+	int c0[3] = { x0, y0, z0 };
+	int c1[3] = { x1, y1, z1 };
+
+	for (int axis = 0; axis < 3; axis++) {
+		const int lo = FMath::Clamp(c0[axis], 0, cell_num - 1);
+		c1[axis] = FMath::Max(lo, FMath::Clamp(c1[axis] - 1, 0, cell_num - 1));
+		c0[axis] = lo;
+	}
+
+	int level = 0;
+	for (; level < levelNum() - 1; level++) {
+		const int shift = VOXEL_PYRAMID_SHIFT + level;
+		if ((c1[0] >> shift) - (c0[0] >> shift) <= 1 && (c1[1] >> shift) - (c0[1] >> shift) <= 1 && (c1[2] >> shift) - (c0[2] >> shift) <= 1) {
+			break;
+		}
+	}
+
+	const int shift = VOXEL_PYRAMID_SHIFT + level;
+	outMin = 255;
+	outMax = 0;
+
+	for (int bx = c0[0] >> shift; bx <= c1[0] >> shift; bx++) {
+		for (int by = c0[1] >> shift; by <= c1[1] >> shift; by++) {
+			for (int bz = c0[2] >> shift; bz <= c1[2] >> shift; bz++) {
+				const int index = blockIndex(level, bx, by, bz);
+				const TPage& page = readPage(index);
+				outMin = FMath::Min(outMin, page.min_density[index & (VOXEL_PYRAMID_PAGE_SIZE - 1)]);
+				outMax = FMath::Max(outMax, page.max_density[index & (VOXEL_PYRAMID_PAGE_SIZE - 1)]);
+			}
+		}
+	}
+}
+
+int TVoxelDensityPyramid::airBlockShift(int x, int y, int z) const {
+	if (isEmpty()) {
+		// one block as wide as any volume
+		return fill <= RAW_ISOLEVEL ? 30 : -1;
+	}
+
+	int shift = -1;
+
+	for (int level = 0; level < levelNum(); level++) {
+		const int s = VOXEL_PYRAMID_SHIFT + level;
+		const int index = blockIndex(level, x >> s, y >> s, z >> s);
+		if (readPage(index).max_density[index & (VOXEL_PYRAMID_PAGE_SIZE - 1)] > RAW_ISOLEVEL) {
+			break;
+		}
+
+		shift = s;
+	}
+
+	return shift;
+}
+
+void TVoxelMaterialBricks::allocate(int voxelNum, unsigned short fill) {
+	brick_num = (voxelNum + VOXEL_BRICK_SIZE - 1) >> VOXEL_BRICK_SHIFT;
+
+	TBrick uniform;
+	uniform.palette.push_back(fill);
+	bricks.assign(brick_num * brick_num * brick_num, uniform);
+}
+
+void TVoxelMaterialBricks::reset() {
+	brick_num = 0;
+	std::vector<TBrick>().swap(bricks);
+}
+
+void TVoxelMaterialBricks::set(int x, int y, int z, unsigned short material) {
+	const int index = brickIndex(x, y, z);
+	const int local = localIndex(x, y, z);
+	TBrick& brick = bricks[index];
+
+	if (brick.palette.empty()) {
+		writeIndex(brick, local, material);
+		return;
+	}
+
+	const auto entry = std::find(brick.palette.begin(), brick.palette.end(), material);
+	if (entry != brick.palette.end()) {
+		if (brick.index_bits > 0) {
+			writeIndex(brick, local, (uint32)(entry - brick.palette.begin()));
+		}
+		return;
+	}
+
+	if (brick.palette.size() < (1u << brick.index_bits)) {
+		writeIndex(brick, local, (uint32)brick.palette.size());
+		brick.palette.push_back(material);
+		return;
+	}
+
+	// the palette is full, repacking drops the entries that fell out of use or widens the indices
+	unsigned short samples[VOXEL_BRICK_VOLUME];
+	decodeBrick(index, samples);
+	samples[local] = material;
+	encodeBrick(index, samples);
+}
+
+template <int Bits>
+static void DecodeMaterialIndices(const uint32* indices, const unsigned short* palette, unsigned short* out) {
+	const uint32 mask = (1u << Bits) - 1;
+
+	for (int w = 0; w < VOXEL_BRICK_VOLUME * Bits / 32; w++) {
+		uint32 word = indices[w];
+		for (int k = 0; k < 32 / Bits; k++, word >>= Bits) {
+			*out++ = palette[word & mask];
+		}
+	}
+}
+
+void TVoxelMaterialBricks::decodeBrick(int index, unsigned short* out) const {
+	decode(bricks[index], out);
+}
+
+void TVoxelMaterialBricks::decode(const TBrick& brick, unsigned short* out) {
+	const uint32* indices = brick.indices.data();
+	const unsigned short* palette = brick.palette.data();
+
+	switch (brick.index_bits) {
+	case 0:
+		std::fill(out, out + VOXEL_BRICK_VOLUME, palette[0]);
+		break;
+	case 1:
+		DecodeMaterialIndices<1>(indices, palette, out);
+		break;
+	case 2:
+		DecodeMaterialIndices<2>(indices, palette, out);
+		break;
+	case 4:
+		DecodeMaterialIndices<4>(indices, palette, out);
+		break;
+	case 8:
+		DecodeMaterialIndices<8>(indices, palette, out);
+		break;
+	default:
+		// raw values pack two to a word with the lower sample first, as in memory
+		FMemory::Memcpy(out, indices, VOXEL_BRICK_VOLUME * sizeof(unsigned short));
+		break;
+	}
+}
+
+bool TVoxelMaterialBricks::isUniform(const TBrick& brick, unsigned short& outMaterial) {
+	if (brick.index_bits == 0) {
+		outMaterial = brick.palette[0];
+		return true;
+	}
+
+	// palettes are only pruned on a repack, a brick painted over may still index a single entry
+	const uint32 index = brick.indices[0] & ((1u << brick.index_bits) - 1);
+	uint32 pattern = index;
+	for (int bits = brick.index_bits; bits < 32; bits <<= 1) {
+		pattern |= pattern << bits;
+	}
+
+	for (uint32 word : brick.indices) {
+		if (word != pattern) {
+			return false;
+		}
+	}
+
+	outMaterial = brick.palette.empty() ? (unsigned short)index : brick.palette[index];
+	return true;
+}
+
+void TVoxelMaterialBricks::encodeBrick(int index, const unsigned short* in) {
+	TBrick& brick = bricks[index];
+	std::vector<unsigned short> palette;
+	uint8 entries[VOXEL_BRICK_VOLUME];
+
+	// runs of one material are the common case, the entry of the previous sample is tried first
+	int last = -1;
+	bool bRaw = false;
+
+	for (int i = 0; i < VOXEL_BRICK_VOLUME && !bRaw; i++) {
+		if (last < 0 || palette[last] != in[i]) {
+			last = (int)(std::find(palette.begin(), palette.end(), in[i]) - palette.begin());
+
+			if (last == (int)palette.size()) {
+				bRaw = palette.size() == 256;
+				palette.push_back(in[i]);
+			}
+		}
+
+		entries[i] = (uint8)last;
+	}
+
+	if (bRaw) {
+		brick.palette = std::vector<unsigned short>();
+		brick.index_bits = 16;
+		brick.indices = std::vector<uint32>(VOXEL_BRICK_VOLUME / 2);
+		FMemory::Memcpy(brick.indices.data(), in, VOXEL_BRICK_VOLUME * sizeof(unsigned short));
+		return;
+	}
+
+	const int count = (int)palette.size();
+	const int bits = count <= 1 ? 0 : count <= 2 ? 1 : count <= 4 ? 2 : count <= 16 ? 4 : 8;
+
+	palette.shrink_to_fit();
+	brick.palette = std::move(palette);
+	brick.index_bits = bits;
+	brick.indices = std::vector<uint32>(VOXEL_BRICK_VOLUME * bits / 32, 0);
+
+	for (int i = 0; bits > 0 && i < VOXEL_BRICK_VOLUME; i++) {
+		brick.indices[(i * bits) >> 5] |= (uint32)entries[i] << ((i * bits) & 31);
+	}
+}
+
+size_t TVoxelMaterialBricks::getAllocatedSize() const {
+	size_t bytes = bricks.capacity() * sizeof(TBrick);
+
+	for (const TBrick& brick : bricks) {
+		bytes += getAllocatedSize(brick);
+	}
+
+	return bytes;
+}
+
+int32 TVoxelMaterialBricks::getAllocationCount() const {
+	int32 count = bricks.capacity() > 0 ? 1 : 0;
+
+	for (const TBrick& brick : bricks) {
+		count += (brick.palette.capacity() > 0 ? 1 : 0) + (brick.indices.capacity() > 0 ? 1 : 0);
+	}
+
+	return count;
+}
+
+int TSubstanceCache::countSurfaceCells() const {
+	int count = 0;
+
+	for (uint32 word : bits) {
+		for (; word != 0; word &= word - 1) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void TSubstanceCache::reset() {
+	cell_num = 0;
+	row_words = 0;
+	bits.clear();
+}
+
+// surface bits of the cells between rows a0..a3 (x, y), (x, y + 1), (x + 1, y), (x + 1, y + 1)
+// of lod 0, sixteen cells per step: a cell is on the surface when the minimum of its corners is
+// empty and the maximum solid
+static void FillSubstanceRow(const unsigned char* a0, const unsigned char* a1, const unsigned char* a2, const unsigned char* a3, int zBegin, int zEnd, uint32* out) {
+	const __m128i bias = _mm_set1_epi8((char)0x80);
+	const __m128i level = _mm_set1_epi8((char)(RAW_ISOLEVEL ^ 0x80));
+
+	int z = zBegin;
+	for (; z + 16 <= zEnd; z += 16) {
+		const __m128i r0 = _mm_loadu_si128((const __m128i*)(a0 + z));
+		const __m128i r1 = _mm_loadu_si128((const __m128i*)(a1 + z));
+		const __m128i r2 = _mm_loadu_si128((const __m128i*)(a2 + z));
+		const __m128i r3 = _mm_loadu_si128((const __m128i*)(a3 + z));
+		const __m128i s0 = _mm_loadu_si128((const __m128i*)(a0 + z + 1));
+		const __m128i s1 = _mm_loadu_si128((const __m128i*)(a1 + z + 1));
+		const __m128i s2 = _mm_loadu_si128((const __m128i*)(a2 + z + 1));
+		const __m128i s3 = _mm_loadu_si128((const __m128i*)(a3 + z + 1));
+
+		const __m128i mn = _mm_min_epu8(_mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3)), _mm_min_epu8(_mm_min_epu8(s0, s1), _mm_min_epu8(s2, s3)));
+		const __m128i mx = _mm_max_epu8(_mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3)), _mm_max_epu8(_mm_max_epu8(s0, s1), _mm_max_epu8(s2, s3)));
+
+		// SSE2 only compares signed bytes, flipping the top bit keeps the unsigned order
+		const __m128i emptyMin = _mm_cmpgt_epi8(_mm_xor_si128(mn, bias), level);
+		const __m128i solidMax = _mm_cmpgt_epi8(_mm_xor_si128(mx, bias), level);
+		const uint32 mask = (uint32)_mm_movemask_epi8(_mm_andnot_si128(emptyMin, solidMax));
+
+		out[z >> 5] |= mask << (z & 31);
+	}
+
+	for (; z < zEnd; z++) {
+		const unsigned char mn = std::min({ a0[z], a1[z], a2[z], a3[z], a0[z + 1], a1[z + 1], a2[z + 1], a3[z + 1] });
+		const unsigned char mx = std::max({ a0[z], a1[z], a2[z], a3[z], a0[z + 1], a1[z + 1], a2[z + 1], a3[z + 1] });
+
+		if (mn <= RAW_ISOLEVEL && mx > RAW_ISOLEVEL) {
+			out[z >> 5] |= 1u << (z & 31);
+		}
+	}
+}
+
+void TVoxelData::rebuildSubstanceCache(bool enableLOD) {
+	clearSubstanceCache();
+
+	if (density_data == NULL) {
+		setCacheToValid();
+		return;
+	}
+
+	const int lodNum = enableLOD ? LOD_ARRAY_SIZE : 1;
+	const int n = voxel_num;
+	const unsigned char* data = density_data;
+
+	for (int lod = 0; lod < lodNum; lod++) {
+		const int step = 1 << lod;
+		const int cells = (n - 1) / step;
+
+		if (cells <= 0) {
+			break;
+		}
+
+		TSubstanceCache& lodCache = substanceCacheLOD[lod];
+		lodCache.cell_num = cells;
+		lodCache.row_words = (cells + 31) >> 5;
+		lodCache.bits.assign((size_t)cells * cells * lodCache.row_words, 0);
+
+		const int rowWords = lodCache.row_words;
+		uint32* bits = lodCache.bits.data();
+		const TVoxelDensityPyramid& pyramid = density_pyramid;
+
+		ParallelFor(cells, [=, &pyramid](int32 x) {
+			for (int y = 0; y < cells; y++) {
+				uint32* out = bits + ((size_t)x * cells + y) * rowWords;
+
+				const unsigned char* a0 = data + ((size_t)x * step * n + y * step) * n;
+				const unsigned char* a1 = a0 + step * n;
+				const unsigned char* a2 = a0 + (size_t)step * n * n;
+				const unsigned char* a3 = a2 + step * n;
+
+				for (int w = 0; w < rowWords; w++) {
+					const int zBegin = w << 5;
+					const int zEnd = FMath::Min(zBegin + 32, cells);
+
+					// a word of cells the pyramid bounds on one side of the isolevel stays zero
+					unsigned char rangeMin, rangeMax;
+					pyramid.getRange(x * step, y * step, zBegin * step, (x + 1) * step, (y + 1) * step, zEnd * step, rangeMin, rangeMax);
+					if (rangeMin > RAW_ISOLEVEL || rangeMax <= RAW_ISOLEVEL) {
+						continue;
+					}
+
+					if (step == 1) {
+						FillSubstanceRow(a0, a1, a2, a3, zBegin, zEnd, out);
+						continue;
+					}
+
+					for (int z = zBegin; z < zEnd; z++) {
+						const int z0 = z * step;
+						const int z1 = z0 + step;
+
+						const unsigned char mn = std::min({ a0[z0], a1[z0], a2[z0], a3[z0], a0[z1], a1[z1], a2[z1], a3[z1] });
+						const unsigned char mx = std::max({ a0[z0], a1[z0], a2[z0], a3[z0], a0[z1], a1[z1], a2[z1], a3[z1] });
+
+						if (mn <= RAW_ISOLEVEL && mx > RAW_ISOLEVEL) {
+							out[z >> 5] |= 1u << (z & 31);
+						}
+					}
+				}
+			}
+		});
+	}
+
+	setCacheToValid();
+}
+
+void TVoxelData::forEach(std::function<void(int x, int y, int z)> func) {
+	for (int x = 0; x < num(); x++)
+		for (int y = 0; y < num(); y++)
+			for (int z = 0; z < num(); z++)
+				func(x, y, z);
+}
+
+void TVoxelData::forEachWithCache(std::function<void(int x, int y, int z)> func, bool LOD) {
+	forEach(func);
+	updateDensityPyramid(0, 0, 0, num() - 1, num() - 1, num() - 1);
+	rebuildSubstanceCache(LOD);
+}
+
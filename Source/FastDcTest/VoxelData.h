@@ -0,0 +1,488 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <memory>
+#include <array>
+#include <functional>
+#include <vector>
+#include <atomic>
+#include <unordered_set>
+
+
+#define LOD_ARRAY_SIZE 7
+
+// bricks are the unit of change tracking and snapshot sharing
+#define VOXEL_BRICK_SHIFT 4
+#define VOXEL_BRICK_SIZE (1 << VOXEL_BRICK_SHIFT)
+#define VOXEL_BRICK_VOLUME (VOXEL_BRICK_SIZE * VOXEL_BRICK_SIZE * VOXEL_BRICK_SIZE)
+
+typedef struct TVoxelPoint {
+	unsigned char density;
+	unsigned short material;
+} TVoxelPoint;
+
+
+typedef struct TVoxelCell {
+	TVoxelPoint point[8];
+} TVoxelCell;
+
+
+enum TVoxelDataFillState {
+	ZERO, ALL, MIX
+};
+
+//
+// Surface cells of one lod, one bit per cell: set where the 8 corners of the cell are neither all
+// solid nor all empty. Cell (x, y, z) of lod l spans the samples x << l to (x + 1) << l on each
+// axis. Every row along z starts on a new word, so slabs of x can be filled in parallel.
+//
+class TSubstanceCache {
+
+private:
+	int cell_num = 0;
+	int row_words = 0;
+	std::vector<uint32> bits;
+
+	friend class TVoxelData;
+
+public:
+	// cells per axis, 0 while the cache is empty
+	int cellNum() const { return cell_num; }
+
+	FORCEINLINE bool isSurface(int x, int y, int z) const {
+		if (bits.empty()) {
+			return false;
+		}
+
+		return (bits[(x * cell_num + y) * row_words + (z >> 5)] >> (z & 31)) & 1;
+	}
+
+	// calls func(x, y, z) for every surface cell, z fastest
+	template <typename TFunc>
+	void forEachSurfaceCell(TFunc&& func) const {
+		if (bits.empty()) {
+			return;
+		}
+
+		for (int x = 0; x < cell_num; x++) {
+			for (int y = 0; y < cell_num; y++) {
+				const uint32* row = &bits[(x * cell_num + y) * row_words];
+
+				for (int w = 0; w < row_words; w++) {
+					for (uint32 word = row[w]; word != 0; word &= word - 1) {
+						func(x, y, (w << 5) + (int)FMath::CountTrailingZeros(word));
+					}
+				}
+			}
+		}
+	}
+
+	int countSurfaceCells() const;
+
+	// drops the contents and keeps the storage for the next rebuild
+	void reset();
+
+	size_t getAllocatedSize() const { return bits.capacity() * sizeof(uint32); }
+	int32 getAllocationCount() const { return bits.capacity() > 0 ? 1 : 0; }
+};
+
+// cells per axis of a block on the finest level of the density pyramid, as a shift
+#define VOXEL_PYRAMID_SHIFT 3
+
+// blocks per page of the density pyramid, as a shift
+#define VOXEL_PYRAMID_PAGE_SHIFT 10
+#define VOXEL_PYRAMID_PAGE_SIZE (1 << VOXEL_PYRAMID_PAGE_SHIFT)
+
+//
+// Min/max pyramid over the raw densities of a volume. A block of level l covers
+// 1 << (VOXEL_PYRAMID_SHIFT + l) cells per axis and bounds every corner of those cells, so a block
+// whose range lies entirely on one side of the isolevel contains no crossing. Writes widen the
+// ranges they touch; a range a write has narrowed stays wide until its region is updated.
+// A uniform volume has no blocks and reads as its fill everywhere.
+//
+// The ranges are kept in pages that copies of a pyramid share until one of them writes to a page,
+// so a snapshot holds on only to the pages edited after it was taken.
+//
+class TVoxelDensityPyramid {
+
+private:
+	struct TPage {
+		unsigned char min_density[VOXEL_PYRAMID_PAGE_SIZE];
+		unsigned char max_density[VOXEL_PYRAMID_PAGE_SIZE];
+	};
+
+	int cell_num = 0;
+	unsigned char fill = 0;
+
+	// blocks per axis and first block of each level, finest first
+	std::vector<int> level_blocks;
+	std::vector<int> level_offset;
+
+	std::vector<std::shared_ptr<TPage>> pages;
+
+	friend class TVoxelData;
+
+	FORCEINLINE int blockIndex(int level, int bx, int by, int bz) const {
+		const int n = level_blocks[level];
+		return level_offset[level] + (bx * n + by) * n + bz;
+	}
+
+	FORCEINLINE const TPage& readPage(int index) const {
+		return *pages[index >> VOXEL_PYRAMID_PAGE_SHIFT];
+	}
+
+	// the page of block index, copied first while another pyramid shares it
+	TPage& writePage(int index);
+	void unsharePages(int first, int last);
+
+	void reset(int voxelNum, unsigned char fillDensity);
+	void allocate(int voxelNum, unsigned char fillDensity);
+
+	// recomputes every block holding a sample of the box, corners inclusive
+	void update(const unsigned char* density, int x0, int y0, int z0, int x1, int y1, int z1);
+
+	// sample (x, y, z) was set to density
+	void widen(int x, int y, int z, unsigned char density);
+
+public:
+	bool isEmpty() const { return pages.empty(); }
+	int levelNum() const { return (int)level_blocks.size(); }
+
+	// bounds of the samples in the box [x0, x1] x [y0, y1] x [z0, z1], clipped to the volume;
+	// looks at no more than 8 blocks, so wide boxes get the bounds of a coarser level
+	void getRange(int x0, int y0, int z0, int x1, int y1, int z1, unsigned char& outMin, unsigned char& outMax) const;
+
+	// log2 of the cells per axis of the widest block around cell (x, y, z) that is all air,
+	// -1 when not even the finest one is
+	int airBlockShift(int x, int y, int z) const;
+
+	// every page this pyramid reads, shared ones included
+	size_t getAllocatedSize() const { return pages.size() * sizeof(TPage); }
+	int32 getAllocationCount() const;
+
+	// the page table plus the pages not in counted yet, which are added to it
+	size_t getAllocatedSize(std::unordered_set<const void*>& counted) const;
+};
+
+//
+// Materials of a volume, kept per brick as a palette of the materials the brick holds and indices
+// into it packed 1, 2, 4 or 8 bits wide in TVoxelBrick layout. A brick of a single material stores
+// no indices at all. When a new material doesn't fit the palette the brick is repacked: entries no
+// sample uses any more are dropped and the indices widened as far as needed. A brick of more than
+// 256 materials keeps the raw 16 bit values instead. The padding of partial bricks on the far
+// faces holds the material the store was allocated with.
+//
+class TVoxelMaterialBricks {
+
+private:
+	struct TBrick {
+		// empty for raw bricks
+		std::vector<unsigned short> palette;
+
+		// VOXEL_BRICK_VOLUME indices of index_bits each, no index straddles two words
+		std::vector<uint32> indices;
+		int index_bits = 0;
+	};
+
+	int brick_num = 0;
+	std::vector<TBrick> bricks;
+
+	friend class TVoxelData;
+	friend class TVoxelSnapshot;
+
+	FORCEINLINE static int localIndex(int x, int y, int z) {
+		const int mask = VOXEL_BRICK_SIZE - 1;
+		return ((((x & mask) << VOXEL_BRICK_SHIFT) | (y & mask)) << VOXEL_BRICK_SHIFT) | (z & mask);
+	}
+
+	FORCEINLINE int brickIndex(int x, int y, int z) const {
+		return ((x >> VOXEL_BRICK_SHIFT) * brick_num + (y >> VOXEL_BRICK_SHIFT)) * brick_num + (z >> VOXEL_BRICK_SHIFT);
+	}
+
+	FORCEINLINE static uint32 readIndex(const TBrick& brick, int local) {
+		const int bit = local * brick.index_bits;
+		return (brick.indices[bit >> 5] >> (bit & 31)) & ((1u << brick.index_bits) - 1);
+	}
+
+	FORCEINLINE static void writeIndex(TBrick& brick, int local, uint32 value) {
+		const int bit = local * brick.index_bits;
+		const uint32 mask = ((1u << brick.index_bits) - 1) << (bit & 31);
+		uint32& word = brick.indices[bit >> 5];
+		word = (word & ~mask) | (value << (bit & 31));
+	}
+
+	// sample local of a brick and all of its samples, also for the copies snapshots keep
+	FORCEINLINE static unsigned short getSample(const TBrick& brick, int local) {
+		if (brick.index_bits == 0) {
+			return brick.palette[0];
+		}
+
+		const uint32 index = readIndex(brick, local);
+		return brick.palette.empty() ? (unsigned short)index : brick.palette[index];
+	}
+
+	static void decode(const TBrick& brick, unsigned short* out);
+
+	// true when every sample of a brick, padding included, holds the same material
+	static bool isUniform(const TBrick& brick, unsigned short& outMaterial);
+
+	static size_t getAllocatedSize(const TBrick& brick) {
+		return brick.palette.capacity() * sizeof(unsigned short) + brick.indices.capacity() * sizeof(uint32);
+	}
+
+	void allocate(int voxelNum, unsigned short fill);
+	void reset();
+
+public:
+	bool isEmpty() const { return bricks.empty(); }
+
+	FORCEINLINE unsigned short get(int x, int y, int z) const {
+		return getSample(bricks[brickIndex(x, y, z)], localIndex(x, y, z));
+	}
+
+	// bricks are independent, threads may set samples of different bricks at the same time
+	void set(int x, int y, int z, unsigned short material);
+
+	// all samples of brick (bx * n + by) * n + bz in TVoxelBrick layout, padding included
+	void decodeBrick(int index, unsigned short* out) const;
+
+	// replaces a brick with the given samples in the narrowest form that holds them
+	void encodeBrick(int index, const unsigned short* in);
+
+	// bits per sample of a brick, 0 for a single material and 16 for raw values
+	int getIndexBits(int index) const { return bricks[index].index_bits; }
+
+	size_t getAllocatedSize() const;
+	int32 getAllocationCount() const;
+};
+
+//
+// Bytes a volume holds per component, by capacity, and the heap blocks behind them.
+//
+struct TVoxelMemoryStats {
+	size_t density = 0;
+	size_t material = 0;
+	size_t pyramid = 0;
+	size_t substanceCache = 0;
+
+	// per-brick change stamps
+	size_t brickVersions = 0;
+
+	int32 allocations = 0;
+
+	size_t getTotal() const { return density + material + pyramid + substanceCache + brickVersions; }
+
+	TVoxelMemoryStats& operator+=(const TVoxelMemoryStats& other);
+};
+
+// Every TVoxelData in the process and the density arrays they hold, for finding leaks.
+struct TVoxelLiveMemory {
+	int64 volumes = 0;
+	int64 densityArrays = 0;
+	int64 densityBytes = 0;
+};
+
+class TVoxelData {
+
+private:
+	TVoxelDataFillState density_state;
+	unsigned short base_fill_mat = 0;
+
+	int voxel_num;
+	float volume_size;
+	unsigned char* density_data;
+
+	// empty while every sample has the base material
+	TVoxelMaterialBricks material_bricks;
+
+	// written by the owning thread, read from anywhere
+	std::atomic<double> last_change;
+	std::atomic<double> last_save;
+	std::atomic<double> last_mesh_generation;
+	std::atomic<double> last_cache_check;
+
+	// per-brick change stamps, snapshots copy only bricks whose stamp moved
+	int brick_num;
+	std::vector<uint64> brick_version;
+	uint64 data_version = 0;
+
+	TVoxelDensityPyramid density_pyramid;
+
+	FVector origin = FVector(0.0f, 0.0f, 0.0f);
+	FVector lower = FVector(0.0f, 0.0f, 0.0f);
+	FVector upper = FVector(0.0f, 0.0f, 0.0f);
+
+	void initializeDensity(bool bFill = true);
+	void initializeMaterial();
+
+	// the only places density_data is allocated and freed, they keep the live counters
+	void allocateDensityArray();
+	void freeDensityArray();
+
+	FORCEINLINE void touchBrick(int x, int y, int z) {
+		const int index = ((x >> VOXEL_BRICK_SHIFT) * brick_num + (y >> VOXEL_BRICK_SHIFT)) * brick_num + (z >> VOXEL_BRICK_SHIFT);
+		brick_version[index] = ++data_version;
+	}
+
+	void touchAllBricks();
+
+	friend class TVoxelSnapshot;
+
+public:
+	std::array<TSubstanceCache, LOD_ARRAY_SIZE> substanceCacheLOD;
+
+	TVoxelData(int, float);
+	~TVoxelData();
+
+	FORCEINLINE int clcLinearIndex(int x, int y, int z) const {
+		return x * voxel_num * voxel_num + y * voxel_num + z;
+	};
+
+	// negative coordinates wrap to huge unsigned values and fail the same compare
+	FORCEINLINE bool isInside(int x, int y, int z) const {
+		return (unsigned)x < (unsigned)voxel_num && (unsigned)y < (unsigned)voxel_num && (unsigned)z < (unsigned)voxel_num;
+	}
+
+	void forEach(std::function<void(int x, int y, int z)> func);
+
+	// forEach followed by rebuildSubstanceCache
+	void forEachWithCache(std::function<void(int x, int y, int z)> func, bool enableLOD);
+
+	void setDensity(int x, int y, int z, float density);
+	float getDensity(int x, int y, int z) const;
+	unsigned char getRawDensity(int x, int y, int z) const;
+
+	// raw x*n*n + y*n + z density array, NULL while the density is uniform
+	const unsigned char* getDensityData() const { return density_data; }
+
+	const TVoxelDensityPyramid& getDensityPyramid() const { return density_pyramid; }
+
+	// tightens the pyramid around the samples in the box after writes that may have narrowed it
+	void updateDensityPyramid(int x0, int y0, int z0, int x1, int y1, int z1);
+
+	void setMaterial(const int x, const int y, const int z, unsigned short material);
+	unsigned short getMaterial(int x, int y, int z) const;
+
+	const TVoxelMaterialBricks& getMaterialBricks() const { return material_bricks; }
+
+	// materials of brick (bx * n + by) * n + bz for bulk readers: true with material set when the
+	// whole brick holds one, otherwise decodeBrickMaterial writes all of them in TVoxelBrick layout
+	bool isBrickMaterialUniform(int index, unsigned short& material) const;
+	void decodeBrickMaterial(int index, unsigned short* out) const;
+
+	float size() const;
+	int num() const;
+
+	int brickNum() const { return brick_num; }
+	uint64 getBrickVersion(int index) const { return brick_version[index]; }
+	uint64 getDataVersion() const { return data_version; }
+
+	FVector voxelIndexToVector(int x, int y, int z) const;
+	void vectorToVoxelIndex(const FVector& v, int& x, int& y, int& z) const;
+
+	void setOrigin(FVector o);
+	FVector getOrigin() const;
+
+	FVector getLower() const { return lower; };
+	FVector getUpper() const { return upper; };
+
+	TVoxelPoint getVoxelPoint(int x, int y, int z) const;
+	void setVoxelPoint(int x, int y, int z, unsigned char density, unsigned short material);
+	void setVoxelPointDensity(int x, int y, int z, unsigned char density);
+	void setVoxelPointMaterial(int x, int y, int z, unsigned short material);
+
+	// fills the substance cache of lod 0, or of every lod that still has a cell, on the task pool;
+	// uniform volumes have no surface cells and leave it empty
+	void rebuildSubstanceCache(bool enableLOD);
+
+	TVoxelDataFillState getDensityFillState() const;
+	//VoxelDataFillState getMaterialFillState() const; 
+
+	void deinitializeDensity(TVoxelDataFillState density_state);
+	void deinitializeMaterial(unsigned short base_mat);
+
+	// direct access to the raw density array for generators, any thread may write disjoint
+	// parts of it until endBulkDensityWrite() stamps every brick as changed; a writer that
+	// overwrites every sample can skip the fill of a newly allocated array
+	unsigned char* beginBulkDensityWrite(bool bFill = true);
+	void endBulkDensityWrite();
+
+	// ends a write that changed only samples of the box, stamping just the bricks holding them
+	void endBulkDensityWrite(int x0, int y0, int z0, int x1, int y1, int z1);
+
+	// XORs a replicated delta into brick (bx, by, bz), both arrays in TVoxelBrick layout;
+	// samples beyond the far faces of the volume are ignored
+	void applyBrickDelta(int bx, int by, int bz, const unsigned char* densityDelta, const unsigned short* materialDelta);
+
+	// overwrites brick (bx, by, bz) with the given samples in TVoxelBrick layout, ignoring those
+	// beyond the far faces; a brick that matches the uniform fill allocates nothing
+	void writeBrick(int bx, int by, int bz, const unsigned char* density, const unsigned short* material);
+
+	// bytes held by the density array, the material bricks, the pyramid, the substance cache and
+	// the brick stamps; the total of getMemoryStats()
+	size_t getAllocatedSize() const;
+
+	// the same per component, plus the brick stamps and the number of heap blocks
+	TVoxelMemoryStats getMemoryStats() const;
+
+	// counters over all volumes, safe to read from any thread
+	static TVoxelLiveMemory getLiveMemory();
+
+	// compact binary form for paging volumes to disk, load fails on a size mismatch or damaged data
+	void save(TArray<uint8>& out) const;
+	bool load(const TArray<uint8>& in);
+
+	void setChanged() { last_change = FPlatformTime::Seconds(); }
+	bool isChanged() { return last_change > last_save; }
+	void resetLastSave() { last_save = FPlatformTime::Seconds(); }
+	bool needToRegenerateMesh() { return last_change > last_mesh_generation; }
+	void resetLastMeshRegenerationTime() { last_mesh_generation = FPlatformTime::Seconds(); }
+
+	bool isSubstanceCacheValid() const { return last_change <= last_cache_check; }
+	void setCacheToValid() { last_cache_check = FPlatformTime::Seconds(); }
+
+	void clearSubstanceCache() {
+		for (TSubstanceCache& lodCache : substanceCacheLOD) {
+			lodCache.reset();
+		}
+
+		last_cache_check = -1;
+	};
+
+};
+
+
+FORCEINLINE float TVoxelData::getDensity(int x, int y, int z) const {
+	// outside reads as empty whatever the fill state, like in the mesher
+	if (!isInside(x, y, z)) {
+		return 0;
+	}
+
+	if (density_data == NULL) {
+		if (density_state == TVoxelDataFillState::ALL) {
+			return 1;
+		}
+
+		return 0;
+	}
+
+	int index = x * voxel_num * voxel_num + y * voxel_num + z;
+
+	float d = (float)density_data[index] / 255.0f;
+	return d;
+}
+
+FORCEINLINE unsigned char TVoxelData::getRawDensity(int x, int y, int z) const {
+	auto index = x * voxel_num * voxel_num + y * voxel_num + z;
+	return density_data[index];
+}
+
+FORCEINLINE float TVoxelData::size() const {
+	return volume_size;
+}
+
+FORCEINLINE int TVoxelData::num() const {
+	return voxel_num;
+}
@@ -0,0 +1,149 @@
+#include "VoxelEditQueue.h"
+
+TVoxelEdit TVoxelEdit::setDensity(int x, int y, int z, float density) {
+	TVoxelEdit edit;
+	edit.type = TVoxelEditType::Density;
+	edit.x = x;
+	edit.y = y;
+	edit.z = z;
+	edit.density = density;
+	return edit;
+}
+
+TVoxelEdit TVoxelEdit::setMaterial(int x, int y, int z, unsigned short material) {
+	TVoxelEdit edit;
+	edit.type = TVoxelEditType::Material;
+	edit.x = x;
+	edit.y = y;
+	edit.z = z;
+	edit.material = material;
+	return edit;
+}
+
+TVoxelEdit TVoxelEdit::digSphere(const FVector& center, float radius) {
+	TVoxelEdit edit;
+	edit.type = TVoxelEditType::DigSphere;
+	edit.center = center;
+	edit.radius = radius;
+	return edit;
+}
+
+TVoxelEdit TVoxelEdit::fillSphere(const FVector& center, float radius, unsigned short material) {
+	TVoxelEdit edit;
+	edit.type = TVoxelEditType::FillSphere;
+	edit.center = center;
+	edit.radius = radius;
+	edit.material = material;
+	return edit;
+}
+
+TVoxelEdit TVoxelEdit::filterSphere(const FVector& center, float radius, const TVoxelFilterSettings& filter) {
+	TVoxelEdit edit;
+	edit.type = TVoxelEditType::FilterSphere;
+	edit.center = center;
+	edit.radius = radius;
+	edit.filter = filter;
+	return edit;
+}
+
+static void applySphere(TVoxelData& data, const TVoxelEdit& edit) {
+	const float step = data.size() / (data.num() - 1);
+	const float s = data.size() / 2;
+
+	const FVector c = (edit.center + FVector(s, s, s)) / step;
+	const float r = edit.radius / step;
+	const bool bDig = edit.type == TVoxelEditType::DigSphere;
+
+	// one voxel of falloff outside the radius keeps the surface smooth
+	const int x0 = FMath::Max(0, FMath::FloorToInt(c.X - r - 1));
+	const int x1 = FMath::Min(data.num() - 1, FMath::CeilToInt(c.X + r + 1));
+	const int y0 = FMath::Max(0, FMath::FloorToInt(c.Y - r - 1));
+	const int y1 = FMath::Min(data.num() - 1, FMath::CeilToInt(c.Y + r + 1));
+	const int z0 = FMath::Max(0, FMath::FloorToInt(c.Z - r - 1));
+	const int z1 = FMath::Min(data.num() - 1, FMath::CeilToInt(c.Z + r + 1));
+
+	for (int x = x0; x <= x1; x++) {
+		for (int y = y0; y <= y1; y++) {
+			for (int z = z0; z <= z1; z++) {
+				const float d = (FVector(x, y, z) - c).Size();
+				const float brush = FMath::Clamp(0.5f + (r - d) * 0.5f, 0.f, 1.f);
+				if (brush <= 0.f) {
+					continue;
+				}
+
+				const float old = data.getDensity(x, y, z);
+				const float density = bDig ? FMath::Min(old, 1.f - brush) : FMath::Max(old, brush);
+
+				if (density != old) {
+					data.setDensity(x, y, z, density);
+				}
+
+				if (!bDig && brush >= 0.5f && data.getMaterial(x, y, z) != edit.material) {
+					data.setMaterial(x, y, z, edit.material);
+				}
+			}
+		}
+	}
+
+	// the writes above only widened the pyramid, a brush can leave whole blocks uniform again
+	data.updateDensityPyramid(x0, y0, z0, x1, y1, z1);
+}
+
+static bool isInside(const TVoxelData& data, const TVoxelEdit& edit) {
+	return edit.x >= 0 && edit.y >= 0 && edit.z >= 0 && edit.x < data.num() && edit.y < data.num() && edit.z < data.num();
+}
+
+void applyVoxelEdit(TVoxelData& data, const TVoxelEdit& edit) {
+	switch (edit.type) {
+	case TVoxelEditType::Density:
+		if (!isInside(data, edit)) break;
+		data.setDensity(edit.x, edit.y, edit.z, edit.density);
+		break;
+	case TVoxelEditType::Material:
+		if (!isInside(data, edit)) break;
+		data.setMaterial(edit.x, edit.y, edit.z, edit.material);
+		break;
+	case TVoxelEditType::DigSphere:
+	case TVoxelEditType::FillSphere:
+		applySphere(data, edit);
+		break;
+	case TVoxelEditType::FilterSphere:
+		VoxelFilterDensitySphere(data, edit.center, edit.radius, edit.filter);
+		break;
+	}
+}
+
+void TVoxelEditQueue::submit(const TVoxelEdit& edit) {
+	queue.Enqueue(edit);
+	pending.Increment();
+}
+
+int TVoxelEditQueue::applyPending(TVoxelData& data) {
+	int applied = 0;
+
+	TVoxelEdit edit;
+	while (queue.Dequeue(edit)) {
+		pending.Decrement();
+		applyVoxelEdit(data, edit);
+		applied++;
+	}
+
+	if (applied > 0) {
+		data.setChanged();
+	}
+
+	return applied;
+}
+
+int TVoxelEditQueue::applyPending(const std::function<void(const TVoxelEdit&)>& apply) {
+	int applied = 0;
+
+	TVoxelEdit edit;
+	while (queue.Dequeue(edit)) {
+		pending.Decrement();
+		apply(edit);
+		applied++;
+	}
+
+	return applied;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "VoxelData.h"
+#include "VoxelFilter.h"
+
+enum class TVoxelEditType : uint8 {
+	Density,
+	Material,
+	DigSphere,
+	FillSphere,
+	FilterSphere
+};
+
+//
+// A single queued modification of a volume.
+// Voxel edits address x, y, z; sphere brushes use center and radius in volume local space.
+//
+struct TVoxelEdit {
+	TVoxelEditType type = TVoxelEditType::Density;
+
+	int x = 0;
+	int y = 0;
+	int z = 0;
+
+	FVector center = FVector(0.0f, 0.0f, 0.0f);
+	float radius = 0;
+
+	float density = 0;
+	unsigned short material = 0;
+
+	TVoxelFilterSettings filter;
+
+	static TVoxelEdit setDensity(int x, int y, int z, float density);
+	static TVoxelEdit setMaterial(int x, int y, int z, unsigned short material);
+	static TVoxelEdit digSphere(const FVector& center, float radius);
+	static TVoxelEdit fillSphere(const FVector& center, float radius, unsigned short material);
+	static TVoxelEdit filterSphere(const FVector& center, float radius, const TVoxelFilterSettings& filter);
+};
+
+//
+// Lock-free multi-producer edit queue.
+//
+// Any thread may submit edits. They reach the volume only inside applyPending, which the owner
+// calls from a single thread at a fixed point of the frame. Readers on other threads never touch
+// the live volume, they read TVoxelSnapshot captured right after applyPending.
+//
+class TVoxelEditQueue {
+
+private:
+	TQueue<TVoxelEdit, EQueueMode::Mpsc> queue;
+	FThreadSafeCounter pending;
+
+public:
+	void submit(const TVoxelEdit& edit);
+
+	// applies everything queued so far, returns the number of applied edits
+	int applyPending(TVoxelData& data);
+
+	// hands everything queued so far to apply, for owners that route edits to several volumes
+	int applyPending(const std::function<void(const TVoxelEdit&)>& apply);
+
+	int num() const { return pending.GetValue(); }
+};
+
+// applies one edit directly, for the owning thread only
+void applyVoxelEdit(TVoxelData& data, const TVoxelEdit& edit);
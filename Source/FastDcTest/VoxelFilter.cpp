@@ -0,0 +1,395 @@
+#include "VoxelFilter.h"
+#include "Async/ParallelFor.h"
+#include <emmintrin.h>
+#include <vector>
+
+// a tile is one brick, its rows along z fill one SSE register
+static_assert(VOXEL_BRICK_SIZE == 16, "filter rows assume sixteen samples per brick row");
+
+#define TILE VOXEL_BRICK_SIZE
+#define MAX_SPAN (TILE + 2 * VOXEL_FILTER_MAX_RADIUS)
+
+// share of the excess over talus that moves to each of the five lower neighbours per step, out
+// of 256; five outflows and five inflows stay below half of any difference, so no pair overshoots
+#define ERODE_RATE 21
+
+struct TFilterKernel {
+	int taps = 0;
+
+	// 8 bit fixed point, summing to 256
+	uint16 weights[2 * VOXEL_FILTER_MAX_RADIUS + 1];
+};
+
+// sphere the filter fades out around, in samples; no sphere applies strength everywhere
+struct TFilterMask {
+	bool bSphere = false;
+	FVector center = FVector(0.0f, 0.0f, 0.0f);
+	float radius = 0;
+};
+
+// copy of the samples of an iteration, the region plus its halo with the volume border repeated
+struct TFilterSource {
+	std::vector<unsigned char> samples;
+	int x0 = 0;
+	int y0 = 0;
+	int z0 = 0;
+	int sx = 0;
+	int sy = 0;
+	int sz = 0;
+
+	FORCEINLINE const unsigned char* row(int x, int y, int z) const {
+		return samples.data() + ((size_t)(x - x0) * sy + (y - y0)) * sz + (z - z0);
+	}
+};
+
+static void BuildKernel(TVoxelFilterType type, int radius, TFilterKernel& kernel) {
+	kernel.taps = 2 * radius + 1;
+
+	float shape[2 * VOXEL_FILTER_MAX_RADIUS + 1];
+	float sum = 0;
+
+	const float sigma = radius * 0.5f + 0.5f;
+	for (int i = 0; i < kernel.taps; i++) {
+		const float d = (float)(i - radius);
+		shape[i] = type == TVoxelFilterType::Box ? 1.f : FMath::Exp(-d * d / (2 * sigma * sigma));
+		sum += shape[i];
+	}
+
+	// rounding goes to the center tap so that flat regions come out unchanged
+	int total = 0;
+	for (int i = 0; i < kernel.taps; i++) {
+		kernel.weights[i] = (uint16)FMath::RoundToInt(shape[i] / sum * 256.f);
+		total += kernel.weights[i];
+	}
+
+	kernel.weights[radius] = (uint16)(kernel.weights[radius] + 256 - total);
+}
+
+// weighted sum of the rows at p + i * stride; 255 * 256 plus rounding still fits 16 bits
+static FORCEINLINE __m128i ConvolveRow(const unsigned char* p, size_t stride, const TFilterKernel& kernel) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_set1_epi16(128);
+	__m128i hi = lo;
+
+	for (int i = 0; i < kernel.taps; i++) {
+		const __m128i row = _mm_loadu_si128((const __m128i*)(p + i * stride));
+		const __m128i weight = _mm_set1_epi16(kernel.weights[i]);
+		lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(row, zero), weight));
+		hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(row, zero), weight));
+	}
+
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+template <bool bMax>
+static FORCEINLINE __m128i MorphologyRow(const unsigned char* p, size_t stride, const TFilterKernel& kernel) {
+	__m128i result = _mm_loadu_si128((const __m128i*)p);
+
+	for (int i = 1; i < kernel.taps; i++) {
+		const __m128i row = _mm_loadu_si128((const __m128i*)(p + i * stride));
+		result = bMax ? _mm_max_epu8(result, row) : _mm_min_epu8(result, row);
+	}
+
+	return result;
+}
+
+// runs rowFilter along z, y and x over tile (tx, ty, tz) and its halo, out holds a row per (x, y)
+template <typename TRowFilter>
+static void FilterTileSeparable(const TFilterSource& source, int tx, int ty, int tz, int radius, const TRowFilter& rowFilter, __m128i* out) {
+	const int span = TILE + 2 * radius;
+
+	alignas(16) unsigned char alongZ[MAX_SPAN * MAX_SPAN * TILE];
+	alignas(16) unsigned char alongY[MAX_SPAN * TILE * TILE];
+
+	for (int i = 0; i < span; i++) {
+		for (int j = 0; j < span; j++) {
+			const __m128i row = rowFilter(source.row(tx - radius + i, ty - radius + j, tz - radius), 1);
+			_mm_store_si128((__m128i*)(alongZ + (i * span + j) * TILE), row);
+		}
+	}
+
+	for (int i = 0; i < span; i++) {
+		for (int j = 0; j < TILE; j++) {
+			const __m128i row = rowFilter(alongZ + (i * span + j) * TILE, TILE);
+			_mm_store_si128((__m128i*)(alongY + (i * TILE + j) * TILE), row);
+		}
+	}
+
+	for (int i = 0; i < TILE; i++) {
+		for (int j = 0; j < TILE; j++) {
+			out[i * TILE + j] = rowFilter(alongY + (i * TILE + j) * TILE, TILE * TILE);
+		}
+	}
+}
+
+// (excess of a over b beyond talus) * ERODE_RATE / 256, as two halves of 16 bit lanes
+static FORCEINLINE void ErodeTransfer(__m128i a, __m128i b, __m128i talus, __m128i& lo, __m128i& hi) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rate = _mm_set1_epi16(ERODE_RATE);
+	const __m128i round = _mm_set1_epi16(128);
+
+	const __m128i excess = _mm_subs_epu8(_mm_subs_epu8(a, b), talus);
+	lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(excess, zero), rate), round), 8);
+	hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(excess, zero), rate), round), 8);
+}
+
+// one erosion step over tile (tx, ty, tz): every sample gives to the five samples below it and
+// receives from the five above, each transfer computed alike from both of its ends
+static void ErodeTile(const TFilterSource& source, int tx, int ty, int tz, unsigned char talusDensity, __m128i* out) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i talus = _mm_set1_epi8((char)talusDensity);
+
+	static const int offsets[5][2] = { { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+	for (int i = 0; i < TILE; i++) {
+		for (int j = 0; j < TILE; j++) {
+			const int x = tx + i;
+			const int y = ty + j;
+			const __m128i center = _mm_loadu_si128((const __m128i*)source.row(x, y, tz));
+
+			__m128i lo = _mm_unpacklo_epi8(center, zero);
+			__m128i hi = _mm_unpackhi_epi8(center, zero);
+
+			for (int k = 0; k < 5; k++) {
+				const __m128i below = _mm_loadu_si128((const __m128i*)source.row(x + offsets[k][0], y + offsets[k][1], tz - 1));
+				const __m128i above = _mm_loadu_si128((const __m128i*)source.row(x + offsets[k][0], y + offsets[k][1], tz + 1));
+
+				__m128i outLo, outHi, inLo, inHi;
+				ErodeTransfer(center, below, talus, outLo, outHi);
+				ErodeTransfer(above, center, talus, inLo, inHi);
+
+				lo = _mm_subs_epu16(_mm_add_epi16(lo, inLo), outLo);
+				hi = _mm_subs_epu16(_mm_add_epi16(hi, inHi), outHi);
+			}
+
+			out[i * TILE + j] = _mm_packus_epi16(lo, hi);
+		}
+	}
+}
+
+// old * (256 - w) + target * w per lane, rounded
+static FORCEINLINE __m128i BlendRow(__m128i old, __m128i target, __m128i weightLo, __m128i weightHi) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(256);
+	const __m128i round = _mm_set1_epi16(128);
+
+	const __m128i lo = _mm_add_epi16(_mm_add_epi16(
+		_mm_mullo_epi16(_mm_unpacklo_epi8(old, zero), _mm_sub_epi16(one, weightLo)),
+		_mm_mullo_epi16(_mm_unpacklo_epi8(target, zero), weightLo)), round);
+	const __m128i hi = _mm_add_epi16(_mm_add_epi16(
+		_mm_mullo_epi16(_mm_unpackhi_epi8(old, zero), _mm_sub_epi16(one, weightHi)),
+		_mm_mullo_epi16(_mm_unpackhi_epi8(target, zero), weightHi)), round);
+
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+static void GatherSource(const TVoxelData& data, int x0, int y0, int z0, int x1, int y1, int z1, bool bParallel, TFilterSource& source) {
+	const int n = data.num();
+	const unsigned char* density = data.getDensityData();
+
+	source.x0 = x0;
+	source.y0 = y0;
+	source.z0 = z0;
+	source.sx = x1 - x0 + 1;
+	source.sy = y1 - y0 + 1;
+	source.sz = z1 - z0 + 1;
+	source.samples.resize((size_t)source.sx * source.sy * source.sz);
+
+	// z beyond the volume repeats the first and last sample of the row
+	const int zBegin = FMath::Max(z0, 0);
+	const int zEnd = FMath::Min(z1, n - 1);
+
+	ParallelFor(source.sx, [&](int32 i) {
+		const int x = FMath::Clamp(x0 + i, 0, n - 1);
+
+		for (int j = 0; j < source.sy; j++) {
+			const int y = FMath::Clamp(y0 + j, 0, n - 1);
+			const unsigned char* in = density + data.clcLinearIndex(x, y, 0);
+			unsigned char* out = source.samples.data() + ((size_t)i * source.sy + j) * source.sz;
+
+			FMemory::Memset(out, in[0], zBegin - z0);
+			FMemory::Memcpy(out + zBegin - z0, in + zBegin, zEnd - zBegin + 1);
+			FMemory::Memset(out + zEnd + 1 - z0, in[n - 1], z1 - zEnd);
+		}
+	}, !bParallel);
+}
+
+static void GrowRegion(TVoxelFilterRegion& region, int x, int y, int z0, int z1) {
+	if (region.isEmpty()) {
+		region.x0 = region.x1 = x;
+		region.y0 = region.y1 = y;
+		region.z0 = z0;
+		region.z1 = z1;
+		return;
+	}
+
+	region.x0 = FMath::Min(region.x0, x);
+	region.x1 = FMath::Max(region.x1, x);
+	region.y0 = FMath::Min(region.y0, y);
+	region.y1 = FMath::Max(region.y1, y);
+	region.z0 = FMath::Min(region.z0, z0);
+	region.z1 = FMath::Max(region.z1, z1);
+}
+
+static void GrowRegion(TVoxelFilterRegion& region, const TVoxelFilterRegion& other) {
+	if (!other.isEmpty()) {
+		GrowRegion(region, other.x0, other.y0, other.z0, other.z1);
+		GrowRegion(region, other.x1, other.y1, other.z0, other.z1);
+	}
+}
+
+static TVoxelFilterRegion FilterRegion(TVoxelData& data, const TVoxelFilterRegion& region, const TVoxelFilterSettings& settings, const TFilterMask& mask) {
+	TVoxelFilterRegion dirty;
+
+	const int n = data.num();
+	const int border = settings.bKeepBorder ? 1 : 0;
+
+	TVoxelFilterRegion clip;
+	clip.x0 = FMath::Max(region.x0, border);
+	clip.y0 = FMath::Max(region.y0, border);
+	clip.z0 = FMath::Max(region.z0, border);
+	clip.x1 = FMath::Min(region.x1, n - 1 - border);
+	clip.y1 = FMath::Min(region.y1, n - 1 - border);
+	clip.z1 = FMath::Min(region.z1, n - 1 - border);
+
+	const int strength = FMath::RoundToInt(FMath::Clamp(settings.strength, 0.f, 1.f) * 256.f);
+
+	// a uniform volume is a fixed point of every filter
+	if (clip.isEmpty() || data.getDensityData() == NULL || strength == 0 || settings.iterations <= 0) {
+		return dirty;
+	}
+
+	const TVoxelFilterType type = settings.type;
+	const bool bErode = type == TVoxelFilterType::Erode;
+	const int radius = bErode ? 1 : FMath::Clamp(settings.radius, 1, VOXEL_FILTER_MAX_RADIUS);
+
+	TFilterKernel kernel;
+	BuildKernel(type, radius, kernel);
+
+	const int bx0 = clip.x0 >> VOXEL_BRICK_SHIFT;
+	const int by0 = clip.y0 >> VOXEL_BRICK_SHIFT;
+	const int bz0 = clip.z0 >> VOXEL_BRICK_SHIFT;
+	const int bxNum = (clip.x1 >> VOXEL_BRICK_SHIFT) - bx0 + 1;
+	const int byNum = (clip.y1 >> VOXEL_BRICK_SHIFT) - by0 + 1;
+	const int bzNum = (clip.z1 >> VOXEL_BRICK_SHIFT) - bz0 + 1;
+	const int tileNum = bxNum * byNum * bzNum;
+
+	unsigned char* density = data.beginBulkDensityWrite();
+	std::vector<TVoxelFilterRegion> tileDirty(tileNum);
+	TFilterSource source;
+
+	for (int iteration = 0; iteration < settings.iterations; iteration++) {
+		GatherSource(data, (bx0 << VOXEL_BRICK_SHIFT) - radius, (by0 << VOXEL_BRICK_SHIFT) - radius, (bz0 << VOXEL_BRICK_SHIFT) - radius,
+			((bx0 + bxNum) << VOXEL_BRICK_SHIFT) - 1 + radius, ((by0 + byNum) << VOXEL_BRICK_SHIFT) - 1 + radius, ((bz0 + bzNum) << VOXEL_BRICK_SHIFT) - 1 + radius,
+			settings.bParallel, source);
+
+		ParallelFor(tileNum, [&](int32 t) {
+			const int tx = (bx0 + t / (byNum * bzNum)) << VOXEL_BRICK_SHIFT;
+			const int ty = (by0 + (t / bzNum) % byNum) << VOXEL_BRICK_SHIFT;
+			const int tz = (bz0 + t % bzNum) << VOXEL_BRICK_SHIFT;
+
+			__m128i filtered[TILE * TILE];
+
+			switch (type) {
+			case TVoxelFilterType::Box:
+			case TVoxelFilterType::Gaussian:
+			case TVoxelFilterType::Sharpen:
+				FilterTileSeparable(source, tx, ty, tz, radius, [&kernel](const unsigned char* p, size_t stride) { return ConvolveRow(p, stride, kernel); }, filtered);
+				break;
+			case TVoxelFilterType::Min:
+				FilterTileSeparable(source, tx, ty, tz, radius, [&kernel](const unsigned char* p, size_t stride) { return MorphologyRow<false>(p, stride, kernel); }, filtered);
+				break;
+			case TVoxelFilterType::Max:
+				FilterTileSeparable(source, tx, ty, tz, radius, [&kernel](const unsigned char* p, size_t stride) { return MorphologyRow<true>(p, stride, kernel); }, filtered);
+				break;
+			case TVoxelFilterType::Erode:
+				ErodeTile(source, tx, ty, tz, settings.talus, filtered);
+				break;
+			}
+
+			// lanes outside the region keep a weight of 0 and come out unchanged
+			const int zBegin = FMath::Max(tz, clip.z0);
+			const int zEnd = FMath::Min(tz + TILE - 1, clip.z1);
+			const float falloff = mask.radius + 1.f;
+
+			alignas(16) uint16 weights[TILE];
+
+			for (int x = FMath::Max(tx, clip.x0); x <= FMath::Min(tx + TILE - 1, clip.x1); x++) {
+				for (int y = FMath::Max(ty, clip.y0); y <= FMath::Min(ty + TILE - 1, clip.y1); y++) {
+					const float dxy = FMath::Square(x - mask.center.X) + FMath::Square(y - mask.center.Y);
+					if (mask.bSphere && dxy >= falloff * falloff) {
+						continue;
+					}
+
+					for (int lane = 0; lane < TILE; lane++) {
+						const int z = tz + lane;
+						int weight = z >= zBegin && z <= zEnd ? strength : 0;
+
+						if (mask.bSphere && weight > 0) {
+							const float d = FMath::Sqrt(dxy + FMath::Square(z - mask.center.Z));
+							weight = FMath::RoundToInt(weight * FMath::Clamp(0.5f + (mask.radius - d) * 0.5f, 0.f, 1.f));
+						}
+
+						weights[lane] = (uint16)weight;
+					}
+
+					const __m128i old = _mm_loadu_si128((const __m128i*)source.row(x, y, tz));
+					__m128i target = filtered[(x - tx) * TILE + (y - ty)];
+
+					if (type == TVoxelFilterType::Sharpen) {
+						// 2 * old - blur clamped to the byte range, only one of the differences is non zero
+						target = _mm_subs_epu8(_mm_adds_epu8(old, _mm_subs_epu8(old, target)), _mm_subs_epu8(target, old));
+					}
+
+					const __m128i result = BlendRow(old, target,
+						_mm_load_si128((const __m128i*)weights), _mm_load_si128((const __m128i*)(weights + 8)));
+
+					const uint32 changed = ~(uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(result, old)) & 0xffff;
+					if (changed == 0) {
+						continue;
+					}
+
+					alignas(16) unsigned char lanes[TILE];
+					_mm_store_si128((__m128i*)lanes, result);
+					FMemory::Memcpy(density + data.clcLinearIndex(x, y, zBegin), lanes + zBegin - tz, zEnd - zBegin + 1);
+
+					GrowRegion(tileDirty[t], x, y, tz + FMath::CountTrailingZeros(changed), tz + FMath::FloorLog2(changed));
+				}
+			}
+		}, !settings.bParallel);
+	}
+
+	for (const TVoxelFilterRegion& tile : tileDirty) {
+		if (!tile.isEmpty()) {
+			data.endBulkDensityWrite(tile.x0, tile.y0, tile.z0, tile.x1, tile.y1, tile.z1);
+			GrowRegion(dirty, tile);
+		}
+	}
+
+	return dirty;
+}
+
+TVoxelFilterRegion VoxelFilterDensity(TVoxelData& data, const TVoxelFilterRegion& region, const TVoxelFilterSettings& settings) {
+	return FilterRegion(data, region, settings, TFilterMask());
+}
+
+TVoxelFilterRegion VoxelFilterDensitySphere(TVoxelData& data, const FVector& center, float radius, const TVoxelFilterSettings& settings) {
+	const float step = data.size() / (data.num() - 1);
+	const float s = data.size() / 2;
+
+	TFilterMask mask;
+	mask.bSphere = true;
+	mask.center = (center + FVector(s, s, s)) / step;
+	mask.radius = radius / step;
+
+	// the same box as the sphere brushes, one sample of falloff outside the radius
+	TVoxelFilterRegion region;
+	region.x0 = FMath::FloorToInt(mask.center.X - mask.radius - 1);
+	region.x1 = FMath::CeilToInt(mask.center.X + mask.radius + 1);
+	region.y0 = FMath::FloorToInt(mask.center.Y - mask.radius - 1);
+	region.y1 = FMath::CeilToInt(mask.center.Y + mask.radius + 1);
+	region.z0 = FMath::FloorToInt(mask.center.Z - mask.radius - 1);
+	region.z1 = FMath::CeilToInt(mask.center.Z + mask.radius + 1);
+
+	return FilterRegion(data, region, settings, mask);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelData.h"
+
+// widest kernel a filter accepts, in samples either side of the center
+#define VOXEL_FILTER_MAX_RADIUS 8
+
+enum class TVoxelFilterType : uint8 {
+	// mean of the cube around a sample
+	Box,
+
+	// normal distribution with a sigma of half the radius plus half a sample
+	Gaussian,
+
+	// unsharp mask, the sample pushed away from its Gaussian blur
+	Sharpen,
+
+	// morphology over the cube: Min shrinks solid matter, Max grows it
+	Min,
+	Max,
+
+	// thermal erosion step, matter above a sample that is emptier by more than talus slides down
+	// into it straight below or diagonally; matter is kept, only moved
+	Erode
+};
+
+struct TVoxelFilterSettings {
+	TVoxelFilterType type = TVoxelFilterType::Gaussian;
+
+	// kernel reach in samples, up to VOXEL_FILTER_MAX_RADIUS; erosion always looks one sample away
+	int radius = 1;
+
+	// blend of the filtered samples over the old ones, 0..1
+	float strength = 1.f;
+
+	// raw density difference erosion leaves standing
+	unsigned char talus = 16;
+
+	// times the whole filter is run, each reading the result of the previous one
+	int iterations = 1;
+
+	// leaves the outer faces of the volume as they are, for chunks that share them with neighbours
+	bool bKeepBorder = false;
+
+	bool bParallel = true;
+};
+
+// box of samples, bounds inclusive like TVoxelData::updateDensityPyramid
+struct TVoxelFilterRegion {
+	int x0 = 0;
+	int y0 = 0;
+	int z0 = 0;
+	int x1 = -1;
+	int y1 = -1;
+	int z1 = -1;
+
+	bool isEmpty() const { return x1 < x0 || y1 < y0 || z1 < z0; }
+};
+
+//
+// Filters the raw densities of region in place, weighted by strength; samples outside the region
+// are read but never written. Returns the box of samples that actually changed, empty when none
+// did, so that only the bricks inside it need a remesh.
+//
+// The region is cut into tiles along the bricks of the volume that run in parallel on the task
+// pool. Every iteration first copies the region plus a halo of the kernel radius, with the border
+// samples of the volume repeated beyond it, then each tile reads its halo from that copy and
+// writes its own samples back, so no tile sees another one's output. The separable kernels run
+// as three passes over rows of sixteen samples along z, one SSE register each; box and Gaussian
+// weights are 8 bit fixed point. Uniform volumes stay uniform under every filter and are left
+// alone.
+//
+TVoxelFilterRegion VoxelFilterDensity(TVoxelData& data, const TVoxelFilterRegion& region, const TVoxelFilterSettings& settings);
+
+// the same within a sphere in volume local space, fading out over a sample at its rim like the
+// sphere brushes
+TVoxelFilterRegion VoxelFilterDensitySphere(TVoxelData& data, const FVector& center, float radius, const TVoxelFilterSettings& settings);
@@ -0,0 +1,393 @@
+#include "VoxelGenerator.h"
+#include "Async/ParallelFor.h"
+#include <vector>
+
+// composites evaluate their children in batches of this size on the stack
+#define VOXEL_SDF_BATCH 64
+
+
+void TVoxelSdf::bounds(const FBox& box, float& outMin, float& outMax) const {
+	const FVector center = box.GetCenter();
+	const float radius = box.GetExtent().Size();
+
+	float d;
+	evaluate(&center.X, &center.Y, &center.Z, 1, &d);
+
+	outMin = d - radius;
+	outMax = d + radius;
+}
+
+//====================================================================================
+// Primitives
+//====================================================================================
+
+class TVoxelSdfSphere : public TVoxelSdf {
+
+private:
+	FVector center;
+	float radius;
+
+public:
+	TVoxelSdfSphere(const FVector& center, float radius) : center(center), radius(radius) { }
+
+	void evaluate(const float* x, const float* y, const float* z, int count, float* out) const override {
+		for (int i = 0; i < count; i++) {
+			const float dx = x[i] - center.X;
+			const float dy = y[i] - center.Y;
+			const float dz = z[i] - center.Z;
+			out[i] = FMath::Sqrt(dx * dx + dy * dy + dz * dz) - radius;
+		}
+	}
+
+	void bounds(const FBox& box, float& outMin, float& outMax) const override {
+		// nearest point of the box and its farthest corner
+		outMin = FMath::Sqrt(box.ComputeSquaredDistanceToPoint(center)) - radius;
+
+		const FVector far(
+			FMath::Max(FMath::Abs(box.Min.X - center.X), FMath::Abs(box.Max.X - center.X)),
+			FMath::Max(FMath::Abs(box.Min.Y - center.Y), FMath::Abs(box.Max.Y - center.Y)),
+			FMath::Max(FMath::Abs(box.Min.Z - center.Z), FMath::Abs(box.Max.Z - center.Z)));
+		outMax = far.Size() - radius;
+	}
+};
+
+class TVoxelSdfBox : public TVoxelSdf {
+
+private:
+	FVector center;
+	FVector extent;
+
+public:
+	TVoxelSdfBox(const FVector& center, const FVector& extent) : center(center), extent(extent) { }
+
+	void evaluate(const float* x, const float* y, const float* z, int count, float* out) const override {
+		for (int i = 0; i < count; i++) {
+			const float qx = FMath::Abs(x[i] - center.X) - extent.X;
+			const float qy = FMath::Abs(y[i] - center.Y) - extent.Y;
+			const float qz = FMath::Abs(z[i] - center.Z) - extent.Z;
+
+			const float ox = FMath::Max(qx, 0.f);
+			const float oy = FMath::Max(qy, 0.f);
+			const float oz = FMath::Max(qz, 0.f);
+
+			out[i] = FMath::Sqrt(ox * ox + oy * oy + oz * oz) + FMath::Min(FMath::Max3(qx, qy, qz), 0.f);
+		}
+	}
+};
+
+class TVoxelSdfTerrain : public TVoxelSdf {
+
+private:
+	float height;
+	float amplitude;
+	TVoxelFbmSettings settings;
+
+public:
+	TVoxelSdfTerrain(float height, float amplitude, const TVoxelFbmSettings& settings) : height(height), amplitude(amplitude), settings(settings) { }
+
+	void evaluate(const float* x, const float* y, const float* z, int count, float* out) const override {
+		float cx[VOXEL_SDF_BATCH];
+		float cy[VOXEL_SDF_BATCH];
+		float cz[VOXEL_SDF_BATCH];
+		float h[VOXEL_SDF_BATCH];
+		int column[VOXEL_SDF_BATCH];
+
+		for (int start = 0; start < count; start += VOXEL_SDF_BATCH) {
+			const int len = FMath::Min(VOXEL_SDF_BATCH, count - start);
+
+			// z rows share one column, evaluate the heightfield once per distinct column
+			int columns = 0;
+			for (int i = 0; i < len; i++) {
+				const int s = start + i;
+				if (columns == 0 || x[s] != cx[columns - 1] || y[s] != cy[columns - 1]) {
+					cx[columns] = x[s];
+					cy[columns] = y[s];
+					cz[columns] = 0;
+					columns++;
+				}
+
+				column[i] = columns - 1;
+			}
+
+			VoxelFbmRow(settings, cx, cy, cz, columns, h);
+
+			for (int i = 0; i < len; i++) {
+				out[start + i] = z[start + i] - (height + amplitude * h[column[i]]);
+			}
+		}
+	}
+
+	void bounds(const FBox& box, float& outMin, float& outMax) const override {
+		const float range = FMath::Abs(amplitude) * settings.amplitudeBound();
+		outMin = box.Min.Z - height - range;
+		outMax = box.Max.Z - height + range;
+	}
+};
+
+class TVoxelSdfNoiseDisplace : public TVoxelSdf {
+
+private:
+	TVoxelSdfPtr sdf;
+	float amplitude;
+	TVoxelFbmSettings settings;
+
+public:
+	TVoxelSdfNoiseDisplace(TVoxelSdfPtr sdf, float amplitude, const TVoxelFbmSettings& settings) : sdf(sdf), amplitude(amplitude), settings(settings) { }
+
+	void evaluate(const float* x, const float* y, const float* z, int count, float* out) const override {
+		float n[VOXEL_SDF_BATCH];
+
+		sdf->evaluate(x, y, z, count, out);
+
+		for (int start = 0; start < count; start += VOXEL_SDF_BATCH) {
+			const int len = FMath::Min(VOXEL_SDF_BATCH, count - start);
+			VoxelFbmRow(settings, x + start, y + start, z + start, len, n);
+
+			for (int i = 0; i < len; i++) {
+				out[start + i] += amplitude * n[i];
+			}
+		}
+	}
+
+	void bounds(const FBox& box, float& outMin, float& outMax) const override {
+		const float range = FMath::Abs(amplitude) * settings.amplitudeBound();
+		sdf->bounds(box, outMin, outMax);
+		outMin -= range;
+		outMax += range;
+	}
+};
+
+//====================================================================================
+// Combinations
+//====================================================================================
+
+enum class TVoxelSdfOperation : uint8 {
+	Union,
+	Subtract,
+	Intersect,
+	SmoothUnion
+};
+
+class TVoxelSdfCombine : public TVoxelSdf {
+
+private:
+	TVoxelSdfPtr a;
+	TVoxelSdfPtr b;
+	TVoxelSdfOperation operation;
+	float k;
+
+	FORCEINLINE float combine(float da, float db) const {
+		switch (operation) {
+		case TVoxelSdfOperation::Union:
+			return FMath::Min(da, db);
+		case TVoxelSdfOperation::Subtract:
+			return FMath::Max(da, -db);
+		case TVoxelSdfOperation::Intersect:
+			return FMath::Max(da, db);
+		default: {
+			const float h = FMath::Clamp(0.5f + 0.5f * (db - da) / k, 0.f, 1.f);
+			return FMath::Lerp(db, da, h) - k * h * (1.f - h);
+		}
+		}
+	}
+
+public:
+	TVoxelSdfCombine(TVoxelSdfPtr a, TVoxelSdfPtr b, TVoxelSdfOperation operation, float k = 0) : a(a), b(b), operation(operation), k(k) { }
+
+	void evaluate(const float* x, const float* y, const float* z, int count, float* out) const override {
+		float db[VOXEL_SDF_BATCH];
+
+		a->evaluate(x, y, z, count, out);
+
+		for (int start = 0; start < count; start += VOXEL_SDF_BATCH) {
+			const int len = FMath::Min(VOXEL_SDF_BATCH, count - start);
+			b->evaluate(x + start, y + start, z + start, len, db);
+
+			for (int i = 0; i < len; i++) {
+				out[start + i] = combine(out[start + i], db[i]);
+			}
+		}
+	}
+
+	void bounds(const FBox& box, float& outMin, float& outMax) const override {
+		float minA, maxA, minB, maxB;
+		a->bounds(box, minA, maxA);
+		b->bounds(box, minB, maxB);
+
+		switch (operation) {
+		case TVoxelSdfOperation::Union:
+			outMin = FMath::Min(minA, minB);
+			outMax = FMath::Min(maxA, maxB);
+			break;
+		case TVoxelSdfOperation::Subtract:
+			outMin = FMath::Max(minA, -maxB);
+			outMax = FMath::Max(maxA, -minB);
+			break;
+		case TVoxelSdfOperation::Intersect:
+			outMin = FMath::Max(minA, minB);
+			outMax = FMath::Max(maxA, maxB);
+			break;
+		default:
+			// the blend digs at most k/4 below the plain minimum
+			outMin = FMath::Min(minA, minB) - k * 0.25f;
+			outMax = FMath::Min(maxA, maxB);
+			break;
+		}
+	}
+};
+
+TVoxelSdfPtr VoxelSdfSphere(const FVector& center, float radius) {
+	return std::make_shared<TVoxelSdfSphere>(center, radius);
+}
+
+TVoxelSdfPtr VoxelSdfBox(const FVector& center, const FVector& extent) {
+	return std::make_shared<TVoxelSdfBox>(center, extent);
+}
+
+TVoxelSdfPtr VoxelSdfTerrain(float height, float amplitude, const TVoxelFbmSettings& settings) {
+	return std::make_shared<TVoxelSdfTerrain>(height, amplitude, settings);
+}
+
+TVoxelSdfPtr VoxelSdfNoiseDisplace(TVoxelSdfPtr sdf, float amplitude, const TVoxelFbmSettings& settings) {
+	return std::make_shared<TVoxelSdfNoiseDisplace>(sdf, amplitude, settings);
+}
+
+TVoxelSdfPtr VoxelSdfUnion(TVoxelSdfPtr a, TVoxelSdfPtr b) {
+	return std::make_shared<TVoxelSdfCombine>(a, b, TVoxelSdfOperation::Union);
+}
+
+TVoxelSdfPtr VoxelSdfSubtract(TVoxelSdfPtr a, TVoxelSdfPtr b) {
+	return std::make_shared<TVoxelSdfCombine>(a, b, TVoxelSdfOperation::Subtract);
+}
+
+TVoxelSdfPtr VoxelSdfIntersect(TVoxelSdfPtr a, TVoxelSdfPtr b) {
+	return std::make_shared<TVoxelSdfCombine>(a, b, TVoxelSdfOperation::Intersect);
+}
+
+TVoxelSdfPtr VoxelSdfSmoothUnion(TVoxelSdfPtr a, TVoxelSdfPtr b, float k) {
+	return std::make_shared<TVoxelSdfCombine>(a, b, TVoxelSdfOperation::SmoothUnion, FMath::Max(k, KINDA_SMALL_NUMBER));
+}
+
+//====================================================================================
+// Generation
+//====================================================================================
+
+void TVoxelSdfGenerator::generateRow(const FVector& start, float step, int count, unsigned char* out) const {
+	float x[VOXEL_SDF_BATCH];
+	float y[VOXEL_SDF_BATCH];
+	float z[VOXEL_SDF_BATCH];
+	float d[VOXEL_SDF_BATCH];
+
+	const float scale = 1.f / (2 * step);
+
+	for (int i = 0; i < VOXEL_SDF_BATCH; i++) {
+		x[i] = start.X;
+		y[i] = start.Y;
+	}
+
+	for (int s = 0; s < count; s += VOXEL_SDF_BATCH) {
+		const int len = FMath::Min(VOXEL_SDF_BATCH, count - s);
+		for (int i = 0; i < len; i++) {
+			z[i] = start.Z + (s + i) * step;
+		}
+
+		sdf->evaluate(x, y, z, len, d);
+
+		// same truncation as TVoxelData::setDensity
+		for (int i = 0; i < len; i++) {
+			const float density = FMath::Clamp(0.5f - d[i] * scale, 0.f, 1.f);
+			out[s + i] = (unsigned char)(255 * density);
+		}
+	}
+}
+
+bool TVoxelSdfGenerator::isUniform(const FBox& box, float step, unsigned char& raw) const {
+	float minDistance, maxDistance;
+	sdf->bounds(box, minDistance, maxDistance);
+
+	if (minDistance >= step) {
+		raw = 0;
+		return true;
+	}
+
+	if (maxDistance <= -step) {
+		raw = 255;
+		return true;
+	}
+
+	return false;
+}
+
+void VoxelGenerate(TVoxelData& data, const FVector& origin, const TVoxelGenerator& generator, bool bParallel) {
+	const int n = data.num();
+	const int b = data.brickNum();
+	const float step = data.size() / (n - 1);
+	const FVector lower = origin + data.voxelIndexToVector(0, 0, 0);
+
+	// 0..255 uniform value, -1 needs sampling
+	std::vector<int> brickState(b * b * b);
+
+	ParallelFor(b, [&](int32 bx) {
+		for (int by = 0; by < b; by++) {
+			for (int bz = 0; bz < b; bz++) {
+				// bounds of the sample positions, not of the cells
+				const int x0 = bx << VOXEL_BRICK_SHIFT;
+				const int y0 = by << VOXEL_BRICK_SHIFT;
+				const int z0 = bz << VOXEL_BRICK_SHIFT;
+				const int x1 = FMath::Min(x0 + VOXEL_BRICK_SIZE, n) - 1;
+				const int y1 = FMath::Min(y0 + VOXEL_BRICK_SIZE, n) - 1;
+				const int z1 = FMath::Min(z0 + VOXEL_BRICK_SIZE, n) - 1;
+				const FBox box(lower + FVector(x0, y0, z0) * step, lower + FVector(x1, y1, z1) * step);
+
+				unsigned char raw;
+				brickState[(bx * b + by) * b + bz] = generator.isUniform(box, step, raw) ? raw : -1;
+			}
+		}
+	}, !bParallel);
+
+	bool bUniform = true;
+	for (int state : brickState) {
+		bUniform &= state == brickState[0];
+	}
+
+	if (bUniform && (brickState[0] == 0 || brickState[0] == 255)) {
+		data.deinitializeDensity(brickState[0] == 0 ? TVoxelDataFillState::ZERO : TVoxelDataFillState::ALL);
+		return;
+	}
+
+	unsigned char* density = data.beginBulkDensityWrite();
+
+	ParallelFor(b, [&](int32 bx) {
+		for (int by = 0; by < b; by++) {
+			for (int bz = 0; bz < b; bz++) {
+				const int state = brickState[(bx * b + by) * b + bz];
+
+				const int z0 = bz << VOXEL_BRICK_SHIFT;
+				const int len = FMath::Min(VOXEL_BRICK_SIZE, n - z0);
+
+				const int xEnd = FMath::Min((bx + 1) << VOXEL_BRICK_SHIFT, n);
+				const int yEnd = FMath::Min((by + 1) << VOXEL_BRICK_SHIFT, n);
+
+				for (int x = bx << VOXEL_BRICK_SHIFT; x < xEnd; x++) {
+					for (int y = by << VOXEL_BRICK_SHIFT; y < yEnd; y++) {
+						unsigned char* row = density + data.clcLinearIndex(x, y, z0);
+
+						if (state >= 0) {
+							FMemory::Memset(row, (uint8)state, len);
+						} else {
+							generator.generateRow(lower + FVector(x, y, z0) * step, step, len, row);
+						}
+					}
+				}
+			}
+		}
+	}, !bParallel);
+
+	data.endBulkDensityWrite();
+}
+
+// chunks entirely above or below the hills stay uniform
+void VoxelGenerateDefaultTerrain(TVoxelData& data, const FVector& origin) {
+	static const TVoxelSdfGenerator generator(VoxelSdfTerrain(0.f, 300.f, TVoxelFbmSettings()));
+	VoxelGenerate(data, origin, generator);
+}
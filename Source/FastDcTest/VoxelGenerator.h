@@ -0,0 +1,77 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelData.h"
+#include "VoxelNoise.h"
+#include <memory>
+
+//
+// Signed distance primitives (negative inside) that evaluate whole batches of samples.
+//
+// bounds() gives a conservative distance range over a box; generation uses it to fill bricks
+// that are entirely inside or outside without evaluating a single sample.
+//
+class TVoxelSdf {
+
+public:
+	virtual ~TVoxelSdf() { }
+
+	virtual void evaluate(const float* x, const float* y, const float* z, int count, float* out) const = 0;
+
+	// the default assumes a true distance field: one sample at the center, widened by the half diagonal
+	virtual void bounds(const FBox& box, float& outMin, float& outMax) const;
+};
+
+typedef std::shared_ptr<const TVoxelSdf> TVoxelSdfPtr;
+
+TVoxelSdfPtr VoxelSdfSphere(const FVector& center, float radius);
+TVoxelSdfPtr VoxelSdfBox(const FVector& center, const FVector& extent);
+
+// heightfield at height + amplitude * fbm(x, y), solid below
+TVoxelSdfPtr VoxelSdfTerrain(float height, float amplitude, const TVoxelFbmSettings& settings);
+
+// adds amplitude * fbm(x, y, z) to the distance of sdf
+TVoxelSdfPtr VoxelSdfNoiseDisplace(TVoxelSdfPtr sdf, float amplitude, const TVoxelFbmSettings& settings);
+
+TVoxelSdfPtr VoxelSdfUnion(TVoxelSdfPtr a, TVoxelSdfPtr b);
+TVoxelSdfPtr VoxelSdfSubtract(TVoxelSdfPtr a, TVoxelSdfPtr b);
+TVoxelSdfPtr VoxelSdfIntersect(TVoxelSdfPtr a, TVoxelSdfPtr b);
+
+// polynomial smooth minimum, blends the surfaces within k of each other
+TVoxelSdfPtr VoxelSdfSmoothUnion(TVoxelSdfPtr a, TVoxelSdfPtr b, float k);
+
+
+//
+// Produces raw densities (0..255, 128 and up is solid) for volumes.
+//
+class TVoxelGenerator {
+
+public:
+	virtual ~TVoxelGenerator() { }
+
+	// count samples starting at start and spaced step apart along z
+	virtual void generateRow(const FVector& start, float step, int count, unsigned char* out) const = 0;
+
+	// true if every sample inside box is known to be raw
+	virtual bool isUniform(const FBox& box, float step, unsigned char& raw) const { return false; }
+};
+
+// maps the distance onto a density ramp two samples wide
+class TVoxelSdfGenerator : public TVoxelGenerator {
+
+private:
+	TVoxelSdfPtr sdf;
+
+public:
+	TVoxelSdfGenerator(TVoxelSdfPtr sdf) : sdf(sdf) { }
+
+	void generateRow(const FVector& start, float step, int count, unsigned char* out) const override;
+	bool isUniform(const FBox& box, float step, unsigned char& raw) const override;
+};
+
+// fills the density of data brick by brick, origin is the volume center in generator space.
+// volumes that turn out uniform end up without a density array
+void VoxelGenerate(TVoxelData& data, const FVector& origin, const TVoxelGenerator& generator, bool bParallel = false);
+
+// the fbm hills of the streamed world, shared by the game and the offline bake
+void VoxelGenerateDefaultTerrain(TVoxelData& data, const FVector& origin);
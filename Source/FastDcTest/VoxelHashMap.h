@@ -0,0 +1,141 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+//
+// Open addressing hash map for 32 bit voxel/edge ids.
+//
+// Keys and values live in two flat arrays that are only ever grown. reset() clears the map
+// without releasing memory, so a map reused for every mesh build stops allocating once it has
+// seen the largest build. 0xffffffff is reserved as the empty key.
+//
+template <typename TValue>
+class TVoxelHashMap {
+
+private:
+	static const uint32 EMPTY_KEY = 0xffffffff;
+	static const int32 MIN_CAPACITY = 1024;
+
+	TArray<uint32> keys;
+	TArray<TValue> values;
+
+	uint32 mask = 0;
+	uint32 shift = 32;
+	int32 count = 0;
+	int32 allocations = 0;
+
+	FORCEINLINE uint32 slot(uint32 key) const {
+		// fibonacci hashing, the high bits of the product are well mixed
+		return (key * 0x9E3779B1u) >> shift;
+	}
+
+	void grow(int32 capacity) {
+		TArray<uint32> oldKeys = MoveTemp(keys);
+		TArray<TValue> oldValues = MoveTemp(values);
+
+		keys.Empty(capacity);
+		keys.Init(uint32(EMPTY_KEY), capacity);
+		values.Empty(capacity);
+		values.SetNum(capacity);
+
+		mask = capacity - 1;
+		shift = 32 - FMath::FloorLog2(capacity);
+		count = 0;
+		allocations++;
+
+		for (int32 i = 0; i < oldKeys.Num(); i++) {
+			if (oldKeys[i] != EMPTY_KEY) {
+				bool bIsNew;
+				add(oldKeys[i], bIsNew) = oldValues[i];
+			}
+		}
+	}
+
+public:
+	// clears all entries, keeps the storage
+	void reset() {
+		if (count > 0) {
+			FMemory::Memset(keys.GetData(), 0xff, keys.Num() * sizeof(uint32));
+			count = 0;
+		}
+	}
+
+	// makes room for num entries without growing during insertion
+	void reserve(int32 num) {
+		const int32 capacity = (int32)FMath::RoundUpToPowerOfTwo(FMath::Max(num * 2, MIN_CAPACITY));
+		if (capacity > keys.Num()) {
+			grow(capacity);
+		}
+	}
+
+	FORCEINLINE TValue* find(uint32 key) {
+		return const_cast<TValue*>(static_cast<const TVoxelHashMap*>(this)->find(key));
+	}
+
+	FORCEINLINE const TValue* find(uint32 key) const {
+		if (count == 0) {
+			return nullptr;
+		}
+
+		for (uint32 i = slot(key);; i = (i + 1) & mask) {
+			const uint32 k = keys[i];
+			if (k == key) {
+				return &values[i];
+			}
+
+			if (k == EMPTY_KEY) {
+				return nullptr;
+			}
+		}
+	}
+
+	// returns the value for key, default-initialized if it was not present
+	FORCEINLINE TValue& add(uint32 key, bool& bIsNew) {
+		checkSlow(key != EMPTY_KEY);
+
+		// keep the load factor at or below one half
+		if ((count + 1) * 2 > keys.Num()) {
+			grow(FMath::Max(keys.Num() * 2, MIN_CAPACITY));
+		}
+
+		for (uint32 i = slot(key);; i = (i + 1) & mask) {
+			if (keys[i] == key) {
+				bIsNew = false;
+				return values[i];
+			}
+
+			if (keys[i] == EMPTY_KEY) {
+				keys[i] = key;
+				values[i] = TValue();
+				count++;
+				bIsNew = true;
+				return values[i];
+			}
+		}
+	}
+
+	template <typename TFunc>
+	void forEach(TFunc&& func) {
+		for (int32 i = 0; i < keys.Num(); i++) {
+			if (keys[i] != EMPTY_KEY) {
+				func(keys[i], values[i]);
+			}
+		}
+	}
+
+	template <typename TFunc>
+	void forEach(TFunc&& func) const {
+		for (int32 i = 0; i < keys.Num(); i++) {
+			if (keys[i] != EMPTY_KEY) {
+				func(keys[i], values[i]);
+			}
+		}
+	}
+
+	int32 num() const { return count; }
+
+	// number of times the storage was (re)allocated since construction
+	int32 getAllocationCount() const { return allocations; }
+
+	size_t getAllocatedSize() const { return keys.GetAllocatedSize() + values.GetAllocatedSize(); }
+};
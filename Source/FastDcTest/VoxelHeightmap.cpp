@@ -0,0 +1,121 @@
+#include "VoxelHeightmap.h"
+#include "Async/ParallelFor.h"
+#include "Misc/FileHelper.h"
+
+float TVoxelHeightmap::getHeight(float x, float y) const {
+	const float fx = FMath::Clamp((x - origin.X) / spacing, 0.f, (float)(sizeX - 1));
+	const float fy = FMath::Clamp((y - origin.Y) / spacing, 0.f, (float)(sizeY - 1));
+
+	// the last row and column interpolate towards themselves
+	const int x0 = FMath::Min(FMath::FloorToInt(fx), FMath::Max(sizeX - 2, 0));
+	const int y0 = FMath::Min(FMath::FloorToInt(fy), FMath::Max(sizeY - 2, 0));
+	const int x1 = FMath::Min(x0 + 1, sizeX - 1);
+	const int y1 = FMath::Min(y0 + 1, sizeY - 1);
+	const float tx = fx - x0;
+	const float ty = fy - y0;
+
+	const float h00 = heights[y0 * sizeX + x0];
+	const float h10 = heights[y0 * sizeX + x1];
+	const float h01 = heights[y1 * sizeX + x0];
+	const float h11 = heights[y1 * sizeX + x1];
+
+	const float h = FMath::Lerp(FMath::Lerp(h00, h10, tx), FMath::Lerp(h01, h11, tx), ty);
+	return baseHeight + h * (heightRange / 65535.f);
+}
+
+bool VoxelLoadHeightmapR16(const FString& fileName, int sizeX, int sizeY, TVoxelHeightmap& out) {
+	TArray<uint8> bytes;
+	if (!FFileHelper::LoadFileToArray(bytes, *fileName) || bytes.Num() == 0 || bytes.Num() % 2 != 0) {
+		UE_LOG(LogTemp, Warning, TEXT("Heightmap %s is missing or not 16 bit"), *fileName);
+		return false;
+	}
+
+	const int count = bytes.Num() / 2;
+	if (sizeX <= 0 || sizeY <= 0) {
+		sizeX = sizeY = FMath::RoundToInt(FMath::Sqrt((float)count));
+	}
+
+	if (sizeX * sizeY != count) {
+		UE_LOG(LogTemp, Warning, TEXT("Heightmap %s holds %d samples, not %d x %d"), *fileName, count, sizeX, sizeY);
+		return false;
+	}
+
+	out.sizeX = sizeX;
+	out.sizeY = sizeY;
+	out.heights.resize(count);
+	FMemory::Memcpy(out.heights.data(), bytes.GetData(), count * sizeof(uint16));
+	return true;
+}
+
+void VoxelImportHeightmap(TVoxelData& data, const FVector& origin, const TVoxelHeightmap& heightmap, bool bParallel) {
+	check(!heightmap.isEmpty());
+
+	const int n = data.num();
+	const float step = data.size() / (n - 1);
+	const FVector lower = origin + data.voxelIndexToVector(0, 0, 0);
+
+	// surface height of every column relative to the lowest sample, in steps
+	std::vector<float> surface(n * n);
+	std::vector<float> slabMin(n);
+	std::vector<float> slabMax(n);
+
+	ParallelFor(n, [&](int32 x) {
+		float lo = MAX_flt;
+		float hi = -MAX_flt;
+
+		for (int y = 0; y < n; y++) {
+			const float h = (heightmap.getHeight(lower.X + x * step, lower.Y + y * step) - lower.Z) / step;
+			surface[x * n + y] = h;
+			lo = FMath::Min(lo, h);
+			hi = FMath::Max(hi, h);
+		}
+
+		slabMin[x] = lo;
+		slabMax[x] = hi;
+	}, !bParallel);
+
+	float minSurface = MAX_flt;
+	float maxSurface = -MAX_flt;
+	for (int x = 0; x < n; x++) {
+		minSurface = FMath::Min(minSurface, slabMin[x]);
+		maxSurface = FMath::Max(maxSurface, slabMax[x]);
+	}
+
+	// the ramp reaches a step either side of the surface
+	if (maxSurface <= -1.f) {
+		data.deinitializeDensity(TVoxelDataFillState::ZERO);
+		return;
+	}
+
+	if (minSurface >= n) {
+		data.deinitializeDensity(TVoxelDataFillState::ALL);
+		return;
+	}
+
+	// every sample of every column is written below
+	unsigned char* density = data.beginBulkDensityWrite(false);
+
+	ParallelFor(n, [&](int32 x) {
+		for (int y = 0; y < n; y++) {
+			const float h = surface[x * n + y];
+			unsigned char* column = density + data.clcLinearIndex(x, y, 0);
+
+			// samples below solidEnd are a step or more under the surface, from airStart on a step
+			// or more above it
+			const int solidEnd = FMath::Clamp(FMath::FloorToInt(h) - 1, 0, n);
+			const int airStart = FMath::Clamp(FMath::CeilToInt(h) + 2, solidEnd, n);
+
+			FMemory::Memset(column, 255, solidEnd);
+
+			// same ramp and truncation as TVoxelSdfGenerator
+			for (int z = solidEnd; z < airStart; z++) {
+				const float d = FMath::Clamp(0.5f - (z - h) * 0.5f, 0.f, 1.f);
+				column[z] = (unsigned char)(255 * d);
+			}
+
+			FMemory::Memset(column + airStart, 0, n - airStart);
+		}
+	}, !bParallel);
+
+	data.endBulkDensityWrite();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelData.h"
+#include <vector>
+
+//
+// 16 bit heightfield, solid below the surface. Sample (i, j) sits at origin + (i, j) * spacing
+// in generator space and raw height h at baseHeight + h / 65535 * heightRange; between samples
+// the height is interpolated bilinearly, beyond the edges the border samples extend outwards.
+//
+struct TVoxelHeightmap {
+	int sizeX = 0;
+	int sizeY = 0;
+
+	// sizeX * sizeY raw heights, x fastest like the rows of an .r16 file
+	std::vector<uint16> heights;
+
+	FVector2D origin = FVector2D(0.f, 0.f);
+	float spacing = 100.f;
+
+	float baseHeight = 0.f;
+	float heightRange = 25600.f;
+
+	bool isEmpty() const { return heights.empty(); }
+
+	float getHeight(float x, float y) const;
+};
+
+// raw little endian 16 bit heights without a header, as landscape tools export them; a size of 0
+// takes the file for a square. Fails when the file is missing or its size doesn't fit
+bool VoxelLoadHeightmapR16(const FString& fileName, int sizeX, int sizeY, TVoxelHeightmap& out);
+
+//
+// Fills the density of data from the heightmap, origin is the volume center in generator space,
+// with the same two sample ramp around the surface as TVoxelSdfGenerator.
+//
+// Works a column of constant x and y at a time: samples more than a step below the surface are
+// set solid and those more than a step above it empty with plain memsets, only the few in between
+// compute a density. Slabs of x run in parallel on the task pool. Volumes entirely above or below
+// the surface end up without a density array.
+//
+void VoxelImportHeightmap(TVoxelData& data, const FVector& origin, const TVoxelHeightmap& heightmap, bool bParallel = false);
@@ -0,0 +1,245 @@
+#include "VoxelJobScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+// the worker the current thread is, -1 outside the scheduler
+static thread_local const TVoxelJobScheduler* CurrentScheduler = nullptr;
+static thread_local int CurrentWorker = -1;
+
+void TVoxelJob::wait() {
+	std::unique_lock<std::mutex> lock(done_lock);
+	done.wait(lock, [this]() { return isDone(); });
+}
+
+double TVoxelJobScheduler::now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TVoxelJobScheduler::TVoxelJobScheduler(int workerNum) {
+	if (workerNum <= 0) {
+		workerNum = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+	}
+
+	for (int i = 0; i < workerNum; i++) {
+		workers.emplace_back(new TWorker());
+	}
+
+	stats.workerNum = workerNum;
+
+	for (int i = 0; i < workerNum; i++) {
+		workers[i]->thread = std::thread([this, i]() { workerLoop(i); });
+	}
+}
+
+TVoxelJobScheduler::~TVoxelJobScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(wake_lock);
+		bStop = true;
+	}
+
+	wake.notify_all();
+
+	for (auto& worker : workers) {
+		worker->thread.join();
+	}
+
+	// nobody is going to run these any more, waiters must not hang
+	for (auto& worker : workers) {
+		for (const TVoxelJobPtr& job : worker->heap) {
+			job->cancel();
+			finish(job, false);
+		}
+	}
+}
+
+TVoxelJobPtr TVoxelJobScheduler::submit(float priority, std::function<void(TVoxelJob& job)> work) {
+	TVoxelJobPtr job = std::make_shared<TVoxelJob>();
+	job->work = std::move(work);
+	job->priority = priority;
+	job->submit_time = now();
+
+	const int index = CurrentScheduler == this ? CurrentWorker : (int)(next_worker++ % workers.size());
+	TWorker& worker = *workers[index];
+
+	{
+		std::lock_guard<std::mutex> lock(worker.lock);
+		worker.heap.push_back(job);
+		std::push_heap(worker.heap.begin(), worker.heap.end(), runsLater);
+	}
+
+	// counted under the wake lock so that a worker about to sleep can't miss it
+	{
+		std::lock_guard<std::mutex> lock(wake_lock);
+		queued++;
+	}
+
+	wake.notify_one();
+	return job;
+}
+
+void TVoxelJobScheduler::reprioritize(const std::vector<std::pair<TVoxelJobPtr, float>>& priorities) {
+	// a job can move between deques while we look, so all of them are held at once, always in
+	// the same order
+	std::vector<std::unique_lock<std::mutex>> locks;
+	for (auto& worker : workers) {
+		locks.emplace_back(worker->lock);
+	}
+
+	for (const auto& pair : priorities) {
+		pair.first->priority = pair.second;
+	}
+
+	for (auto& worker : workers) {
+		std::make_heap(worker->heap.begin(), worker->heap.end(), runsLater);
+	}
+}
+
+TVoxelJobPtr TVoxelJobScheduler::pop(int index) {
+	{
+		TWorker& worker = *workers[index];
+		std::lock_guard<std::mutex> lock(worker.lock);
+
+		if (!worker.heap.empty()) {
+			std::pop_heap(worker.heap.begin(), worker.heap.end(), runsLater);
+			TVoxelJobPtr job = std::move(worker.heap.back());
+			worker.heap.pop_back();
+			queued--;
+			return job;
+		}
+	}
+
+	// the victim is the deque with the most urgent top, another thief may beat us to it
+	for (int attempt = 0; attempt < 2; attempt++) {
+		int victim = -1;
+		float best = 0;
+
+		for (int i = 0; i < (int)workers.size(); i++) {
+			if (i == index) {
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(workers[i]->lock);
+			if (!workers[i]->heap.empty() && (victim < 0 || workers[i]->heap.front()->priority < best)) {
+				victim = i;
+				best = workers[i]->heap.front()->priority;
+			}
+		}
+
+		if (victim < 0) {
+			return nullptr;
+		}
+
+		TWorker& worker = *workers[victim];
+		std::lock_guard<std::mutex> lock(worker.lock);
+
+		if (!worker.heap.empty()) {
+			std::pop_heap(worker.heap.begin(), worker.heap.end(), runsLater);
+			TVoxelJobPtr job = std::move(worker.heap.back());
+			worker.heap.pop_back();
+			queued--;
+
+			std::lock_guard<std::mutex> statsLock(stats_lock);
+			stats.stolen++;
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+void TVoxelJobScheduler::workerLoop(int index) {
+	CurrentScheduler = this;
+	CurrentWorker = index;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(wake_lock);
+			wake.wait(lock, [this]() { return bStop || queued > 0; });
+
+			if (bStop) {
+				return;
+			}
+		}
+
+		// the job counted in queued may be taken by another worker first, then we look again
+		TVoxelJobPtr job = pop(index);
+		if (!job) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		run(job);
+	}
+}
+
+void TVoxelJobScheduler::run(const TVoxelJobPtr& job) {
+	if (job->isCancelled()) {
+		finish(job, false);
+		return;
+	}
+
+	running++;
+	job->start_time = now();
+	job->state.store(TVoxelJob::RUNNING, std::memory_order_release);
+
+	job->work(*job);
+
+	running--;
+	finish(job, true);
+}
+
+void TVoxelJobScheduler::finish(const TVoxelJobPtr& job, bool bRan) {
+	const double end = now();
+
+	{
+		std::lock_guard<std::mutex> lock(stats_lock);
+
+		if (bRan && !job->isCancelled()) {
+			const double waited = job->start_time - job->submit_time;
+			const double latency = end - job->submit_time;
+
+			stats.completed++;
+			wait_sum += waited;
+			latency_sum += latency;
+			stats.maxWait = std::max(stats.maxWait, waited);
+			stats.maxLatency = std::max(stats.maxLatency, latency);
+		} else {
+			stats.cancelled++;
+		}
+	}
+
+	// the work may hold the last references to what it captured, let go of it before waking waiters
+	job->work = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(job->done_lock);
+		job->state.store(TVoxelJob::DONE, std::memory_order_release);
+	}
+
+	job->done.notify_all();
+}
+
+TVoxelJobStats TVoxelJobScheduler::getStats() const {
+	std::lock_guard<std::mutex> lock(stats_lock);
+
+	TVoxelJobStats result = stats;
+	result.queued = queued;
+	result.running = running;
+
+	if (stats.completed > 0) {
+		result.meanWait = wait_sum / stats.completed;
+		result.meanLatency = latency_sum / stats.completed;
+	}
+
+	return result;
+}
+
+void TVoxelJobScheduler::resetStats() {
+	std::lock_guard<std::mutex> lock(stats_lock);
+
+	const int workerNum = stats.workerNum;
+	stats = TVoxelJobStats();
+	stats.workerNum = workerNum;
+	wait_sum = 0;
+	latency_sum = 0;
+}
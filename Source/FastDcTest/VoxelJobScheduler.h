@@ -0,0 +1,146 @@
+#pragma once
+
+// plain standard library on purpose, the scheduler runs and is tested without the engine
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class TVoxelJobScheduler;
+
+//
+// One unit of work for TVoxelJobScheduler. Lower priority values run sooner. A job can be
+// cancelled at any time: one still queued is dropped without running, a running one sees
+// isCancelled() and is expected to stop at its next stage.
+//
+class TVoxelJob {
+
+private:
+	enum TState : int {
+		QUEUED, RUNNING, DONE
+	};
+
+	std::function<void(TVoxelJob& job)> work;
+
+	// read and written under the lock of the deque holding the job
+	float priority = 0;
+
+	std::atomic<bool> cancelled{ false };
+	std::atomic<int> state{ QUEUED };
+
+	// seconds on the scheduler clock
+	double submit_time = 0;
+	double start_time = 0;
+
+	std::mutex done_lock;
+	std::condition_variable done;
+
+	friend class TVoxelJobScheduler;
+
+public:
+	void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+	bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+	// the flag itself, for TVoxelMeshingContext::cancelFlag
+	const std::atomic<bool>* getCancelFlag() const { return &cancelled; }
+
+	bool isDone() const { return state.load(std::memory_order_acquire) == DONE; }
+	bool isRunning() const { return state.load(std::memory_order_acquire) == RUNNING; }
+
+	// blocks until the job has run or been dropped
+	void wait();
+};
+
+using TVoxelJobPtr = std::shared_ptr<TVoxelJob>;
+
+struct TVoxelJobStats {
+	int workerNum = 0;
+
+	// jobs waiting in the deques and jobs being worked on right now
+	int queued = 0;
+	int running = 0;
+
+	// since construction or the last resetStats()
+	size_t completed = 0;
+	size_t cancelled = 0;
+	size_t stolen = 0;
+
+	// seconds from submission to the start of a job and from submission to its end, over the
+	// completed jobs
+	double meanWait = 0;
+	double maxWait = 0;
+	double meanLatency = 0;
+	double maxLatency = 0;
+};
+
+//
+// Priority job scheduler over a fixed set of worker threads.
+//
+// Every worker owns a deque kept as a heap on priority and works off its most urgent job.
+// Submissions from outside go to the workers in turn, a job submitted from a worker stays with it.
+// A worker that runs dry steals the most urgent job among the tops of the other deques, so a
+// burst that landed on one worker spreads over all of them in priority order. Priorities of
+// queued jobs can be recomputed when what is urgent changes, e.g. once per frame as the viewer
+// moves.
+//
+class TVoxelJobScheduler {
+
+private:
+	struct TWorker {
+		std::mutex lock;
+		std::vector<TVoxelJobPtr> heap;
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<TWorker>> workers;
+
+	std::mutex wake_lock;
+	std::condition_variable wake;
+	bool bStop = false;
+
+	std::atomic<int> queued{ 0 };
+	std::atomic<int> running{ 0 };
+	std::atomic<unsigned> next_worker{ 0 };
+
+	mutable std::mutex stats_lock;
+	TVoxelJobStats stats;
+	double wait_sum = 0;
+	double latency_sum = 0;
+
+	// std heaps keep the largest element on top, the top here is the lowest priority value
+	static bool runsLater(const TVoxelJobPtr& a, const TVoxelJobPtr& b) { return a->priority > b->priority; }
+
+	void workerLoop(int index);
+	TVoxelJobPtr pop(int index);
+	void run(const TVoxelJobPtr& job);
+	void finish(const TVoxelJobPtr& job, bool bRan);
+
+public:
+	// 0 workers picks one per hardware thread but one, at least one
+	explicit TVoxelJobScheduler(int workerNum = 0);
+
+	// drops the queued jobs and waits for the running ones
+	~TVoxelJobScheduler();
+
+	TVoxelJobPtr submit(float priority, std::function<void(TVoxelJob& job)> work);
+
+	// new priorities for jobs that may still be queued, the others are left alone
+	void reprioritize(const std::vector<std::pair<TVoxelJobPtr, float>>& priorities);
+
+	int workerNum() const { return (int)workers.size(); }
+
+	TVoxelJobStats getStats() const;
+	void resetStats();
+
+	// the clock submission and start times are taken from
+	static double now();
+};
+
+// Checks priority order, work stealing, cancellation, reprioritization and shutdown on plain
+// threads, see VoxelJobSchedulerTest.cpp. Reports every failed check and returns their number.
+int VoxelTestJobScheduler(const std::function<void(const std::string& failure)>& fail);
@@ -0,0 +1,238 @@
+#include "VoxelJobScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+// long enough for any job of these checks, a check that runs into it has failed
+static const std::chrono::seconds TestTimeout(5);
+
+// a job that holds its worker until opened, so that the jobs behind it queue up
+struct TJobGate {
+	std::atomic<bool> bOpen{ false };
+
+	TVoxelJobPtr hold(TVoxelJobScheduler& scheduler) {
+		TVoxelJobPtr job = scheduler.submit(-1000.f, [this](TVoxelJob&) {
+			const auto deadline = std::chrono::steady_clock::now() + TestTimeout;
+			while (!bOpen && std::chrono::steady_clock::now() < deadline) {
+				std::this_thread::yield();
+			}
+		});
+
+		while (!job->isRunning() && !job->isDone()) {
+			std::this_thread::yield();
+		}
+
+		return job;
+	}
+};
+
+// one worker runs its queue strictly by priority, the order of submission doesn't matter
+static void TestPriorityOrder(const std::function<void(const std::string&)>& fail) {
+	TVoxelJobScheduler scheduler(1);
+	TJobGate gate;
+	gate.hold(scheduler);
+
+	std::mutex lock;
+	std::vector<float> order;
+	std::vector<TVoxelJobPtr> jobs;
+
+	for (int i = 0; i < 64; i++) {
+		const float priority = (float)((i * 37) % 64);
+		jobs.push_back(scheduler.submit(priority, [&, priority](TVoxelJob&) {
+			std::lock_guard<std::mutex> guard(lock);
+			order.push_back(priority);
+		}));
+	}
+
+	gate.bOpen = true;
+	for (const TVoxelJobPtr& job : jobs) {
+		job->wait();
+	}
+
+	if (order.size() != jobs.size() || !std::is_sorted(order.begin(), order.end())) {
+		fail("priority order: jobs did not run lowest priority first");
+	}
+}
+
+// jobs a busy worker submits to its own deque are all taken by the idle ones
+static void TestWorkStealing(const std::function<void(const std::string&)>& fail) {
+	TVoxelJobScheduler scheduler(4);
+	const int jobNum = 32;
+
+	std::mutex lock;
+	std::vector<std::thread::id> threads;
+	std::atomic<int> ran{ 0 };
+
+	TVoxelJobPtr owner = scheduler.submit(0.f, [&](TVoxelJob&) {
+		std::vector<TVoxelJobPtr> burst;
+		for (int i = 0; i < jobNum; i++) {
+			burst.push_back(scheduler.submit((float)i, [&](TVoxelJob&) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				std::lock_guard<std::mutex> guard(lock);
+				threads.push_back(std::this_thread::get_id());
+				ran++;
+			}));
+		}
+
+		// this worker stays busy until the others have emptied its deque
+		for (const TVoxelJobPtr& job : burst) {
+			job->wait();
+		}
+	});
+
+	owner->wait();
+
+	std::sort(threads.begin(), threads.end());
+	const int threadNum = (int)(std::unique(threads.begin(), threads.end()) - threads.begin());
+
+	if (ran != jobNum) {
+		fail("work stealing: " + std::to_string((int)ran) + " of " + std::to_string(jobNum) + " jobs ran");
+	}
+
+	if (scheduler.getStats().stolen < (size_t)jobNum) {
+		fail("work stealing: only " + std::to_string(scheduler.getStats().stolen) + " jobs were stolen");
+	}
+
+	if (threadNum < 2) {
+		fail("work stealing: the burst ran on a single worker");
+	}
+}
+
+// a queued job is dropped without running, a running one sees the flag and waiters return
+static void TestCancellation(const std::function<void(const std::string&)>& fail) {
+	TVoxelJobScheduler scheduler(1);
+
+	{
+		TJobGate gate;
+		gate.hold(scheduler);
+
+		std::atomic<bool> bRan{ false };
+		TVoxelJobPtr job = scheduler.submit(0.f, [&](TVoxelJob&) { bRan = true; });
+		job->cancel();
+
+		gate.bOpen = true;
+		job->wait();
+
+		if (bRan || !job->isDone()) {
+			fail("cancellation: a job cancelled in the queue ran");
+		}
+
+		if (scheduler.getStats().cancelled != 1) {
+			fail("cancellation: the dropped job was not counted as cancelled");
+		}
+	}
+
+	std::atomic<bool> bSeen{ false };
+	TVoxelJobPtr job = scheduler.submit(0.f, [&](TVoxelJob& self) {
+		const auto deadline = std::chrono::steady_clock::now() + TestTimeout;
+		while (!self.isCancelled() && std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::yield();
+		}
+
+		bSeen = self.isCancelled();
+	});
+
+	while (!job->isRunning() && !job->isDone()) {
+		std::this_thread::yield();
+	}
+
+	job->cancel();
+	job->wait();
+
+	if (!bSeen) {
+		fail("cancellation: a running job did not see its cancel flag");
+	}
+}
+
+// new priorities reorder jobs that are already queued
+static void TestReprioritize(const std::function<void(const std::string&)>& fail) {
+	TVoxelJobScheduler scheduler(1);
+	TJobGate gate;
+	gate.hold(scheduler);
+
+	std::mutex lock;
+	std::vector<int> order;
+	std::vector<TVoxelJobPtr> jobs;
+
+	for (int i = 0; i < 3; i++) {
+		jobs.push_back(scheduler.submit((float)(i + 1), [&, i](TVoxelJob&) {
+			std::lock_guard<std::mutex> guard(lock);
+			order.push_back(i);
+		}));
+	}
+
+	// the last job becomes the most urgent and the first the least
+	scheduler.reprioritize({ { jobs[2], 0.f }, { jobs[0], 5.f } });
+
+	gate.bOpen = true;
+	for (const TVoxelJobPtr& job : jobs) {
+		job->wait();
+	}
+
+	if (order != std::vector<int>({ 2, 1, 0 })) {
+		fail("reprioritize: queued jobs kept their old order");
+	}
+}
+
+// jobs still queued when the scheduler goes away are dropped and their waiters return
+static void TestShutdown(const std::function<void(const std::string&)>& fail) {
+	std::vector<TVoxelJobPtr> jobs;
+	std::atomic<int> ran{ 0 };
+
+	{
+		TVoxelJobScheduler scheduler(1);
+		scheduler.submit(-1.f, [](TVoxelJob&) { std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+
+		for (int i = 0; i < 8; i++) {
+			jobs.push_back(scheduler.submit((float)i, [&](TVoxelJob&) { ran++; }));
+		}
+	}
+
+	for (const TVoxelJobPtr& job : jobs) {
+		if (!job->isDone()) {
+			fail("shutdown: a queued job was left without finishing");
+			return;
+		}
+	}
+
+	if (ran != 0) {
+		fail("shutdown: queued jobs ran after the scheduler stopped");
+	}
+}
+
+int VoxelTestJobScheduler(const std::function<void(const std::string& failure)>& fail) {
+	int failures = 0;
+	auto count = [&](const std::string& failure) {
+		failures++;
+		fail(failure);
+	};
+
+	TestPriorityOrder(count);
+	TestWorkStealing(count);
+	TestCancellation(count);
+	TestReprioritize(count);
+	TestShutdown(count);
+
+	return failures;
+}
+
+// the engine only adds the console command, the checks above build with the scheduler alone
+#if defined(UE_BUILD_SHIPPING) && !UE_BUILD_SHIPPING
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+
+static void TestJobSchedulerCommand() {
+	const int Failures = VoxelTestJobScheduler([](const std::string& Failure) {
+		UE_LOG(LogTemp, Error, TEXT("TestJobScheduler: %s"), UTF8_TO_TCHAR(Failure.c_str()));
+	});
+
+	UE_LOG(LogTemp, Display, TEXT("TestJobScheduler: %d failures"), Failures);
+}
+
+static FAutoConsoleCommand TestJobSchedulerCmd(
+	TEXT("fastdc.TestJobScheduler"),
+	TEXT("Checks priority order, work stealing, cancellation and reprioritization of the job scheduler on plain threads."),
+	FConsoleCommandDelegate::CreateStatic(&TestJobSchedulerCommand));
+
+#endif
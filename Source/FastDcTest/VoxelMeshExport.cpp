@@ -0,0 +1,213 @@
+#include "VoxelMeshExport.h"
+#include <cstdarg>
+#include <cstdio>
+
+static const uint32 VOXEL_MESH_MAGIC = 0x48534d56; // "VMSH"
+static const uint32 VOXEL_MESH_FORMAT_VERSION = 1;
+
+struct TVoxelMeshHeader {
+	uint32 magic;
+	uint32 version;
+	uint32 vertex_num;
+	uint32 index_num;
+
+	// position = bounds_min + quantized * bounds_scale
+	float bounds_min[3];
+	float bounds_scale[3];
+};
+
+template <typename T>
+static void AppendValue(TArray<uint8>& out, const T& value) {
+	out.Append((const uint8*)&value, sizeof(T));
+}
+
+static void AppendText(TArray<uint8>& out, const char* format, ...) {
+	char line[256];
+
+	va_list args;
+	va_start(args, format);
+	const int len = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+
+	out.Append((const uint8*)line, FMath::Clamp(len, 0, (int)sizeof(line) - 1));
+}
+
+void VoxelWriteMeshBinary(const TVoxelMeshData& mesh, TArray<uint8>& out) {
+	const int32 vertexNum = mesh.Vertices.Num();
+	const int32 indexNum = mesh.Triangles.Num();
+	const bool bWideIndices = vertexNum > 65536;
+
+	FBox bounds(ForceInit);
+	for (const FVector& v : mesh.Vertices) {
+		bounds += v;
+	}
+
+	TVoxelMeshHeader header;
+	FMemory::Memzero(&header, sizeof(header));
+	header.magic = VOXEL_MESH_MAGIC;
+	header.version = VOXEL_MESH_FORMAT_VERSION;
+	header.vertex_num = vertexNum;
+	header.index_num = indexNum;
+
+	if (vertexNum > 0) {
+		for (int axis = 0; axis < 3; axis++) {
+			header.bounds_min[axis] = bounds.Min[axis];
+			header.bounds_scale[axis] = (bounds.Max[axis] - bounds.Min[axis]) / 65535.f;
+		}
+	}
+
+	out.Reset();
+	out.Reserve(sizeof(header) + vertexNum * (6 + 4 + 2) + indexNum * (bWideIndices ? 4 : 2));
+	AppendValue(out, header);
+
+	for (const FVector& v : mesh.Vertices) {
+		for (int axis = 0; axis < 3; axis++) {
+			const float scale = header.bounds_scale[axis];
+			const int q = scale > 0.f ? FMath::RoundToInt((v[axis] - header.bounds_min[axis]) / scale) : 0;
+			AppendValue(out, (uint16)FMath::Clamp(q, 0, 65535));
+		}
+	}
+
+	for (int32 i = 0; i < vertexNum; i++) {
+		int16 n[2];
+		VoxelEncodeNormal(i < mesh.Normals.Num() ? mesh.Normals[i] : FVector(0.0f, 0.0f, 1.0f), n);
+		AppendValue(out, n[0]);
+		AppendValue(out, n[1]);
+	}
+
+	for (int32 i = 0; i < vertexNum; i++) {
+		AppendValue(out, (uint16)(i < mesh.Materials.Num() ? mesh.Materials[i] : 0));
+	}
+
+	for (int32 index : mesh.Triangles) {
+		if (bWideIndices) {
+			AppendValue(out, (uint32)index);
+		} else {
+			AppendValue(out, (uint16)index);
+		}
+	}
+}
+
+bool VoxelReadMeshBinary(const TArray<uint8>& in, TVoxelMeshData& out) {
+	if ((size_t)in.Num() < sizeof(TVoxelMeshHeader)) {
+		return false;
+	}
+
+	TVoxelMeshHeader header;
+	FMemory::Memcpy(&header, in.GetData(), sizeof(header));
+
+	if (header.magic != VOXEL_MESH_MAGIC || header.version != VOXEL_MESH_FORMAT_VERSION || header.index_num % 3 != 0) {
+		return false;
+	}
+
+	const bool bWideIndices = header.vertex_num > 65536;
+	const size_t expected = sizeof(header) + (size_t)header.vertex_num * (6 + 4 + 2) + (size_t)header.index_num * (bWideIndices ? 4 : 2);
+	if ((size_t)in.Num() != expected) {
+		return false;
+	}
+
+	const uint8* src = in.GetData() + sizeof(header);
+	const int32 vertexNum = header.vertex_num;
+
+	out.Vertices.SetNumUninitialized(vertexNum);
+	out.Normals.SetNumUninitialized(vertexNum);
+	out.Materials.SetNumUninitialized(vertexNum);
+	out.Triangles.SetNumUninitialized(header.index_num);
+
+	for (int32 i = 0; i < vertexNum; i++, src += 6) {
+		uint16 q[3];
+		FMemory::Memcpy(q, src, sizeof(q));
+		out.Vertices[i] = FVector(
+			header.bounds_min[0] + q[0] * header.bounds_scale[0],
+			header.bounds_min[1] + q[1] * header.bounds_scale[1],
+			header.bounds_min[2] + q[2] * header.bounds_scale[2]);
+	}
+
+	for (int32 i = 0; i < vertexNum; i++, src += 4) {
+		int16 n[2];
+		FMemory::Memcpy(n, src, sizeof(n));
+		out.Normals[i] = VoxelDecodeNormal(n);
+	}
+
+	FMemory::Memcpy(out.Materials.GetData(), src, vertexNum * sizeof(uint16));
+	src += vertexNum * sizeof(uint16);
+
+	for (int32 i = 0; i < out.Triangles.Num(); i++) {
+		uint32 index;
+
+		if (bWideIndices) {
+			FMemory::Memcpy(&index, src, sizeof(uint32));
+			src += sizeof(uint32);
+		} else {
+			uint16 narrow;
+			FMemory::Memcpy(&narrow, src, sizeof(uint16));
+			src += sizeof(uint16);
+			index = narrow;
+		}
+
+		if (index >= header.vertex_num) {
+			return false;
+		}
+
+		out.Triangles[i] = index;
+	}
+
+	return true;
+}
+
+void VoxelWriteMeshObj(const TVoxelMeshData& mesh, TArray<uint8>& out) {
+	out.Reset();
+	AppendText(out, "# %d vertices, %d triangles\n", mesh.Vertices.Num(), mesh.Triangles.Num() / 3);
+
+	for (const FVector& v : mesh.Vertices) {
+		AppendText(out, "v %.4f %.4f %.4f\n", v.X, v.Y, v.Z);
+	}
+
+	for (const FVector& n : mesh.Normals) {
+		AppendText(out, "vn %.4f %.4f %.4f\n", n.X, n.Y, n.Z);
+	}
+
+	// indices are one based, vertex and normal share them
+	for (int32 i = 0; i + 2 < mesh.Triangles.Num(); i += 3) {
+		const int32 a = mesh.Triangles[i] + 1;
+		const int32 b = mesh.Triangles[i + 1] + 1;
+		const int32 c = mesh.Triangles[i + 2] + 1;
+		AppendText(out, "f %d//%d %d//%d %d//%d\n", a, a, b, b, c, c);
+	}
+}
+
+void VoxelWriteMeshPly(const TVoxelMeshData& mesh, TArray<uint8>& out) {
+	const int32 vertexNum = mesh.Vertices.Num();
+	const int32 triangleNum = mesh.Triangles.Num() / 3;
+
+	out.Reset();
+	AppendText(out, "ply\nformat binary_little_endian 1.0\n");
+	AppendText(out, "element vertex %d\n", vertexNum);
+	AppendText(out, "property float x\nproperty float y\nproperty float z\n");
+	AppendText(out, "property float nx\nproperty float ny\nproperty float nz\n");
+	AppendText(out, "property ushort material\n");
+	AppendText(out, "element face %d\n", triangleNum);
+	AppendText(out, "property list uchar int vertex_indices\nend_header\n");
+
+	out.Reserve(out.Num() + vertexNum * 26 + triangleNum * 13);
+
+	for (int32 i = 0; i < vertexNum; i++) {
+		const FVector& v = mesh.Vertices[i];
+		const FVector n = i < mesh.Normals.Num() ? mesh.Normals[i] : FVector(0.0f, 0.0f, 1.0f);
+
+		AppendValue(out, v.X);
+		AppendValue(out, v.Y);
+		AppendValue(out, v.Z);
+		AppendValue(out, n.X);
+		AppendValue(out, n.Y);
+		AppendValue(out, n.Z);
+		AppendValue(out, (uint16)(i < mesh.Materials.Num() ? mesh.Materials[i] : 0));
+	}
+
+	for (int32 t = 0; t < triangleNum; t++) {
+		AppendValue(out, (uint8)3);
+		AppendValue(out, (int32)mesh.Triangles[t * 3]);
+		AppendValue(out, (int32)mesh.Triangles[t * 3 + 1]);
+		AppendValue(out, (int32)mesh.Triangles[t * 3 + 2]);
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelMesher.h"
+
+//
+// Mesh files for offline baking.
+//
+// The binary form is what the pipeline imports: positions quantized to 16 bits inside the mesh
+// bounds, normals octahedron mapped to two 16 bit values, 16 bit materials and 16 bit indices
+// for meshes of up to 65536 vertices, about a third of the raw arrays. OBJ and PLY are for
+// looking at the result in other tools; PLY keeps the materials, OBJ drops them.
+//
+
+void VoxelWriteMeshBinary(const TVoxelMeshData& mesh, TArray<uint8>& out);
+
+// false on a damaged file or a format version mismatch
+bool VoxelReadMeshBinary(const TArray<uint8>& in, TVoxelMeshData& out);
+
+void VoxelWriteMeshObj(const TVoxelMeshData& mesh, TArray<uint8>& out);
+
+// binary little endian PLY with float positions and normals and a ushort material per vertex
+void VoxelWriteMeshPly(const TVoxelMeshData& mesh, TArray<uint8>& out);
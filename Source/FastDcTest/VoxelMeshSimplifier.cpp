@@ -0,0 +1,717 @@
+#include "VoxelMeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+
+// post transform cache the triangle order is tuned for, typical of current GPUs
+static const int32 VERTEX_CACHE_SIZE = 32;
+
+// a collapse is rejected when a triangle around it would turn further than this (cosine)
+static const float MIN_NORMAL_COS = 0.2f;
+
+
+void TVoxelSimplifySettings::lockVolumeFaces(float volumeSize, int voxelNum, int stride) {
+	const float step = volumeSize / (voxelNum - 1) * stride;
+	const float half = volumeSize / 2 - step;
+	interior = FBox(FVector(-half, -half, -half), FVector(half, half, half));
+}
+
+//====================================================================================
+// Quadrics
+//====================================================================================
+
+void TVoxelMeshSimplifier::TQuadric::reset() {
+	a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = 0;
+}
+
+void TVoxelMeshSimplifier::TQuadric::addPlane(double a, double b, double c, double d) {
+	a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+	b2 += b * b; bc += b * c; bd += b * d;
+	c2 += c * c; cd += c * d;
+	d2 += d * d;
+}
+
+void TVoxelMeshSimplifier::TQuadric::add(const TQuadric& q) {
+	a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+	b2 += q.b2; bc += q.bc; bd += q.bd;
+	c2 += q.c2; cd += q.cd;
+	d2 += q.d2;
+}
+
+double TVoxelMeshSimplifier::TQuadric::evaluate(const FVector& p) const {
+	const double x = p.X;
+	const double y = p.Y;
+	const double z = p.Z;
+
+	return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+		b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+		c2 * z * z + 2 * cd * z + d2;
+}
+
+bool TVoxelMeshSimplifier::TQuadric::optimum(FVector& out) const {
+	// cofactors of the symmetric 3x3 part
+	const double c00 = b2 * c2 - bc * bc;
+	const double c01 = ac * bc - ab * c2;
+	const double c02 = ab * bc - ac * b2;
+	const double c11 = a2 * c2 - ac * ac;
+	const double c12 = ab * ac - a2 * bc;
+	const double c22 = a2 * b2 - ab * ab;
+
+	const double det = a2 * c00 + ab * c01 + ac * c02;
+	const double trace = a2 + b2 + c2;
+
+	// planes that are (nearly) parallel or share a line leave the point free along them
+	if (std::abs(det) <= 1e-6 * trace * trace * trace) {
+		return false;
+	}
+
+	const double inv = -1.0 / det;
+	out.X = (float)((c00 * ad + c01 * bd + c02 * cd) * inv);
+	out.Y = (float)((c01 * ad + c11 * bd + c12 * cd) * inv);
+	out.Z = (float)((c02 * ad + c12 * bd + c22 * cd) * inv);
+	return true;
+}
+
+//====================================================================================
+// Welding and topology
+//====================================================================================
+
+static FORCEINLINE uint64 WeldCellKey(int32 x, int32 y, int32 z) {
+	return ((uint64)(x & 0x1fffff) << 42) | ((uint64)(y & 0x1fffff) << 21) | (uint64)(z & 0x1fffff);
+}
+
+void TVoxelMeshSimplifier::weld(TVoxelMeshData& mesh, const TVoxelSimplifySettings& settings) {
+	const int32 vertexNum = mesh.Vertices.Num();
+	const float invCell = 1.f / settings.weldDistance;
+	const float maxDistSquared = settings.weldDistance * settings.weldDistance;
+
+	remap.resize(vertexNum);
+	weld_next.assign(vertexNum, -1);
+	weld_cells.clear();
+
+	for (int32 i = 0; i < vertexNum; i++) {
+		remap[i] = i;
+
+		const FVector& p = mesh.Vertices[i];
+		if (settings.interior.IsValid && !settings.interior.IsInside(p)) {
+			continue;
+		}
+
+		const int32 cx = FMath::FloorToInt(p.X * invCell);
+		const int32 cy = FMath::FloorToInt(p.Y * invCell);
+		const int32 cz = FMath::FloorToInt(p.Z * invCell);
+
+		int32 found = -1;
+		for (int32 n = 0; n < 27 && found < 0; n++) {
+			const auto it = weld_cells.find(WeldCellKey(cx + n / 9 - 1, cy + (n / 3) % 3 - 1, cz + n % 3 - 1));
+			if (it == weld_cells.end()) {
+				continue;
+			}
+
+			for (int32 r = it->second; r >= 0; r = weld_next[r]) {
+				if (mesh.Materials[r] == mesh.Materials[i] && FVector::DistSquared(mesh.Vertices[r], p) <= maxDistSquared) {
+					found = r;
+					break;
+				}
+			}
+		}
+
+		if (found >= 0) {
+			remap[i] = found;
+			continue;
+		}
+
+		const auto inserted = weld_cells.emplace(WeldCellKey(cx, cy, cz), i);
+		if (!inserted.second) {
+			weld_next[i] = inserted.first->second;
+			inserted.first->second = i;
+		}
+	}
+
+	// welded triangles that lost an edge are dropped
+	int32* indices = mesh.Triangles.GetData();
+	int32 write = 0;
+	for (int32 t = 0; t < mesh.Triangles.Num(); t += 3) {
+		const int32 a = remap[indices[t]];
+		const int32 b = remap[indices[t + 1]];
+		const int32 c = remap[indices[t + 2]];
+
+		if (a != b && b != c && a != c) {
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+	}
+
+	mesh.Triangles.SetNum(write, false);
+}
+
+void TVoxelMeshSimplifier::gatherNeighbours(int32 vertex, std::vector<int32>& out) const {
+	out.clear();
+	for (const int32 t : vertex_triangles[vertex]) {
+		for (int k = 0; k < 3; k++) {
+			const int32 w = triangles[t * 3 + k];
+			if (w != vertex) {
+				out.push_back(w);
+			}
+		}
+	}
+}
+
+void TVoxelMeshSimplifier::buildTopology(const TVoxelMeshData& mesh, const TVoxelSimplifySettings& settings) {
+	const int32 vertexNum = mesh.Vertices.Num();
+	const int32 triangleNum = mesh.Triangles.Num() / 3;
+
+	triangles.assign(mesh.Triangles.GetData(), mesh.Triangles.GetData() + mesh.Triangles.Num());
+	triangle_removed.assign(triangleNum, 0);
+
+	// the inner vectors keep their capacity between runs
+	if ((int32)vertex_triangles.size() < vertexNum) {
+		vertex_triangles.resize(vertexNum);
+	}
+
+	for (int32 v = 0; v < vertexNum; v++) {
+		vertex_triangles[v].clear();
+	}
+
+	vertex_flags.assign(vertexNum, 0);
+	vertex_versions.assign(vertexNum, 0);
+	quadrics.resize(vertexNum);
+	for (TQuadric& q : quadrics) {
+		q.reset();
+	}
+
+	for (int32 t = 0; t < triangleNum; t++) {
+		const int32* tri = &triangles[t * 3];
+		for (int k = 0; k < 3; k++) {
+			vertex_triangles[tri[k]].push_back(t);
+		}
+
+		const FVector& p0 = mesh.Vertices[tri[0]];
+		FVector n = (mesh.Vertices[tri[1]] - p0) ^ (mesh.Vertices[tri[2]] - p0);
+		const float len = n.Size();
+		if (len <= 0) {
+			continue;
+		}
+
+		n /= len;
+		const double d = -(double)(n | p0);
+		for (int k = 0; k < 3; k++) {
+			quadrics[tri[k]].addPlane(n.X, n.Y, n.Z, d);
+		}
+	}
+
+	for (int32 v = 0; v < vertexNum; v++) {
+		if (settings.interior.IsValid && !settings.interior.IsInside(mesh.Vertices[v])) {
+			vertex_flags[v] |= VERTEX_LOCKED;
+			continue;
+		}
+
+		// every triangle adds both of its other vertices, an edge used by exactly two
+		// triangles shows up twice
+		gatherNeighbours(v, neighbours_a);
+		std::sort(neighbours_a.begin(), neighbours_a.end());
+
+		for (size_t i = 0; i < neighbours_a.size();) {
+			size_t j = i;
+			while (j < neighbours_a.size() && neighbours_a[j] == neighbours_a[i]) {
+				j++;
+			}
+
+			if (j - i != 2 || mesh.Materials[neighbours_a[i]] != mesh.Materials[v]) {
+				vertex_flags[v] |= VERTEX_LOCKED;
+				break;
+			}
+
+			i = j;
+		}
+	}
+}
+
+//====================================================================================
+// Edge collapse
+//====================================================================================
+
+bool TVoxelMeshSimplifier::computeCollapse(const TVoxelMeshData& mesh, int32 a, int32 b, TCollapse& out) const {
+	const bool bLockedA = (vertex_flags[a] & VERTEX_LOCKED) != 0;
+	const bool bLockedB = (vertex_flags[b] & VERTEX_LOCKED) != 0;
+
+	if (bLockedA && bLockedB) {
+		return false;
+	}
+
+	TQuadric q = quadrics[a];
+	q.add(quadrics[b]);
+
+	const FVector& pa = mesh.Vertices[a];
+	const FVector& pb = mesh.Vertices[b];
+
+	out.keep = bLockedB ? b : a;
+	out.remove = bLockedB ? a : b;
+
+	if (bLockedA || bLockedB) {
+		out.target = mesh.Vertices[out.keep];
+	} else {
+		const FVector mid = (pa + pb) * 0.5f;
+
+		// an optimum far off the edge comes from nearly parallel planes, not from a feature
+		FVector optimum;
+		if (q.optimum(optimum) && FVector::DistSquared(optimum, mid) <= FVector::DistSquared(pa, pb)) {
+			out.target = optimum;
+		} else {
+			const double ea = q.evaluate(pa);
+			const double eb = q.evaluate(pb);
+			const double em = q.evaluate(mid);
+			out.target = em <= ea && em <= eb ? mid : (ea <= eb ? pa : pb);
+		}
+	}
+
+	out.cost = FMath::Max(q.evaluate(out.target), 0.0);
+	out.keep_version = vertex_versions[out.keep];
+	out.remove_version = vertex_versions[out.remove];
+	return true;
+}
+
+void TVoxelMeshSimplifier::pushCollapses(const TVoxelMeshData& mesh, int32 vertex, double maxCost) {
+	gatherNeighbours(vertex, neighbours_a);
+	std::sort(neighbours_a.begin(), neighbours_a.end());
+	neighbours_a.erase(std::unique(neighbours_a.begin(), neighbours_a.end()), neighbours_a.end());
+
+	for (const int32 w : neighbours_a) {
+		TCollapse c;
+		if (computeCollapse(mesh, vertex, w, c) && c.cost <= maxCost) {
+			heap.push_back(c);
+			std::push_heap(heap.begin(), heap.end());
+		}
+	}
+}
+
+bool TVoxelMeshSimplifier::canCollapse(const TVoxelMeshData& mesh, const TCollapse& collapse) {
+	const int32 u = collapse.remove;
+	const int32 v = collapse.keep;
+
+	// link condition: the two vertices may only share the apexes of the two triangles on
+	// their edge, anything else would pinch the surface
+	gatherNeighbours(u, neighbours_a);
+	gatherNeighbours(v, neighbours_b);
+	std::sort(neighbours_a.begin(), neighbours_a.end());
+	std::sort(neighbours_b.begin(), neighbours_b.end());
+	neighbours_a.erase(std::unique(neighbours_a.begin(), neighbours_a.end()), neighbours_a.end());
+	neighbours_b.erase(std::unique(neighbours_b.begin(), neighbours_b.end()), neighbours_b.end());
+
+	// a tetrahedron would fold into two back to back triangles
+	if (neighbours_a.size() <= 3 && neighbours_b.size() <= 3) {
+		return false;
+	}
+
+	int32 common = 0;
+	for (size_t i = 0, j = 0; i < neighbours_a.size() && j < neighbours_b.size();) {
+		if (neighbours_a[i] < neighbours_b[j]) {
+			i++;
+		} else if (neighbours_a[i] > neighbours_b[j]) {
+			j++;
+		} else {
+			common++;
+			i++;
+			j++;
+		}
+	}
+
+	int32 shared = 0;
+	for (const int32 t : vertex_triangles[u]) {
+		const int32* tri = &triangles[t * 3];
+		shared += tri[0] == v || tri[1] == v || tri[2] == v;
+	}
+
+	if (shared != 2 || common != 2) {
+		return false;
+	}
+
+	// no remaining triangle may flip or collapse to a sliver
+	for (const int32 moved : { u, v }) {
+		for (const int32 t : vertex_triangles[moved]) {
+			const int32* tri = &triangles[t * 3];
+			const int32 other = moved == u ? v : u;
+			if (tri[0] == other || tri[1] == other || tri[2] == other) {
+				continue;
+			}
+
+			FVector p[3];
+			for (int k = 0; k < 3; k++) {
+				p[k] = mesh.Vertices[tri[k]];
+			}
+
+			const FVector before = (p[1] - p[0]) ^ (p[2] - p[0]);
+			for (int k = 0; k < 3; k++) {
+				if (tri[k] == moved) {
+					p[k] = collapse.target;
+				}
+			}
+
+			const FVector after = (p[1] - p[0]) ^ (p[2] - p[0]);
+			const float lenSquared = before.SizeSquared() * after.SizeSquared();
+			if (lenSquared <= 0 || (before | after) < MIN_NORMAL_COS * FMath::Sqrt(lenSquared)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static FORCEINLINE void EraseTriangle(std::vector<int32>& list, int32 t) {
+	for (size_t i = 0; i < list.size(); i++) {
+		if (list[i] == t) {
+			list[i] = list.back();
+			list.pop_back();
+			return;
+		}
+	}
+}
+
+int32 TVoxelMeshSimplifier::collapse(TVoxelMeshData& mesh, const TCollapse& collapse) {
+	const int32 u = collapse.remove;
+	const int32 v = collapse.keep;
+
+	int32 removed = 0;
+	for (const int32 t : vertex_triangles[u]) {
+		int32* tri = &triangles[t * 3];
+
+		if (tri[0] == v || tri[1] == v || tri[2] == v) {
+			triangle_removed[t] = 1;
+			removed++;
+
+			for (int k = 0; k < 3; k++) {
+				if (tri[k] != u) {
+					EraseTriangle(vertex_triangles[tri[k]], t);
+				}
+			}
+		} else {
+			for (int k = 0; k < 3; k++) {
+				if (tri[k] == u) {
+					tri[k] = v;
+				}
+			}
+
+			vertex_triangles[v].push_back(t);
+		}
+	}
+
+	vertex_triangles[u].clear();
+	vertex_flags[u] |= VERTEX_REMOVED;
+
+	mesh.Vertices[v] = collapse.target;
+	mesh.Normals[v] = (mesh.Normals[u] + mesh.Normals[v]).GetSafeNormal();
+
+	quadrics[v].add(quadrics[u]);
+	vertex_versions[v]++;
+
+	return removed;
+}
+
+//====================================================================================
+// Vertex cache order
+//====================================================================================
+
+// Forsyth's linear speed vertex cache optimisation: greedily emits the triangle whose vertices
+// are the most recently used and have the fewest triangles left
+static float VertexCacheScore(int32 cachePosition, int32 remaining) {
+	if (remaining == 0) {
+		return -1.f;
+	}
+
+	float score = 0;
+	if (cachePosition >= 0) {
+		// the triangle just emitted is scored lower so that strips do not double back
+		score = cachePosition < 3 ? 0.75f : std::pow(1.f - (float)(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+	}
+
+	// boost vertices with few triangles left so that they get finished and leave the cache
+	return score + 2.f / FMath::Sqrt((float)remaining);
+}
+
+void TVoxelMeshSimplifier::optimizeVertexCache(std::vector<int32>& indices, int32 vertexNum) {
+	const int32 triangleNum = (int32)indices.size() / 3;
+	if (triangleNum == 0) {
+		return;
+	}
+
+	cache_remaining.assign(vertexNum, 0);
+	for (const int32 i : indices) {
+		cache_remaining[i]++;
+	}
+
+	cache_offsets.resize(vertexNum + 1);
+	cache_offsets[0] = 0;
+	for (int32 v = 0; v < vertexNum; v++) {
+		cache_offsets[v + 1] = cache_offsets[v] + cache_remaining[v];
+	}
+
+	// triangles of a vertex, the first cache_remaining of them not yet emitted
+	cache_position.assign(vertexNum, 0);
+	cache_vertex_triangles.resize(indices.size());
+	for (int32 t = 0; t < triangleNum; t++) {
+		for (int k = 0; k < 3; k++) {
+			const int32 v = indices[t * 3 + k];
+			cache_vertex_triangles[cache_offsets[v] + cache_position[v]++] = t;
+		}
+	}
+
+	cache_position.assign(vertexNum, -1);
+	cache_vertex_score.resize(vertexNum);
+	for (int32 v = 0; v < vertexNum; v++) {
+		cache_vertex_score[v] = VertexCacheScore(-1, cache_remaining[v]);
+	}
+
+	int32 best = 0;
+	cache_triangle_score.resize(triangleNum);
+	for (int32 t = 0; t < triangleNum; t++) {
+		cache_triangle_score[t] = cache_vertex_score[indices[t * 3]] + cache_vertex_score[indices[t * 3 + 1]] + cache_vertex_score[indices[t * 3 + 2]];
+		if (cache_triangle_score[t] > cache_triangle_score[best]) {
+			best = t;
+		}
+	}
+
+	cache_emitted.assign(triangleNum, 0);
+	cache_output.clear();
+	cache_output.reserve(indices.size());
+
+	int32 cache[VERTEX_CACHE_SIZE + 3];
+	int32 cacheNum = 0;
+	int32 scan = 0;
+
+	for (int32 emitted = 0; emitted < triangleNum; emitted++) {
+		// nothing in the cache has triangles left, continue with the next one in input order
+		if (best < 0) {
+			while (cache_emitted[scan]) {
+				scan++;
+			}
+
+			best = scan;
+		}
+
+		const int32* tri = &indices[best * 3];
+		cache_emitted[best] = 1;
+
+		for (int k = 0; k < 3; k++) {
+			const int32 v = tri[k];
+			cache_output.push_back(v);
+
+			int32* list = &cache_vertex_triangles[cache_offsets[v]];
+			for (int32 i = 0; i < cache_remaining[v]; i++) {
+				if (list[i] == best) {
+					list[i] = list[cache_remaining[v] - 1];
+					list[cache_remaining[v] - 1] = best;
+					break;
+				}
+			}
+
+			cache_remaining[v]--;
+		}
+
+		// the emitted triangle moves to the front, everything past the cache size drops out
+		int32 next[VERTEX_CACHE_SIZE + 3];
+		int32 nextNum = 0;
+		for (int k = 0; k < 3; k++) {
+			next[nextNum++] = tri[k];
+		}
+
+		for (int32 i = 0; i < cacheNum; i++) {
+			const int32 v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				next[nextNum++] = v;
+			}
+		}
+
+		for (int32 i = 0; i < nextNum; i++) {
+			const int32 v = next[i];
+			cache_position[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+			cache_vertex_score[v] = VertexCacheScore(cache_position[v], cache_remaining[v]);
+		}
+
+		best = -1;
+		float bestScore = -1.f;
+		for (int32 i = 0; i < nextNum; i++) {
+			const int32 v = next[i];
+			const int32* list = &cache_vertex_triangles[cache_offsets[v]];
+
+			for (int32 j = 0; j < cache_remaining[v]; j++) {
+				const int32 t = list[j];
+				const int32* other = &indices[t * 3];
+
+				const float score = cache_vertex_score[other[0]] + cache_vertex_score[other[1]] + cache_vertex_score[other[2]];
+				cache_triangle_score[t] = score;
+
+				if (score > bestScore) {
+					best = t;
+					bestScore = score;
+				}
+			}
+		}
+
+		cacheNum = FMath::Min(nextNum, VERTEX_CACHE_SIZE);
+		for (int32 i = 0; i < cacheNum; i++) {
+			cache[i] = next[i];
+		}
+	}
+
+	indices.swap(cache_output);
+}
+
+//====================================================================================
+// Output
+//====================================================================================
+
+void TVoxelMeshSimplifier::writeMesh(TVoxelMeshData& mesh, bool bOptimizeVertexCache) {
+	const int32 vertexNum = mesh.Vertices.Num();
+
+	int32 write = 0;
+	for (size_t t = 0; t < triangle_removed.size(); t++) {
+		if (!triangle_removed[t]) {
+			triangles[write++] = triangles[t * 3];
+			triangles[write++] = triangles[t * 3 + 1];
+			triangles[write++] = triangles[t * 3 + 2];
+		}
+	}
+
+	triangles.resize(write);
+
+	if (bOptimizeVertexCache) {
+		optimizeVertexCache(triangles, vertexNum);
+	}
+
+	// vertices in order of first use, unused ones are dropped
+	remap.assign(vertexNum, -1);
+	int32 used = 0;
+	for (int32& i : triangles) {
+		if (remap[i] < 0) {
+			remap[i] = used++;
+		}
+
+		i = remap[i];
+	}
+
+	out_vertices.resize(used);
+	out_normals.resize(used);
+	out_materials.resize(used);
+	for (int32 v = 0; v < vertexNum; v++) {
+		if (remap[v] >= 0) {
+			out_vertices[remap[v]] = mesh.Vertices[v];
+			out_normals[remap[v]] = mesh.Normals[v];
+			out_materials[remap[v]] = mesh.Materials[v];
+		}
+	}
+
+	mesh.Vertices.SetNum(used, false);
+	mesh.Normals.SetNum(used, false);
+	mesh.Materials.SetNum(used, false);
+	mesh.Triangles.SetNum(write, false);
+
+	if (used > 0) {
+		FMemory::Memcpy(mesh.Vertices.GetData(), out_vertices.data(), used * sizeof(FVector));
+		FMemory::Memcpy(mesh.Normals.GetData(), out_normals.data(), used * sizeof(FVector));
+		FMemory::Memcpy(mesh.Materials.GetData(), out_materials.data(), used * sizeof(uint16));
+	}
+
+	if (write > 0) {
+		FMemory::Memcpy(mesh.Triangles.GetData(), triangles.data(), write * sizeof(int32));
+	}
+}
+
+void TVoxelMeshSimplifier::simplify(TVoxelMeshData& mesh, const TVoxelSimplifySettings& settings) {
+	// meshes from elsewhere may come without materials
+	if (mesh.Materials.Num() != mesh.Vertices.Num()) {
+		mesh.Materials.SetNumZeroed(mesh.Vertices.Num());
+	}
+
+	if (settings.weldDistance > 0) {
+		weld(mesh, settings);
+	}
+
+	buildTopology(mesh, settings);
+
+	const double maxCost = (double)settings.maxError * settings.maxError;
+	int32 triangleNum = mesh.Triangles.Num() / 3;
+
+	heap.clear();
+	for (int32 t = 0; t < triangleNum; t++) {
+		const int32* tri = &triangles[t * 3];
+
+		// on a consistently wound surface every edge appears once in each direction
+		for (int k = 0; k < 3; k++) {
+			const int32 a = tri[k];
+			const int32 b = tri[(k + 1) % 3];
+
+			TCollapse c;
+			if (a < b && computeCollapse(mesh, a, b, c) && c.cost <= maxCost) {
+				heap.push_back(c);
+			}
+		}
+	}
+
+	std::make_heap(heap.begin(), heap.end());
+
+	while (!heap.empty() && (settings.maxTriangles <= 0 || triangleNum > settings.maxTriangles)) {
+		std::pop_heap(heap.begin(), heap.end());
+		const TCollapse c = heap.back();
+		heap.pop_back();
+
+		// entries of moved or removed vertices are stale, their current collapses were pushed again
+		if ((vertex_flags[c.keep] | vertex_flags[c.remove]) & VERTEX_REMOVED) {
+			continue;
+		}
+
+		if (vertex_versions[c.keep] != c.keep_version || vertex_versions[c.remove] != c.remove_version) {
+			continue;
+		}
+
+		if (!canCollapse(mesh, c)) {
+			continue;
+		}
+
+		triangleNum -= collapse(mesh, c);
+		pushCollapses(mesh, c.keep, maxCost);
+	}
+
+	writeMesh(mesh, settings.bOptimizeVertexCache);
+}
+
+template <typename T>
+static size_t VectorSize(const std::vector<T>& v) {
+	return v.capacity() * sizeof(T);
+}
+
+size_t TVoxelMeshSimplifier::getAllocatedSize() const {
+	size_t size = VectorSize(remap) + VectorSize(weld_next) + VectorSize(triangles) + VectorSize(triangle_removed) +
+		VectorSize(vertex_triangles) + VectorSize(vertex_flags) + VectorSize(vertex_versions) + VectorSize(quadrics) +
+		VectorSize(heap) + VectorSize(neighbours_a) + VectorSize(neighbours_b) +
+		VectorSize(cache_offsets) + VectorSize(cache_vertex_triangles) + VectorSize(cache_remaining) + VectorSize(cache_position) +
+		VectorSize(cache_vertex_score) + VectorSize(cache_triangle_score) + VectorSize(cache_emitted) + VectorSize(cache_output) +
+		VectorSize(out_vertices) + VectorSize(out_normals) + VectorSize(out_materials);
+
+	for (const std::vector<int32>& list : vertex_triangles) {
+		size += VectorSize(list);
+	}
+
+	// buckets plus one node per entry
+	size += weld_cells.bucket_count() * sizeof(void*) + weld_cells.size() * (sizeof(std::pair<uint64, int32>) + sizeof(void*));
+	return size;
+}
+
+
+void VoxelSimplifyMesh(TVoxelMeshingContext& context, const TVoxelSimplifySettings& settings) {
+	if (!context.simplifier) {
+		context.simplifier.reset(new TVoxelMeshSimplifier());
+	}
+
+	const int32 inputTriangles = context.mesh.Triangles.Num() / 3;
+	context.simplifier->simplify(context.mesh, settings);
+
+	context.simplifyStats.runs++;
+	context.simplifyStats.inputTriangles += inputTriangles;
+	context.simplifyStats.outputTriangles += context.mesh.Triangles.Num() / 3;
+
+	// collapsed vertices moved and took a new normal
+	if (context.surface.isEnabled()) {
+		VoxelGenerateSurfaceAttributes(context.mesh, context.surface);
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelMesher.h"
+#include <unordered_map>
+#include <vector>
+
+
+struct TVoxelSimplifySettings {
+	// collapses stop once the mesh is down to this many triangles, 0 simplifies as far as maxError allows
+	int32 maxTriangles = 0;
+
+	// no vertex moves further than this from the planes of the triangles it replaces, in local units
+	float maxError = 1.f;
+
+	// vertices of the same material closer than this are merged first, 0 disables welding
+	float weldDistance = 0.f;
+
+	// when valid, vertices outside this box are neither moved nor removed so that the mesh
+	// still matches the unsimplified meshes of neighbouring chunks
+	FBox interior = FBox(ForceInit);
+
+	// reorder triangles for the post transform cache and vertices for fetch locality
+	bool bOptimizeVertexCache = true;
+
+	// interior of a volume meshed at stride, one cell layer inside each of its faces
+	void lockVolumeFaces(float volumeSize, int voxelNum, int stride);
+};
+
+//
+// Post-process of a dual contouring mesh: welding, quadric error edge collapse and vertex cache
+// ordering, on the calling thread.
+//
+// Vertices on open or non-manifold edges, on material boundaries and outside the interior box are
+// locked; a collapse may end on them but never moves them, so material borders and chunk seams are
+// kept exactly. Collapses that would flip a triangle or pinch the surface are skipped, a watertight
+// input stays watertight.
+//
+// Like the meshing context it lives in, the scratch memory is kept between runs.
+//
+class TVoxelMeshSimplifier {
+
+private:
+	struct TQuadric {
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		void reset();
+		void addPlane(double a, double b, double c, double d);
+		void add(const TQuadric& q);
+		double evaluate(const FVector& p) const;
+
+		// minimizer of the error, false when the planes do not pin down a point
+		bool optimum(FVector& out) const;
+	};
+
+	struct TCollapse {
+		double cost;
+		int32 keep;
+		int32 remove;
+		uint32 keep_version;
+		uint32 remove_version;
+		FVector target;
+
+		bool operator<(const TCollapse& other) const { return cost > other.cost; }
+	};
+
+	enum : uint8 {
+		VERTEX_LOCKED = 1,
+		VERTEX_REMOVED = 2
+	};
+
+	std::vector<int32> remap;
+	std::unordered_map<uint64, int32> weld_cells;
+	std::vector<int32> weld_next;
+
+	std::vector<int32> triangles;
+	std::vector<uint8> triangle_removed;
+
+	std::vector<std::vector<int32>> vertex_triangles;
+	std::vector<uint8> vertex_flags;
+	std::vector<uint32> vertex_versions;
+	std::vector<TQuadric> quadrics;
+
+	std::vector<TCollapse> heap;
+	std::vector<int32> neighbours_a;
+	std::vector<int32> neighbours_b;
+
+	// vertex cache optimization
+	std::vector<int32> cache_offsets;
+	std::vector<int32> cache_vertex_triangles;
+	std::vector<int32> cache_remaining;
+	std::vector<int32> cache_position;
+	std::vector<float> cache_vertex_score;
+	std::vector<float> cache_triangle_score;
+	std::vector<uint8> cache_emitted;
+	std::vector<int32> cache_output;
+
+	std::vector<FVector> out_vertices;
+	std::vector<FVector> out_normals;
+	std::vector<uint16> out_materials;
+
+	void weld(TVoxelMeshData& mesh, const TVoxelSimplifySettings& settings);
+	void buildTopology(const TVoxelMeshData& mesh, const TVoxelSimplifySettings& settings);
+
+	void gatherNeighbours(int32 vertex, std::vector<int32>& out) const;
+	bool computeCollapse(const TVoxelMeshData& mesh, int32 a, int32 b, TCollapse& out) const;
+	void pushCollapses(const TVoxelMeshData& mesh, int32 vertex, double maxCost);
+	bool canCollapse(const TVoxelMeshData& mesh, const TCollapse& collapse);
+	int32 collapse(TVoxelMeshData& mesh, const TCollapse& collapse);
+
+	void optimizeVertexCache(std::vector<int32>& indices, int32 vertexNum);
+	void writeMesh(TVoxelMeshData& mesh, bool bOptimizeVertexCache);
+
+public:
+	void simplify(TVoxelMeshData& mesh, const TVoxelSimplifySettings& settings);
+
+	size_t getAllocatedSize() const;
+};
+
+// simplifies context.mesh in place through the context's simplifier
+void VoxelSimplifyMesh(TVoxelMeshingContext& context, const TVoxelSimplifySettings& settings);
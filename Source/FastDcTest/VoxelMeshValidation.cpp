@@ -0,0 +1,544 @@
+#include "VoxelMeshValidation.h"
+
+#if !UE_BUILD_SHIPPING
+
+#include "VoxelData.h"
+#include "VoxelSnapshot.h"
+#include "VoxelGenerator.h"
+#include "VoxelMeshSimplifier.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/Crc.h"
+#include "Misc/Parse.h"
+#include <algorithm>
+#include <array>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// three quantized positions, rotated so that the smallest comes first
+typedef std::array<int32, 9> TTriangleKey;
+
+static void QuantizeTriangles(const TVoxelMeshData& mesh, float quantum, std::vector<TTriangleKey>& out) {
+	const float scale = 1.f / quantum;
+	const int32 vertexNum = mesh.Vertices.Num();
+
+	out.clear();
+	out.reserve(mesh.Triangles.Num() / 3);
+
+	for (int32 t = 0; t + 2 < mesh.Triangles.Num(); t += 3) {
+		std::array<int32, 3> v[3];
+		bool bValid = true;
+
+		for (int i = 0; i < 3; i++) {
+			const int32 index = mesh.Triangles[t + i];
+			if (index < 0 || index >= vertexNum) {
+				bValid = false;
+				break;
+			}
+
+			const FVector& p = mesh.Vertices[index];
+			v[i] = { FMath::RoundToInt(p.X * scale), FMath::RoundToInt(p.Y * scale), FMath::RoundToInt(p.Z * scale) };
+		}
+
+		// VoxelCheckMesh reports these
+		if (!bValid) {
+			continue;
+		}
+
+		// rotating keeps the winding
+		int first = 0;
+		for (int i = 1; i < 3; i++) {
+			if (v[i] < v[first]) {
+				first = i;
+			}
+		}
+
+		TTriangleKey key;
+		for (int i = 0; i < 3; i++) {
+			for (int c = 0; c < 3; c++) {
+				key[i * 3 + c] = v[(first + i) % 3][c];
+			}
+		}
+
+		out.push_back(key);
+	}
+
+	std::sort(out.begin(), out.end());
+}
+
+TVoxelMeshCheck VoxelCheckMesh(const TVoxelMeshData& mesh) {
+	TVoxelMeshCheck result;
+
+	for (const FVector& v : mesh.Vertices) {
+		if (v.ContainsNaN()) {
+			result.invalidVertices++;
+		}
+	}
+
+	if (mesh.Triangles.Num() % 3 != 0) {
+		result.invalidIndices++;
+	}
+
+	const int32 vertexNum = mesh.Vertices.Num();
+	std::unordered_map<uint64, int32> directed;
+
+	auto edgeKey = [](int32 a, int32 b) {
+		return ((uint64)(uint32)a << 32) | (uint32)b;
+	};
+
+	for (int32 t = 0; t + 2 < mesh.Triangles.Num(); t += 3) {
+		const int32 a = mesh.Triangles[t];
+		const int32 b = mesh.Triangles[t + 1];
+		const int32 c = mesh.Triangles[t + 2];
+
+		if (a < 0 || b < 0 || c < 0 || a >= vertexNum || b >= vertexNum || c >= vertexNum) {
+			result.invalidIndices++;
+			continue;
+		}
+
+		if (a == b || b == c || a == c) {
+			result.degenerateTriangles++;
+			continue;
+		}
+
+		directed[edgeKey(a, b)]++;
+		directed[edgeKey(b, c)]++;
+		directed[edgeKey(c, a)]++;
+	}
+
+	for (const auto& edge : directed) {
+		const int32 a = (int32)(edge.first >> 32);
+		const int32 b = (int32)(edge.first & 0xffffffff);
+
+		const auto reverse = directed.find(edgeKey(b, a));
+		const int32 reverseCount = reverse != directed.end() ? reverse->second : 0;
+
+		// a closed surface walks every edge once in each direction
+		if (edge.second != reverseCount) {
+			result.openEdges++;
+		}
+
+		// count every undirected edge once
+		if (a < b || reverseCount == 0) {
+			if (edge.second + reverseCount > 2) {
+				result.nonManifoldEdges++;
+			}
+		}
+	}
+
+	return result;
+}
+
+uint32 VoxelHashMesh(const TVoxelMeshData& mesh, float quantum) {
+	std::vector<TTriangleKey> keys;
+	QuantizeTriangles(mesh, quantum, keys);
+
+	return FCrc::MemCrc32(keys.data(), keys.size() * sizeof(TTriangleKey), mesh.Vertices.Num());
+}
+
+bool VoxelMeshEquals(const TVoxelMeshData& a, const TVoxelMeshData& b, float quantum) {
+	if (a.Vertices.Num() != b.Vertices.Num() || a.Triangles.Num() != b.Triangles.Num()) {
+		return false;
+	}
+
+	std::vector<TTriangleKey> keysA;
+	std::vector<TTriangleKey> keysB;
+	QuantizeTriangles(a, quantum, keysA);
+	QuantizeTriangles(b, quantum, keysB);
+
+	return keysA == keysB;
+}
+
+//====================================================================================
+// Suite
+//====================================================================================
+
+// different code paths have to agree to the last bit, this only absorbs the quantization
+static const float EQUIVALENCE_QUANTUM = 0.001f;
+
+class TVoxelMeshValidator {
+
+private:
+	TMap<FString, uint32> goldens;
+	bool bRecord;
+	bool bGoldensChanged = false;
+
+	int32 failures = 0;
+	int32 checks = 0;
+
+	TVoxelMeshingContext* context;
+	TVoxelMeshingContext* other;
+
+	void fail(const FString& message) {
+		UE_LOG(LogTemp, Error, TEXT("ValidateMesher: %s"), *message);
+		failures++;
+	}
+
+	void expect(bool bCondition, const FString& message) {
+		checks++;
+		if (!bCondition) {
+			fail(message);
+		}
+	}
+
+	void checkTopology(const FString& name, const TVoxelMeshData& mesh, bool bManifold) {
+		const TVoxelMeshCheck result = VoxelCheckMesh(mesh);
+
+		expect(result.invalidIndices == 0 && result.invalidVertices == 0, FString::Printf(TEXT("%s: %d invalid indices, %d invalid vertices"),
+			*name, result.invalidIndices, result.invalidVertices));
+		expect(result.degenerateTriangles == 0, FString::Printf(TEXT("%s: %d degenerate triangles"), *name, result.degenerateTriangles));
+		expect(result.openEdges == 0, FString::Printf(TEXT("%s: %d open edges"), *name, result.openEdges));
+
+		if (bManifold) {
+			expect(result.nonManifoldEdges == 0, FString::Printf(TEXT("%s: %d non-manifold edges"), *name, result.nonManifoldEdges));
+		}
+	}
+
+	void checkGolden(const FString& name, const TVoxelMeshData& mesh) {
+		const uint32 hash = VoxelHashMesh(mesh);
+
+		if (bRecord) {
+			goldens.Add(name, hash);
+			bGoldensChanged = true;
+			return;
+		}
+
+		const uint32* golden = goldens.Find(name);
+		expect(golden != nullptr, FString::Printf(TEXT("%s: no golden hash, run with 'record' to add it"), *name));
+		if (golden == nullptr) {
+			return;
+		}
+
+		expect(*golden == hash, FString::Printf(TEXT("%s: mesh hash %08x, golden %08x"), *name, hash, *golden));
+	}
+
+	// the optimized kernels and the snapshot reader against the generic kernel on the live data
+	void checkPaths(const FString& name, const TVoxelData& data, int stride, bool bManifold) {
+		PolygonizeVolumeReference(&data, *context, stride);
+		checkTopology(name, context->mesh, bManifold);
+
+		PolygonizeVolume(&data, *other, stride);
+		expect(VoxelMeshEquals(context->mesh, other->mesh, EQUIVALENCE_QUANTUM), FString::Printf(TEXT("%s: specialized kernel differs from reference"), *name));
+
+		const std::shared_ptr<const TVoxelSnapshot> snapshot = TVoxelSnapshot::capture(data, nullptr);
+		PolygonizeVolume(snapshot.get(), *other, stride);
+		expect(VoxelMeshEquals(context->mesh, other->mesh, EQUIVALENCE_QUANTUM), FString::Printf(TEXT("%s: snapshot mesh differs from reference"), *name));
+
+		PolygonizeVolumeSweep(&data, *other, stride);
+		expect(VoxelMeshEquals(context->mesh, other->mesh, EQUIVALENCE_QUANTUM), FString::Printf(TEXT("%s: sweep mesh differs from reference"), *name));
+	}
+
+	// serial, parallel and one sample at a time generation must give identical densities
+	void checkGenerator(const FString& name, const TVoxelGenerator& generator, const TVoxelData& data, bool bBruteForce) {
+		const int n = data.num();
+
+		TVoxelData parallel(n, data.size());
+		VoxelGenerate(parallel, FVector::ZeroVector, generator, true);
+
+		int32 mismatches = 0;
+		const float step = data.size() / (n - 1);
+
+		for (int x = 0; x < n; x++) {
+			for (int y = 0; y < n; y++) {
+				for (int z = 0; z < n; z++) {
+					const float d = data.getDensity(x, y, z);
+					mismatches += d != parallel.getDensity(x, y, z);
+
+					if (bBruteForce) {
+						unsigned char raw;
+						generator.generateRow(data.voxelIndexToVector(x, y, z), step, 1, &raw);
+						mismatches += d != raw / 255.0f;
+					}
+				}
+			}
+		}
+
+		expect(mismatches == 0, FString::Printf(TEXT("%s: %d generated densities differ between paths"), *name, mismatches));
+	}
+
+	void checkScene(const FString& name, int num, float size, TVoxelSdfPtr sdf, bool bManifold, int maxStride = 2) {
+		const TVoxelSdfGenerator generator(sdf);
+
+		TVoxelData data(num, size);
+		VoxelGenerate(data, FVector::ZeroVector, generator);
+		checkGenerator(name, generator, data, num <= 64);
+
+		for (int stride = 1; stride <= maxStride; stride *= 2) {
+			const FString pass = FString::Printf(TEXT("%s_s%d"), *name, stride);
+			checkPaths(pass, data, stride, bManifold);
+			checkGolden(pass, context->mesh);
+
+			// simplification keeps a closed surface closed
+			TVoxelSimplifySettings settings;
+			settings.maxError = size / (num - 1) * stride;
+			settings.weldDistance = settings.maxError * 0.01f;
+			settings.lockVolumeFaces(size, num, stride);
+			VoxelSimplifyMesh(*other, settings);
+			checkTopology(pass + TEXT("_simplified"), other->mesh, bManifold);
+
+			expect(stride > 1 || context->mesh.Triangles.Num() > 0, FString::Printf(TEXT("%s: empty mesh"), *pass));
+		}
+	}
+
+	// open volumes of a 2x2x2 grid at random strides, joined by their seams, have to close a
+	// surface that lies inside the grid; vertices are merged by exact position
+	void checkSeams(const FString& name, int num, float size, TVoxelSdfPtr sdf, FRandomStream& stream, bool bManifold) {
+		const TVoxelSdfGenerator generator(sdf);
+
+		std::unique_ptr<TVoxelData> volumes[2][2][2];
+		TVoxelMeshBoundary boundaries[2][2][2];
+		FVector origins[2][2][2];
+		FString strides;
+
+		TVoxelMeshData merged;
+		std::map<std::array<float, 3>, int32> welded;
+
+		auto append = [&](const TVoxelMeshData& mesh, const FVector& offset) {
+			for (int32 index : mesh.Triangles) {
+				const FVector v = mesh.Vertices[index] + offset;
+				const auto it = welded.emplace(std::array<float, 3>{ { v.X, v.Y, v.Z } }, merged.Vertices.Num());
+				if (it.second) {
+					merged.Vertices.Add(v);
+				}
+
+				merged.Triangles.Add(it.first->second);
+			}
+		};
+
+		for (int i = 0; i < 8; i++) {
+			const int dx = i >> 2, dy = (i >> 1) & 1, dz = i & 1;
+			const int stride = (num - 1) % 4 == 0 ? 1 << stream.RandRange(0, 2) : 1;
+			strides += FString::Printf(TEXT("%d"), stride);
+
+			origins[dx][dy][dz] = FVector(dx - 0.5f, dy - 0.5f, dz - 0.5f) * size;
+			volumes[dx][dy][dz].reset(new TVoxelData(num, size));
+			VoxelGenerate(*volumes[dx][dy][dz], origins[dx][dy][dz], generator);
+
+			// every other volume swept, the seams have to weld to its boundary all the same
+			if (i & 1) {
+				PolygonizeVolumeSweep(volumes[dx][dy][dz].get(), *context, stride, &boundaries[dx][dy][dz]);
+			} else {
+				PolygonizeVolume(volumes[dx][dy][dz].get(), *context, stride, &boundaries[dx][dy][dz]);
+			}
+
+			append(context->mesh, origins[dx][dy][dz]);
+
+			// the open path of the specialized kernels against the generic one
+			TVoxelMeshBoundary reference;
+			PolygonizeVolumeReference(volumes[dx][dy][dz].get(), *other, stride, &reference);
+			expect(VoxelMeshEquals(context->mesh, other->mesh, EQUIVALENCE_QUANTUM) && reference.Vertices.Num() == boundaries[dx][dy][dz].Vertices.Num(),
+				FString::Printf(TEXT("%s: open %s differs from reference"), *name, (i & 1) ? TEXT("sweep") : TEXT("specialized kernel")));
+		}
+
+		for (int i = 0; i < 8; i++) {
+			const int dx = i >> 2, dy = (i >> 1) & 1, dz = i & 1;
+
+			TVoxelSeamNeighbourhood neighbours;
+			for (int j = 0; j < 8; j++) {
+				const int ex = dx + (j >> 2), ey = dy + ((j >> 1) & 1), ez = dz + (j & 1);
+				const bool bInside = ex < 2 && ey < 2 && ez < 2;
+
+				neighbours.boundaries[j >> 2][(j >> 1) & 1][j & 1] = bInside ? &boundaries[ex][ey][ez] : nullptr;
+				neighbours.origins[j >> 2][(j >> 1) & 1][j & 1] = FVector(ex - 0.5f, ey - 0.5f, ez - 0.5f) * size;
+			}
+
+			VoxelBuildSeam(volumes[dx][dy][dz].get(), neighbours, *context);
+			append(context->mesh, FVector::ZeroVector);
+		}
+
+		checkTopology(FString::Printf(TEXT("%s (strides %s)"), *name, *strides), merged, bManifold);
+	}
+
+	TVoxelSdfPtr randomScene(FRandomStream& stream) {
+		auto shape = [&stream]() {
+			const FVector center(stream.FRandRange(-150.f, 150.f), stream.FRandRange(-150.f, 150.f), stream.FRandRange(-150.f, 150.f));
+			const float extent = stream.FRandRange(30.f, 120.f);
+
+			return stream.RandRange(0, 1) == 0 ? VoxelSdfSphere(center, extent) : VoxelSdfBox(center, FVector(extent, extent * 0.7f, extent * 0.5f));
+		};
+
+		TVoxelSdfPtr sdf = shape();
+		const int32 count = stream.RandRange(2, 6);
+
+		for (int32 i = 0; i < count; i++) {
+			switch (stream.RandRange(0, 2)) {
+			case 0:
+				sdf = VoxelSdfUnion(sdf, shape());
+				break;
+			case 1:
+				sdf = VoxelSdfSubtract(sdf, shape());
+				break;
+			default:
+				sdf = VoxelSdfSmoothUnion(sdf, shape(), 40.f);
+				break;
+			}
+		}
+
+		return sdf;
+	}
+
+	void fuzz(FRandomStream& stream, int32 iteration) {
+		const int num = stream.FRand() < 0.25f ? 32 : stream.RandRange(2, 40);
+		const int stride = stream.RandRange(1, 4);
+		const int pattern = stream.RandRange(0, 4);
+
+		TVoxelData data(num, 10.f * num);
+
+		for (int x = 0; x < num; x++) {
+			for (int y = 0; y < num; y++) {
+				for (int z = 0; z < num; z++) {
+					switch (pattern) {
+					case 0:
+						data.setVoxelPointDensity(x, y, z, (unsigned char)stream.RandRange(0, 255));
+						break;
+					case 1:
+						// sparse solid specks
+						data.setVoxelPointDensity(x, y, z, stream.FRand() < 0.1f ? 255 : 0);
+						break;
+					case 2:
+						// every sample right at the isolevel
+						data.setVoxelPointDensity(x, y, z, stream.RandRange(0, 1) ? 128 : 127);
+						break;
+					case 3:
+						// solid from the low faces, reaching the volume boundary
+						data.setVoxelPointDensity(x, y, z, x + y + z < num ? 255 : 0);
+						break;
+					default:
+						break;
+					}
+				}
+			}
+		}
+
+		if (pattern == 4) {
+			data.deinitializeDensity(stream.RandRange(0, 1) ? TVoxelDataFillState::ALL : TVoxelDataFillState::ZERO);
+		}
+
+		// samples outside the volume read as empty instead of out of range memory
+		for (int i = 0; i < 16; i++) {
+			const int x = stream.RandRange(-2, num + 1);
+			const int y = stream.RandRange(-2, num + 1);
+			const int z = stream.RandRange(-2, num + 1);
+
+			if (!data.isInside(x, y, z)) {
+				checks++;
+				if (data.getDensity(x, y, z) != 0) {
+					fail(FString::Printf(TEXT("fuzz %d: density outside the volume at %d %d %d"), iteration, x, y, z));
+				}
+			}
+		}
+
+		const FString name = FString::Printf(TEXT("fuzz %d (num %d, stride %d, pattern %d)"), iteration, num, stride, pattern);
+		checkPaths(name, data, stride, false);
+	}
+
+public:
+	TVoxelMeshValidator(bool bRecord) : bRecord(bRecord) {
+		context = TVoxelMeshingContextPool::get().acquire();
+		other = TVoxelMeshingContextPool::get().acquire();
+	}
+
+	~TVoxelMeshValidator() {
+		TVoxelMeshingContextPool::get().release(context);
+		TVoxelMeshingContextPool::get().release(other);
+	}
+
+	void loadGoldens(const FString& file) {
+		TArray<FString> lines;
+		FFileHelper::LoadFileToStringArray(lines, *file);
+
+		for (const FString& line : lines) {
+			FString key;
+			FString value;
+			if (line.Split(TEXT(" "), &key, &value)) {
+				goldens.Add(key, FParse::HexNumber(*value));
+			}
+		}
+	}
+
+	void saveGoldens(const FString& file) {
+		if (!bGoldensChanged) {
+			return;
+		}
+
+		TArray<FString> lines;
+		for (const auto& golden : goldens) {
+			lines.Add(FString::Printf(TEXT("%s %08x"), *golden.Key, golden.Value));
+		}
+
+		lines.Sort();
+		FFileHelper::SaveStringArrayToFile(lines, *file);
+	}
+
+	int32 run(int32 fuzzIterations) {
+		checkScene(TEXT("box"), 64, 500, VoxelSdfBox(FVector::ZeroVector, FVector(120, 90, 60)), true);
+		checkScene(TEXT("sphere"), 64, 500, VoxelSdfSphere(FVector(10, -20, 5), 180), true);
+
+		// everything solid, only the closing faces of the volume remain
+		checkScene(TEXT("solid"), 32, 500, VoxelSdfBox(FVector::ZeroVector, FVector(1000, 1000, 1000)), true);
+
+		// same as AFastDualContouringActor::BeginPlay
+		checkScene(TEXT("beginplay"), 256, 500, VoxelSdfUnion(
+			VoxelSdfBox(FVector::ZeroVector, FVector(100, 100, 100)),
+			VoxelSdfSphere(FVector(100, 100, 100), 100.f)), true);
+
+		checkScene(TEXT("terrain"), 64, 1000, VoxelSdfTerrain(0.f, 300.f, TVoxelFbmSettings()), false);
+
+		// streamed chunks share their border samples and mesh at the strides of their LODs
+		checkScene(TEXT("chunk_sphere"), 65, 500, VoxelSdfSphere(FVector(10, -20, 5), 180), true, 4);
+		checkScene(TEXT("chunk_terrain"), 33, 1000, VoxelSdfTerrain(0.f, 300.f, TVoxelFbmSettings()), false, 4);
+
+		FRandomStream stream(20181003);
+		for (int i = 0; i < 4; i++) {
+			checkScene(FString::Printf(TEXT("random%d"), i), 64, 500, randomScene(stream), false);
+		}
+
+		for (int i = 0; i < 4; i++) {
+			checkSeams(FString::Printf(TEXT("seams_sphere%d"), i), 32, 250, VoxelSdfSphere(FVector(10, -20, 5), 180), stream, true);
+			checkSeams(FString::Printf(TEXT("seams_random%d"), i), 33, 400, randomScene(stream), stream, false);
+		}
+
+		for (int32 i = 0; i < fuzzIterations; i++) {
+			fuzz(stream, i);
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("ValidateMesher: %d checks, %d failures"), checks, failures);
+		return failures;
+	}
+};
+
+int32 VoxelValidateMesher(const FString& goldenFile, bool bRecord, int32 fuzzIterations) {
+	TVoxelMeshValidator validator(bRecord);
+	validator.loadGoldens(goldenFile);
+
+	const int32 failures = validator.run(fuzzIterations);
+
+	validator.saveGoldens(goldenFile);
+	return failures;
+}
+
+static void ValidateMesherCommand(const TArray<FString>& Args) {
+	bool bRecord = false;
+	int32 FuzzIterations = 200;
+
+	for (const FString& Arg : Args) {
+		if (Arg == TEXT("record")) {
+			bRecord = true;
+		} else if (Arg.StartsWith(TEXT("fuzz="))) {
+			FuzzIterations = FCString::Atoi(*Arg.Mid(5));
+		}
+	}
+
+	VoxelValidateMesher(FPaths::Combine(FPaths::ProjectDir(), TEXT("Test"), TEXT("VoxelMeshGolden.txt")), bRecord, FuzzIterations);
+}
+
+static FAutoConsoleCommand ValidateMesherCmd(
+	TEXT("fastdc.ValidateMesher"),
+	TEXT("Checks golden meshes, topology and optimized against reference meshing paths. Arguments: [record] [fuzz=N]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&ValidateMesherCommand));
+
+#endif
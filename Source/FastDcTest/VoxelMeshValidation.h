@@ -0,0 +1,39 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelMesher.h"
+
+#if !UE_BUILD_SHIPPING
+
+//
+// Development checks for the contouring pipeline, run headless through the console command
+// fastdc.ValidateMesher [record] [fuzz=N]. Golden hashes are checked in as Test/VoxelMeshGolden.txt
+// and a scene without one fails. They depend on the QEF solver's float results: when a change to
+// the mesher or the compiler moves them, run with 'record' and commit the file with the change.
+//
+
+struct TVoxelMeshCheck {
+	int32 invalidIndices = 0;
+	int32 invalidVertices = 0;
+	int32 degenerateTriangles = 0;
+
+	// directed edges whose reverse is used a different number of times
+	int32 openEdges = 0;
+
+	// edges shared by more than two triangles
+	int32 nonManifoldEdges = 0;
+
+	bool isWatertight() const { return invalidIndices == 0 && invalidVertices == 0 && degenerateTriangles == 0 && openEdges == 0; }
+	bool isManifold() const { return isWatertight() && nonManifoldEdges == 0; }
+};
+
+TVoxelMeshCheck VoxelCheckMesh(const TVoxelMeshData& mesh);
+
+// independent of vertex and triangle order, positions are compared on a grid of quantum
+uint32 VoxelHashMesh(const TVoxelMeshData& mesh, float quantum = 0.01f);
+bool VoxelMeshEquals(const TVoxelMeshData& a, const TVoxelMeshData& b, float quantum = 0.01f);
+
+// runs the whole suite and logs every failure, returns the number of failures
+int32 VoxelValidateMesher(const FString& goldenFile, bool bRecord, int32 fuzzIterations);
+
+#endif
@@ -0,0 +1,1622 @@
+#include "VoxelMesher.h"
+#include "VoxelMeshSimplifier.h"
+#include "Misc/ScopeLock.h"
+#include "HAL/IConsoleManager.h"
+#include "qef_simd.h"
+#include "VoxelIndex.h"
+#include "VoxelData.h"
+#include "VoxelSnapshot.h"
+#include <emmintrin.h>
+
+
+// Read once per build. Lockstep peers must agree on it, set it in DefaultEngine.ini rather than per machine.
+static TAutoConsoleVariable<int32> CVarQefMode(
+	TEXT("fastdc.QefMode"),
+	0,
+	TEXT("Vertex placement solver.\n")
+	TEXT(" 0: float, approximate reciprocal square root (fastest)\n")
+	TEXT(" 1: float, correctly rounded operations only, identical results on every SSE2 machine"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSweepMesher(
+	TEXT("fastdc.SweepMesher"),
+	0,
+	TEXT("Mesh volumes in one sweep along x that keeps a few slices of crossings and vertices instead of\n")
+	TEXT("hash maps over the whole surface. Same mesh in another order. Volumes too large for the hash map\n")
+	TEXT("ids are always swept."),
+	ECVF_Default);
+
+// raw density above this is solid, the same split as the 0.5 test on normalized densities
+static const unsigned char RAW_ISOLEVEL = 127;
+
+static const TVoxelIndex4 AXIS_OFFSET[3] = {
+	TVoxelIndex4(1, 0, 0, 0),
+	TVoxelIndex4(0, 1, 0, 0),
+	TVoxelIndex4(0, 0, 1, 0)
+};
+
+static const TVoxelIndex4 EDGE_NODE_OFFSETS[3][4] = {
+	{ TVoxelIndex4(0), TVoxelIndex4(0, 0, 1, 0), TVoxelIndex4(0, 1, 0, 0), TVoxelIndex4(0, 1, 1, 0) },
+	{ TVoxelIndex4(0), TVoxelIndex4(1, 0, 0, 0), TVoxelIndex4(0, 0, 1, 0), TVoxelIndex4(1, 0, 1, 0) },
+	{ TVoxelIndex4(0), TVoxelIndex4(0, 1, 0, 0), TVoxelIndex4(1, 0, 0, 0), TVoxelIndex4(1, 1, 0, 0) },
+};
+
+// the 12 edges of a cell relative to its node: axis, dx, dy, dz
+static const int CELL_EDGES[12][4] = {
+	{ 0, 0, 0, 0 }, { 0, 0, 0, 1 }, { 0, 0, 1, 0 }, { 0, 0, 1, 1 },
+	{ 1, 0, 0, 0 }, { 1, 0, 0, 1 }, { 1, 1, 0, 0 }, { 1, 1, 0, 1 },
+	{ 2, 0, 0, 0 }, { 2, 0, 1, 0 }, { 2, 1, 0, 0 }, { 2, 1, 1, 0 },
+};
+
+template <typename TKernel>
+static void InitEncodedOffsets(TKernel& kernel) {
+	for (int i = 0; i < 12; i++) {
+		kernel.edge_offsets[i] = kernel.encodeEdge(CELL_EDGES[i][0], CELL_EDGES[i][1], CELL_EDGES[i][2], CELL_EDGES[i][3]);
+	}
+
+	for (int axis = 0; axis < 3; axis++) {
+		for (int i = 0; i < 4; i++) {
+			const TVoxelIndex4& o = EDGE_NODE_OFFSETS[axis][i];
+			kernel.node_offsets[axis * 4 + i] = kernel.encodeVoxel(o.X, o.Y, o.Z);
+		}
+	}
+}
+
+static constexpr int CeilLog2(int v) {
+	return v <= 1 ? 0 : 1 + CeilLog2((v + 1) >> 1);
+}
+
+//
+// Index math of a meshing pass over a volume of Num voxels per axis, sampling every
+// 2^LogStride-th voxel. Num is a power of two for standalone volumes and one more for chunks
+// that share their border samples. Cells are addressed in sample units; ids pack each cell
+// coordinate into just enough bits for cells + 2 (the cell below the volume and the far
+// neighbour) and the edge axis above them.
+// Everything except the offset tables resolves to constant shifts, masks and multiplies.
+//
+template <int Num, int LogStride>
+class TVoxelMeshKernel {
+
+public:
+	static const int CELLS = (Num - 1) / (1 << LogStride) + 1;
+	static const int BITS = CeilLog2(CELLS + 2);
+	static const int AXIS_SHIFT = BITS * 3;
+	static const int BRICKS = (Num + VOXEL_BRICK_SIZE - 1) >> VOXEL_BRICK_SHIFT;
+
+	uint32 edge_offsets[12];
+	uint32 node_offsets[12];
+
+	explicit TVoxelMeshKernel(int num) {
+		check(num == Num);
+		InitEncodedOffsets(*this);
+	}
+
+	FORCEINLINE int cellNum() const { return CELLS; }
+	FORCEINLINE int stride() const { return 1 << LogStride; }
+
+	FORCEINLINE int toVoxel(int cell) const { return cell * (1 << LogStride); }
+	FORCEINLINE bool isInside(int v) const { return (unsigned)v < (unsigned)Num; }
+
+	FORCEINLINE int linearIndex(int x, int y, int z) const {
+		return (x * Num + y) * Num + z;
+	}
+
+	FORCEINLINE int brickIndex(int x, int y, int z) const {
+		return ((x >> VOXEL_BRICK_SHIFT) * BRICKS + (y >> VOXEL_BRICK_SHIFT)) * BRICKS + (z >> VOXEL_BRICK_SHIFT);
+	}
+
+	FORCEINLINE uint32 encodeVoxel(int x, int y, int z) const {
+		return x | (y << BITS) | (z << (BITS * 2));
+	}
+
+	FORCEINLINE uint32 encodeEdge(int axis, int x, int y, int z) const {
+		return encodeVoxel(x, y, z) | (axis << AXIS_SHIFT);
+	}
+
+	FORCEINLINE int edgeAxis(uint32 edge) const { return edge >> AXIS_SHIFT; }
+	FORCEINLINE uint32 edgeNode(uint32 edge) const { return edge & ((1u << AXIS_SHIFT) - 1); }
+};
+
+// Fallback for sizes and strides without a specialization, same interface with runtime values.
+class TVoxelMeshKernelGeneric {
+
+private:
+	int voxel_num;
+	int sample_stride;
+	int cell_num;
+	int brick_num;
+
+public:
+	static const int BITS = 10;
+	static const int AXIS_SHIFT = 30;
+
+	uint32 edge_offsets[12];
+	uint32 node_offsets[12];
+
+	TVoxelMeshKernelGeneric(int num, int stride) :
+		voxel_num(num), sample_stride(stride), cell_num((num - 1) / stride + 1), brick_num((num + VOXEL_BRICK_SIZE - 1) >> VOXEL_BRICK_SHIFT) {
+		InitEncodedOffsets(*this);
+	}
+
+	FORCEINLINE int cellNum() const { return cell_num; }
+	FORCEINLINE int stride() const { return sample_stride; }
+
+	FORCEINLINE int toVoxel(int cell) const { return cell * sample_stride; }
+	FORCEINLINE bool isInside(int v) const { return (unsigned)v < (unsigned)voxel_num; }
+
+	FORCEINLINE int linearIndex(int x, int y, int z) const {
+		return (x * voxel_num + y) * voxel_num + z;
+	}
+
+	FORCEINLINE int brickIndex(int x, int y, int z) const {
+		return ((x >> VOXEL_BRICK_SHIFT) * brick_num + (y >> VOXEL_BRICK_SHIFT)) * brick_num + (z >> VOXEL_BRICK_SHIFT);
+	}
+
+	FORCEINLINE uint32 encodeVoxel(int x, int y, int z) const {
+		return x | (y << BITS) | (z << (BITS * 2));
+	}
+
+	FORCEINLINE uint32 encodeEdge(int axis, int x, int y, int z) const {
+		return encodeVoxel(x, y, z) | (axis << AXIS_SHIFT);
+	}
+
+	FORCEINLINE int edgeAxis(uint32 edge) const { return edge >> AXIS_SHIFT; }
+	FORCEINLINE uint32 edgeNode(uint32 edge) const { return edge & ((1u << AXIS_SHIFT) - 1); }
+};
+
+// density readers, one per volume type, addressed through the kernel index math
+
+class TVoxelDataReader {
+
+private:
+	const unsigned char* density;
+	float fill;
+
+public:
+	explicit TVoxelDataReader(const TVoxelData* data) :
+		density(data->getDensityData()), fill(data->getDensityFillState() == TVoxelDataFillState::ALL ? 1.f : 0.f) { }
+
+	template <typename TKernel>
+	FORCEINLINE float read(const TKernel& kernel, int x, int y, int z) const {
+		if (density == NULL) {
+			return fill;
+		}
+
+		return (float)density[kernel.linearIndex(x, y, z)] / 255.0f;
+	}
+};
+
+class TVoxelSnapshotReader {
+
+private:
+	const TVoxelSnapshot* snapshot;
+
+public:
+	explicit TVoxelSnapshotReader(const TVoxelSnapshot* data) : snapshot(data) { }
+
+	template <typename TKernel>
+	FORCEINLINE float read(const TKernel& kernel, int x, int y, int z) const {
+		const int mask = VOXEL_BRICK_SIZE - 1;
+		const int local = ((((x & mask) << VOXEL_BRICK_SHIFT) | (y & mask)) << VOXEL_BRICK_SHIFT) | (z & mask);
+		return (float)snapshot->getBrickDensity(kernel.brickIndex(x, y, z), local) / 255.0f;
+	}
+};
+
+static TVoxelDataReader MakeReader(const TVoxelData* data) { return TVoxelDataReader(data); }
+static TVoxelSnapshotReader MakeReader(const TVoxelSnapshot* data) { return TVoxelSnapshotReader(data); }
+
+//
+// Materials at the solid ends of crossings, for either volume type. A brick is decoded into the
+// context the first time one of its samples is read, a brick of a single material only notes
+// it. Scans run along x, so the buffers of the bricks they have left behind go to the bricks
+// ahead of them.
+//
+template <typename TVolume>
+class TVoxelMaterialReader {
+
+private:
+	const TVolume* volume;
+	TVoxelMeshingContext& context;
+	int brick_num;
+	int released = 0;
+
+	int32 decode(int index) {
+		unsigned short material;
+		if (volume->isBrickMaterialUniform(index, material)) {
+			return -2 - (int32)material;
+		}
+
+		const int32 first = context.allocateBrickMaterials();
+		volume->decodeBrickMaterial(index, &context.brickMaterials[first]);
+		return first;
+	}
+
+public:
+	TVoxelMaterialReader(const TVolume* volume, TVoxelMeshingContext& context) :
+		volume(volume), context(context), brick_num(volume->brickNum()) {
+		context.resetBrickMaterials(brick_num * brick_num * brick_num);
+	}
+
+	FORCEINLINE unsigned short read(int x, int y, int z) {
+		const int index = ((x >> VOXEL_BRICK_SHIFT) * brick_num + (y >> VOXEL_BRICK_SHIFT)) * brick_num + (z >> VOXEL_BRICK_SHIFT);
+		int32& slot = context.brickMaterialSlots[index];
+		if (slot == -1) {
+			slot = decode(index);
+		}
+
+		if (slot < 0) {
+			return (unsigned short)(-2 - slot);
+		}
+
+		const int mask = VOXEL_BRICK_SIZE - 1;
+		return context.brickMaterials[slot + (((((x & mask) << VOXEL_BRICK_SHIFT) | (y & mask)) << VOXEL_BRICK_SHIFT) | (z & mask))];
+	}
+
+	// no sample below x is read any more
+	void releaseBelow(int x) {
+		const int bx = FMath::Min(x >> VOXEL_BRICK_SHIFT, brick_num);
+		for (; released < bx; released++) {
+			context.releaseBrickMaterials(released * brick_num * brick_num, (released + 1) * brick_num * brick_num);
+		}
+	}
+};
+
+// density at a cell corner, everything outside the volume reads as air
+template <typename TKernel, typename TReader>
+FORCEINLINE float Density(const TKernel& kernel, const TReader& reader, const TVoxelIndex4& cell) {
+	const int x = kernel.toVoxel(cell.X);
+	const int y = kernel.toVoxel(cell.Y);
+	const int z = kernel.toVoxel(cell.Z);
+
+	if (!kernel.isInside(x) || !kernel.isInside(y) || !kernel.isInside(z)) {
+		return 0;
+	}
+
+	return reader.read(kernel, x, y, z);
+}
+
+// where the isolevel crosses from p1 (0) to p2 (1), the same cases as vertexInterpolation
+FORCEINLINE float EdgeFraction(float valp1, float valp2) {
+	static const float isolevel = 0.5f;
+
+	if (std::abs(isolevel - valp1) < 0.00001) {
+		return 0.f;
+	}
+
+	if (std::abs(isolevel - valp2) < 0.00001) {
+		return 1.f;
+	}
+
+	if (std::abs(valp1 - valp2) < 0.00001) {
+		return 0.f;
+	}
+
+	return (isolevel - valp1) / (valp2 - valp1);
+}
+
+static FVector vertexInterpolation(FVector p1, FVector p2, float valp1, float valp2) {
+	static const float isolevel = 0.5f;
+
+	if (std::abs(isolevel - valp1) < 0.00001) {
+		return p1;
+	}
+
+	if (std::abs(isolevel - valp2) < 0.00001) {
+		return p2;
+	}
+
+	if (std::abs(valp1 - valp2) < 0.00001) {
+		return p1;
+	}
+
+	if (valp1 == valp2) {
+		return p1;
+	}
+
+	float mu = (isolevel - valp1) / (valp2 - valp1);
+	return p1 + (p2 - p1) *mu;
+}
+
+// density at a cell corner clamped into the volume, one-sided differences on the faces of an open volume
+template <typename TKernel, typename TReader>
+FORCEINLINE float ClampedDensity(const TKernel& kernel, const TReader& reader, const TVoxelIndex4& cell, int lastNode) {
+	return Density(kernel, reader, TVoxelIndex4(FMath::Clamp(cell.X, 0, lastNode), FMath::Clamp(cell.Y, 0, lastNode), FMath::Clamp(cell.Z, 0, lastNode), 0));
+}
+
+//
+// Node range and pyramid blocks of one meshing pass, shared by the hash map passes and the sweep.
+//
+// A closed scan starts one cell below the volume so that surfaces touching its low faces get
+// closed the same way as on the high faces. An open scan stays on the samples, cells outside
+// them are left to the seams.
+//
+// Nodes are scanned in blocks one finest pyramid block wide. A block whose samples, the far ends
+// of its edges included, lie on one side of the isolevel has no crossing; next to air outside a
+// closed volume only an all-air block can be passed over.
+//
+template <typename TVolume, typename TKernel>
+class TVoxelNodeScan {
+
+private:
+	const TKernel& kernel;
+	const TVoxelDensityPyramid& pyramid;
+	int last_sample;
+	int block_nodes;
+
+public:
+	bool bOpen;
+	int lastNode;
+	int first;
+	int last;
+
+	TVoxelNodeScan(const TVolume* voxelData, const TKernel& kernel, bool bOpen) :
+		kernel(kernel), pyramid(voxelData->getDensityPyramid()), last_sample(voxelData->num() - 1),
+		block_nodes(FMath::Max(1, (1 << VOXEL_PYRAMID_SHIFT) / kernel.stride())), bOpen(bOpen) {
+		lastNode = last_sample / kernel.stride();
+		first = bOpen ? 0 : -1;
+		last = bOpen ? lastNode : kernel.cellNum() - 1;
+	}
+
+	// the closed scan's node -1 is a block of its own so that the others line up with the pyramid
+	FORCEINLINE int blockStart(int node) const { return node < 0 ? -1 : node - node % block_nodes; }
+	FORCEINLINE int blockEnd(int b) const { return b < 0 ? -1 : FMath::Min(b + block_nodes - 1, last); }
+	FORCEINLINE int nextBlock(int b) const { return b < 0 ? 0 : b + block_nodes; }
+
+	bool mayCross(int bx, int by, int bz) const {
+		const int lo[3] = { kernel.toVoxel(bx), kernel.toVoxel(by), kernel.toVoxel(bz) };
+		const int hi[3] = { kernel.toVoxel(blockEnd(bx) + 1), kernel.toVoxel(blockEnd(by) + 1), kernel.toVoxel(blockEnd(bz) + 1) };
+
+		unsigned char mn, mx;
+		pyramid.getRange(FMath::Max(lo[0], 0), FMath::Max(lo[1], 0), FMath::Max(lo[2], 0),
+			FMath::Min(hi[0], last_sample), FMath::Min(hi[1], last_sample), FMath::Min(hi[2], last_sample), mn, mx);
+
+		if (mx <= RAW_ISOLEVEL) {
+			return false;
+		}
+
+		const bool bInside = bOpen || (lo[0] >= 0 && lo[1] >= 0 && lo[2] >= 0 && hi[0] <= last_sample && hi[1] <= last_sample && hi[2] <= last_sample);
+		return !(bInside && mn > RAW_ISOLEVEL);
+	}
+
+	// the crossing on the edge from node p along axis, false where there is none
+	template <typename TReader>
+	FORCEINLINE bool crossing(TVoxelMaterialReader<TVolume>& materials, const TReader& reader, const TVoxelIndex4& p, int axis, EdgeInfo& info) const {
+		const TVoxelIndex4 q = p + AXIS_OFFSET[axis];
+
+		if (bOpen && (q.X > lastNode || q.Y > lastNode || q.Z > lastNode)) {
+			return false;
+		}
+
+		const float pDensity = Density(kernel, reader, p);
+		const float qDensity = Density(kernel, reader, q);
+
+		const bool zeroCrossing = (pDensity >= 0.5f && qDensity < 0.5f) || (pDensity < 0.5f && qDensity >= 0.5f);
+
+		if (!zeroCrossing) {
+			return false;
+		}
+
+		FVector4 tmp;
+		if (bOpen) {
+			tmp = FVector4(
+				ClampedDensity(kernel, reader, p + TVoxelIndex4(1, 0, 0, 0), lastNode) - ClampedDensity(kernel, reader, p - TVoxelIndex4(1, 0, 0, 0), lastNode),
+				ClampedDensity(kernel, reader, p + TVoxelIndex4(0, 1, 0, 0), lastNode) - ClampedDensity(kernel, reader, p - TVoxelIndex4(0, 1, 0, 0), lastNode),
+				ClampedDensity(kernel, reader, p + TVoxelIndex4(0, 0, 1, 0), lastNode) - ClampedDensity(kernel, reader, p - TVoxelIndex4(0, 0, 1, 0), lastNode),
+				0.f);
+		} else {
+			tmp = FVector4(
+				Density(kernel, reader, p + TVoxelIndex4(1, 0, 0, 0)) - Density(kernel, reader, p - TVoxelIndex4(1, 0, 0, 0)),
+				Density(kernel, reader, p + TVoxelIndex4(0, 1, 0, 0)) - Density(kernel, reader, p - TVoxelIndex4(0, 1, 0, 0)),
+				Density(kernel, reader, p + TVoxelIndex4(0, 0, 1, 0)) - Density(kernel, reader, p - TVoxelIndex4(0, 0, 1, 0)),
+				0.f);
+		}
+
+		const FVector4 normal = -tmp.GetSafeNormal(0.000001f);
+
+		info.setCrossing(EdgeFraction(pDensity, qDensity), pDensity >= 0.5f);
+		VoxelEncodeNormal(FVector(normal.X, normal.Y, normal.Z), info.normal);
+
+		// the solid end is always inside the volume
+		const TVoxelIndex4& solid = info.winding() ? p : q;
+		info.material = materials.read(kernel.toVoxel(solid.X), kernel.toVoxel(solid.Y), kernel.toVoxel(solid.Z));
+		return true;
+	}
+
+	// calls func(cell) for the cells around the edge from node p along axis that get a vertex
+	template <typename TFunc>
+	FORCEINLINE void forEachEdgeCell(const TVoxelIndex4& p, int axis, TFunc&& func) const {
+		const auto edgeNodes = EDGE_NODE_OFFSETS[axis];
+		for (int i = 0; i < 4; i++) {
+			const auto nodeIdxPos = p - edgeNodes[i];
+
+			// nodes outside the scanned range can never close a quad
+			if (nodeIdxPos.X < first || nodeIdxPos.Y < first || nodeIdxPos.Z < first) {
+				continue;
+			}
+
+			if (bOpen && (nodeIdxPos.X >= lastNode || nodeIdxPos.Y >= lastNode || nodeIdxPos.Z >= lastNode)) {
+				continue;
+			}
+
+			func(nodeIdxPos);
+		}
+	}
+};
+
+template <typename TVolume, typename TKernel>
+void FindActiveVoxels(const TVolume* voxelData, const TKernel& kernel, TVoxelMeshingContext& context, bool bOpen) {
+	const auto reader = MakeReader(voxelData);
+	TVoxelMaterialReader<TVolume> materials(voxelData, context);
+	const TVoxelNodeScan<TVolume, TKernel> scan(voxelData, kernel, bOpen);
+
+	// ids are biased by one to keep the cell below the volume unsigned
+	for (int bx = scan.first; bx <= scan.last; bx = scan.nextBlock(bx)) {
+		materials.releaseBelow(kernel.toVoxel(FMath::Max(bx, 0)));
+
+		for (int by = scan.first; by <= scan.last; by = scan.nextBlock(by)) {
+			for (int bz = scan.first; bz <= scan.last; bz = scan.nextBlock(bz)) {
+				if (!scan.mayCross(bx, by, bz)) {
+					continue;
+				}
+
+				for (int x = bx; x <= scan.blockEnd(bx); x++) {
+					for (int y = by; y <= scan.blockEnd(by); y++) {
+						for (int z = bz; z <= scan.blockEnd(bz); z++) {
+							const TVoxelIndex4 p(x, y, z, 0);
+
+							for (int axis = 0; axis < 3; axis++) {
+								EdgeInfo crossing;
+								if (!scan.crossing(materials, reader, p, axis, crossing)) {
+									continue;
+								}
+
+								bool bIsNew;
+								context.activeEdges.add(kernel.encodeEdge(axis, x + 1, y + 1, z + 1), bIsNew) = crossing;
+
+								scan.forEachEdgeCell(p, axis, [&](const TVoxelIndex4& cell) {
+									context.activeVoxels.add(kernel.encodeVoxel(cell.X + 1, cell.Y + 1, cell.Z + 1), bIsNew);
+								});
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+// Vertex of a cell from the crossings on its edges, null where an edge has none; (cx, cy, cz) is
+// the low corner of the cell and step its size. Returns the index of the vertex in mesh.
+static int32 PlaceVertex(const EdgeInfo* const edges[12], float cx, float cy, float cz, float step, int32 qefMode, TVoxelMeshData& mesh) {
+	FVector4 p[12];
+	FVector4 n[12];
+	unsigned short m[12];
+
+	int idx = 0;
+	for (int i = 0; i < 12; i++) {
+		const EdgeInfo* info = edges[i];
+
+		if (info != nullptr) {
+			const int* edge = CELL_EDGES[i];
+			FVector4 pos(cx + edge[1] * step, cy + edge[2] * step, cz + edge[3] * step, 1.f);
+			pos[edge[0]] += info->fraction() * step;
+
+			p[idx] = pos;
+			n[idx] = FVector4(VoxelDecodeNormal(info->normal), 0.f);
+			m[idx] = info->material;
+			idx++;
+		}
+	}
+
+	// majority vote, ties go to the first edge
+	unsigned short material = m[0];
+	int materialVotes = 0;
+	for (int i = 0; i < idx; i++) {
+		int votes = 0;
+		for (int j = 0; j < idx; j++) {
+			votes += m[j] == m[i];
+		}
+
+		if (votes > materialVotes) {
+			material = m[i];
+			materialVotes = votes;
+		}
+	}
+
+	FVector4 nodePos;
+	qef_solve_from_points_4d(&p[0].X, &n[0].X, idx, &nodePos.X, SVD_NUM_SWEEPS, qefMode != 0);
+
+	FVector4 nodeNormal;
+	for (int i = 0; i < idx; i++) {
+		nodeNormal += n[i];
+	}
+
+	nodeNormal *= (1.f / (float)idx);
+
+	mesh.Vertices.Add(FVector(nodePos.X, nodePos.Y, nodePos.Z));
+	mesh.Normals.Add(FVector(nodeNormal.X, nodeNormal.Y, nodeNormal.Z));
+	return mesh.Materials.Add(material);
+}
+
+// s and step map cell coordinates to the volume's space like voxelIndexToVector
+template <typename TKernel>
+static void GenerateVertexData(const TKernel& kernel, TVoxelMeshingContext& context, int32 qefMode, float s, float step) {
+	const TVoxelHashMap<EdgeInfo>& edges = context.activeEdges;
+	const uint32 mask = (1u << TKernel::BITS) - 1;
+
+	context.activeVoxels.forEach([&](uint32 voxelID, int32& vertexIndex) {
+		const EdgeInfo* cellEdges[12];
+		for (int i = 0; i < 12; i++) {
+			cellEdges[i] = edges.find(voxelID + kernel.edge_offsets[i]);
+		}
+
+		// low corner of the cell, ids are biased by one
+		const float cx = s + ((int)(voxelID & mask) - 1) * step;
+		const float cy = s + ((int)((voxelID >> TKernel::BITS) & mask) - 1) * step;
+		const float cz = s + ((int)((voxelID >> (TKernel::BITS * 2)) & mask) - 1) * step;
+
+		vertexIndex = PlaceVertex(cellEdges, cx, cy, cz, step, qefMode, context.mesh);
+	});
+
+	if (context.surface.isEnabled()) {
+		VoxelGenerateSurfaceAttributes(context.mesh, context.surface);
+	}
+}
+
+static FORCEINLINE __m128 SelectPs(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+void VoxelGenerateSurfaceAttributes(TVoxelMeshData& Mesh, const TVoxelSurfaceSettings& Settings, int32 FirstVertex) {
+	const int32 vertexNum = Mesh.Vertices.Num();
+	Mesh.UVs.SetNumUninitialized(vertexNum, false);
+	Mesh.Colors.SetNumUninitialized(vertexNum, false);
+	Mesh.Tangents.SetNumUninitialized(vertexNum, false);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 signBit = _mm_set1_ps(-0.f);
+	const __m128 scale = _mm_set1_ps(Settings.uvScale);
+
+	for (int32 i = FirstVertex; i < vertexNum; i += 4) {
+		// the last batch repeats its final vertex
+		alignas(16) float px[4], py[4], pz[4], nx[4], ny[4], nz[4];
+		for (int k = 0; k < 4; k++) {
+			const int32 v = FMath::Min(i + k, vertexNum - 1);
+			const FVector p = Mesh.Vertices[v] + Settings.uvOrigin;
+			const FVector& n = Mesh.Normals[v];
+
+			px[k] = p.X;
+			py[k] = p.Y;
+			pz[k] = p.Z;
+			nx[k] = n.X;
+			ny[k] = n.Y;
+			nz[k] = n.Z;
+		}
+
+		__m128 NX = _mm_load_ps(nx);
+		__m128 NY = _mm_load_ps(ny);
+		__m128 NZ = _mm_load_ps(nz);
+		const __m128 PX = _mm_load_ps(px);
+		const __m128 PY = _mm_load_ps(py);
+		const __m128 PZ = _mm_load_ps(pz);
+
+		// vertex normals are means of crossing normals, zero ones point up
+		const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(NX, NX), _mm_mul_ps(NY, NY)), _mm_mul_ps(NZ, NZ));
+		const __m128 degenerate = _mm_cmplt_ps(len2, _mm_set1_ps(1e-12f));
+		const __m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(len2, _mm_set1_ps(1e-12f))));
+		NX = _mm_andnot_ps(degenerate, _mm_mul_ps(NX, invLen));
+		NY = _mm_andnot_ps(degenerate, _mm_mul_ps(NY, invLen));
+		NZ = SelectPs(degenerate, one, _mm_mul_ps(NZ, invLen));
+
+		const __m128 AX = _mm_andnot_ps(signBit, NX);
+		const __m128 AY = _mm_andnot_ps(signBit, NY);
+		const __m128 AZ = _mm_andnot_ps(signBit, NZ);
+
+		// the largest component is at least 1 / sqrt(3), the sum never gets near zero
+		__m128 WX = _mm_mul_ps(AX, AX);
+		__m128 WY = _mm_mul_ps(AY, AY);
+		__m128 WZ = _mm_mul_ps(AZ, AZ);
+		WX = _mm_mul_ps(WX, WX);
+		WY = _mm_mul_ps(WY, WY);
+		WZ = _mm_mul_ps(WZ, WZ);
+		const __m128 invW = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(WX, WY), WZ));
+
+		// dominant axis, ties go to z and then to x
+		const __m128 domZ = _mm_and_ps(_mm_cmpge_ps(AZ, AX), _mm_cmpge_ps(AZ, AY));
+		const __m128 domX = _mm_andnot_ps(domZ, _mm_cmpge_ps(AX, AY));
+		const __m128 domY = _mm_andnot_ps(_mm_or_ps(domX, domZ), _mm_cmpeq_ps(zero, zero));
+
+		// +-1 by the side the surface faces, so that opposite faces aren't mirrored
+		const __m128 dominant = SelectPs(domZ, NZ, SelectPs(domX, NX, NY));
+		const __m128 S = _mm_or_ps(_mm_and_ps(dominant, signBit), one);
+
+		// U axis of the projection with tangent x bitangent along the normal: (0, s, 0) for x,
+		// (-s, 0, 0) for y and (s, 0, 0) for z
+		__m128 TX = _mm_andnot_ps(domX, _mm_xor_ps(S, _mm_and_ps(domY, signBit)));
+		__m128 TY = _mm_and_ps(domX, S);
+
+		const __m128 U = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(TX, PX), _mm_mul_ps(TY, PY)), scale);
+		const __m128 V = _mm_xor_ps(_mm_mul_ps(SelectPs(domZ, PY, PZ), scale), signBit);
+
+		// Gram-Schmidt, the axis is off the dominant one so at least half of it remains
+		const __m128 d = _mm_add_ps(_mm_mul_ps(TX, NX), _mm_mul_ps(TY, NY));
+		TX = _mm_sub_ps(TX, _mm_mul_ps(NX, d));
+		TY = _mm_sub_ps(TY, _mm_mul_ps(NY, d));
+		__m128 TZ = _mm_sub_ps(zero, _mm_mul_ps(NZ, d));
+
+		const __m128 invT = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(TX, TX), _mm_mul_ps(TY, TY)), _mm_mul_ps(TZ, TZ))));
+		TX = _mm_mul_ps(TX, invT);
+		TY = _mm_mul_ps(TY, invT);
+		TZ = _mm_mul_ps(TZ, invT);
+
+		alignas(16) float u[4], v[4], wx[4], wy[4], wz[4], tx[4], ty[4], tz[4];
+		_mm_store_ps(nx, NX);
+		_mm_store_ps(ny, NY);
+		_mm_store_ps(nz, NZ);
+		_mm_store_ps(u, U);
+		_mm_store_ps(v, V);
+		_mm_store_ps(wx, _mm_mul_ps(WX, invW));
+		_mm_store_ps(wy, _mm_mul_ps(WY, invW));
+		_mm_store_ps(wz, _mm_mul_ps(WZ, invW));
+		_mm_store_ps(tx, TX);
+		_mm_store_ps(ty, TY);
+		_mm_store_ps(tz, TZ);
+
+		const int batch = FMath::Min(4, vertexNum - i);
+		for (int k = 0; k < batch; k++) {
+			const float material = i + k < Mesh.Materials.Num() ? Mesh.Materials[i + k] : 0;
+
+			Mesh.Normals[i + k] = FVector(nx[k], ny[k], nz[k]);
+			Mesh.UVs[i + k] = FVector2D(u[k], v[k]);
+			Mesh.Colors[i + k] = FLinearColor(wx[k], wy[k], wz[k], material * (1.f / 255.f));
+			Mesh.Tangents[i + k] = FProcMeshTangent(FVector(tx[k], ty[k], tz[k]), false);
+		}
+	}
+}
+
+// Whether the quad a b c d (in winding order) is better split along a-c than along b-d:
+// the diagonal whose two triangles fold least, which also keeps concave quads from flipping
+// a triangle. Flat quads take the shorter diagonal.
+static bool SplitAlongAC(const FVector& a, const FVector& b, const FVector& c, const FVector& d) {
+	auto fold = [](const FVector& n1, const FVector& n2) {
+		const float len = FMath::Sqrt(n1.SizeSquared() * n2.SizeSquared());
+		return len > 0 ? (n1 | n2) / len : -1.f;
+	};
+
+	const float foldAC = fold((b - a) ^ (c - a), (c - a) ^ (d - a));
+	const float foldBD = fold((b - a) ^ (d - a), (c - b) ^ (d - b));
+
+	if (FMath::Abs(foldAC - foldBD) > 1e-4f) {
+		return foldAC > foldBD;
+	}
+
+	return (c - a).SizeSquared() <= (d - b).SizeSquared();
+}
+
+// two triangles for the vertices of the 4 cells around an edge, in EDGE_NODE_OFFSETS order
+static void AddEdgeQuad(const int edgeVoxels[4], bool bWinding, TVoxelMeshData& mesh) {
+	const TArray<FVector>& varray = mesh.Vertices;
+	TArray<int32>& triarray = mesh.Triangles;
+
+	// the quad in winding order
+	int quad[4];
+	if (bWinding) {
+		quad[0] = edgeVoxels[0];
+		quad[1] = edgeVoxels[1];
+		quad[2] = edgeVoxels[3];
+		quad[3] = edgeVoxels[2];
+	} else {
+		quad[0] = edgeVoxels[0];
+		quad[1] = edgeVoxels[2];
+		quad[2] = edgeVoxels[3];
+		quad[3] = edgeVoxels[1];
+	}
+
+	if (SplitAlongAC(varray[quad[0]], varray[quad[1]], varray[quad[2]], varray[quad[3]])) {
+		triarray.Add(quad[0]);
+		triarray.Add(quad[1]);
+		triarray.Add(quad[2]);
+
+		triarray.Add(quad[0]);
+		triarray.Add(quad[2]);
+		triarray.Add(quad[3]);
+	} else {
+		triarray.Add(quad[0]);
+		triarray.Add(quad[1]);
+		triarray.Add(quad[3]);
+
+		triarray.Add(quad[1]);
+		triarray.Add(quad[2]);
+		triarray.Add(quad[3]);
+	}
+}
+
+template <typename TKernel>
+static void GenerateTriangles(const TKernel& kernel, TVoxelMeshingContext& context) {
+	const TVoxelHashMap<int32>& vertexIndices = context.activeVoxels;
+
+	context.activeEdges.forEach([&](uint32 edge, const EdgeInfo& info) {
+		const int axis = kernel.edgeAxis(edge);
+
+		const uint32 nodeID = kernel.edgeNode(edge);
+		const uint32_t voxelIDs[4] = {
+			nodeID - kernel.node_offsets[axis * 4 + 0],
+			nodeID - kernel.node_offsets[axis * 4 + 1],
+			nodeID - kernel.node_offsets[axis * 4 + 2],
+			nodeID - kernel.node_offsets[axis * 4 + 3],
+		};
+		// attempt to find the 4 voxels which share this edge
+		int edgeVoxels[4];
+		int numFoundVoxels = 0;
+		for (int i = 0; i < 4; i++) {
+			const int32* vertexIndex = vertexIndices.find(voxelIDs[i]);
+			if (vertexIndex != nullptr) {
+				edgeVoxels[numFoundVoxels++] = *vertexIndex;
+			}
+		}
+
+		// we can only generate a quad (or two triangles) if all 4 are found
+		if (numFoundVoxels < 4) {
+			return;
+		}
+
+		AddEdgeQuad(edgeVoxels, info.winding(), context.mesh);
+	});
+}
+
+// keeps the vertex of cell (x, y, z) if the cell lies on a face of the open volume
+static void AddBoundaryCell(TVoxelMeshBoundary& boundary, int x, int y, int z, const TVoxelMeshData& mesh, int32 vertexIndex) {
+	const int last = boundary.cellNum - 1;
+	if (x != 0 && y != 0 && z != 0 && x != last && y != last && z != last) {
+		return;
+	}
+
+	bool bIsNew;
+	boundary.cells.add(TVoxelMeshBoundary::encodeCell(x, y, z), bIsNew) = boundary.Vertices.Num();
+	boundary.Vertices.Add(mesh.Vertices[vertexIndex]);
+	boundary.Normals.Add(mesh.Normals[vertexIndex]);
+	boundary.Materials.Add(mesh.Materials[vertexIndex]);
+}
+
+// vertices of the cells on the faces of an open volume, cell coordinates come back out of the voxel ids
+template <typename TKernel>
+static void ExtractBoundary(const TKernel& kernel, const TVoxelMeshingContext& context, int cellNum, TVoxelMeshBoundary& boundary) {
+	boundary.reset();
+	boundary.stride = kernel.stride();
+	boundary.cellNum = cellNum;
+
+	const uint32 mask = (1u << TKernel::BITS) - 1;
+
+	context.activeVoxels.forEach([&](uint32 voxelID, const int32& vertexIndex) {
+		const int x = (int)(voxelID & mask) - 1;
+		const int y = (int)((voxelID >> TKernel::BITS) & mask) - 1;
+		const int z = (int)((voxelID >> (TKernel::BITS * 2)) & mask) - 1;
+
+		AddBoundaryCell(boundary, x, y, z, context.mesh, vertexIndex);
+	});
+}
+
+template <typename TVolume, typename TKernel>
+static void Polygonize(const TVolume* Volume, const TKernel& Kernel, TVoxelMeshingContext& Context, TVoxelMeshBoundary* Boundary) {
+	Context.reset();
+
+	FindActiveVoxels(Volume, Kernel, Context, Boundary != nullptr);
+	if (Context.isCancelled()) {
+		return;
+	}
+
+	// one vertex per active voxel, at most one quad per active edge
+	Context.reserveMesh(Context.activeVoxels.num(), Context.activeEdges.num() * 6);
+
+	// same mapping as voxelIndexToVector, in cell units
+	const float Step = Volume->size() / (Volume->num() - 1) * Kernel.stride();
+	GenerateVertexData(Kernel, Context, CVarQefMode.GetValueOnAnyThread(), -Volume->size() / 2, Step);
+	if (Context.isCancelled()) {
+		return;
+	}
+
+	if (Boundary != nullptr) {
+		ExtractBoundary(Kernel, Context, (Volume->num() - 1) / Kernel.stride(), *Boundary);
+	}
+
+	GenerateTriangles(Kernel, Context);
+}
+
+//
+// The same mesh in one sweep along x. Node slice x holds the crossings on the edges starting at
+// nodes of that x; once it is found the cells of slice x - 1 have all their edges and get their
+// vertices, after which every cell around the edges of node slice x - 1 is placed and their
+// quads go out. Crossings live in a ring of two node slices and vertex indices in a ring of three
+// cell slices, so the working set is a few slices whatever the surface area, and there are no
+// ids to pack, which lifts the cell limit of the generic kernel.
+//
+// Vertices and triangles come out in another order than from the hash map passes, with the same
+// positions and the same quads.
+//
+template <typename TVolume, typename TKernel>
+static void PolygonizeSweep(const TVolume* Volume, const TKernel& Kernel, TVoxelMeshingContext& Context, TVoxelMeshBoundary* Boundary) {
+	Context.reset();
+
+	const auto Reader = MakeReader(Volume);
+	TVoxelMaterialReader<TVolume> Materials(Volume, Context);
+	const TVoxelNodeScan<TVolume, TKernel> Scan(Volume, Kernel, Boundary != nullptr);
+	const int32 QefMode = CVarQefMode.GetValueOnAnyThread();
+
+	if (Boundary != nullptr) {
+		Boundary->reset();
+		Boundary->stride = Kernel.stride();
+		Boundary->cellNum = Scan.lastNode;
+	}
+
+	const int First = Scan.first;
+	const int Last = Scan.last;
+	const int Dim = Last - First + 1;
+	const int Rows = Dim * Dim;
+
+	// same mapping as voxelIndexToVector, in cell units
+	const float Step = Volume->size() / (Volume->num() - 1) * Kernel.stride();
+	const float S = -Volume->size() / 2;
+
+	// vertex slots: no vertex, a vertex still to place, or its index once placed
+	static const int32 NO_VERTEX = -1;
+	static const int32 PENDING_VERTEX = -2;
+
+	Context.reserveSweep(Rows);
+	EdgeInfo* const SliceEdges = Context.sliceEdges.data();
+	uint8* const SliceAxes = Context.sliceAxes.data();
+	int32* const SliceVertices = Context.sliceVertices.data();
+
+	auto row = [&](int y, int z) { return (y - First) * Dim + (z - First); };
+	auto edgeSlot = [&](int x) { return ((x - First) & 1) * Rows; };
+	auto vertexSlot = [&](int x) { return ((x - First) % 3) * Rows; };
+
+	// finds the crossings of node slice x, a block row of the pyramid at a time
+	auto scanSlice = [&](int x) {
+		uint8* axes = SliceAxes + edgeSlot(x);
+		EdgeInfo* edges = SliceEdges + edgeSlot(x) * 3;
+		FMemory::Memzero(axes, Rows);
+
+		const int bx = Scan.blockStart(x);
+
+		for (int by = First; by <= Last; by = Scan.nextBlock(by)) {
+			for (int bz = First; bz <= Last; bz = Scan.nextBlock(bz)) {
+				if (!Scan.mayCross(bx, by, bz)) {
+					continue;
+				}
+
+				for (int y = by; y <= Scan.blockEnd(by); y++) {
+					for (int z = bz; z <= Scan.blockEnd(bz); z++) {
+						const TVoxelIndex4 p(x, y, z, 0);
+						const int r = row(y, z);
+
+						for (int axis = 0; axis < 3; axis++) {
+							if (!Scan.crossing(Materials, Reader, p, axis, edges[r * 3 + axis])) {
+								continue;
+							}
+
+							axes[r] |= 1 << axis;
+
+							Scan.forEachEdgeCell(p, axis, [&](const TVoxelIndex4& cell) {
+								int32& slot = SliceVertices[vertexSlot(cell.X) + row(cell.Y, cell.Z)];
+								slot = PENDING_VERTEX;
+							});
+						}
+					}
+				}
+			}
+		}
+	};
+
+	// places the vertices of cell slice x, node slices x and x + 1 are complete
+	auto placeSlice = [&](int x) {
+		int32* vertices = SliceVertices + vertexSlot(x);
+
+		for (int y = First; y <= Last; y++) {
+			for (int z = First; z <= Last; z++) {
+				int32& vertexIndex = vertices[row(y, z)];
+				if (vertexIndex != PENDING_VERTEX) {
+					continue;
+				}
+
+				const EdgeInfo* cellEdges[12];
+				for (int i = 0; i < 12; i++) {
+					const int* edge = CELL_EDGES[i];
+					const int ex = x + edge[1];
+					const int ey = y + edge[2];
+					const int ez = z + edge[3];
+
+					cellEdges[i] = nullptr;
+					if (ex <= Last && ey <= Last && ez <= Last) {
+						const int r = row(ey, ez);
+						if (SliceAxes[edgeSlot(ex) + r] & (1 << edge[0])) {
+							cellEdges[i] = &SliceEdges[(edgeSlot(ex) + r) * 3 + edge[0]];
+						}
+					}
+				}
+
+				vertexIndex = PlaceVertex(cellEdges, S + x * Step, S + y * Step, S + z * Step, Step, QefMode, Context.mesh);
+
+				if (Boundary != nullptr) {
+					AddBoundaryCell(*Boundary, x, y, z, Context.mesh, vertexIndex);
+				}
+			}
+		}
+	};
+
+	// quads of node slice x, cell slices x - 1 and x are placed
+	auto triangulateSlice = [&](int x) {
+		const uint8* axes = SliceAxes + edgeSlot(x);
+		const EdgeInfo* edges = SliceEdges + edgeSlot(x) * 3;
+
+		for (int y = First; y <= Last; y++) {
+			for (int z = First; z <= Last; z++) {
+				const int r = row(y, z);
+				if (axes[r] == 0) {
+					continue;
+				}
+
+				for (int axis = 0; axis < 3; axis++) {
+					if ((axes[r] & (1 << axis)) == 0) {
+						continue;
+					}
+
+					int edgeVoxels[4];
+					int numFoundVoxels = 0;
+					for (int i = 0; i < 4; i++) {
+						const TVoxelIndex4& o = EDGE_NODE_OFFSETS[axis][i];
+						const int cx = x - o.X;
+						const int cy = y - o.Y;
+						const int cz = z - o.Z;
+
+						if (cx < First || cy < First || cz < First) {
+							break;
+						}
+
+						const int32 vertexIndex = SliceVertices[vertexSlot(cx) + row(cy, cz)];
+						if (vertexIndex < 0) {
+							break;
+						}
+
+						edgeVoxels[numFoundVoxels++] = vertexIndex;
+					}
+
+					if (numFoundVoxels == 4) {
+						AddEdgeQuad(edgeVoxels, edges[r * 3 + axis].winding(), Context.mesh);
+					}
+				}
+			}
+		}
+	};
+
+	for (int x = First; x <= Last + 1; x++) {
+		if (Context.isCancelled()) {
+			return;
+		}
+
+		if (x <= Last) {
+			std::fill(SliceVertices + vertexSlot(x), SliceVertices + vertexSlot(x) + Rows, NO_VERTEX);
+			Materials.releaseBelow(Kernel.toVoxel(FMath::Max(x, 0)));
+			scanSlice(x);
+		}
+
+		if (x - 1 >= First) {
+			const int32 FirstVertex = Context.mesh.Vertices.Num();
+			placeSlice(x - 1);
+			triangulateSlice(x - 1);
+
+			if (Context.surface.isEnabled()) {
+				VoxelGenerateSurfaceAttributes(Context.mesh, Context.surface, FirstVertex);
+			}
+		}
+	}
+}
+
+template <typename TVolume, typename TKernel>
+static void PolygonizeWith(const TVolume* Volume, const TKernel& Kernel, TVoxelMeshingContext& Context, TVoxelMeshBoundary* Boundary, bool bSweep) {
+	if (bSweep) {
+		PolygonizeSweep(Volume, Kernel, Context, Boundary);
+	} else {
+		Polygonize(Volume, Kernel, Context, Boundary);
+	}
+}
+
+template <typename TVolume, int Num>
+static bool PolygonizeSpecialized(const TVolume* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary, bool bSweep) {
+	switch (Stride) {
+	case 1:
+		PolygonizeWith(Volume, TVoxelMeshKernel<Num, 0>(Volume->num()), Context, Boundary, bSweep);
+		return true;
+	case 2:
+		PolygonizeWith(Volume, TVoxelMeshKernel<Num, 1>(Volume->num()), Context, Boundary, bSweep);
+		return true;
+	case 4:
+		PolygonizeWith(Volume, TVoxelMeshKernel<Num, 2>(Volume->num()), Context, Boundary, bSweep);
+		return true;
+	default:
+		return false;
+	}
+}
+
+// false for sizes and strides without a specialized kernel; 2^k + 1 samples are chunks sharing
+// their borders, meshed at the strides of their LODs
+template <typename TVolume>
+static bool PolygonizeBySize(const TVolume* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary, bool bSweep) {
+	switch (Volume->num()) {
+	case 32:
+		return PolygonizeSpecialized<TVolume, 32>(Volume, Context, Stride, Boundary, bSweep);
+	case 33:
+		return PolygonizeSpecialized<TVolume, 33>(Volume, Context, Stride, Boundary, bSweep);
+	case 64:
+		return PolygonizeSpecialized<TVolume, 64>(Volume, Context, Stride, Boundary, bSweep);
+	case 65:
+		return PolygonizeSpecialized<TVolume, 65>(Volume, Context, Stride, Boundary, bSweep);
+	case 128:
+		return PolygonizeSpecialized<TVolume, 128>(Volume, Context, Stride, Boundary, bSweep);
+	case 129:
+		return PolygonizeSpecialized<TVolume, 129>(Volume, Context, Stride, Boundary, bSweep);
+	case 256:
+		return PolygonizeSpecialized<TVolume, 256>(Volume, Context, Stride, Boundary, bSweep);
+	case 257:
+		return PolygonizeSpecialized<TVolume, 257>(Volume, Context, Stride, Boundary, bSweep);
+	default:
+		return false;
+	}
+}
+
+template <typename TVolume>
+void PolygonizeVolumeReference(const TVolume* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary) {
+	check(Stride > 0);
+	check(Boundary == nullptr || (Volume->num() - 1) % Stride == 0);
+
+	// 10 bits per axis have to hold cells + 1 plus the bias of the cell below the volume
+	const TVoxelMeshKernelGeneric Kernel(Volume->num(), Stride);
+	if (Kernel.cellNum() > (1 << TVoxelMeshKernelGeneric::BITS) - 2) {
+		UE_LOG(LogTemp, Error, TEXT("PolygonizeVolume: %d cells per axis is too many for the generic kernel"), Kernel.cellNum());
+		Context.reset();
+		return;
+	}
+
+	Polygonize(Volume, Kernel, Context, Boundary);
+}
+
+template <typename TVolume>
+void PolygonizeVolumeSweep(const TVolume* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary) {
+	check(Stride > 0);
+	check(Boundary == nullptr || (Volume->num() - 1) % Stride == 0);
+
+	if (!PolygonizeBySize(Volume, Context, Stride, Boundary, true)) {
+		PolygonizeSweep(Volume, TVoxelMeshKernelGeneric(Volume->num(), Stride), Context, Boundary);
+	}
+}
+
+template <typename TVolume>
+void PolygonizeVolume(const TVolume* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary) {
+	check(Stride > 0);
+	check(Boundary == nullptr || (Volume->num() - 1) % Stride == 0);
+
+	// volumes whose ids don't fit the generic kernel can only be swept
+	const int CellNum = (Volume->num() - 1) / Stride + 1;
+	if (CVarSweepMesher.GetValueOnAnyThread() != 0 || CellNum > (1 << TVoxelMeshKernelGeneric::BITS) - 2) {
+		PolygonizeVolumeSweep(Volume, Context, Stride, Boundary);
+		return;
+	}
+
+	if (!PolygonizeBySize(Volume, Context, Stride, Boundary, false)) {
+		PolygonizeVolumeReference(Volume, Context, Stride, Boundary);
+	}
+}
+
+template void PolygonizeVolume<TVoxelData>(const TVoxelData* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary);
+template void PolygonizeVolume<TVoxelSnapshot>(const TVoxelSnapshot* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary);
+template void PolygonizeVolumeReference<TVoxelData>(const TVoxelData* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary);
+template void PolygonizeVolumeReference<TVoxelSnapshot>(const TVoxelSnapshot* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary);
+template void PolygonizeVolumeSweep<TVoxelData>(const TVoxelData* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary);
+template void PolygonizeVolumeSweep<TVoxelSnapshot>(const TVoxelSnapshot* Volume, TVoxelMeshingContext& Context, int Stride, TVoxelMeshBoundary* Boundary);
+
+//====================================================================================
+// Seams
+//====================================================================================
+
+// one cell of the neighbourhood: which volume in the low 3 bits, its cell coordinate above
+static uint32 SeamCellKey(int neighbour, const TVoxelIndex4& cell) {
+	return neighbour | (cell.X << 3) | (cell.Y << 12) | (cell.Z << 21);
+}
+
+struct TSeamEdge {
+	TVoxelIndex4 start = TVoxelIndex4(0);
+	int axis = 0;
+	int stride = 1;
+
+	// cells around the edge in EDGE_NODE_OFFSETS order
+	uint32 keys[4];
+	const TVoxelMeshBoundary* boundaries[4];
+	int neighbours[4];
+	TVoxelIndex4 cells[4] = { TVoxelIndex4(0), TVoxelIndex4(0), TVoxelIndex4(0), TVoxelIndex4(0) };
+};
+
+// calls func for every minimal edge of the seam: on the owner's high faces, owned by it, with
+// all four cells available and the finest of their strides equal to the edge length
+template <typename TFunc>
+static void ForEachSeamEdge(int lastSample, const TVoxelSeamNeighbourhood& neighbours, TFunc&& func) {
+	int minStride = 0;
+	int maxStride = 0;
+	for (int i = 0; i < 8; i++) {
+		const TVoxelMeshBoundary* boundary = neighbours.boundaries[i >> 2][(i >> 1) & 1][i & 1];
+		if (boundary != nullptr) {
+			minStride = minStride == 0 ? boundary->stride : FMath::Min(minStride, boundary->stride);
+			maxStride = FMath::Max(maxStride, boundary->stride);
+		}
+	}
+
+	if (minStride == 0) {
+		return;
+	}
+
+	TSeamEdge edge;
+	for (int stride = minStride; stride <= maxStride; stride *= 2) {
+		edge.stride = stride;
+
+		for (int plane = 0; plane < 3; plane++) {
+			for (int axis = 0; axis < 3; axis++) {
+				if (axis == plane) {
+					continue;
+				}
+
+				const int other = 3 - plane - axis;
+				edge.axis = axis;
+
+				// edges on the low line of the face belong to the neighbour below, the high line is
+				// shared with another face of this seam and taken from the lower plane axis only
+				for (int a = 0; a + stride <= lastSample; a += stride) {
+					for (int b = stride; b <= lastSample; b += stride) {
+						if (b == lastSample && other < plane) {
+							continue;
+						}
+
+						int start[3];
+						start[plane] = lastSample;
+						start[axis] = a;
+						start[other] = b;
+						edge.start = TVoxelIndex4(start[0], start[1], start[2], 0);
+
+						bool bMinimal = false;
+						bool bValid = true;
+						for (int i = 0; i < 4 && bValid; i++) {
+							const TVoxelIndex4& o = EDGE_NODE_OFFSETS[axis][i];
+							const TVoxelIndex4 node(edge.start.X - o.X * stride, edge.start.Y - o.Y * stride, edge.start.Z - o.Z * stride, 0);
+
+							// the volume holding the cell center
+							const int dx = node.X * 2 + stride >= lastSample * 2;
+							const int dy = node.Y * 2 + stride >= lastSample * 2;
+							const int dz = node.Z * 2 + stride >= lastSample * 2;
+							const TVoxelMeshBoundary* boundary = neighbours.boundaries[dx][dy][dz];
+
+							// finer cells mean a shorter edge here, taken at that stride
+							if (boundary == nullptr || boundary->stride < stride) {
+								bValid = false;
+								break;
+							}
+
+							bMinimal |= boundary->stride == stride;
+
+							const int t = boundary->stride;
+							const TVoxelIndex4 cell((node.X - dx * lastSample) / t, (node.Y - dy * lastSample) / t, (node.Z - dz * lastSample) / t, 0);
+							const int neighbour = (dx << 2) | (dy << 1) | dz;
+
+							edge.boundaries[i] = boundary;
+							edge.neighbours[i] = neighbour;
+							edge.cells[i] = cell;
+							edge.keys[i] = SeamCellKey(neighbour, cell);
+						}
+
+						if (bValid && bMinimal) {
+							func(edge);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+template <typename TVolume>
+void VoxelBuildSeam(const TVolume* Volume, const TVoxelSeamNeighbourhood& Neighbours, TVoxelMeshingContext& Context) {
+	Context.reset();
+
+	const int lastSample = Volume->num() - 1;
+	const float step = Volume->size() / lastSample;
+	const float s = -Volume->size() / 2;
+	const FVector& origin = Neighbours.origins[0][0][0];
+
+	for (int i = 0; i < 8; i++) {
+		const TVoxelMeshBoundary* boundary = Neighbours.boundaries[i >> 2][(i >> 1) & 1][i & 1];
+		if (boundary != nullptr && boundary->cellNum >= 1 << 9) {
+			UE_LOG(LogTemp, Error, TEXT("VoxelBuildSeam: %d cells per axis is too many"), boundary->cellNum);
+			return;
+		}
+	}
+
+	TVoxelMaterialReader<TVolume> Materials(Volume, Context);
+
+	auto sample = [&](const TVoxelIndex4& p) {
+		return Volume->getDensity(FMath::Clamp(p.X, 0, lastSample), FMath::Clamp(p.Y, 0, lastSample), FMath::Clamp(p.Z, 0, lastSample));
+	};
+
+	// vertices the seam had to add sum their crossings in place and are divided once all are in
+	TVoxelHashMap<int32>& vertexIndices = Context.activeVoxels;
+	TVoxelHashMap<int32>& addedVertices = Context.seamVertices;
+	TVoxelMeshData& mesh = Context.mesh;
+
+	struct TSeamCrossing {
+		FVector pos;
+		FVector normal;
+		unsigned short material;
+		bool winding;
+	};
+
+	auto crossing = [&](const TSeamEdge& edge, TSeamCrossing& out) {
+		const TVoxelIndex4 p = edge.start;
+		const TVoxelIndex4 q(p.X + AXIS_OFFSET[edge.axis].X * edge.stride, p.Y + AXIS_OFFSET[edge.axis].Y * edge.stride, p.Z + AXIS_OFFSET[edge.axis].Z * edge.stride, 0);
+
+		const float pDensity = Volume->getDensity(p.X, p.Y, p.Z);
+		const float qDensity = Volume->getDensity(q.X, q.Y, q.Z);
+
+		const bool zeroCrossing = (pDensity >= 0.5f && qDensity < 0.5f) || (pDensity < 0.5f && qDensity >= 0.5f);
+		if (!zeroCrossing) {
+			return false;
+		}
+
+		out.winding = pDensity >= 0.5f;
+
+		const TVoxelIndex4& solid = out.winding ? p : q;
+		out.material = Materials.read(solid.X, solid.Y, solid.Z);
+
+		const FVector p1(s + p.X * step, s + p.Y * step, s + p.Z * step);
+		const FVector q1(s + q.X * step, s + q.Y * step, s + q.Z * step);
+		out.pos = vertexInterpolation(p1, q1, pDensity, qDensity) + origin;
+
+		const FVector4 gradient(
+			sample(p + TVoxelIndex4(1, 0, 0, 0)) - sample(p - TVoxelIndex4(1, 0, 0, 0)),
+			sample(p + TVoxelIndex4(0, 1, 0, 0)) - sample(p - TVoxelIndex4(0, 1, 0, 0)),
+			sample(p + TVoxelIndex4(0, 0, 1, 0)) - sample(p - TVoxelIndex4(0, 0, 1, 0)),
+			0.f);
+		const FVector4 normal = -gradient.GetSafeNormal(0.000001f);
+		out.normal = FVector(normal.X, normal.Y, normal.Z);
+		return true;
+	};
+
+	// vertices: copies of the boundary vertices the edges reach, plus the ones coarse cells lack
+	ForEachSeamEdge(lastSample, Neighbours, [&](const TSeamEdge& edge) {
+		TSeamCrossing info;
+		if (!crossing(edge, info)) {
+			return;
+		}
+
+		for (int i = 0; i < 4; i++) {
+			bool bIsNew;
+			int32& vertexIndex = vertexIndices.add(edge.keys[i], bIsNew);
+
+			if (bIsNew) {
+				vertexIndex = mesh.Vertices.Num();
+
+				const TVoxelIndex4& cell = edge.cells[i];
+				const int32* boundaryIndex = edge.boundaries[i]->cells.find(TVoxelMeshBoundary::encodeCell(cell.X, cell.Y, cell.Z));
+				const int n = edge.neighbours[i];
+
+				if (boundaryIndex != nullptr) {
+					mesh.Vertices.Add(edge.boundaries[i]->Vertices[*boundaryIndex] + Neighbours.origins[n >> 2][(n >> 1) & 1][n & 1]);
+					mesh.Normals.Add(edge.boundaries[i]->Normals[*boundaryIndex]);
+					mesh.Materials.Add(edge.boundaries[i]->Materials[*boundaryIndex]);
+				} else {
+					mesh.Vertices.Add(FVector::ZeroVector);
+					mesh.Normals.Add(FVector::ZeroVector);
+					mesh.Materials.Add(info.material);
+
+					bool bAdded;
+					addedVertices.add(vertexIndex, bAdded) = 0;
+				}
+			}
+
+			int32* added = addedVertices.find(vertexIndex);
+			if (added != nullptr) {
+				mesh.Vertices[vertexIndex] += info.pos;
+				mesh.Normals[vertexIndex] += info.normal;
+				(*added)++;
+			}
+		}
+	});
+
+	addedVertices.forEach([&](uint32 vertexIndex, int32& crossings) {
+		mesh.Vertices[vertexIndex] /= (float)crossings;
+		mesh.Normals[vertexIndex] = mesh.Normals[vertexIndex].GetSafeNormal();
+	});
+
+	// seam vertices are already in the output space
+	if (Context.surface.isEnabled()) {
+		VoxelGenerateSurfaceAttributes(mesh, Context.surface);
+	}
+
+	// triangles: the quad of each edge with cells shared on the coarse side folded together
+	ForEachSeamEdge(lastSample, Neighbours, [&](const TSeamEdge& edge) {
+		TSeamCrossing info;
+		if (!crossing(edge, info)) {
+			return;
+		}
+
+		int edgeVoxels[4];
+		for (int i = 0; i < 4; i++) {
+			edgeVoxels[i] = *vertexIndices.find(edge.keys[i]);
+		}
+
+		int quad[4];
+		if (info.winding) {
+			quad[0] = edgeVoxels[0];
+			quad[1] = edgeVoxels[1];
+			quad[2] = edgeVoxels[3];
+			quad[3] = edgeVoxels[2];
+		} else {
+			quad[0] = edgeVoxels[0];
+			quad[1] = edgeVoxels[2];
+			quad[2] = edgeVoxels[3];
+			quad[3] = edgeVoxels[1];
+		}
+
+		int polygon[4];
+		int corners = 0;
+		for (int i = 0; i < 4; i++) {
+			if (quad[i] != quad[(i + 3) % 4]) {
+				polygon[corners++] = quad[i];
+			}
+		}
+
+		if (corners == 3 && polygon[0] != polygon[2]) {
+			mesh.Triangles.Add(polygon[0]);
+			mesh.Triangles.Add(polygon[1]);
+			mesh.Triangles.Add(polygon[2]);
+		} else if (corners == 4) {
+			if (SplitAlongAC(mesh.Vertices[quad[0]], mesh.Vertices[quad[1]], mesh.Vertices[quad[2]], mesh.Vertices[quad[3]])) {
+				mesh.Triangles.Add(quad[0]);
+				mesh.Triangles.Add(quad[1]);
+				mesh.Triangles.Add(quad[2]);
+
+				mesh.Triangles.Add(quad[0]);
+				mesh.Triangles.Add(quad[2]);
+				mesh.Triangles.Add(quad[3]);
+			} else {
+				mesh.Triangles.Add(quad[0]);
+				mesh.Triangles.Add(quad[1]);
+				mesh.Triangles.Add(quad[3]);
+
+				mesh.Triangles.Add(quad[1]);
+				mesh.Triangles.Add(quad[2]);
+				mesh.Triangles.Add(quad[3]);
+			}
+		}
+	});
+}
+
+template void VoxelBuildSeam<TVoxelData>(const TVoxelData* Volume, const TVoxelSeamNeighbourhood& Neighbours, TVoxelMeshingContext& Context);
+template void VoxelBuildSeam<TVoxelSnapshot>(const TVoxelSnapshot* Volume, const TVoxelSeamNeighbourhood& Neighbours, TVoxelMeshingContext& Context);
+
+
+void TVoxelMeshBoundary::reset() {
+	cells.reset();
+	Vertices.Reset();
+	Normals.Reset();
+	Materials.Reset();
+}
+
+size_t TVoxelMeshBoundary::getAllocatedSize() const {
+	return cells.getAllocatedSize() + Vertices.GetAllocatedSize() + Normals.GetAllocatedSize() + Materials.GetAllocatedSize();
+}
+
+
+TVoxelMeshingContext::TVoxelMeshingContext() {
+}
+
+TVoxelMeshingContext::~TVoxelMeshingContext() {
+}
+
+void TVoxelMeshingContext::reset() {
+	build_allocations = getAllocationCount();
+
+	activeEdges.reset();
+	activeVoxels.reset();
+	seamVertices.reset();
+
+	// Reset keeps the allocation, Empty would free it
+	mesh.Vertices.Reset();
+	mesh.Normals.Reset();
+	mesh.Materials.Reset();
+	mesh.Triangles.Reset();
+	mesh.UVs.Reset();
+	mesh.Colors.Reset();
+	mesh.Tangents.Reset();
+}
+
+template <typename T>
+static bool reserveArray(TArray<T>& array, int32 num) {
+	if (array.Max() >= num) {
+		return false;
+	}
+
+	// some headroom so that a slowly growing surface does not reallocate every build
+	array.Reserve(num + num / 4);
+	return true;
+}
+
+void TVoxelMeshingContext::reserveMesh(int32 vertexNum, int32 indexNum) {
+	mesh_allocations += reserveArray(mesh.Vertices, vertexNum);
+	mesh_allocations += reserveArray(mesh.Normals, vertexNum);
+	mesh_allocations += reserveArray(mesh.Materials, vertexNum);
+	mesh_allocations += reserveArray(mesh.Triangles, indexNum);
+
+	if (surface.isEnabled()) {
+		mesh_allocations += reserveArray(mesh.UVs, vertexNum);
+		mesh_allocations += reserveArray(mesh.Colors, vertexNum);
+		mesh_allocations += reserveArray(mesh.Tangents, vertexNum);
+	}
+}
+
+template <typename T>
+static bool resizeVector(std::vector<T>& vector, size_t num) {
+	const bool bGrown = vector.capacity() < num;
+	if (vector.size() < num) {
+		vector.resize(num);
+	}
+
+	return bGrown;
+}
+
+void TVoxelMeshingContext::reserveSweep(int32 rowNum) {
+	mesh_allocations += resizeVector(sliceEdges, (size_t)rowNum * 2 * 3);
+	mesh_allocations += resizeVector(sliceAxes, (size_t)rowNum * 2);
+	mesh_allocations += resizeVector(sliceVertices, (size_t)rowNum * 3);
+}
+
+void TVoxelMeshingContext::resetBrickMaterials(int32 brickNum) {
+	mesh_allocations += resizeVector(brickMaterialSlots, brickNum);
+	std::fill(brickMaterialSlots.begin(), brickMaterialSlots.begin() + brickNum, -1);
+
+	free_brick_materials.clear();
+	for (int32 first = 0; first < (int32)brickMaterials.size(); first += VOXEL_BRICK_VOLUME) {
+		free_brick_materials.push_back(first);
+	}
+}
+
+int32 TVoxelMeshingContext::allocateBrickMaterials() {
+	if (!free_brick_materials.empty()) {
+		const int32 first = free_brick_materials.back();
+		free_brick_materials.pop_back();
+		return first;
+	}
+
+	const int32 first = (int32)brickMaterials.size();
+	mesh_allocations += resizeVector(brickMaterials, first + VOXEL_BRICK_VOLUME);
+	return first;
+}
+
+void TVoxelMeshingContext::releaseBrickMaterials(int32 first, int32 last) {
+	for (int32 index = first; index < last; index++) {
+		int32& slot = brickMaterialSlots[index];
+		if (slot >= 0) {
+			free_brick_materials.push_back(slot);
+		}
+
+		slot = -1;
+	}
+}
+
+int32 TVoxelMeshingContext::getAllocationCount() const {
+	return activeEdges.getAllocationCount() + activeVoxels.getAllocationCount() + seamVertices.getAllocationCount() + mesh_allocations;
+}
+
+size_t TVoxelMeshingContext::getAllocatedSize() const {
+	return activeEdges.getAllocatedSize() + activeVoxels.getAllocatedSize() + seamVertices.getAllocatedSize() +
+		sliceEdges.capacity() * sizeof(EdgeInfo) + sliceAxes.capacity() + sliceVertices.capacity() * sizeof(int32) +
+		brickMaterialSlots.capacity() * sizeof(int32) + brickMaterials.capacity() * sizeof(unsigned short) + free_brick_materials.capacity() * sizeof(int32) +
+		mesh.Vertices.GetAllocatedSize() + mesh.Normals.GetAllocatedSize() + mesh.Materials.GetAllocatedSize() + mesh.Triangles.GetAllocatedSize() +
+		mesh.UVs.GetAllocatedSize() + mesh.Colors.GetAllocatedSize() + mesh.Tangents.GetAllocatedSize() +
+		(simplifier ? simplifier->getAllocatedSize() : 0);
+}
+
+TVoxelMeshingMemoryStats& TVoxelMeshingMemoryStats::operator+=(const TVoxelMeshingMemoryStats& other) {
+	hashMaps += other.hashMaps;
+	sweep += other.sweep;
+	materials += other.materials;
+	mesh += other.mesh;
+	simplifier += other.simplifier;
+	allocations += other.allocations;
+	lastBuildPeak += other.lastBuildPeak;
+	lastBuildAllocations += other.lastBuildAllocations;
+	return *this;
+}
+
+TVoxelSimplifyStats& TVoxelSimplifyStats::operator+=(const TVoxelSimplifyStats& other) {
+	runs += other.runs;
+	inputTriangles += other.inputTriangles;
+	outputTriangles += other.outputTriangles;
+	return *this;
+}
+
+template <typename TValue>
+static size_t usedMapSize(const TVoxelHashMap<TValue>& map) {
+	return (size_t)map.num() * (sizeof(uint32) + sizeof(TValue));
+}
+
+template <typename T>
+static size_t usedArraySize(const TArray<T>& array) {
+	return (size_t)array.Num() * sizeof(T);
+}
+
+TVoxelMeshingMemoryStats TVoxelMeshingContext::getMemoryStats() const {
+	TVoxelMeshingMemoryStats stats;
+	stats.hashMaps = activeEdges.getAllocatedSize() + activeVoxels.getAllocatedSize() + seamVertices.getAllocatedSize();
+	stats.sweep = sliceEdges.capacity() * sizeof(EdgeInfo) + sliceAxes.capacity() + sliceVertices.capacity() * sizeof(int32);
+	stats.materials = brickMaterialSlots.capacity() * sizeof(int32) + brickMaterials.capacity() * sizeof(unsigned short) + free_brick_materials.capacity() * sizeof(int32);
+	stats.mesh = mesh.Vertices.GetAllocatedSize() + mesh.Normals.GetAllocatedSize() + mesh.Materials.GetAllocatedSize() + mesh.Triangles.GetAllocatedSize() +
+		mesh.UVs.GetAllocatedSize() + mesh.Colors.GetAllocatedSize() + mesh.Tangents.GetAllocatedSize();
+	stats.simplifier = simplifier ? simplifier->getAllocatedSize() : 0;
+	stats.allocations = getAllocationCount();
+
+	// nothing is cleared before the next reset, so what the last build filled is still there
+	stats.lastBuildPeak = usedMapSize(activeEdges) + usedMapSize(activeVoxels) + usedMapSize(seamVertices) +
+		sliceEdges.size() * sizeof(EdgeInfo) + sliceAxes.size() + sliceVertices.size() * sizeof(int32) +
+		brickMaterialSlots.size() * sizeof(int32) + brickMaterials.size() * sizeof(unsigned short) +
+		usedArraySize(mesh.Vertices) + usedArraySize(mesh.Normals) + usedArraySize(mesh.Materials) + usedArraySize(mesh.Triangles) +
+		usedArraySize(mesh.UVs) + usedArraySize(mesh.Colors) + usedArraySize(mesh.Tangents) + stats.simplifier;
+	stats.lastBuildAllocations = stats.allocations - build_allocations;
+	return stats;
+}
+
+
+TVoxelMeshingContextPool& TVoxelMeshingContextPool::get() {
+	static TVoxelMeshingContextPool pool;
+	return pool;
+}
+
+TVoxelMeshingContext* TVoxelMeshingContextPool::acquire() {
+	FScopeLock Lock(&lock);
+
+	if (free_list.empty()) {
+		contexts.emplace_back(new TVoxelMeshingContext());
+		free_list.reserve(contexts.size());
+		return contexts.back().get();
+	}
+
+	TVoxelMeshingContext* context = free_list.back();
+	free_list.pop_back();
+	return context;
+}
+
+void TVoxelMeshingContextPool::release(TVoxelMeshingContext* context) {
+	if (context == nullptr) {
+		return;
+	}
+
+	context->cancelFlag = nullptr;
+	context->surface = TVoxelSurfaceSettings();
+	const TVoxelMeshingMemoryStats stats = context->getMemoryStats();
+
+	FScopeLock Lock(&lock);
+	context->released_stats = stats;
+	context->released_simplify = context->simplifyStats;
+	free_list.push_back(context);
+}
+
+TVoxelMeshingPoolStats TVoxelMeshingContextPool::getStats() {
+	FScopeLock Lock(&lock);
+
+	TVoxelMeshingPoolStats stats;
+	stats.contexts = (int32)contexts.size();
+	stats.inUse = (int32)(contexts.size() - free_list.size());
+
+	for (const std::unique_ptr<TVoxelMeshingContext>& context : contexts) {
+		stats.memory += context->released_stats;
+		stats.simplify += context->released_simplify;
+		stats.largestBuild = FMath::Max(stats.largestBuild, context->released_stats.lastBuildPeak);
+	}
+
+	return stats;
+}
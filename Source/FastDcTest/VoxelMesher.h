@@ -0,0 +1,339 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "ProceduralMeshComponent.h"
+#include "VoxelHashMap.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+
+struct TVoxelMeshData {
+	TArray<FVector> Vertices;
+	TArray<FVector> Normals;
+
+	// per vertex, the most common material on the solid side of its edges
+	TArray<uint16> Materials;
+
+	TArray<int32> Triangles;
+
+	// per vertex, filled only when the mesh was built with TVoxelSurfaceSettings enabled
+	TArray<FVector2D> UVs;
+	TArray<FLinearColor> Colors;
+	TArray<FProcMeshTangent> Tangents;
+};
+
+//
+// Vertex attributes for triplanar materials, computed per vertex by the mesher:
+//
+// - UVs project the position along the axis the normal points at most, V downwards.
+// - Tangents are that projection's U axis made orthogonal to the normal.
+// - Colors hold the weights of the x, y and z projections, |n|^4 normalized, in RGB and the
+//   material / 255 in alpha. The procedural mesh component keeps 8 bits per channel, so
+//   materials above 255 don't survive the upload.
+//
+struct TVoxelSurfaceSettings {
+	// texture repeats per unit of length, 0 leaves UVs, colors and tangents empty
+	float uvScale = 0.f;
+
+	// added to positions before they are projected, so that volumes meshed in their own local
+	// space line up in one texture space
+	FVector uvOrigin = FVector::ZeroVector;
+
+	bool isEnabled() const { return uvScale > 0.f; }
+};
+
+// Normalizes the normals of Mesh from FirstVertex on and computes their surface attributes, four
+// vertices at a time with SSE.
+void VoxelGenerateSurfaceAttributes(TVoxelMeshData& Mesh, const TVoxelSurfaceSettings& Settings, int32 FirstVertex = 0);
+
+// Unit vector on the octahedron, the lower hemisphere folded over the diagonals, as two snorm16.
+// A zero vector encodes as -32768 and decodes back to zero.
+FORCEINLINE void VoxelEncodeNormal(const FVector& n, int16 out[2]) {
+	const float l1 = FMath::Abs(n.X) + FMath::Abs(n.Y) + FMath::Abs(n.Z);
+	if (l1 < 1e-12f) {
+		out[0] = -32768;
+		out[1] = -32768;
+		return;
+	}
+
+	float u = n.X / l1;
+	float v = n.Y / l1;
+
+	if (n.Z < 0.f) {
+		const float fu = (1.f - FMath::Abs(v)) * (u >= 0.f ? 1.f : -1.f);
+		const float fv = (1.f - FMath::Abs(u)) * (v >= 0.f ? 1.f : -1.f);
+		u = fu;
+		v = fv;
+	}
+
+	out[0] = (int16)FMath::RoundToInt(FMath::Clamp(u, -1.f, 1.f) * 32767.f);
+	out[1] = (int16)FMath::RoundToInt(FMath::Clamp(v, -1.f, 1.f) * 32767.f);
+}
+
+FORCEINLINE FVector VoxelDecodeNormal(const int16 in[2]) {
+	if (in[0] == -32768) {
+		return FVector(0.f, 0.f, 0.f);
+	}
+
+	float u = in[0] * (1.f / 32767.f);
+	float v = in[1] * (1.f / 32767.f);
+	const float z = 1.f - FMath::Abs(u) - FMath::Abs(v);
+
+	if (z < 0.f) {
+		const float fu = (1.f - FMath::Abs(v)) * (u >= 0.f ? 1.f : -1.f);
+		const float fv = (1.f - FMath::Abs(u)) * (v >= 0.f ? 1.f : -1.f);
+		u = fu;
+		v = fv;
+	}
+
+	return FVector(u, v, z).GetSafeNormal();
+}
+
+//
+// One zero crossing in 8 bytes. The edge is the key it is stored under, so only where the surface
+// crosses it is kept: a fraction of the edge from its low end, 15 bits with the winding above
+// them, the octahedron mapped surface normal and the material of the solid end.
+//
+struct EdgeInfo {
+	uint16 crossing = 0;
+	int16 normal[2] = { 0, 0 };
+	unsigned short material = 0;
+
+	FORCEINLINE void setCrossing(float fraction, bool bWinding) {
+		crossing = (uint16)FMath::RoundToInt(FMath::Clamp(fraction, 0.f, 1.f) * 32767.f) | (bWinding ? 0x8000 : 0);
+	}
+
+	FORCEINLINE float fraction() const { return (crossing & 0x7fff) * (1.f / 32767.f); }
+
+	// the low end of the edge is solid
+	FORCEINLINE bool winding() const { return (crossing & 0x8000) != 0; }
+};
+
+class TVoxelMeshSimplifier;
+
+//
+// Vertices of the outermost cell layer of a volume meshed with open faces, in the volume's local
+// space. Seams to neighbouring volumes are built from these instead of remeshing either side.
+//
+struct TVoxelMeshBoundary {
+	int stride = 1;
+
+	// cells per axis, the last one ends on the volume's last sample
+	int cellNum = 0;
+
+	// encodeCell(x, y, z) -> index into the arrays below
+	TVoxelHashMap<int32> cells;
+
+	TArray<FVector> Vertices;
+	TArray<FVector> Normals;
+	TArray<uint16> Materials;
+
+	static uint32 encodeCell(int x, int y, int z) { return x | (y << 10) | (z << 20); }
+
+	void reset();
+	size_t getAllocatedSize() const;
+};
+
+//
+// What the seam of one volume in a regular grid of volumes sharing their border samples joins:
+// the volume itself at [0][0][0] and its neighbours at [dx][dy][dz], each meshed open at its own
+// stride. A volume's seam covers the sample edges on its three high faces, including the lines
+// where they meet, so that every edge between volumes belongs to exactly one seam.
+//
+struct TVoxelSeamNeighbourhood {
+	// null where a neighbour is not available, the part of the seam that needs it stays open
+	const TVoxelMeshBoundary* boundaries[2][2][2];
+
+	// position of each volume's local space in the output space
+	FVector origins[2][2][2];
+};
+
+//
+// Bytes a meshing context holds by capacity, and what its last build actually used of them.
+//
+struct TVoxelMeshingMemoryStats {
+	size_t hashMaps = 0;
+	size_t sweep = 0;
+	size_t materials = 0;
+	size_t mesh = 0;
+	size_t simplifier = 0;
+	int32 allocations = 0;
+
+	// entries, array elements and rings filled by the last build, the simplifier counted whole
+	size_t lastBuildPeak = 0;
+
+	// buffers that grew during the last build, 0 once the context is warm
+	int32 lastBuildAllocations = 0;
+
+	size_t getTotal() const { return hashMaps + sweep + materials + mesh + simplifier; }
+
+	TVoxelMeshingMemoryStats& operator+=(const TVoxelMeshingMemoryStats& other);
+};
+
+// VoxelSimplifyMesh runs through a context and the triangles they took in and left
+struct TVoxelSimplifyStats {
+	int32 runs = 0;
+	int64 inputTriangles = 0;
+	int64 outputTriangles = 0;
+
+	TVoxelSimplifyStats& operator+=(const TVoxelSimplifyStats& other);
+};
+
+//
+// Scratch memory of one mesh build.
+//
+// All containers are reset, never freed, between builds. After a context has meshed its largest
+// volume further builds through it do not touch the heap. A context is used by one thread at a
+// time; a worker may keep one for its whole lifetime or borrow one from TVoxelMeshingContextPool.
+//
+class TVoxelMeshingContext {
+
+	friend class TVoxelMeshingContextPool;
+
+private:
+	int32 mesh_allocations = 0;
+
+	// getAllocationCount() when the last build began
+	int32 build_allocations = 0;
+
+	// taken by the pool on release, under its lock
+	TVoxelMeshingMemoryStats released_stats;
+	TVoxelSimplifyStats released_simplify;
+
+	// buffers in brickMaterials no brick holds
+	std::vector<int32> free_brick_materials;
+
+public:
+	TVoxelHashMap<EdgeInfo> activeEdges;
+
+	// voxel id -> vertex index, assigned by GenerateVertexData
+	TVoxelHashMap<int32> activeVoxels;
+
+	// vertices VoxelBuildSeam had to add -> number of crossings summed into them so far
+	TVoxelHashMap<int32> seamVertices;
+
+	// rings of PolygonizeVolumeSweep, rows of a slice are y * dim + z: crossings of two node slices,
+	// three per row, the axes that have one and vertex indices of three cell slices
+	std::vector<EdgeInfo> sliceEdges;
+	std::vector<uint8> sliceAxes;
+	std::vector<int32> sliceVertices;
+
+	// materials of the bricks a build reads, each decoded once when it is first needed: brick
+	// index -> first of its samples in brickMaterials, -1 while not decoded, or -2 - material for
+	// a brick of a single material
+	std::vector<int32> brickMaterialSlots;
+	std::vector<unsigned short> brickMaterials;
+
+	// output of the last build, valid until the next reset
+	TVoxelMeshData mesh;
+
+	// scratch of VoxelSimplifyMesh, created by its first use
+	std::unique_ptr<TVoxelMeshSimplifier> simplifier;
+
+	// counted by VoxelSimplifyMesh over the lifetime of the context
+	TVoxelSimplifyStats simplifyStats;
+
+	// set by a job scheduler while the build may still be cancelled; the polygonizers look at it
+	// between their stages and per slice and stop with an incomplete mesh and boundary once it is
+	// raised. Cleared when the context goes back to the pool
+	const std::atomic<bool>* cancelFlag = nullptr;
+
+	bool isCancelled() const { return cancelFlag != nullptr && cancelFlag->load(std::memory_order_relaxed); }
+
+	// surface attributes of the builds through this context, including seams and simplification.
+	// Reset when the context goes back to the pool
+	TVoxelSurfaceSettings surface;
+
+	TVoxelMeshingContext();
+	~TVoxelMeshingContext();
+
+	void reset();
+
+	// grows the output arrays up front so that filling them never reallocates
+	void reserveMesh(int32 vertexNum, int32 indexNum);
+
+	// sizes the slice rings for slices of rowNum rows
+	void reserveSweep(int32 rowNum);
+
+	// a brick table of brickNum bricks with none of them decoded
+	void resetBrickMaterials(int32 brickNum);
+
+	// a buffer for the samples of one brick, returns its first sample
+	int32 allocateBrickMaterials();
+
+	// takes the buffers of the bricks [first, last) back, they read as not decoded again
+	void releaseBrickMaterials(int32 first, int32 last);
+
+	// number of times any scratch or output buffer had to grow since construction
+	int32 getAllocationCount() const;
+
+	size_t getAllocatedSize() const;
+
+	// only for the thread using the context
+	TVoxelMeshingMemoryStats getMemoryStats() const;
+};
+
+struct TVoxelMeshingPoolStats {
+	int32 contexts = 0;
+	int32 inUse = 0;
+
+	// contexts in use count as of their last release
+	TVoxelMeshingMemoryStats memory;
+
+	// largest lastBuildPeak of any context
+	size_t largestBuild = 0;
+
+	// contexts in use count as of their last release
+	TVoxelSimplifyStats simplify;
+};
+
+//
+// Process wide free list of meshing contexts, safe to use from any thread.
+// Contexts handed out keep their capacity, so after warm-up builds run without allocating.
+//
+class TVoxelMeshingContextPool {
+
+private:
+	FCriticalSection lock;
+	std::vector<std::unique_ptr<TVoxelMeshingContext>> contexts;
+	std::vector<TVoxelMeshingContext*> free_list;
+
+public:
+	static TVoxelMeshingContextPool& get();
+
+	TVoxelMeshingContext* acquire();
+	void release(TVoxelMeshingContext* context);
+
+	TVoxelMeshingPoolStats getStats();
+};
+
+// Dual contouring of the whole volume into context.mesh, sampling every Stride-th voxel.
+// TVolume is TVoxelData or TVoxelSnapshot. Sizes 32..256 with stride 1, 2 or 4 run a
+// kernel specialized at compile time, anything else falls back to runtime index math.
+//
+// Without a Boundary the surface is closed on the faces of the volume. With one the faces are
+// left open for VoxelBuildSeam and the vertices along them are written to Boundary; num - 1
+// must then be a multiple of Stride.
+template <typename TVolume>
+void PolygonizeVolume(const TVolume* Volume, TVoxelMeshingContext& Context, int Stride = 1, TVoxelMeshBoundary* Boundary = nullptr);
+
+// Same output through the runtime index math only, the baseline specialized kernels are checked against.
+template <typename TVolume>
+void PolygonizeVolumeReference(const TVolume* Volume, TVoxelMeshingContext& Context, int Stride = 1, TVoxelMeshBoundary* Boundary = nullptr);
+
+// Same mesh, vertices and triangles in another order, from one sweep along x that keeps only a
+// few slices of crossings and vertices. Working memory grows with the area of a slice instead of
+// the surface, and there is no limit on the cells per axis. PolygonizeVolume takes this path
+// with fastdc.SweepMesher set and for volumes too large for its hash map ids.
+template <typename TVolume>
+void PolygonizeVolumeSweep(const TVolume* Volume, TVoxelMeshingContext& Context, int Stride = 1, TVoxelMeshBoundary* Boundary = nullptr);
+
+// Seam strip of Volume into context.mesh, in the output space of Neighbours.origins. Only the
+// samples on the high faces of Volume are read, everything else comes from the boundaries.
+// Neighbouring strides may differ by any power of two: edges are taken at the finest stride
+// around them and the coarse side's cells fold quads into triangles. A coarse cell that has no
+// vertex for a crossing only the fine side samples gets one at the mean of those crossings.
+template <typename TVolume>
+void VoxelBuildSeam(const TVolume* Volume, const TVoxelSeamNeighbourhood& Neighbours, TVoxelMeshingContext& Context);
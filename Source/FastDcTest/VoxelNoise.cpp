@@ -0,0 +1,383 @@
+#include "VoxelNoise.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#if defined(__AVX2__)
+#define VOXEL_NOISE_AVX2 1
+#else
+#define VOXEL_NOISE_AVX2 0
+#endif
+
+//
+// The noise functions are written once against small lane types and instantiated for
+// scalar, SSE2 (4 lanes) and AVX2 (8 lanes). Masks select between values, integer math
+// wraps like uint32.
+//
+
+// scalar lanes
+
+struct TF1 {
+	float v;
+	TF1() { }
+	TF1(float a) : v(a) { }
+	static TF1 load(const float* p) { return TF1(*p); }
+	void store(float* p) const { *p = v; }
+};
+
+struct TI1 {
+	int32 v;
+	TI1() { }
+	TI1(int32 a) : v(a) { }
+};
+
+struct TM1 {
+	bool v;
+	TM1(bool a) : v(a) { }
+};
+
+FORCEINLINE TF1 operator+(TF1 a, TF1 b) { return TF1(a.v + b.v); }
+FORCEINLINE TF1 operator-(TF1 a, TF1 b) { return TF1(a.v - b.v); }
+FORCEINLINE TF1 operator*(TF1 a, TF1 b) { return TF1(a.v * b.v); }
+FORCEINLINE TI1 operator+(TI1 a, TI1 b) { return TI1((int32)((uint32)a.v + (uint32)b.v)); }
+FORCEINLINE TI1 operator*(TI1 a, TI1 b) { return TI1((int32)((uint32)a.v * (uint32)b.v)); }
+FORCEINLINE TI1 operator^(TI1 a, TI1 b) { return TI1(a.v ^ b.v); }
+FORCEINLINE TI1 operator&(TI1 a, TI1 b) { return TI1(a.v & b.v); }
+FORCEINLINE TM1 operator&(TM1 a, TM1 b) { return TM1(a.v && b.v); }
+FORCEINLINE TM1 operator|(TM1 a, TM1 b) { return TM1(a.v || b.v); }
+FORCEINLINE TM1 AndNot(TM1 a, TM1 b) { return TM1(!a.v && b.v); }
+FORCEINLINE TM1 Not(TM1 a) { return TM1(!a.v); }
+FORCEINLINE TI1 Shr(TI1 a, int n) { return TI1((int32)((uint32)a.v >> n)); }
+FORCEINLINE TI1 Shl(TI1 a, int n) { return TI1((int32)((uint32)a.v << n)); }
+FORCEINLINE TF1 Floor(TF1 a) { return TF1(FMath::FloorToFloat(a.v)); }
+FORCEINLINE TI1 ToInt(TF1 a) { return TI1((int32)a.v); }
+FORCEINLINE TF1 ToFloat(TI1 a) { return TF1((float)a.v); }
+FORCEINLINE TF1 Max(TF1 a, TF1 b) { return TF1(a.v > b.v ? a.v : b.v); }
+FORCEINLINE TM1 GreaterEq(TF1 a, TF1 b) { return TM1(a.v >= b.v); }
+FORCEINLINE TM1 IntLess(TI1 a, TI1 b) { return TM1(a.v < b.v); }
+FORCEINLINE TM1 IntEq(TI1 a, TI1 b) { return TM1(a.v == b.v); }
+FORCEINLINE TF1 Select(TM1 m, TF1 a, TF1 b) { return m.v ? a : b; }
+FORCEINLINE TI1 MaskToInt(TM1 m) { return TI1(m.v ? 1 : 0); }
+
+FORCEINLINE TF1 FlipSign(TF1 a, TI1 signBit) {
+	uint32 bits;
+	FMemory::Memcpy(&bits, &a.v, sizeof(bits));
+	bits ^= (uint32)signBit.v;
+	FMemory::Memcpy(&a.v, &bits, sizeof(bits));
+	return a;
+}
+
+// SSE2 lanes
+
+struct TF4 {
+	__m128 v;
+	TF4() { }
+	TF4(__m128 a) : v(a) { }
+	TF4(float a) : v(_mm_set1_ps(a)) { }
+	static TF4 load(const float* p) { return TF4(_mm_loadu_ps(p)); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+struct TI4 {
+	__m128i v;
+	TI4() { }
+	TI4(__m128i a) : v(a) { }
+	TI4(int32 a) : v(_mm_set1_epi32(a)) { }
+};
+
+struct TM4 {
+	__m128 v;
+	TM4(__m128 a) : v(a) { }
+};
+
+// SSE2 has no 32 bit mullo, combine the even and odd 64 bit products
+FORCEINLINE __m128i MulLo32(__m128i a, __m128i b) {
+	const __m128i even = _mm_mul_epu32(a, b);
+	const __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+FORCEINLINE TF4 operator+(TF4 a, TF4 b) { return TF4(_mm_add_ps(a.v, b.v)); }
+FORCEINLINE TF4 operator-(TF4 a, TF4 b) { return TF4(_mm_sub_ps(a.v, b.v)); }
+FORCEINLINE TF4 operator*(TF4 a, TF4 b) { return TF4(_mm_mul_ps(a.v, b.v)); }
+FORCEINLINE TI4 operator+(TI4 a, TI4 b) { return TI4(_mm_add_epi32(a.v, b.v)); }
+FORCEINLINE TI4 operator*(TI4 a, TI4 b) { return TI4(MulLo32(a.v, b.v)); }
+FORCEINLINE TI4 operator^(TI4 a, TI4 b) { return TI4(_mm_xor_si128(a.v, b.v)); }
+FORCEINLINE TI4 operator&(TI4 a, TI4 b) { return TI4(_mm_and_si128(a.v, b.v)); }
+FORCEINLINE TM4 operator&(TM4 a, TM4 b) { return TM4(_mm_and_ps(a.v, b.v)); }
+FORCEINLINE TM4 operator|(TM4 a, TM4 b) { return TM4(_mm_or_ps(a.v, b.v)); }
+FORCEINLINE TM4 AndNot(TM4 a, TM4 b) { return TM4(_mm_andnot_ps(a.v, b.v)); }
+FORCEINLINE TM4 Not(TM4 a) { return TM4(_mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1)))); }
+FORCEINLINE TI4 Shr(TI4 a, int n) { return TI4(_mm_srli_epi32(a.v, n)); }
+FORCEINLINE TI4 Shl(TI4 a, int n) { return TI4(_mm_slli_epi32(a.v, n)); }
+FORCEINLINE TI4 ToInt(TF4 a) { return TI4(_mm_cvttps_epi32(a.v)); }
+FORCEINLINE TF4 ToFloat(TI4 a) { return TF4(_mm_cvtepi32_ps(a.v)); }
+FORCEINLINE TF4 Max(TF4 a, TF4 b) { return TF4(_mm_max_ps(a.v, b.v)); }
+FORCEINLINE TM4 GreaterEq(TF4 a, TF4 b) { return TM4(_mm_cmpge_ps(a.v, b.v)); }
+FORCEINLINE TM4 IntLess(TI4 a, TI4 b) { return TM4(_mm_castsi128_ps(_mm_cmplt_epi32(a.v, b.v))); }
+FORCEINLINE TM4 IntEq(TI4 a, TI4 b) { return TM4(_mm_castsi128_ps(_mm_cmpeq_epi32(a.v, b.v))); }
+FORCEINLINE TF4 Select(TM4 m, TF4 a, TF4 b) { return TF4(_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))); }
+FORCEINLINE TI4 MaskToInt(TM4 m) { return TI4(_mm_srli_epi32(_mm_castps_si128(m.v), 31)); }
+FORCEINLINE TF4 FlipSign(TF4 a, TI4 signBit) { return TF4(_mm_xor_ps(a.v, _mm_castsi128_ps(signBit.v))); }
+
+FORCEINLINE TF4 Floor(TF4 a) {
+	// truncation rounds negative values up, step those down by one
+	const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+	return TF4(_mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.f))));
+}
+
+#if VOXEL_NOISE_AVX2
+
+// AVX2 lanes
+
+struct TF8 {
+	__m256 v;
+	TF8() { }
+	TF8(__m256 a) : v(a) { }
+	TF8(float a) : v(_mm256_set1_ps(a)) { }
+	static TF8 load(const float* p) { return TF8(_mm256_loadu_ps(p)); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+struct TI8 {
+	__m256i v;
+	TI8() { }
+	TI8(__m256i a) : v(a) { }
+	TI8(int32 a) : v(_mm256_set1_epi32(a)) { }
+};
+
+struct TM8 {
+	__m256 v;
+	TM8(__m256 a) : v(a) { }
+};
+
+FORCEINLINE TF8 operator+(TF8 a, TF8 b) { return TF8(_mm256_add_ps(a.v, b.v)); }
+FORCEINLINE TF8 operator-(TF8 a, TF8 b) { return TF8(_mm256_sub_ps(a.v, b.v)); }
+FORCEINLINE TF8 operator*(TF8 a, TF8 b) { return TF8(_mm256_mul_ps(a.v, b.v)); }
+FORCEINLINE TI8 operator+(TI8 a, TI8 b) { return TI8(_mm256_add_epi32(a.v, b.v)); }
+FORCEINLINE TI8 operator*(TI8 a, TI8 b) { return TI8(_mm256_mullo_epi32(a.v, b.v)); }
+FORCEINLINE TI8 operator^(TI8 a, TI8 b) { return TI8(_mm256_xor_si256(a.v, b.v)); }
+FORCEINLINE TI8 operator&(TI8 a, TI8 b) { return TI8(_mm256_and_si256(a.v, b.v)); }
+FORCEINLINE TM8 operator&(TM8 a, TM8 b) { return TM8(_mm256_and_ps(a.v, b.v)); }
+FORCEINLINE TM8 operator|(TM8 a, TM8 b) { return TM8(_mm256_or_ps(a.v, b.v)); }
+FORCEINLINE TM8 AndNot(TM8 a, TM8 b) { return TM8(_mm256_andnot_ps(a.v, b.v)); }
+FORCEINLINE TM8 Not(TM8 a) { return TM8(_mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))); }
+FORCEINLINE TI8 Shr(TI8 a, int n) { return TI8(_mm256_srli_epi32(a.v, n)); }
+FORCEINLINE TI8 Shl(TI8 a, int n) { return TI8(_mm256_slli_epi32(a.v, n)); }
+FORCEINLINE TF8 Floor(TF8 a) { return TF8(_mm256_floor_ps(a.v)); }
+FORCEINLINE TI8 ToInt(TF8 a) { return TI8(_mm256_cvttps_epi32(a.v)); }
+FORCEINLINE TF8 ToFloat(TI8 a) { return TF8(_mm256_cvtepi32_ps(a.v)); }
+FORCEINLINE TF8 Max(TF8 a, TF8 b) { return TF8(_mm256_max_ps(a.v, b.v)); }
+FORCEINLINE TM8 GreaterEq(TF8 a, TF8 b) { return TM8(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)); }
+FORCEINLINE TM8 IntLess(TI8 a, TI8 b) { return TM8(_mm256_castsi256_ps(_mm256_cmpgt_epi32(b.v, a.v))); }
+FORCEINLINE TM8 IntEq(TI8 a, TI8 b) { return TM8(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v))); }
+FORCEINLINE TF8 Select(TM8 m, TF8 a, TF8 b) { return TF8(_mm256_blendv_ps(b.v, a.v, m.v)); }
+FORCEINLINE TI8 MaskToInt(TM8 m) { return TI8(_mm256_srli_epi32(_mm256_castps_si256(m.v), 31)); }
+FORCEINLINE TF8 FlipSign(TF8 a, TI8 signBit) { return TF8(_mm256_xor_ps(a.v, _mm256_castsi256_ps(signBit.v))); }
+
+#endif
+
+// noise kernels, shared by all lane widths
+
+template <typename TI>
+FORCEINLINE TI Hash3(TI x, TI y, TI z, TI seed) {
+	TI h = seed ^ (x * TI(501125321)) ^ (y * TI(1136930381)) ^ (z * TI(1720413743));
+	h = h * TI(0x27d4eb2d);
+	return h ^ Shr(h, 15);
+}
+
+// one of Perlin's 12 edge gradients dotted with the offset
+template <typename TF, typename TI>
+FORCEINLINE TF Grad3(TI hash, TF x, TF y, TF z) {
+	const TI h = hash & TI(15);
+	const TF u = Select(IntLess(h, TI(8)), x, y);
+	const TF v = Select(IntLess(h, TI(4)), y, Select(IntEq(h, TI(12)) | IntEq(h, TI(14)), x, z));
+	return FlipSign(u, Shl(h & TI(1), 31)) + FlipSign(v, Shl(h & TI(2), 30));
+}
+
+template <typename TF>
+FORCEINLINE TF Lerp(TF a, TF b, TF t) {
+	return a + (b - a) * t;
+}
+
+template <typename TF, typename TI>
+FORCEINLINE TF GradientNoise(TF x, TF y, TF z, TI seed) {
+	const TF fx = Floor(x);
+	const TF fy = Floor(y);
+	const TF fz = Floor(z);
+
+	const TI ix = ToInt(fx);
+	const TI iy = ToInt(fy);
+	const TI iz = ToInt(fz);
+
+	const TF x0 = x - fx;
+	const TF y0 = y - fy;
+	const TF z0 = z - fz;
+	const TF x1 = x0 - TF(1.f);
+	const TF y1 = y0 - TF(1.f);
+	const TF z1 = z0 - TF(1.f);
+
+	// 6t^5 - 15t^4 + 10t^3
+	const TF u = x0 * x0 * x0 * (x0 * (x0 * TF(6.f) - TF(15.f)) + TF(10.f));
+	const TF v = y0 * y0 * y0 * (y0 * (y0 * TF(6.f) - TF(15.f)) + TF(10.f));
+	const TF w = z0 * z0 * z0 * (z0 * (z0 * TF(6.f) - TF(15.f)) + TF(10.f));
+
+	const TI ix1 = ix + TI(1);
+	const TI iy1 = iy + TI(1);
+	const TI iz1 = iz + TI(1);
+
+	const TF n000 = Grad3(Hash3(ix, iy, iz, seed), x0, y0, z0);
+	const TF n100 = Grad3(Hash3(ix1, iy, iz, seed), x1, y0, z0);
+	const TF n010 = Grad3(Hash3(ix, iy1, iz, seed), x0, y1, z0);
+	const TF n110 = Grad3(Hash3(ix1, iy1, iz, seed), x1, y1, z0);
+	const TF n001 = Grad3(Hash3(ix, iy, iz1, seed), x0, y0, z1);
+	const TF n101 = Grad3(Hash3(ix1, iy, iz1, seed), x1, y0, z1);
+	const TF n011 = Grad3(Hash3(ix, iy1, iz1, seed), x0, y1, z1);
+	const TF n111 = Grad3(Hash3(ix1, iy1, iz1, seed), x1, y1, z1);
+
+	return Lerp(
+		Lerp(Lerp(n000, n100, u), Lerp(n010, n110, u), v),
+		Lerp(Lerp(n001, n101, u), Lerp(n011, n111, u), v),
+		w);
+}
+
+template <typename TF, typename TI>
+FORCEINLINE TF SimplexCorner(TF x, TF y, TF z, TI hash) {
+	const TF t = Max(TF(0.6f) - x * x - y * y - z * z, TF(0.f));
+	const TF t2 = t * t;
+	return t2 * t2 * Grad3(hash, x, y, z);
+}
+
+template <typename TF, typename TI>
+FORCEINLINE TF SimplexNoise(TF x, TF y, TF z, TI seed) {
+	static const float F3 = 1.f / 3.f;
+	static const float G3 = 1.f / 6.f;
+
+	// skew into the simplex lattice
+	const TF s = (x + y + z) * TF(F3);
+	const TF fi = Floor(x + s);
+	const TF fj = Floor(y + s);
+	const TF fk = Floor(z + s);
+
+	const TF t = (fi + fj + fk) * TF(G3);
+	const TF x0 = x - (fi - t);
+	const TF y0 = y - (fj - t);
+	const TF z0 = z - (fk - t);
+
+	// which of the six tetrahedra the point falls into
+	const auto xGeY = GreaterEq(x0, y0);
+	const auto yGeZ = GreaterEq(y0, z0);
+	const auto xGeZ = GreaterEq(x0, z0);
+
+	const auto i1 = xGeY & xGeZ;
+	const auto j1 = AndNot(xGeY, yGeZ);
+	const auto k1 = Not(xGeZ) & Not(yGeZ);
+	const auto i2 = xGeY | xGeZ;
+	const auto j2 = Not(xGeY) | yGeZ;
+	const auto k2 = Not(xGeZ & yGeZ);
+
+	const TF x1 = x0 - Select(i1, TF(1.f), TF(0.f)) + TF(G3);
+	const TF y1 = y0 - Select(j1, TF(1.f), TF(0.f)) + TF(G3);
+	const TF z1 = z0 - Select(k1, TF(1.f), TF(0.f)) + TF(G3);
+	const TF x2 = x0 - Select(i2, TF(1.f), TF(0.f)) + TF(2.f * G3);
+	const TF y2 = y0 - Select(j2, TF(1.f), TF(0.f)) + TF(2.f * G3);
+	const TF z2 = z0 - Select(k2, TF(1.f), TF(0.f)) + TF(2.f * G3);
+	const TF x3 = x0 - TF(1.f - 3.f * G3);
+	const TF y3 = y0 - TF(1.f - 3.f * G3);
+	const TF z3 = z0 - TF(1.f - 3.f * G3);
+
+	const TI i = ToInt(fi);
+	const TI j = ToInt(fj);
+	const TI k = ToInt(fk);
+
+	const TF n0 = SimplexCorner(x0, y0, z0, Hash3(i, j, k, seed));
+	const TF n1 = SimplexCorner(x1, y1, z1, Hash3(i + MaskToInt(i1), j + MaskToInt(j1), k + MaskToInt(k1), seed));
+	const TF n2 = SimplexCorner(x2, y2, z2, Hash3(i + MaskToInt(i2), j + MaskToInt(j2), k + MaskToInt(k2), seed));
+	const TF n3 = SimplexCorner(x3, y3, z3, Hash3(i + TI(1), j + TI(1), k + TI(1), seed));
+
+	return (n0 + n1 + n2 + n3) * TF(32.f);
+}
+
+template <typename TF, typename TI>
+static int NoiseRowLanes(TVoxelNoiseType type, const float* x, const float* y, const float* z, int count, int32 seed, float* out, int width) {
+	int i = 0;
+	for (; i + width <= count; i += width) {
+		const TF px = TF::load(x + i);
+		const TF py = TF::load(y + i);
+		const TF pz = TF::load(z + i);
+
+		const TF n = type == TVoxelNoiseType::Gradient ? GradientNoise(px, py, pz, TI(seed)) : SimplexNoise(px, py, pz, TI(seed));
+		n.store(out + i);
+	}
+
+	return i;
+}
+
+float VoxelGradientNoise(float x, float y, float z, int32 seed) {
+	return GradientNoise(TF1(x), TF1(y), TF1(z), TI1(seed)).v;
+}
+
+float VoxelSimplexNoise(float x, float y, float z, int32 seed) {
+	return SimplexNoise(TF1(x), TF1(y), TF1(z), TI1(seed)).v;
+}
+
+void VoxelNoiseRow(TVoxelNoiseType type, const float* x, const float* y, const float* z, int count, int32 seed, float* out) {
+#if VOXEL_NOISE_AVX2
+	int i = NoiseRowLanes<TF8, TI8>(type, x, y, z, count, seed, out, 8);
+#else
+	int i = NoiseRowLanes<TF4, TI4>(type, x, y, z, count, seed, out, 4);
+#endif
+
+	// tail
+	for (; i < count; i++) {
+		out[i] = type == TVoxelNoiseType::Gradient ? VoxelGradientNoise(x[i], y[i], z[i], seed) : VoxelSimplexNoise(x[i], y[i], z[i], seed);
+	}
+}
+
+float TVoxelFbmSettings::amplitudeBound() const {
+	float sum = 0;
+	float amplitude = 1;
+	for (int i = 0; i < octaves; i++) {
+		sum += amplitude;
+		amplitude *= gain;
+	}
+
+	// both noises stay a little inside +-1.1
+	return sum * 1.1f;
+}
+
+void VoxelFbmRow(const TVoxelFbmSettings& settings, const float* x, const float* y, const float* z, int count, float* out) {
+	static const int BATCH = 64;
+
+	float sx[BATCH];
+	float sy[BATCH];
+	float sz[BATCH];
+	float n[BATCH];
+
+	for (int start = 0; start < count; start += BATCH) {
+		const int len = FMath::Min(BATCH, count - start);
+
+		for (int i = 0; i < len; i++) {
+			out[start + i] = 0;
+		}
+
+		float frequency = settings.frequency;
+		float amplitude = 1;
+
+		for (int octave = 0; octave < settings.octaves; octave++) {
+			for (int i = 0; i < len; i++) {
+				sx[i] = x[start + i] * frequency;
+				sy[i] = y[start + i] * frequency;
+				sz[i] = z[start + i] * frequency;
+			}
+
+			VoxelNoiseRow(settings.type, sx, sy, sz, len, settings.seed + octave, n);
+
+			for (int i = 0; i < len; i++) {
+				out[start + i] += n[i] * amplitude;
+			}
+
+			frequency *= settings.lacunarity;
+			amplitude *= settings.gain;
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+//
+// Batch gradient (improved Perlin) and simplex noise, both roughly in [-1, 1].
+//
+// Rows run 8 samples at a time when the module is compiled with AVX2, 4 at a time with SSE2
+// otherwise; the scalar functions are the reference the SIMD lanes match. Lattice hashing is
+// arithmetic, so there is no permutation table to gather from and any int seed works.
+//
+
+enum class TVoxelNoiseType : uint8 {
+	Gradient,
+	Simplex
+};
+
+struct TVoxelFbmSettings {
+	TVoxelNoiseType type = TVoxelNoiseType::Simplex;
+	float frequency = 0.001f;
+	int octaves = 5;
+	float lacunarity = 2.f;
+	float gain = 0.5f;
+	int32 seed = 1337;
+
+	// upper bound of |fbm|, for analytic bounds
+	float amplitudeBound() const;
+};
+
+float VoxelGradientNoise(float x, float y, float z, int32 seed);
+float VoxelSimplexNoise(float x, float y, float z, int32 seed);
+
+void VoxelNoiseRow(TVoxelNoiseType type, const float* x, const float* y, const float* z, int count, int32 seed, float* out);
+void VoxelFbmRow(const TVoxelFbmSettings& settings, const float* x, const float* y, const float* z, int count, float* out);
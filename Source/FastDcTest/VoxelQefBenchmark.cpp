@@ -0,0 +1,452 @@
+#include "VoxelQefBenchmark.h"
+
+#if !UE_BUILD_SHIPPING
+
+#include "qef_simd.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+enum class TQefFeature : uint8 {
+	Plane,
+	Edge,
+	Corner,
+	Degenerate,
+	Num
+};
+
+static const TCHAR* QEF_FEATURE_NAMES[] = { TEXT("plane"), TEXT("edge"), TEXT("corner"), TEXT("degenerate") };
+
+// one cell's hermite data in every layout the entry points take
+struct TQefProblem {
+	TQefFeature feature;
+	int count;
+
+	__m128 simd_positions[QEF_MAX_INPUT_COUNT];
+	__m128 simd_normals[QEF_MAX_INPUT_COUNT];
+
+	FVector4 positions[QEF_MAX_INPUT_COUNT];
+	FVector4 normals[QEF_MAX_INPUT_COUNT];
+
+	// position, normal, position, normal, ...
+	FVector4 interleaved[QEF_MAX_INPUT_COUNT * 2];
+
+	float positions3[QEF_MAX_INPUT_COUNT * 3];
+	float normals3[QEF_MAX_INPUT_COUNT * 3];
+
+	double positionsd[QEF_MAX_INPUT_COUNT * 4];
+	double normalsd[QEF_MAX_INPUT_COUNT * 4];
+
+	void set(int i, const FVector& p, const FVector& n) {
+		simd_positions[i] = _mm_set_ps(1.f, p.Z, p.Y, p.X);
+		simd_normals[i] = _mm_set_ps(0.f, n.Z, n.Y, n.X);
+
+		positions[i] = FVector4(p, 1.f);
+		normals[i] = FVector4(n, 0.f);
+
+		interleaved[i * 2] = positions[i];
+		interleaved[i * 2 + 1] = normals[i];
+
+		for (int c = 0; c < 3; c++) {
+			positions3[i * 3 + c] = p[c];
+			normals3[i * 3 + c] = n[c];
+		}
+
+		for (int c = 0; c < 4; c++) {
+			positionsd[i * 4 + c] = positions[i][c];
+			normalsd[i * 4 + c] = normals[i][c];
+		}
+	}
+};
+
+//====================================================================================
+// Problems
+//====================================================================================
+
+static FVector RandomUnit(FRandomStream& stream) {
+	for (;;) {
+		const FVector v(stream.FRandRange(-1.f, 1.f), stream.FRandRange(-1.f, 1.f), stream.FRandRange(-1.f, 1.f));
+		const float size = v.Size();
+		if (size > 0.1f && size <= 1.f) {
+			return v / size;
+		}
+	}
+}
+
+// surfaces through a point of a unit cell somewhere in a 256 cell volume, as the mesher sees them
+static void MakeProblem(FRandomStream& stream, TQefFeature feature, TQefProblem& problem) {
+	problem.feature = feature;
+	problem.count = stream.RandRange(2, QEF_MAX_INPUT_COUNT);
+
+	const FVector cell(stream.RandRange(-128, 127), stream.RandRange(-128, 127), stream.RandRange(-128, 127));
+	const FVector center = cell + FVector(stream.FRandRange(0.2f, 0.8f), stream.FRandRange(0.2f, 0.8f), stream.FRandRange(0.2f, 0.8f));
+
+	auto randomInCell = [&]() {
+		return cell + FVector(stream.FRand(), stream.FRand(), stream.FRand());
+	};
+
+	if (feature == TQefFeature::Degenerate) {
+		const FVector p = randomInCell();
+		const FVector n = RandomUnit(stream);
+
+		switch (stream.RandRange(0, 3)) {
+		case 0:
+			// every intersection at the same spot
+			for (int i = 0; i < problem.count; i++) {
+				problem.set(i, p, n);
+			}
+			break;
+		case 1:
+			// some normals lost to a flat density gradient
+			for (int i = 0; i < problem.count; i++) {
+				problem.set(i, randomInCell(), i % 2 ? FVector(0, 0, 0) : n);
+			}
+			break;
+		case 2:
+			// two intersections on almost parallel planes
+			problem.count = 2;
+			problem.set(0, p, n);
+			problem.set(1, randomInCell(), (n + RandomUnit(stream) * 0.001f).GetSafeNormal());
+			break;
+		default:
+			// one plane seen from far away, the points span the whole volume
+			for (int i = 0; i < problem.count; i++) {
+				problem.set(i, FVector(stream.FRandRange(-128.f, 128.f), stream.FRandRange(-128.f, 128.f), p.Z), FVector(0, 0, 1));
+			}
+			break;
+		}
+
+		return;
+	}
+
+	const int planeNum = feature == TQefFeature::Plane ? 1 : feature == TQefFeature::Edge ? 2 : 3;
+
+	FVector planes[3];
+	for (int k = 0; k < planeNum; k++) {
+		planes[k] = RandomUnit(stream);
+	}
+
+	for (int i = 0; i < problem.count; i++) {
+		const FVector& n = planes[i % planeNum];
+		const FVector q = randomInCell();
+
+		// on the plane, with the jitter of normals estimated from quantized densities
+		const FVector p = q - n * FVector::DotProduct(q - center, n);
+		problem.set(i, p, (n + RandomUnit(stream) * 0.02f).GetSafeNormal());
+	}
+}
+
+//====================================================================================
+// Reference
+//====================================================================================
+
+static void JacobiRotate(double a[3][3], double v[3][3], int p, int q) {
+	if (a[p][q] == 0) {
+		return;
+	}
+
+	const double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+	const double t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+	const double c = 1 / std::sqrt(t * t + 1);
+	const double s = t * c;
+
+	for (int k = 0; k < 3; k++) {
+		const double akp = a[k][p];
+		const double akq = a[k][q];
+		a[k][p] = c * akp - s * akq;
+		a[k][q] = s * akp + c * akq;
+	}
+
+	for (int k = 0; k < 3; k++) {
+		const double apk = a[p][k];
+		const double aqk = a[q][k];
+		a[p][k] = c * apk - s * aqk;
+		a[q][k] = s * apk + c * aqk;
+	}
+
+	for (int k = 0; k < 3; k++) {
+		const double vkp = v[k][p];
+		const double vkq = v[k][q];
+		v[k][p] = c * vkp - s * vkq;
+		v[k][q] = s * vkp + c * vkq;
+	}
+}
+
+// same pseudo inverse truncation as qef_simd.h, but with exact arithmetic and full convergence
+static void ReferenceSolve(const TQefProblem& problem, double x[3]) {
+	double ata[3][3] = {};
+	double atb[3] = {};
+	double mass[3] = {};
+
+	for (int i = 0; i < problem.count; i++) {
+		const double p[3] = { problem.positions[i].X, problem.positions[i].Y, problem.positions[i].Z };
+		const double n[3] = { problem.normals[i].X, problem.normals[i].Y, problem.normals[i].Z };
+		const double d = p[0] * n[0] + p[1] * n[1] + p[2] * n[2];
+
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				ata[r][c] += n[r] * n[c];
+			}
+
+			atb[r] += d * n[r];
+			mass[r] += p[r];
+		}
+	}
+
+	double b[3];
+	for (int r = 0; r < 3; r++) {
+		mass[r] /= problem.count;
+	}
+
+	for (int r = 0; r < 3; r++) {
+		b[r] = atb[r] - (ata[r][0] * mass[0] + ata[r][1] * mass[1] + ata[r][2] * mass[2]);
+	}
+
+	double a[3][3];
+	double v[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+	FMemory::Memcpy(a, ata, sizeof(a));
+
+	for (int sweep = 0; sweep < 64; sweep++) {
+		if (a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2] < 1e-30) {
+			break;
+		}
+
+		JacobiRotate(a, v, 0, 1);
+		JacobiRotate(a, v, 0, 2);
+		JacobiRotate(a, v, 1, 2);
+	}
+
+	double y[3] = {};
+	for (int k = 0; k < 3; k++) {
+		const double sigma = a[k][k];
+		const double inv = sigma != 0 ? 1 / sigma : 0;
+		if (sigma == 0 || FMath::Min(std::fabs(sigma), std::fabs(inv)) < PSUEDO_INVERSE_THRESHOLD) {
+			continue;
+		}
+
+		// project b on the eigenvector and scale
+		const double projection = (v[0][k] * b[0] + v[1][k] * b[1] + v[2][k] * b[2]) * inv;
+		for (int r = 0; r < 3; r++) {
+			y[r] += v[r][k] * projection;
+		}
+	}
+
+	for (int r = 0; r < 3; r++) {
+		x[r] = y[r] + mass[r];
+	}
+}
+
+// sum of squared plane distances of x, the quantity all solvers minimize
+static double QefResidual(const TQefProblem& problem, const double x[3]) {
+	double sum = 0;
+	for (int i = 0; i < problem.count; i++) {
+		const FVector4& p = problem.positions[i];
+		const FVector4& n = problem.normals[i];
+		const double d = n.X * (x[0] - p.X) + n.Y * (x[1] - p.Y) + n.Z * (x[2] - p.Z);
+		sum += d * d;
+	}
+
+	return sum;
+}
+
+//====================================================================================
+// Entry points
+//====================================================================================
+
+enum class TQefEntry : uint8 {
+	Simd,
+	Vec4,
+	Interleaved,
+	Vec3,
+	Deterministic,
+	Double,
+	Num
+};
+
+static const TCHAR* QEF_ENTRY_NAMES[] = { TEXT("simd"), TEXT("4d"), TEXT("4d_interleaved"), TEXT("3d"), TEXT("4d_deterministic"), TEXT("4d_double") };
+
+template <TQefEntry Entry>
+FORCEINLINE float Solve(const TQefProblem& problem, int sweeps, FVector4& out) {
+	switch (Entry) {
+	case TQefEntry::Simd: {
+		__m128 solved;
+		const float error = qef_solve_from_points(problem.simd_positions, problem.simd_normals, problem.count, &solved, sweeps);
+		_mm_store_ps(&out.X, solved);
+		return error;
+	}
+	case TQefEntry::Vec4:
+		return qef_solve_from_points_4d(&problem.positions[0].X, &problem.normals[0].X, problem.count, &out.X, sweeps);
+	case TQefEntry::Interleaved:
+		return qef_solve_from_points_4d_interleaved(&problem.interleaved[0].X, 8, problem.count, &out.X, sweeps);
+	case TQefEntry::Deterministic:
+		return qef_solve_from_points_4d(&problem.positions[0].X, &problem.normals[0].X, problem.count, &out.X, sweeps, true);
+	case TQefEntry::Double: {
+		double solved[4];
+		const double error = qef_solve_from_points_4d_double(problem.positionsd, problem.normalsd, problem.count, solved, sweeps);
+		out = FVector4(solved[0], solved[1], solved[2], solved[3]);
+		return (float)error;
+	}
+	default:
+		return qef_solve_from_points_3d(problem.positions3, problem.normals3, problem.count, &out.X, sweeps);
+	}
+}
+
+struct TQefBenchmarkResult {
+	double nsPerSolve = 0;
+	double batchSolvesPerSecond = 0;
+
+	double meanError[(int)TQefFeature::Num] = {};
+	double maxError = 0;
+
+	// residual above the reference solution, averaged over the non degenerate problems
+	double meanExcessResidual = 0;
+};
+
+template <TQefEntry Entry>
+static TQefBenchmarkResult Measure(const std::vector<TQefProblem>& problems, const std::vector<FVector>& reference, int sweeps, int32 repetitions) {
+	TQefBenchmarkResult result;
+	const int32 num = (int32)problems.size();
+
+	// accuracy
+	int32 featureCount[(int)TQefFeature::Num] = {};
+	int32 residualCount = 0;
+
+	for (int32 i = 0; i < num; i++) {
+		const TQefProblem& problem = problems[i];
+
+		FVector4 solved;
+		Solve<Entry>(problem, sweeps, solved);
+
+		const double error = (FVector(solved.X, solved.Y, solved.Z) - reference[i]).Size();
+		result.meanError[(int)problem.feature] += error;
+		result.maxError = FMath::Max(result.maxError, error);
+		featureCount[(int)problem.feature]++;
+
+		if (problem.feature != TQefFeature::Degenerate) {
+			const double x[3] = { solved.X, solved.Y, solved.Z };
+			const double r[3] = { reference[i].X, reference[i].Y, reference[i].Z };
+			result.meanExcessResidual += QefResidual(problem, x) - QefResidual(problem, r);
+			residualCount++;
+		}
+	}
+
+	for (int f = 0; f < (int)TQefFeature::Num; f++) {
+		result.meanError[f] /= FMath::Max(featureCount[f], 1);
+	}
+
+	result.meanExcessResidual /= FMath::Max(residualCount, 1);
+
+	// a sink the optimizer cannot see through
+	std::atomic<float> sink(0.f);
+
+	// single thread latency
+	double start = FPlatformTime::Seconds();
+	float sum = 0;
+	for (int32 r = 0; r < repetitions; r++) {
+		for (int32 i = 0; i < num; i++) {
+			FVector4 solved;
+			sum += Solve<Entry>(problems[i], sweeps, solved) + solved.X;
+		}
+	}
+
+	result.nsPerSolve = (FPlatformTime::Seconds() - start) * 1e9 / ((double)num * repetitions);
+	sink = sink + sum;
+
+	// every worker solving its own slice at once
+	static const int32 BATCHES = 64;
+
+	start = FPlatformTime::Seconds();
+	ParallelFor(BATCHES, [&](int32 batch) {
+		const int32 begin = num * batch / BATCHES;
+		const int32 end = num * (batch + 1) / BATCHES;
+
+		float batchSum = 0;
+		for (int32 r = 0; r < repetitions; r++) {
+			for (int32 i = begin; i < end; i++) {
+				FVector4 solved;
+				batchSum += Solve<Entry>(problems[i], sweeps, solved) + solved.X;
+			}
+		}
+
+		float expected = sink.load();
+		while (!sink.compare_exchange_weak(expected, expected + batchSum)) { }
+	});
+
+	result.batchSolvesPerSecond = (double)num * repetitions / (FPlatformTime::Seconds() - start);
+	return result;
+}
+
+static TQefBenchmarkResult MeasureEntry(TQefEntry entry, const std::vector<TQefProblem>& problems, const std::vector<FVector>& reference, int sweeps, int32 repetitions) {
+	switch (entry) {
+	case TQefEntry::Simd:
+		return Measure<TQefEntry::Simd>(problems, reference, sweeps, repetitions);
+	case TQefEntry::Vec4:
+		return Measure<TQefEntry::Vec4>(problems, reference, sweeps, repetitions);
+	case TQefEntry::Interleaved:
+		return Measure<TQefEntry::Interleaved>(problems, reference, sweeps, repetitions);
+	case TQefEntry::Deterministic:
+		return Measure<TQefEntry::Deterministic>(problems, reference, sweeps, repetitions);
+	case TQefEntry::Double:
+		return Measure<TQefEntry::Double>(problems, reference, sweeps, repetitions);
+	default:
+		return Measure<TQefEntry::Vec3>(problems, reference, sweeps, repetitions);
+	}
+}
+
+void VoxelBenchmarkQef(int32 problemNum, int32 repetitions) {
+	static const int SWEEPS[] = { 1, 2, 3, 4, 5, 6, 8 };
+
+	FRandomStream stream(5);
+
+	std::vector<TQefProblem> problems(FMath::Max(problemNum, 4));
+	std::vector<FVector> reference(problems.size());
+
+	for (size_t i = 0; i < problems.size(); i++) {
+		MakeProblem(stream, (TQefFeature)(i % (int)TQefFeature::Num), problems[i]);
+
+		double x[3];
+		ReferenceSolve(problems[i], x);
+		reference[i] = FVector(x[0], x[1], x[2]);
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("BenchQef: %d problems x %d repetitions, errors in cell units"), (int32)problems.size(), repetitions);
+	UE_LOG(LogTemp, Display, TEXT("%-15s %6s %9s %12s %10s %10s %10s %10s %10s %12s"),
+		TEXT("entry"), TEXT("sweeps"), TEXT("ns/solve"), TEXT("batch M/s"),
+		QEF_FEATURE_NAMES[0], QEF_FEATURE_NAMES[1], QEF_FEATURE_NAMES[2], QEF_FEATURE_NAMES[3], TEXT("max"), TEXT("excess res."));
+
+	for (int e = 0; e < (int)TQefEntry::Num; e++) {
+		for (int sweeps : SWEEPS) {
+			const TQefBenchmarkResult r = MeasureEntry((TQefEntry)e, problems, reference, sweeps, repetitions);
+
+			UE_LOG(LogTemp, Display, TEXT("%-15s %6d %9.1f %12.2f %10.2e %10.2e %10.2e %10.2e %10.2e %12.2e"),
+				QEF_ENTRY_NAMES[e], sweeps, r.nsPerSolve, r.batchSolvesPerSecond * 1e-6,
+				r.meanError[0], r.meanError[1], r.meanError[2], r.meanError[3], r.maxError, r.meanExcessResidual);
+		}
+	}
+}
+
+static void BenchQefCommand(const TArray<FString>& Args) {
+	int32 ProblemNum = 4096;
+	int32 Repetitions = 20;
+
+	for (const FString& Arg : Args) {
+		if (Arg.StartsWith(TEXT("problems="))) {
+			ProblemNum = FCString::Atoi(*Arg.Mid(9));
+		} else if (Arg.StartsWith(TEXT("reps="))) {
+			Repetitions = FCString::Atoi(*Arg.Mid(5));
+		}
+	}
+
+	VoxelBenchmarkQef(ProblemNum, FMath::Max(Repetitions, 1));
+}
+
+static FAutoConsoleCommand BenchQefCmd(
+	TEXT("fastdc.BenchQef"),
+	TEXT("Times every qef_simd.h entry point for 1 to 8 sweeps and compares it to a double precision solver. Arguments: [problems=N] [reps=N]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchQefCommand));
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if !UE_BUILD_SHIPPING
+
+//
+// Speed and accuracy of the qef_simd.h entry points for every sweep count, run from the
+// development console: fastdc.BenchQef [problems=N] [reps=N].
+//
+// Problems are synthetic cells with 2 to 12 edge intersections on one plane, an edge, a
+// corner or a degenerate configuration. Accuracy is measured against a double precision
+// solver iterated to convergence, in cell units.
+//
+void VoxelBenchmarkQef(int32 problemNum, int32 repetitions);
+
+#endif
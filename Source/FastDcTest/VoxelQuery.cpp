@@ -0,0 +1,415 @@
+#include "VoxelQuery.h"
+#include <algorithm>
+
+// raw density above this is solid, the same test the substance cache and the density pyramid use
+static const unsigned char RAW_ISOLEVEL = 127;
+static const float ISOLEVEL = 0.5f;
+
+// number of probes per mixed cell - trilinear density along a ray is cubic so a single
+// entry/exit comparison can miss a thin crossing
+static const int CELL_PROBES = 4;
+static const int REFINE_STEPS = 6;
+
+// conversion between volume local space and continuous voxel index space
+struct TVoxelGridSpace {
+	float Step;
+	float Half;
+	int Num;
+
+	TVoxelGridSpace(const TVoxelData& VoxelData) : Step(VoxelData.size() / (VoxelData.num() - 1)), Half(VoxelData.size() / 2), Num(VoxelData.num()) { }
+
+	FVector ToGrid(const FVector& Pos) const {
+		return (Pos + FVector(Half)) / Step;
+	}
+
+	// cell containing grid position G and the fractional position inside it
+	void Locate(const FVector& G, int Cell[3], FVector& Frac) const {
+		for (int Axis = 0; Axis < 3; Axis++) {
+			const float V = FMath::Clamp(G[Axis], 0.f, (float)(Num - 1));
+			Cell[Axis] = FMath::Clamp(FMath::FloorToInt(V), 0, Num - 2);
+			Frac[Axis] = V - Cell[Axis];
+		}
+	}
+};
+
+static bool IsUniform(const TVoxelData& VoxelData) {
+	// density storage exists only in MIX state
+	return VoxelData.getDensityFillState() != TVoxelDataFillState::MIX;
+}
+
+// corner i is at offset ((i >> 2) & 1, (i >> 1) & 1, i & 1)
+static void LoadCell(const TVoxelData& VoxelData, const int Cell[3], unsigned char Corners[8]) {
+	const int X = Cell[0];
+	const int Y = Cell[1];
+	const int Z = Cell[2];
+
+	Corners[0] = VoxelData.getRawDensity(X, Y, Z);
+	Corners[1] = VoxelData.getRawDensity(X, Y, Z + 1);
+	Corners[2] = VoxelData.getRawDensity(X, Y + 1, Z);
+	Corners[3] = VoxelData.getRawDensity(X, Y + 1, Z + 1);
+	Corners[4] = VoxelData.getRawDensity(X + 1, Y, Z);
+	Corners[5] = VoxelData.getRawDensity(X + 1, Y, Z + 1);
+	Corners[6] = VoxelData.getRawDensity(X + 1, Y + 1, Z);
+	Corners[7] = VoxelData.getRawDensity(X + 1, Y + 1, Z + 1);
+}
+
+static float Trilinear(const unsigned char C[8], const FVector& F) {
+	const float C00 = FMath::Lerp((float)C[0], (float)C[1], F.Z);
+	const float C01 = FMath::Lerp((float)C[2], (float)C[3], F.Z);
+	const float C10 = FMath::Lerp((float)C[4], (float)C[5], F.Z);
+	const float C11 = FMath::Lerp((float)C[6], (float)C[7], F.Z);
+
+	const float C0 = FMath::Lerp(C00, C01, F.Y);
+	const float C1 = FMath::Lerp(C10, C11, F.Y);
+
+	return FMath::Lerp(C0, C1, F.X) / 255.f;
+}
+
+static FVector TrilinearGradient(const unsigned char C[8], const FVector& F) {
+	const float C00 = FMath::Lerp((float)C[0], (float)C[1], F.Z);
+	const float C01 = FMath::Lerp((float)C[2], (float)C[3], F.Z);
+	const float C10 = FMath::Lerp((float)C[4], (float)C[5], F.Z);
+	const float C11 = FMath::Lerp((float)C[6], (float)C[7], F.Z);
+
+	const float DX = FMath::Lerp(C10, C11, F.Y) - FMath::Lerp(C00, C01, F.Y);
+	const float DY = FMath::Lerp(C01 - C00, C11 - C10, F.X);
+
+	const float DZ0 = FMath::Lerp((float)C[1] - C[0], (float)C[3] - C[2], F.Y);
+	const float DZ1 = FMath::Lerp((float)C[5] - C[4], (float)C[7] - C[6], F.Y);
+	const float DZ = FMath::Lerp(DZ0, DZ1, F.X);
+
+	return FVector(DX, DY, DZ) / 255.f;
+}
+
+float VoxelSampleDensity(const TVoxelData& VoxelData, const FVector& Pos) {
+	if (IsUniform(VoxelData)) {
+		return VoxelData.getDensity(0, 0, 0);
+	}
+
+	const TVoxelGridSpace Grid(VoxelData);
+
+	int Cell[3];
+	FVector Frac;
+	Grid.Locate(Grid.ToGrid(Pos), Cell, Frac);
+
+	unsigned char Corners[8];
+	LoadCell(VoxelData, Cell, Corners);
+	return Trilinear(Corners, Frac);
+}
+
+FVector VoxelSampleNormal(const TVoxelData& VoxelData, const FVector& Pos) {
+	if (IsUniform(VoxelData)) {
+		return FVector(0.0f, 0.0f, 1.0f);
+	}
+
+	const TVoxelGridSpace Grid(VoxelData);
+
+	int Cell[3];
+	FVector Frac;
+	Grid.Locate(Grid.ToGrid(Pos), Cell, Frac);
+
+	unsigned char Corners[8];
+	LoadCell(VoxelData, Cell, Corners);
+
+	const FVector Normal = -TrilinearGradient(Corners, Frac);
+	return Normal.IsNearlyZero(1e-6f) ? FVector(0.0f, 0.0f, 1.0f) : Normal.GetSafeNormal();
+}
+
+bool VoxelRayCast(const TVoxelData& VoxelData, const FVector& Start, const FVector& Direction, float MaxDistance, TVoxelRayHit& OutHit) {
+	const FVector Dir = Direction.GetSafeNormal();
+	if (Dir.IsZero() || MaxDistance <= 0.f || VoxelData.num() < 2) {
+		return false;
+	}
+
+	if (VoxelData.getDensityFillState() == TVoxelDataFillState::ZERO) {
+		return false;
+	}
+
+	const TVoxelGridSpace Grid(VoxelData);
+	const float Max = (float)(Grid.Num - 1);
+
+	// ray in grid space, parametrized by local space distance
+	const FVector O = Grid.ToGrid(Start);
+	const FVector D = Dir / Grid.Step;
+
+	// clip against the volume box
+	float TEnter = 0.f;
+	float TExit = MaxDistance;
+	int EnterAxis = -1;
+
+	for (int Axis = 0; Axis < 3; Axis++) {
+		if (FMath::Abs(D[Axis]) < 1e-12f) {
+			if (O[Axis] < 0.f || O[Axis] > Max) {
+				return false;
+			}
+
+			continue;
+		}
+
+		float T0 = (0.f - O[Axis]) / D[Axis];
+		float T1 = (Max - O[Axis]) / D[Axis];
+		if (T0 > T1) {
+			std::swap(T0, T1);
+		}
+
+		if (T0 > TEnter) {
+			TEnter = T0;
+			EnterAxis = Axis;
+		}
+
+		TExit = FMath::Min(TExit, T1);
+	}
+
+	if (TEnter > TExit) {
+		return false;
+	}
+
+	const FVector GEnter = O + D * TEnter;
+
+	int Cell[3];
+	FVector Frac;
+	Grid.Locate(GEnter, Cell, Frac);
+
+	unsigned char Corners[8];
+
+	auto SampleAt = [&](float T) {
+		const FVector G = O + D * T;
+		FVector F;
+		for (int Axis = 0; Axis < 3; Axis++) {
+			F[Axis] = FMath::Clamp(G[Axis] - Cell[Axis], 0.f, 1.f);
+		}
+		return F;
+	};
+
+	auto MakeHit = [&](float T, bool bAtEntry) {
+		OutHit.Distance = T;
+		OutHit.Location = Start + Dir * T;
+
+		if (bAtEntry) {
+			// ray starts in solid or enters through a solid volume face
+			OutHit.Normal = -Dir;
+			if (EnterAxis >= 0) {
+				FVector FaceNormal(0.0f, 0.0f, 0.0f);
+				FaceNormal[EnterAxis] = D[EnterAxis] > 0.f ? -1.f : 1.f;
+				OutHit.Normal = FaceNormal;
+			}
+		} else {
+			const FVector Normal = -TrilinearGradient(Corners, SampleAt(T));
+			OutHit.Normal = Normal.IsNearlyZero(1e-6f) ? -Dir : Normal.GetSafeNormal();
+		}
+
+		return true;
+	};
+
+	if (IsUniform(VoxelData)) {
+		return MakeHit(TEnter, true);
+	}
+
+	LoadCell(VoxelData, Cell, Corners);
+	if (Trilinear(Corners, Frac) >= ISOLEVEL) {
+		return MakeHit(TEnter, true);
+	}
+
+	const TVoxelDensityPyramid& Pyramid = VoxelData.getDensityPyramid();
+
+	// Amanatides & Woo cell traversal
+	int StepDir[3];
+	float TMax[3];
+	float TDelta[3];
+
+	for (int Axis = 0; Axis < 3; Axis++) {
+		if (D[Axis] > 0.f) {
+			StepDir[Axis] = 1;
+			TMax[Axis] = TEnter + (Cell[Axis] + 1 - GEnter[Axis]) / D[Axis];
+			TDelta[Axis] = 1.f / D[Axis];
+		} else if (D[Axis] < 0.f) {
+			StepDir[Axis] = -1;
+			TMax[Axis] = TEnter + (Cell[Axis] - GEnter[Axis]) / D[Axis];
+			TDelta[Axis] = -1.f / D[Axis];
+		} else {
+			StepDir[Axis] = 0;
+			TMax[Axis] = TExit + 1.f;
+			TDelta[Axis] = 0.f;
+		}
+	}
+
+	float TCell = TEnter;
+
+	// moves to the next cell along the ray, false once the ray leaves the volume or its range
+	auto StepCell = [&]() {
+		if (FMath::Min3(TMax[0], TMax[1], TMax[2]) >= TExit) {
+			return false;
+		}
+
+		int Axis = 0;
+		if (TMax[1] < TMax[Axis]) Axis = 1;
+		if (TMax[2] < TMax[Axis]) Axis = 2;
+
+		Cell[Axis] += StepDir[Axis];
+		if (Cell[Axis] < 0 || Cell[Axis] > Grid.Num - 2) {
+			return false;
+		}
+
+		TCell = TMax[Axis];
+		TMax[Axis] += TDelta[Axis];
+		return true;
+	};
+
+	// crosses the cells of all-air pyramid blocks without reading their samples
+	auto SkipAir = [&]() {
+		for (int Shift = Pyramid.airBlockShift(Cell[0], Cell[1], Cell[2]); Shift >= 0; Shift = Pyramid.airBlockShift(Cell[0], Cell[1], Cell[2])) {
+			const int Block[3] = { Cell[0] >> Shift, Cell[1] >> Shift, Cell[2] >> Shift };
+
+			do {
+				if (!StepCell()) {
+					return false;
+				}
+			} while ((Cell[0] >> Shift) == Block[0] && (Cell[1] >> Shift) == Block[1] && (Cell[2] >> Shift) == Block[2]);
+		}
+
+		return true;
+	};
+
+	while (true) {
+		const float TNext = FMath::Min(FMath::Min3(TMax[0], TMax[1], TMax[2]), TExit);
+
+		unsigned char MinDensity = 255;
+		unsigned char MaxDensity = 0;
+		for (int i = 0; i < 8; i++) {
+			MinDensity = FMath::Min(MinDensity, Corners[i]);
+			MaxDensity = FMath::Max(MaxDensity, Corners[i]);
+		}
+
+		if (MinDensity > RAW_ISOLEVEL) {
+			return MakeHit(TCell, false);
+		}
+
+		// with all corners in air the trilinear density can't reach the isolevel, skip without sampling
+		if (MaxDensity > RAW_ISOLEVEL) {
+			float TA = TCell;
+			for (int Probe = 1; Probe <= CELL_PROBES; Probe++) {
+				float TB = TCell + (TNext - TCell) * Probe / CELL_PROBES;
+				float FB = Trilinear(Corners, SampleAt(TB));
+
+				if (FB >= ISOLEVEL) {
+					float FA = Trilinear(Corners, SampleAt(TA));
+
+					for (int Step = 0; Step < REFINE_STEPS; Step++) {
+						const float TM = (TA + TB) * 0.5f;
+						const float FM = Trilinear(Corners, SampleAt(TM));
+						if (FM >= ISOLEVEL) {
+							TB = TM;
+							FB = FM;
+						} else {
+							TA = TM;
+							FA = FM;
+						}
+					}
+
+					// final sub-voxel position by linear interpolation inside the bracket
+					const float Mu = (FB - FA) > 1e-6f ? (ISOLEVEL - FA) / (FB - FA) : 0.f;
+					return MakeHit(TA + (TB - TA) * FMath::Clamp(Mu, 0.f, 1.f), false);
+				}
+
+				TA = TB;
+			}
+		}
+
+		if (!StepCell() || !SkipAir()) {
+			break;
+		}
+
+		LoadCell(VoxelData, Cell, Corners);
+	}
+
+	return false;
+}
+
+// any solid sample in both the sphere (grid space center C, squared radius R2) and the box
+static bool SphereBoxHasSolid(const TVoxelData& VoxelData, const FVector& C, float R2, int X0, int X1, int Y0, int Y1, int Z0, int Z1) {
+	for (int X = X0; X <= X1; X++) {
+		const float DX2 = FMath::Square(X - C.X);
+
+		for (int Y = Y0; Y <= Y1; Y++) {
+			const float Rest = R2 - DX2 - FMath::Square(Y - C.Y);
+			if (Rest < 0.f) {
+				continue;
+			}
+
+			// clip the z row to the sphere so only voxels inside it are read
+			const float ZR = FMath::Sqrt(Rest);
+			const int ZMin = FMath::Max(Z0, FMath::CeilToInt(C.Z - ZR));
+			const int ZMax = FMath::Min(Z1, FMath::FloorToInt(C.Z + ZR));
+
+			for (int Z = ZMin; Z <= ZMax; Z++) {
+				if (VoxelData.getRawDensity(X, Y, Z) > RAW_ISOLEVEL) {
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+bool VoxelSphereOverlap(const TVoxelData& VoxelData, const FVector& Center, float Radius) {
+	if (Radius < 0.f || VoxelData.num() < 2) {
+		return false;
+	}
+
+	const TVoxelDataFillState State = VoxelData.getDensityFillState();
+	if (State == TVoxelDataFillState::ZERO) {
+		return false;
+	}
+
+	const TVoxelGridSpace Grid(VoxelData);
+	const FVector C = Grid.ToGrid(Center);
+	const float R = Radius / Grid.Step;
+	const float R2 = R * R;
+
+	if (State == TVoxelDataFillState::ALL) {
+		// any voxel inside the sphere is solid - test the one closest to the center
+		FVector Nearest;
+		for (int Axis = 0; Axis < 3; Axis++) {
+			Nearest[Axis] = (float)FMath::Clamp(FMath::RoundToInt(C[Axis]), 0, Grid.Num - 1);
+		}
+
+		return (Nearest - C).SizeSquared() <= R2;
+	}
+
+	const int X0 = FMath::Max(0, FMath::CeilToInt(C.X - R));
+	const int X1 = FMath::Min(Grid.Num - 1, FMath::FloorToInt(C.X + R));
+	const int Y0 = FMath::Max(0, FMath::CeilToInt(C.Y - R));
+	const int Y1 = FMath::Min(Grid.Num - 1, FMath::FloorToInt(C.Y + R));
+	const int Z0 = FMath::Max(0, FMath::CeilToInt(C.Z - R));
+	const int Z1 = FMath::Min(Grid.Num - 1, FMath::FloorToInt(C.Z + R));
+
+	// the box is read one finest pyramid block at a time, blocks that are all air are passed over
+	const TVoxelDensityPyramid& Pyramid = VoxelData.getDensityPyramid();
+	const int Block = 1 << VOXEL_PYRAMID_SHIFT;
+
+	for (int BX = X0 & ~(Block - 1); BX <= X1; BX += Block) {
+		for (int BY = Y0 & ~(Block - 1); BY <= Y1; BY += Block) {
+			for (int BZ = Z0 & ~(Block - 1); BZ <= Z1; BZ += Block) {
+				const int BX0 = FMath::Max(X0, BX);
+				const int BX1 = FMath::Min(X1, BX + Block - 1);
+				const int BY0 = FMath::Max(Y0, BY);
+				const int BY1 = FMath::Min(Y1, BY + Block - 1);
+				const int BZ0 = FMath::Max(Z0, BZ);
+				const int BZ1 = FMath::Min(Z1, BZ + Block - 1);
+
+				unsigned char MinDensity, MaxDensity;
+				Pyramid.getRange(BX0, BY0, BZ0, BX1, BY1, BZ1, MinDensity, MaxDensity);
+				if (MaxDensity <= RAW_ISOLEVEL) {
+					continue;
+				}
+
+				if (SphereBoxHasSolid(VoxelData, C, R2, BX0, BX1, BY0, BY1, BZ0, BZ1)) {
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelData.h"
+
+//
+// Native queries against the density field of a TVoxelData volume.
+// All positions are in volume local space (the same space voxelIndexToVector returns),
+// so results are available as soon as densities are written - no mesh or collision cooking involved.
+//
+
+struct TVoxelRayHit {
+	FVector Location = FVector(0.0f, 0.0f, 0.0f);
+	FVector Normal = FVector(0.0f, 0.0f, 1.0f);
+	float Distance = 0.f;
+};
+
+// trilinear density at an arbitrary local position, clamped to the volume bounds
+float VoxelSampleDensity(const TVoxelData& VoxelData, const FVector& Pos);
+
+// outward surface normal (negated density gradient) at an arbitrary local position
+FVector VoxelSampleNormal(const TVoxelData& VoxelData, const FVector& Pos);
+
+// 3D-DDA march over the voxel cells, refined to the sub-voxel isosurface crossing; cells of
+// all-air density pyramid blocks are crossed without reading them
+// returns the first air -> solid transition along the ray
+bool VoxelRayCast(const TVoxelData& VoxelData, const FVector& Start, const FVector& Direction, float MaxDistance, TVoxelRayHit& OutHit);
+
+// true if any solid voxel lies inside the sphere
+bool VoxelSphereOverlap(const TVoxelData& VoxelData, const FVector& Center, float Radius);
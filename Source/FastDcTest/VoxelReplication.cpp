@@ -0,0 +1,632 @@
+#include "VoxelReplication.h"
+#include "Misc/Crc.h"
+#include <algorithm>
+
+static const uint32 VOXEL_UPDATE_MAGIC = 0x5552584d; // "MXRU"
+static const uint32 VOXEL_ACK_MAGIC = 0x4152584d; // "MXRA"
+
+// density, low and high material bytes as separate planes, material changes are mostly in the low byte
+static const int BRICK_DELTA_SIZE = VOXEL_BRICK_VOLUME * 3;
+
+enum class TVoxelUpdateKind : uint8 {
+	Edits,
+	Bricks
+};
+
+struct TVoxelUpdateHeader {
+	uint32 magic;
+	uint8 kind;
+	uint8 reset;
+	uint16 reserved;
+	int32 voxel_num;
+	uint32 count;
+	uint64 base_version;
+	uint64 version;
+};
+
+struct TVoxelAckHeader {
+	uint32 magic;
+	uint32 reserved;
+	uint64 version;
+};
+
+//====================================================================================
+// Encoding
+//====================================================================================
+
+static void WriteVarint(TArray<uint8>& out, uint32 value) {
+	while (value >= 0x80) {
+		out.Add((uint8)(value | 0x80));
+		value >>= 7;
+	}
+
+	out.Add((uint8)value);
+}
+
+static void WriteSigned(TArray<uint8>& out, int32 value) {
+	WriteVarint(out, ((uint32)value << 1) ^ (uint32)(value >> 31));
+}
+
+template <typename T>
+static void WriteValue(TArray<uint8>& out, const T& value) {
+	out.Append((const uint8*)&value, sizeof(T));
+}
+
+// reads fail softly, a damaged message leaves bError set and everything after it zero
+struct TVoxelMessageReader {
+	const uint8* data;
+	int32 num;
+	int32 pos = 0;
+	bool bError = false;
+
+	explicit TVoxelMessageReader(const TArray<uint8>& message) : data(message.GetData()), num(message.Num()) { }
+
+	bool read(void* out, int32 size) {
+		if (bError || pos + size > num) {
+			bError = true;
+			FMemory::Memzero(out, size);
+			return false;
+		}
+
+		FMemory::Memcpy(out, data + pos, size);
+		pos += size;
+		return true;
+	}
+
+	template <typename T>
+	T value() {
+		T v;
+		read(&v, sizeof(T));
+		return v;
+	}
+
+	uint32 varint() {
+		uint32 v = 0;
+		for (int shift = 0; shift < 35; shift += 7) {
+			const uint8 b = value<uint8>();
+			v |= (uint32)(b & 0x7f) << shift;
+			if ((b & 0x80) == 0) {
+				return v;
+			}
+		}
+
+		bError = true;
+		return 0;
+	}
+
+	int32 signedVarint() {
+		const uint32 v = varint();
+		return (int32)(v >> 1) ^ -(int32)(v & 1);
+	}
+};
+
+// zero runs and literal runs alternate; a literal run ends where two zeros in a row begin
+static void WriteRle(TArray<uint8>& out, const uint8* data, int32 num) {
+	int32 i = 0;
+	while (i < num) {
+		const int32 zeroStart = i;
+		while (i < num && data[i] == 0) {
+			i++;
+		}
+
+		const int32 literalStart = i;
+		while (i < num && !(data[i] == 0 && (i + 1 >= num || data[i + 1] == 0))) {
+			i++;
+		}
+
+		WriteVarint(out, literalStart - zeroStart);
+		WriteVarint(out, i - literalStart);
+		out.Append(data + literalStart, i - literalStart);
+	}
+}
+
+static bool ReadRle(TVoxelMessageReader& reader, uint8* out, int32 num) {
+	int32 i = 0;
+	while (i < num && !reader.bError) {
+		const uint32 zeros = reader.varint();
+		const uint32 literals = reader.varint();
+
+		if (zeros > (uint32)(num - i) || literals > (uint32)(num - i) - zeros) {
+			return false;
+		}
+
+		FMemory::Memzero(out + i, zeros);
+		i += zeros;
+
+		reader.read(out + i, literals);
+		i += literals;
+	}
+
+	return !reader.bError;
+}
+
+static void WriteEdit(TArray<uint8>& out, const TVoxelEdit& edit) {
+	out.Add((uint8)edit.type);
+
+	switch (edit.type) {
+	case TVoxelEditType::Density:
+	case TVoxelEditType::Material:
+		WriteSigned(out, edit.x);
+		WriteSigned(out, edit.y);
+		WriteSigned(out, edit.z);
+
+		if (edit.type == TVoxelEditType::Density) {
+			WriteValue(out, edit.density);
+		} else {
+			WriteValue(out, (uint16)edit.material);
+		}
+		break;
+	case TVoxelEditType::DigSphere:
+	case TVoxelEditType::FillSphere:
+		WriteValue(out, edit.center.X);
+		WriteValue(out, edit.center.Y);
+		WriteValue(out, edit.center.Z);
+		WriteValue(out, edit.radius);
+
+		if (edit.type == TVoxelEditType::FillSphere) {
+			WriteValue(out, (uint16)edit.material);
+		}
+		break;
+	case TVoxelEditType::FilterSphere:
+		WriteValue(out, edit.center.X);
+		WriteValue(out, edit.center.Y);
+		WriteValue(out, edit.center.Z);
+		WriteValue(out, edit.radius);
+		WriteValue(out, (uint8)edit.filter.type);
+		WriteValue(out, (uint8)FMath::Clamp(edit.filter.radius, 0, 255));
+		WriteValue(out, edit.filter.strength);
+		WriteValue(out, (uint8)edit.filter.talus);
+		WriteValue(out, (uint8)FMath::Clamp(edit.filter.iterations, 0, 255));
+		WriteValue(out, (uint8)edit.filter.bKeepBorder);
+		break;
+	}
+}
+
+static bool ReadEdit(TVoxelMessageReader& reader, TVoxelEdit& edit) {
+	const uint8 type = reader.value<uint8>();
+	if (type > (uint8)TVoxelEditType::FilterSphere) {
+		return false;
+	}
+
+	edit.type = (TVoxelEditType)type;
+
+	switch (edit.type) {
+	case TVoxelEditType::Density:
+	case TVoxelEditType::Material:
+		edit.x = reader.signedVarint();
+		edit.y = reader.signedVarint();
+		edit.z = reader.signedVarint();
+
+		if (edit.type == TVoxelEditType::Density) {
+			edit.density = reader.value<float>();
+		} else {
+			edit.material = reader.value<uint16>();
+		}
+		break;
+	case TVoxelEditType::DigSphere:
+	case TVoxelEditType::FillSphere:
+		edit.center.X = reader.value<float>();
+		edit.center.Y = reader.value<float>();
+		edit.center.Z = reader.value<float>();
+		edit.radius = reader.value<float>();
+
+		if (edit.type == TVoxelEditType::FillSphere) {
+			edit.material = reader.value<uint16>();
+		}
+		break;
+	case TVoxelEditType::FilterSphere:
+		edit.center.X = reader.value<float>();
+		edit.center.Y = reader.value<float>();
+		edit.center.Z = reader.value<float>();
+		edit.radius = reader.value<float>();
+		edit.filter.type = (TVoxelFilterType)FMath::Min(reader.value<uint8>(), (uint8)TVoxelFilterType::Erode);
+		edit.filter.radius = reader.value<uint8>();
+		edit.filter.strength = reader.value<float>();
+		edit.filter.talus = reader.value<uint8>();
+		edit.filter.iterations = reader.value<uint8>();
+		edit.filter.bKeepBorder = reader.value<uint8>() != 0;
+		break;
+	}
+
+	return !reader.bError;
+}
+
+static void BrickCoords(int index, int brickNum, int& bx, int& by, int& bz) {
+	bz = index % brickNum;
+	by = (index / brickNum) % brickNum;
+	bx = index / (brickNum * brickNum);
+}
+
+// checksum of the samples inside the volume, the padding of partial bricks depends on the base material
+static uint32 BrickCrc(TVoxelBrick& brick, int voxelNum, int bx, int by, int bz) {
+	for (int lx = 0; lx < VOXEL_BRICK_SIZE; lx++) {
+		for (int ly = 0; ly < VOXEL_BRICK_SIZE; ly++) {
+			for (int lz = 0; lz < VOXEL_BRICK_SIZE; lz++) {
+				const bool bInside = (bx << VOXEL_BRICK_SHIFT) + lx < voxelNum && (by << VOXEL_BRICK_SHIFT) + ly < voxelNum && (bz << VOXEL_BRICK_SHIFT) + lz < voxelNum;
+				if (!bInside) {
+					const int local = (((lx << VOXEL_BRICK_SHIFT) | ly) << VOXEL_BRICK_SHIFT) | lz;
+					brick.density[local] = 0;
+					brick.material[local] = 0;
+				}
+			}
+		}
+	}
+
+	return FCrc::MemCrc32(&brick, sizeof(TVoxelBrick));
+}
+
+static void WriteUpdateHeader(TArray<uint8>& out, TVoxelUpdateKind kind, bool bReset, int32 voxelNum, uint64 baseVersion, uint64 version) {
+	TVoxelUpdateHeader header;
+	FMemory::Memzero(&header, sizeof(header));
+	header.magic = VOXEL_UPDATE_MAGIC;
+	header.kind = (uint8)kind;
+	header.reset = bReset;
+	header.voxel_num = voxelNum;
+	header.base_version = baseVersion;
+	header.version = version;
+
+	out.Reset();
+	WriteValue(out, header);
+}
+
+static void SetUpdateCount(TArray<uint8>& out, uint32 count) {
+	FMemory::Memcpy(out.GetData() + STRUCT_OFFSET(TVoxelUpdateHeader, count), &count, sizeof(count));
+}
+
+//====================================================================================
+// Server
+//====================================================================================
+
+TVoxelReplicationServer::TVoxelReplicationServer(const TVoxelData& data, const TVoxelReplicationSettings& settings) : settings(settings) {
+	current = TVoxelSnapshot::capture(data, nullptr);
+	history[current->getDataVersion()] = current;
+
+	journal_start = current->getDataVersion();
+	journaled_version = current->getDataVersion();
+}
+
+void TVoxelReplicationServer::applyEdit(TVoxelData& data, const TVoxelEdit& edit) {
+	// something changed the volume behind the journal's back, replay cannot reach past it
+	if (data.getDataVersion() != journaled_version) {
+		journal.clear();
+		journal_start = data.getDataVersion();
+	}
+
+	applyVoxelEdit(data, edit);
+	data.setChanged();
+
+	journaled_version = data.getDataVersion();
+	journal.push_back({ journaled_version, edit });
+
+	while ((int)journal.size() > settings.maxJournalEdits) {
+		journal_start = journal.front().version;
+		journal.pop_front();
+	}
+}
+
+void TVoxelReplicationServer::publish(const TVoxelData& data) {
+	if (data.getDataVersion() == current->getDataVersion()) {
+		return;
+	}
+
+	if (data.getDataVersion() != journaled_version) {
+		journal.clear();
+		journal_start = data.getDataVersion();
+		journaled_version = data.getDataVersion();
+	}
+
+	current = TVoxelSnapshot::capture(data, current);
+	history[current->getDataVersion()] = current;
+	prune();
+}
+
+void TVoxelReplicationServer::prune() {
+	// clients resyncing from 0 need no history
+	uint64 oldest = current->getDataVersion();
+	for (const auto& it : clients) {
+		if (it.second.acked != 0) {
+			oldest = FMath::Min(oldest, it.second.acked);
+		}
+	}
+
+	history.erase(history.begin(), history.lower_bound(oldest));
+
+	while (!journal.empty() && journal.front().version <= oldest) {
+		journal.pop_front();
+	}
+
+	journal_start = FMath::Max(journal_start, oldest);
+}
+
+void TVoxelReplicationServer::addClient(int32 id, uint64 ackedVersion) {
+	TClient& client = clients[id];
+	client.acked = history.count(ackedVersion) > 0 ? ackedVersion : 0;
+	client.bInFlight = false;
+}
+
+void TVoxelReplicationServer::removeClient(int32 id) {
+	clients.erase(id);
+	prune();
+}
+
+bool TVoxelReplicationServer::writeEdits(const TClient& client, TArray<uint8>& out) const {
+	const uint64 version = current->getDataVersion();
+
+	if (client.acked == 0 || client.acked < journal_start) {
+		return false;
+	}
+
+	int count = 0;
+	for (const TJournalEntry& entry : journal) {
+		count += entry.version > client.acked && entry.version <= version;
+	}
+
+	if (count > settings.maxMessageEdits) {
+		return false;
+	}
+
+	WriteUpdateHeader(out, TVoxelUpdateKind::Edits, false, current->num(), client.acked, version);
+	SetUpdateCount(out, count);
+
+	for (const TJournalEntry& entry : journal) {
+		if (entry.version > client.acked && entry.version <= version) {
+			WriteEdit(out, entry.edit);
+		}
+	}
+
+	// the bricks the replay has to reproduce
+	const int brickNum = current->brickNum();
+	const int brickCount = brickNum * brickNum * brickNum;
+
+	int changed = 0;
+	for (int i = 0; i < brickCount; i++) {
+		changed += current->getBrickVersion(i) > client.acked;
+	}
+
+	WriteVarint(out, changed);
+
+	TVoxelBrick brick;
+	for (int i = 0; i < brickCount; i++) {
+		if (current->getBrickVersion(i) > client.acked) {
+			int bx, by, bz;
+			BrickCoords(i, brickNum, bx, by, bz);
+			current->readBrickAt(i, brick);
+
+			WriteVarint(out, i);
+			WriteValue(out, BrickCrc(brick, current->num(), bx, by, bz));
+		}
+	}
+
+	return true;
+}
+
+void TVoxelReplicationServer::writeBricks(const TClient& client, TArray<uint8>& out) const {
+	const auto base = client.acked != 0 ? history.find(client.acked) : history.end();
+	const TVoxelSnapshot* baseSnapshot = base != history.end() ? base->second.get() : nullptr;
+
+	// without a base the client starts over from an empty volume
+	const bool bReset = baseSnapshot == nullptr;
+	WriteUpdateHeader(out, TVoxelUpdateKind::Bricks, bReset, current->num(), bReset ? 0 : client.acked, current->getDataVersion());
+
+	const int brickNum = current->brickNum();
+	const int brickCount = brickNum * brickNum * brickNum;
+
+	TVoxelBrick now;
+	TVoxelBrick before;
+	uint8 delta[BRICK_DELTA_SIZE];
+
+	if (bReset) {
+		FMemory::Memzero(&before, sizeof(before));
+	}
+
+	uint32 count = 0;
+	for (int i = 0; i < brickCount; i++) {
+		if (!bReset && current->getBrickVersion(i) == baseSnapshot->getBrickVersion(i)) {
+			continue;
+		}
+
+		current->readBrickAt(i, now);
+		if (!bReset) {
+			baseSnapshot->readBrickAt(i, before);
+		}
+
+		uint8 any = 0;
+		for (int v = 0; v < VOXEL_BRICK_VOLUME; v++) {
+			const unsigned short material = now.material[v] ^ before.material[v];
+			delta[v] = now.density[v] ^ before.density[v];
+			delta[VOXEL_BRICK_VOLUME + v] = (uint8)material;
+			delta[VOXEL_BRICK_VOLUME * 2 + v] = (uint8)(material >> 8);
+			any |= delta[v] | delta[VOXEL_BRICK_VOLUME + v] | delta[VOXEL_BRICK_VOLUME * 2 + v];
+		}
+
+		// rewritten with the same content
+		if (!any) {
+			continue;
+		}
+
+		int bx, by, bz;
+		BrickCoords(i, brickNum, bx, by, bz);
+
+		WriteVarint(out, i);
+		WriteValue(out, BrickCrc(now, current->num(), bx, by, bz));
+		WriteRle(out, delta, BRICK_DELTA_SIZE);
+		count++;
+	}
+
+	SetUpdateCount(out, count);
+}
+
+bool TVoxelReplicationServer::writeUpdate(int32 id, TArray<uint8>& out) {
+	const auto it = clients.find(id);
+	if (it == clients.end()) {
+		return false;
+	}
+
+	TClient& client = it->second;
+	if (client.bInFlight || client.acked == current->getDataVersion()) {
+		return false;
+	}
+
+	if (!settings.bSendEdits || !writeEdits(client, out)) {
+		writeBricks(client, out);
+	}
+
+	client.bInFlight = true;
+	return true;
+}
+
+bool TVoxelReplicationServer::readAck(int32 id, const TArray<uint8>& message) {
+	const auto it = clients.find(id);
+	if (it == clients.end()) {
+		return false;
+	}
+
+	TVoxelMessageReader reader(message);
+	const TVoxelAckHeader header = reader.value<TVoxelAckHeader>();
+	if (reader.bError || header.magic != VOXEL_ACK_MAGIC) {
+		return false;
+	}
+
+	// a version the server no longer knows can only be repaired by a resync
+	it->second.acked = history.count(header.version) > 0 ? header.version : 0;
+	it->second.bInFlight = false;
+	prune();
+	return true;
+}
+
+//====================================================================================
+// Client
+//====================================================================================
+
+bool TVoxelReplicationClient::applyUpdate(TVoxelData& data, const TArray<uint8>& message) {
+	TVoxelMessageReader reader(message);
+	const TVoxelUpdateHeader header = reader.value<TVoxelUpdateHeader>();
+
+	if (reader.bError || header.magic != VOXEL_UPDATE_MAGIC || header.voxel_num != data.num() || header.kind > (uint8)TVoxelUpdateKind::Bricks) {
+		UE_LOG(LogTemp, Warning, TEXT("VoxelReplication: malformed update ignored"));
+		return false;
+	}
+
+	// sent before our last acknowledgement arrived, the server answers that one next
+	if (!header.reset && header.base_version != version) {
+		return false;
+	}
+
+	if (header.reset) {
+		data.deinitializeDensity(TVoxelDataFillState::ZERO);
+		data.deinitializeMaterial(0);
+	}
+
+	const int brickNum = data.brickNum();
+	const int brickCount = brickNum * brickNum * brickNum;
+	bool bMatches = true;
+
+	TVoxelBrick brick;
+	auto checkBrick = [&](uint32 index, uint32 crc) {
+		if (index >= (uint32)brickCount) {
+			bMatches = false;
+			return;
+		}
+
+		int bx, by, bz;
+		BrickCoords(index, brickNum, bx, by, bz);
+		TVoxelSnapshot::readBrick(data, bx, by, bz, brick);
+		bMatches &= BrickCrc(brick, data.num(), bx, by, bz) == crc;
+	};
+
+	if (header.kind == (uint8)TVoxelUpdateKind::Edits) {
+		for (uint32 i = 0; i < header.count && !reader.bError; i++) {
+			TVoxelEdit edit;
+			if (!ReadEdit(reader, edit)) {
+				bMatches = false;
+				break;
+			}
+
+			applyVoxelEdit(data, edit);
+		}
+
+		const uint32 checks = reader.varint();
+		for (uint32 i = 0; i < checks && !reader.bError; i++) {
+			const uint32 index = reader.varint();
+			checkBrick(index, reader.value<uint32>());
+		}
+	} else {
+		uint8 delta[BRICK_DELTA_SIZE];
+		unsigned short material[VOXEL_BRICK_VOLUME];
+
+		for (uint32 i = 0; i < header.count && !reader.bError; i++) {
+			const uint32 index = reader.varint();
+			const uint32 crc = reader.value<uint32>();
+
+			if (index >= (uint32)brickCount || !ReadRle(reader, delta, BRICK_DELTA_SIZE)) {
+				bMatches = false;
+				break;
+			}
+
+			for (int v = 0; v < VOXEL_BRICK_VOLUME; v++) {
+				material[v] = delta[VOXEL_BRICK_VOLUME + v] | (delta[VOXEL_BRICK_VOLUME * 2 + v] << 8);
+			}
+
+			int bx, by, bz;
+			BrickCoords(index, brickNum, bx, by, bz);
+			data.applyBrickDelta(bx, by, bz, delta, material);
+
+			checkBrick(index, crc);
+		}
+	}
+
+	data.setChanged();
+
+	if (reader.bError || !bMatches) {
+		UE_LOG(LogTemp, Warning, TEXT("VoxelReplication: update to version %llu did not reproduce the server state, requesting a resync"), header.version);
+		version = 0;
+		return false;
+	}
+
+	version = header.version;
+	return true;
+}
+
+void TVoxelReplicationClient::writeAck(TArray<uint8>& out) const {
+	TVoxelAckHeader header;
+	FMemory::Memzero(&header, sizeof(header));
+	header.magic = VOXEL_ACK_MAGIC;
+	header.version = version;
+
+	out.Reset();
+	WriteValue(out, header);
+}
+
+//====================================================================================
+// Loopback
+//====================================================================================
+
+void TVoxelLoopbackTransport::sendToClient(const TArray<uint8>& message) {
+	to_client.push_back(message);
+	bytes_to_client += message.Num();
+}
+
+void TVoxelLoopbackTransport::sendToServer(const TArray<uint8>& message) {
+	to_server.push_back(message);
+	bytes_to_server += message.Num();
+}
+
+bool TVoxelLoopbackTransport::receiveOnClient(TArray<uint8>& out) {
+	if (to_client.empty()) {
+		return false;
+	}
+
+	out = MoveTemp(to_client.front());
+	to_client.pop_front();
+	return true;
+}
+
+bool TVoxelLoopbackTransport::receiveOnServer(TArray<uint8>& out) {
+	if (to_server.empty()) {
+		return false;
+	}
+
+	out = MoveTemp(to_server.front());
+	to_server.pop_front();
+	return true;
+}
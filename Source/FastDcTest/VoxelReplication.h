@@ -0,0 +1,127 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelData.h"
+#include "VoxelSnapshot.h"
+#include "VoxelEditQueue.h"
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+//
+// Replication of a volume from a server to clients that hold a copy of it.
+//
+// Versions are the server's data versions. A client is brought from the version it last
+// acknowledged to the current one either by replaying the brush edits recorded in the journal,
+// or by brick deltas: the XOR of every changed brick against the acknowledged snapshot, run
+// length coded. Edit messages carry the checksum of every brick they change, a client whose
+// replay came out different drops back to version 0 and receives the whole volume as bricks.
+//
+// One update per client is in flight at a time, the connection must deliver messages in order
+// and intact. Everything here runs on the thread that owns the volumes.
+//
+
+struct TVoxelReplicationSettings {
+	// replay journaled edits when they cover the client's gap, otherwise always send bricks
+	bool bSendEdits = true;
+
+	// oldest edits are dropped beyond this, clients further behind get bricks
+	int maxJournalEdits = 4096;
+
+	// larger gaps are sent as bricks even when the journal covers them
+	int maxMessageEdits = 256;
+};
+
+class TVoxelReplicationServer {
+
+private:
+	struct TJournalEntry {
+		uint64 version;
+		TVoxelEdit edit;
+	};
+
+	struct TClient {
+		uint64 acked = 0;
+		bool bInFlight = false;
+	};
+
+	TVoxelReplicationSettings settings;
+
+	// published snapshots that a client may still have acknowledged, they share unchanged bricks
+	std::map<uint64, std::shared_ptr<const TVoxelSnapshot>> history;
+	std::shared_ptr<const TVoxelSnapshot> current;
+
+	// every change after journal_start is in the journal, tagged with the data version it produced
+	std::deque<TJournalEntry> journal;
+	uint64 journal_start = 0;
+	uint64 journaled_version = 0;
+
+	std::unordered_map<int32, TClient> clients;
+
+	void prune();
+	bool writeEdits(const TClient& client, TArray<uint8>& out) const;
+	void writeBricks(const TClient& client, TArray<uint8>& out) const;
+
+public:
+	TVoxelReplicationServer(const TVoxelData& data, const TVoxelReplicationSettings& settings = TVoxelReplicationSettings());
+
+	// applies and journals an edit; changes made to the volume any other way are found at the
+	// next publish and replicated as bricks
+	void applyEdit(TVoxelData& data, const TVoxelEdit& edit);
+
+	// makes the current state of the volume the version clients are brought to
+	void publish(const TVoxelData& data);
+
+	uint64 getVersion() const { return current->getDataVersion(); }
+
+	// ackedVersion is a version the client already holds, getVersion() for a client that built
+	// the same volume itself or 0 for one that starts empty
+	void addClient(int32 id, uint64 ackedVersion);
+	void removeClient(int32 id);
+
+	// false when the client is up to date or still has to acknowledge the previous update
+	bool writeUpdate(int32 id, TArray<uint8>& out);
+
+	bool readAck(int32 id, const TArray<uint8>& message);
+};
+
+class TVoxelReplicationClient {
+
+private:
+	uint64 version;
+
+public:
+	explicit TVoxelReplicationClient(uint64 version) : version(version) { }
+
+	uint64 getVersion() const { return version; }
+
+	// applies one update to the local copy; false when it was rejected or did not reproduce the
+	// server state, the next acknowledgement then asks for a full resync
+	bool applyUpdate(TVoxelData& data, const TArray<uint8>& message);
+
+	void writeAck(TArray<uint8>& out) const;
+};
+
+//
+// In-process stand-in for a reliable, ordered connection between a server and one client.
+//
+class TVoxelLoopbackTransport {
+
+private:
+	std::deque<TArray<uint8>> to_client;
+	std::deque<TArray<uint8>> to_server;
+	size_t bytes_to_client = 0;
+	size_t bytes_to_server = 0;
+
+public:
+	void sendToClient(const TArray<uint8>& message);
+	void sendToServer(const TArray<uint8>& message);
+
+	bool receiveOnClient(TArray<uint8>& out);
+	bool receiveOnServer(TArray<uint8>& out);
+
+	size_t getBytesToClient() const { return bytes_to_client; }
+	size_t getBytesToServer() const { return bytes_to_server; }
+};
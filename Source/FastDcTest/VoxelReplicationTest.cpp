@@ -0,0 +1,146 @@
+#include "VoxelReplication.h"
+
+#if !UE_BUILD_SHIPPING
+
+#include "VoxelGenerator.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/Parse.h"
+
+struct TReplicationPeer {
+	TVoxelData data;
+	TVoxelReplicationClient client;
+	TVoxelLoopbackTransport transport;
+
+	TReplicationPeer(int num, float size, uint64 version) : data(num, size), client(version) { }
+};
+
+// one round trip per peer over the loopback connections
+static void PumpReplication(TVoxelReplicationServer& server, TArray<TReplicationPeer*>& peers) {
+	TArray<uint8> message;
+
+	for (int32 id = 0; id < peers.Num(); id++) {
+		TReplicationPeer& peer = *peers[id];
+
+		if (server.writeUpdate(id, message)) {
+			peer.transport.sendToClient(message);
+		}
+
+		while (peer.transport.receiveOnClient(message)) {
+			peer.client.applyUpdate(peer.data, message);
+			peer.client.writeAck(message);
+			peer.transport.sendToServer(message);
+		}
+
+		while (peer.transport.receiveOnServer(message)) {
+			server.readAck(id, message);
+		}
+	}
+}
+
+static bool SameVolume(const TVoxelData& a, const TVoxelData& b) {
+	for (int x = 0; x < a.num(); x++) {
+		for (int y = 0; y < a.num(); y++) {
+			for (int z = 0; z < a.num(); z++) {
+				if (a.getDensity(x, y, z) != b.getDensity(x, y, z) || a.getMaterial(x, y, z) != b.getMaterial(x, y, z)) {
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// the same random edits replicated once as edit replays and once as brick deltas, to a peer that
+// generated the volume itself and to one that starts empty
+static void TestReplication(int32 editNum, int32 editsPerPublish) {
+	const int num = 64;
+	const float size = 1000.f;
+	const TVoxelSdfGenerator generator(VoxelSdfTerrain(0.f, 300.f, TVoxelFbmSettings()));
+
+	for (int mode = 0; mode < 2; mode++) {
+		TVoxelReplicationSettings settings;
+		settings.bSendEdits = mode == 0;
+
+		TVoxelData data(num, size);
+		VoxelGenerate(data, FVector::ZeroVector, generator);
+
+		TArray<uint8> full;
+		data.save(full);
+
+		TVoxelReplicationServer server(data, settings);
+
+		TReplicationPeer generated(num, size, server.getVersion());
+		VoxelGenerate(generated.data, FVector::ZeroVector, generator);
+
+		TReplicationPeer empty(num, size, 0);
+
+		TArray<TReplicationPeer*> peers = { &generated, &empty };
+		server.addClient(0, generated.client.getVersion());
+		server.addClient(1, empty.client.getVersion());
+
+		// brings the empty peer up to date before the edits start
+		PumpReplication(server, peers);
+		const size_t initialBytes = empty.transport.getBytesToClient();
+
+		FRandomStream stream(20181017);
+		for (int32 i = 0; i < editNum; i++) {
+			const FVector center(stream.FRandRange(-size / 2, size / 2), stream.FRandRange(-size / 2, size / 2), stream.FRandRange(-200.f, 200.f));
+			const float radius = stream.FRandRange(20.f, 80.f);
+
+			const float kind = stream.FRand();
+			if (kind < 0.4f) {
+				server.applyEdit(data, TVoxelEdit::digSphere(center, radius));
+			} else if (kind < 0.8f) {
+				server.applyEdit(data, TVoxelEdit::fillSphere(center, radius, 1 + stream.RandHelper(3)));
+			} else {
+				TVoxelFilterSettings filter;
+				filter.type = (TVoxelFilterType)stream.RandHelper((int32)TVoxelFilterType::Erode + 1);
+				filter.radius = 1 + stream.RandHelper(3);
+				server.applyEdit(data, TVoxelEdit::filterSphere(center, radius, filter));
+			}
+
+			if ((i + 1) % editsPerPublish == 0) {
+				server.publish(data);
+				PumpReplication(server, peers);
+			}
+		}
+
+		server.publish(data);
+		for (int i = 0; i < 3; i++) {
+			PumpReplication(server, peers);
+		}
+
+		const bool bGenerated = generated.client.getVersion() == server.getVersion() && SameVolume(data, generated.data);
+		const bool bEmpty = empty.client.getVersion() == server.getVersion() && SameVolume(data, empty.data);
+
+		UE_LOG(LogTemp, Display, TEXT("TestReplication %s: %d edits, %llu bytes (%.1f per edit), full volume %d bytes, resync from empty %llu bytes, %s"),
+			settings.bSendEdits ? TEXT("edits") : TEXT("bricks"),
+			editNum,
+			(uint64)generated.transport.getBytesToClient(),
+			(float)generated.transport.getBytesToClient() / FMath::Max(editNum, 1),
+			full.Num(),
+			(uint64)initialBytes,
+			bGenerated && bEmpty ? TEXT("replicas match") : TEXT("REPLICAS DIFFER"));
+	}
+}
+
+static void TestReplicationCommand(const TArray<FString>& Args) {
+	int32 EditNum = 200;
+	int32 EditsPerPublish = 4;
+
+	for (const FString& Arg : Args) {
+		FParse::Value(*Arg, TEXT("edits="), EditNum);
+		FParse::Value(*Arg, TEXT("publish="), EditsPerPublish);
+	}
+
+	TestReplication(EditNum, FMath::Max(EditsPerPublish, 1));
+}
+
+static FAutoConsoleCommand TestReplicationCmd(
+	TEXT("fastdc.TestReplication"),
+	TEXT("Replicates random edits to loopback clients and compares their volumes. Arguments: [edits=N] [publish=N]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&TestReplicationCommand));
+
+#endif
@@ -0,0 +1,371 @@
+#include "VoxelSnapshot.h"
+#include <algorithm>
+
+// density_data may be NULL and materials empty for a uniform component, the fill value is used then
+static void fillBrick(const TVoxelData& data, const unsigned char* density_data, unsigned char density_fill, const TVoxelMaterialBricks& materials, unsigned short base_fill_mat, int bx, int by, int bz, TVoxelBrick& brick) {
+	const int n = data.num();
+	const int x0 = bx << VOXEL_BRICK_SHIFT;
+	const int y0 = by << VOXEL_BRICK_SHIFT;
+	const int z0 = bz << VOXEL_BRICK_SHIFT;
+
+	// bricks on the far border may be partial, the tail of each row stays zeroed
+	const int rowLen = FMath::Min(VOXEL_BRICK_SIZE, n - z0);
+	FMemory::Memzero(brick.density, sizeof(brick.density));
+
+	// materials are stored in brick layout and decode straight into place, the padding is reset
+	// to the base material below
+	const bool bMaterial = !materials.isEmpty();
+	if (bMaterial) {
+		materials.decodeBrick((bx * data.brickNum() + by) * data.brickNum() + bz, brick.material);
+	}
+
+	for (int lx = 0; lx < VOXEL_BRICK_SIZE; lx++) {
+		for (int ly = 0; ly < VOXEL_BRICK_SIZE; ly++) {
+			const int local = ((lx << VOXEL_BRICK_SHIFT) | ly) << VOXEL_BRICK_SHIFT;
+			const int x = x0 + lx;
+			const int y = y0 + ly;
+
+			if (x >= n || y >= n) {
+				for (int lz = 0; lz < VOXEL_BRICK_SIZE; lz++) {
+					brick.material[local + lz] = base_fill_mat;
+				}
+				continue;
+			}
+
+			const int index = data.clcLinearIndex(x, y, z0);
+			if (density_data != NULL) {
+				FMemory::Memcpy(&brick.density[local], &density_data[index], rowLen);
+			} else {
+				FMemory::Memset(&brick.density[local], density_fill, rowLen);
+			}
+
+			if (!bMaterial) {
+				for (int lz = 0; lz < rowLen; lz++) {
+					brick.material[local + lz] = base_fill_mat;
+				}
+			}
+
+			for (int lz = rowLen; lz < VOXEL_BRICK_SIZE; lz++) {
+				brick.material[local + lz] = base_fill_mat;
+			}
+		}
+	}
+}
+
+void TVoxelSnapshot::readBrick(const TVoxelData& data, int bx, int by, int bz, TVoxelBrick& out) {
+	const unsigned char density_fill = data.density_state == TVoxelDataFillState::ALL ? 255 : 0;
+	fillBrick(data, data.density_data, density_fill, data.material_bricks, data.base_fill_mat, bx, by, bz, out);
+}
+
+void TVoxelSnapshot::storeBrick(const TVoxelData& data, int index, TBrickBlock& block, int slot) {
+	const int n = data.voxel_num;
+	const int bz = index % data.brick_num;
+	const int by = (index / data.brick_num) % data.brick_num;
+	const int bx = index / (data.brick_num * data.brick_num);
+	const int x0 = bx << VOXEL_BRICK_SHIFT;
+	const int y0 = by << VOXEL_BRICK_SHIFT;
+	const int z0 = bz << VOXEL_BRICK_SHIFT;
+	const int x1 = FMath::Min(x0 + VOXEL_BRICK_SIZE, n);
+	const int y1 = FMath::Min(y0 + VOXEL_BRICK_SIZE, n);
+	const int z1 = FMath::Min(z0 + VOXEL_BRICK_SIZE, n);
+
+	unsigned char density_fill = data.density_state == TVoxelDataFillState::ALL ? 255 : 0;
+	unsigned char samples[VOXEL_BRICK_VOLUME];
+	bool bDensity = false;
+
+	if (data.density_data != NULL) {
+		density_fill = data.density_data[data.clcLinearIndex(x0, y0, z0)];
+
+		// pyramid ranges only ever widen, equal bounds need no look at the samples
+		unsigned char mn, mx;
+		data.density_pyramid.getRange(x0, y0, z0, x1 - 1, y1 - 1, z1 - 1, mn, mx);
+
+		if (mn != mx) {
+			FMemory::Memzero(samples, sizeof(samples));
+			unsigned char diff = 0;
+
+			for (int x = x0; x < x1; x++) {
+				for (int y = y0; y < y1; y++) {
+					unsigned char* row = &samples[(((x - x0) << VOXEL_BRICK_SHIFT) | (y - y0)) << VOXEL_BRICK_SHIFT];
+					FMemory::Memcpy(row, &data.density_data[data.clcLinearIndex(x, y, z0)], z1 - z0);
+
+					for (int z = 0; z < z1 - z0; z++) {
+						diff |= row[z] ^ density_fill;
+					}
+				}
+			}
+
+			bDensity = diff != 0;
+		}
+	}
+
+	unsigned short material_fill = data.base_fill_mat;
+	const TVoxelMaterialBricks::TBrick* material = nullptr;
+
+	if (!data.material_bricks.isEmpty()) {
+		material = &data.material_bricks.bricks[index];
+		if (TVoxelMaterialBricks::isUniform(*material, material_fill)) {
+			material = nullptr;
+		}
+	}
+
+	block.density_fill[slot] = density_fill;
+	block.material_fill[slot] = material_fill;
+
+	if (!bDensity && material == nullptr) {
+		block.bricks[slot] = nullptr;
+		return;
+	}
+
+	auto brick = std::make_shared<TStoredBrick>();
+	if (bDensity) {
+		brick->density.assign(samples, samples + VOXEL_BRICK_VOLUME);
+	}
+
+	// the encoded form is copied as it is, a brick costs what it costs in the volume
+	if (material != nullptr) {
+		brick->material = *material;
+	} else {
+		brick->material.palette.assign(1, material_fill);
+	}
+
+	block.bricks[slot] = brick;
+}
+
+std::shared_ptr<const TVoxelSnapshot> TVoxelSnapshot::capture(const TVoxelData& data, const std::shared_ptr<const TVoxelSnapshot>& previous) {
+	auto snapshot = std::make_shared<TVoxelSnapshot>();
+
+	snapshot->density_state = data.density_state;
+	snapshot->base_fill_mat = data.base_fill_mat;
+	snapshot->uniform_volume = data.density_data == NULL && data.material_bricks.isEmpty();
+	snapshot->voxel_num = data.voxel_num;
+	snapshot->volume_size = data.volume_size;
+	snapshot->brick_num = data.brick_num;
+	snapshot->data_version = data.data_version;
+	snapshot->density_pyramid = data.density_pyramid;
+
+	const int brickCount = snapshot->brickCount();
+	snapshot->blocks.resize((brickCount + VOXEL_SNAPSHOT_BLOCK_SIZE - 1) >> VOXEL_SNAPSHOT_BLOCK_SHIFT);
+
+	const bool bCanShare = previous && previous->voxel_num == data.voxel_num;
+
+	for (int block = 0; block < (int)snapshot->blocks.size(); block++) {
+		const int first = block << VOXEL_SNAPSHOT_BLOCK_SHIFT;
+		const int count = FMath::Min(VOXEL_SNAPSHOT_BLOCK_SIZE, brickCount - first);
+		const TBrickBlock* old = bCanShare ? previous->blocks[block].get() : nullptr;
+
+		// version stamps are unique per write, equal stamps mean equal content; changes of the
+		// fill state or the base material stamp every brick
+		bool bSame = old != nullptr;
+		for (int i = 0; i < count && bSame; i++) {
+			bSame = old->brick_version[i] == data.brick_version[first + i];
+		}
+
+		if (bSame) {
+			snapshot->blocks[block] = previous->blocks[block];
+			continue;
+		}
+
+		auto copy = std::make_shared<TBrickBlock>();
+		for (int i = 0; i < count; i++) {
+			const int index = first + i;
+			copy->brick_version[i] = data.brick_version[index];
+
+			if (old != nullptr && old->brick_version[i] == data.brick_version[index]) {
+				copy->bricks[i] = old->bricks[i];
+				copy->density_fill[i] = old->density_fill[i];
+				copy->material_fill[i] = old->material_fill[i];
+			} else {
+				storeBrick(data, index, *copy, i);
+			}
+		}
+
+		snapshot->blocks[block] = copy;
+	}
+
+	return snapshot;
+}
+
+std::shared_ptr<const TVoxelSnapshot> TVoxelSnapshot::restore(TVoxelData& data, const TVoxelSnapshot& target, const TVoxelSnapshot& live) {
+	check(target.voxel_num == data.voxel_num && live.voxel_num == data.voxel_num);
+	check(live.data_version == data.data_version);
+
+	// a uniform target frees the arrays again instead of writing every brick
+	if (target.uniform_volume) {
+		data.deinitializeDensity(target.density_state);
+		data.deinitializeMaterial(target.base_fill_mat);
+		return capture(data, nullptr);
+	}
+
+	// bricks of a uniform volume have no stamps of their own, a changed fill touches all of them
+	const bool bAll = target.base_fill_mat != data.base_fill_mat || (data.density_data == NULL && target.density_state != data.density_state);
+	data.base_fill_mat = target.base_fill_mat;
+
+	TVoxelBrick brick;
+	int index = 0;
+	for (int bx = 0; bx < data.brick_num; bx++) {
+		for (int by = 0; by < data.brick_num; by++) {
+			for (int bz = 0; bz < data.brick_num; bz++, index++) {
+				if (bAll || target.getBrickVersion(index) != live.getBrickVersion(index)) {
+					target.readBrickAt(index, brick);
+					data.writeBrick(bx, by, bz, brick.density, brick.material);
+				}
+			}
+		}
+	}
+
+	auto snapshot = std::make_shared<TVoxelSnapshot>(target);
+	snapshot->density_state = data.density_state;
+	snapshot->uniform_volume = data.density_data == NULL && data.material_bricks.isEmpty();
+	snapshot->data_version = data.data_version;
+	snapshot->density_pyramid = data.density_pyramid;
+
+	// the written bricks carry new stamps, only their blocks need copies with the bricks of target
+	const int brickCount = snapshot->brickCount();
+	for (int block = 0; block < (int)snapshot->blocks.size(); block++) {
+		const int first = block << VOXEL_SNAPSHOT_BLOCK_SHIFT;
+		const int count = FMath::Min(VOXEL_SNAPSHOT_BLOCK_SIZE, brickCount - first);
+		const TBrickBlock& old = *target.blocks[block];
+
+		bool bSame = true;
+		for (int i = 0; i < count && bSame; i++) {
+			bSame = old.brick_version[i] == data.brick_version[first + i];
+		}
+
+		if (!bSame) {
+			auto copy = std::make_shared<TBrickBlock>(old);
+			for (int i = 0; i < count; i++) {
+				copy->brick_version[i] = data.brick_version[first + i];
+			}
+			snapshot->blocks[block] = copy;
+		}
+	}
+
+	return snapshot;
+}
+
+FVector TVoxelSnapshot::voxelIndexToVector(int x, int y, int z) const {
+	const float step = size() / (num() - 1);
+	const float s = -size() / 2;
+	return FVector(s + x * step, s + y * step, s + z * step);
+}
+
+void TVoxelSnapshot::padBrick(int index, unsigned char* density, unsigned short* material) const {
+	const int x0 = (index / (brick_num * brick_num)) << VOXEL_BRICK_SHIFT;
+	const int y0 = ((index / brick_num) % brick_num) << VOXEL_BRICK_SHIFT;
+	const int z0 = (index % brick_num) << VOXEL_BRICK_SHIFT;
+
+	if (x0 + VOXEL_BRICK_SIZE <= voxel_num && y0 + VOXEL_BRICK_SIZE <= voxel_num && z0 + VOXEL_BRICK_SIZE <= voxel_num) {
+		return;
+	}
+
+	for (int lx = 0; lx < VOXEL_BRICK_SIZE; lx++) {
+		for (int ly = 0; ly < VOXEL_BRICK_SIZE; ly++) {
+			const bool bRowInside = x0 + lx < voxel_num && y0 + ly < voxel_num;
+
+			for (int lz = 0; lz < VOXEL_BRICK_SIZE; lz++) {
+				if (bRowInside && z0 + lz < voxel_num) {
+					continue;
+				}
+
+				const int local = (((lx << VOXEL_BRICK_SHIFT) | ly) << VOXEL_BRICK_SHIFT) | lz;
+				if (density != nullptr) {
+					density[local] = 0;
+				}
+				material[local] = base_fill_mat;
+			}
+		}
+	}
+}
+
+bool TVoxelSnapshot::isBrickMaterialUniform(int index, unsigned short& material) const {
+	const TBrickBlock& block = blockOf(index);
+	const int slot = index & (VOXEL_SNAPSHOT_BLOCK_SIZE - 1);
+
+	if (const TStoredBrick* brick = block.bricks[slot].get()) {
+		return TVoxelMaterialBricks::isUniform(brick->material, material);
+	}
+
+	material = block.material_fill[slot];
+	return true;
+}
+
+void TVoxelSnapshot::decodeBrickMaterial(int index, unsigned short* out) const {
+	const TBrickBlock& block = blockOf(index);
+	const int slot = index & (VOXEL_SNAPSHOT_BLOCK_SIZE - 1);
+
+	if (const TStoredBrick* brick = block.bricks[slot].get()) {
+		TVoxelMaterialBricks::decode(brick->material, out);
+	} else {
+		std::fill(out, out + VOXEL_BRICK_VOLUME, block.material_fill[slot]);
+	}
+
+	padBrick(index, nullptr, out);
+}
+
+void TVoxelSnapshot::readBrickAt(int index, TVoxelBrick& out) const {
+	const TBrickBlock& block = blockOf(index);
+	const int slot = index & (VOXEL_SNAPSHOT_BLOCK_SIZE - 1);
+	const TStoredBrick* brick = block.bricks[slot].get();
+
+	// stored densities are padded already
+	if (brick != nullptr && !brick->density.empty()) {
+		FMemory::Memcpy(out.density, brick->density.data(), sizeof(out.density));
+	} else {
+		FMemory::Memset(out.density, block.density_fill[slot], sizeof(out.density));
+	}
+
+	decodeBrickMaterial(index, out.material);
+	padBrick(index, out.density, out.material);
+}
+
+int TVoxelSnapshot::getStoredBrickCount() const {
+	int count = 0;
+	for (int i = 0; i < brickCount(); i++) {
+		if (brickPtr(i)) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+size_t TVoxelSnapshot::getAllocatedSize(std::unordered_set<const void*>* counted) const {
+	std::unordered_set<const void*> own;
+	if (counted == nullptr) {
+		counted = &own;
+	}
+
+	size_t bytes = sizeof(TVoxelSnapshot) + blocks.capacity() * sizeof(blocks[0]);
+
+	for (const auto& block : blocks) {
+		// the bricks of a block were counted along with it
+		if (!counted->insert(block.get()).second) {
+			continue;
+		}
+
+		bytes += sizeof(TBrickBlock);
+		for (const auto& brick : block->bricks) {
+			if (brick && counted->insert(brick.get()).second) {
+				bytes += sizeof(TStoredBrick) + brick->density.capacity() + TVoxelMaterialBricks::getAllocatedSize(brick->material);
+			}
+		}
+	}
+
+	return bytes + density_pyramid.getAllocatedSize(*counted);
+}
+
+int TVoxelSnapshot::getSharedBrickCount(const TVoxelSnapshot& other) const {
+	if (other.voxel_num != voxel_num) {
+		return 0;
+	}
+
+	int count = 0;
+	for (int i = 0; i < brickCount(); i++) {
+		if (brickPtr(i) && brickPtr(i) == other.brickPtr(i)) {
+			count++;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelData.h"
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+struct TVoxelBrick {
+	unsigned char density[VOXEL_BRICK_VOLUME];
+	unsigned short material[VOXEL_BRICK_VOLUME];
+};
+
+// bricks per block of the brick table of a snapshot, as a shift
+#define VOXEL_SNAPSHOT_BLOCK_SHIFT 6
+#define VOXEL_SNAPSHOT_BLOCK_SIZE (1 << VOXEL_SNAPSHOT_BLOCK_SHIFT)
+
+//
+// Immutable copy-on-write view of a TVoxelData.
+//
+// A snapshot is captured on the thread that owns the volume, at the point where queued edits
+// have been applied. Bricks that did not change since the previous snapshot are shared with it.
+// A brick of one density and one material stores just those two values in the brick table, so
+// uniform volumes and the air and rock of mixed ones store no bricks at all; the others keep
+// their densities and a copy of the palette encoding of their materials. The brick table is split
+// into blocks that are shared as a whole while none of their bricks changed, and the density
+// pyramid shares its pages with the volume, so a snapshot after a small edit costs about the
+// bricks the edit touched. Once captured a snapshot can be read from any thread (mesher, physics,
+// save) while the live volume keeps being edited.
+//
+class TVoxelSnapshot {
+
+private:
+	struct TStoredBrick {
+		// VOXEL_BRICK_VOLUME densities in TVoxelBrick layout, empty when all of them equal the fill
+		// of the block
+		std::vector<unsigned char> density;
+
+		// padding of partial bricks as in the volume
+		TVoxelMaterialBricks::TBrick material;
+	};
+
+	struct TBrickBlock {
+		// null for a brick of one density and one material, which the fills hold
+		std::shared_ptr<const TStoredBrick> bricks[VOXEL_SNAPSHOT_BLOCK_SIZE];
+		uint64 brick_version[VOXEL_SNAPSHOT_BLOCK_SIZE] = {};
+		unsigned char density_fill[VOXEL_SNAPSHOT_BLOCK_SIZE] = {};
+		unsigned short material_fill[VOXEL_SNAPSHOT_BLOCK_SIZE] = {};
+	};
+
+	TVoxelDataFillState density_state = TVoxelDataFillState::ZERO;
+	unsigned short base_fill_mat = 0;
+
+	// no density array and no materials in the volume
+	bool uniform_volume = true;
+
+	int voxel_num = 0;
+	float volume_size = 0;
+	int brick_num = 0;
+	uint64 data_version = 0;
+
+	std::vector<std::shared_ptr<const TBrickBlock>> blocks;
+
+	TVoxelDensityPyramid density_pyramid;
+
+	FORCEINLINE const TBrickBlock& blockOf(int index) const {
+		return *blocks[index >> VOXEL_SNAPSHOT_BLOCK_SHIFT];
+	}
+
+	FORCEINLINE const std::shared_ptr<const TStoredBrick>& brickPtr(int index) const {
+		return blockOf(index).bricks[index & (VOXEL_SNAPSHOT_BLOCK_SIZE - 1)];
+	}
+
+	FORCEINLINE int brickIndex(int x, int y, int z) const {
+		return ((x >> VOXEL_BRICK_SHIFT) * brick_num + (y >> VOXEL_BRICK_SHIFT)) * brick_num + (z >> VOXEL_BRICK_SHIFT);
+	}
+
+	FORCEINLINE static int localIndex(int x, int y, int z) {
+		const int mask = VOXEL_BRICK_SIZE - 1;
+		return ((((x & mask) << VOXEL_BRICK_SHIFT) | (y & mask)) << VOXEL_BRICK_SHIFT) | (z & mask);
+	}
+
+	int brickCount() const { return brick_num * brick_num * brick_num; }
+
+	// brick index of the live volume into slot of block, as fills alone where it is uniform
+	static void storeBrick(const TVoxelData& data, int index, TBrickBlock& block, int slot);
+
+	// samples of a partial brick beyond the far faces, density 0 and the base material
+	void padBrick(int index, unsigned char* density, unsigned short* material) const;
+
+	FORCEINLINE bool isInside(int x, int y, int z) const {
+		return (unsigned)x < (unsigned)voxel_num && (unsigned)y < (unsigned)voxel_num && (unsigned)z < (unsigned)voxel_num;
+	}
+
+public:
+	// previous must be null or a snapshot of the same volume, bricks are shared with it where the brick versions still match
+	static std::shared_ptr<const TVoxelSnapshot> capture(const TVoxelData& data, const std::shared_ptr<const TVoxelSnapshot>& previous);
+
+	// writes target back into data, which must still hold the state live was captured from; only
+	// bricks whose versions differ between the two are written. The returned snapshot describes the
+	// restored volume and shares every brick with target
+	static std::shared_ptr<const TVoxelSnapshot> restore(TVoxelData& data, const TVoxelSnapshot& target, const TVoxelSnapshot& live);
+
+	// brick (bx, by, bz) of the live volume; samples beyond its far faces read as density 0 and the base material
+	static void readBrick(const TVoxelData& data, int bx, int by, int bz, TVoxelBrick& out);
+
+	float size() const { return volume_size; }
+	int num() const { return voxel_num; }
+	uint64 getDataVersion() const { return data_version; }
+	TVoxelDataFillState getDensityFillState() const { return density_state; }
+	const TVoxelDensityPyramid& getDensityPyramid() const { return density_pyramid; }
+
+	FVector voxelIndexToVector(int x, int y, int z) const;
+
+	int brickNum() const { return brick_num; }
+	uint64 getBrickVersion(int index) const { return blockOf(index).brick_version[index & (VOXEL_SNAPSHOT_BLOCK_SIZE - 1)]; }
+	unsigned short getBaseMaterial() const { return base_fill_mat; }
+
+	// density of sample local of the brick with linear brick index (bx * n + by) * n + bz, both in
+	// TVoxelBrick layout; padding reads as the fill of a uniform brick
+	FORCEINLINE unsigned char getBrickDensity(int index, int local) const {
+		const TBrickBlock& block = blockOf(index);
+		const int slot = index & (VOXEL_SNAPSHOT_BLOCK_SIZE - 1);
+		const TStoredBrick* brick = block.bricks[slot].get();
+
+		return brick != nullptr && !brick->density.empty() ? brick->density[local] : block.density_fill[slot];
+	}
+
+	FORCEINLINE unsigned short getBrickMaterial(int index, int local) const {
+		const TBrickBlock& block = blockOf(index);
+		const int slot = index & (VOXEL_SNAPSHOT_BLOCK_SIZE - 1);
+		const TStoredBrick* brick = block.bricks[slot].get();
+
+		return brick != nullptr ? TVoxelMaterialBricks::getSample(brick->material, local) : block.material_fill[slot];
+	}
+
+	// as on TVoxelData, the padding of decoded bricks holds the base material
+	bool isBrickMaterialUniform(int index, unsigned short& material) const;
+	void decodeBrickMaterial(int index, unsigned short* out) const;
+
+	// contents of a brick, uniform ones included; same layout and padding as readBrick
+	void readBrickAt(int index, TVoxelBrick& out) const;
+
+	FORCEINLINE unsigned char getRawDensity(int x, int y, int z) const {
+		return getBrickDensity(brickIndex(x, y, z), localIndex(x, y, z));
+	}
+
+	FORCEINLINE float getDensity(int x, int y, int z) const {
+		if (!isInside(x, y, z)) {
+			return 0;
+		}
+
+		return (float)getRawDensity(x, y, z) / 255.0f;
+	}
+
+	FORCEINLINE unsigned short getMaterial(int x, int y, int z) const {
+		if (!isInside(x, y, z)) {
+			return 0;
+		}
+
+		return getBrickMaterial(brickIndex(x, y, z), localIndex(x, y, z));
+	}
+
+	// number of bricks this snapshot stores and how many of them it shares with the given one
+	int getStoredBrickCount() const;
+	int getSharedBrickCount(const TVoxelSnapshot& other) const;
+
+	// bytes of the brick table, the stored bricks and the pyramid; blocks, bricks and pages found
+	// in counted are skipped and the others added to it, so that a total over snapshots sharing
+	// them counts each once. Without a set everything the snapshot reads is counted
+	size_t getAllocatedSize(std::unordered_set<const void*>* counted = nullptr) const;
+};
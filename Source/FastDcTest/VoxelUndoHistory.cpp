@@ -0,0 +1,72 @@
+#include "VoxelUndoHistory.h"
+#include <unordered_set>
+
+void TVoxelUndoHistory::reset(const std::shared_ptr<const TVoxelSnapshot>& snapshot) {
+	steps.clear();
+	steps.push_back(snapshot);
+	position = 0;
+}
+
+void TVoxelUndoHistory::push(const std::shared_ptr<const TVoxelSnapshot>& snapshot) {
+	// edits that changed nothing don't make a step
+	if (position >= 0 && steps[position]->getDataVersion() == snapshot->getDataVersion()) {
+		return;
+	}
+
+	steps.resize(position + 1);
+	steps.push_back(snapshot);
+
+	if ((int)steps.size() > max_steps) {
+		steps.erase(steps.begin(), steps.end() - max_steps);
+	}
+
+	position = (int)steps.size() - 1;
+}
+
+std::shared_ptr<const TVoxelSnapshot> TVoxelUndoHistory::restore(TVoxelData& data, int to) {
+	// the restored step shares its bricks with the old one but carries the current stamps, so the
+	// next capture against it copies only what gets edited afterwards
+	steps[to] = TVoxelSnapshot::restore(data, *steps[to], *steps[position]);
+	position = to;
+	return steps[to];
+}
+
+std::shared_ptr<const TVoxelSnapshot> TVoxelUndoHistory::undo(TVoxelData& data) {
+	if (position < 0) {
+		return nullptr;
+	}
+
+	if (data.getDataVersion() != steps[position]->getDataVersion()) {
+		push(TVoxelSnapshot::capture(data, steps[position]));
+	}
+
+	return canUndo() ? restore(data, position - 1) : nullptr;
+}
+
+std::shared_ptr<const TVoxelSnapshot> TVoxelUndoHistory::redo(TVoxelData& data) {
+	if (position < 0) {
+		return nullptr;
+	}
+
+	// edits since the last push end the redo chain
+	if (data.getDataVersion() != steps[position]->getDataVersion()) {
+		push(TVoxelSnapshot::capture(data, steps[position]));
+		return nullptr;
+	}
+
+	return canRedo() ? restore(data, position + 1) : nullptr;
+}
+
+size_t TVoxelUndoHistory::getAllocatedSize(std::unordered_set<const void*>* counted) const {
+	std::unordered_set<const void*> own;
+	if (counted == nullptr) {
+		counted = &own;
+	}
+
+	size_t bytes = steps.capacity() * sizeof(steps[0]);
+	for (const auto& step : steps) {
+		bytes += step->getAllocatedSize(counted);
+	}
+
+	return bytes;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelSnapshot.h"
+#include <memory>
+#include <vector>
+
+//
+// Undo and redo for one volume, every step is a TVoxelSnapshot of it.
+//
+// Consecutive steps share the bricks nobody edited in between, so the history costs about as much
+// as the bricks edited within it, and recording a step costs no more than the capture that
+// publishes it for the mesher. Stepping back or forth writes only the bricks whose versions
+// differ between the two steps into the live volume. The oldest steps are dropped beyond maxSteps.
+//
+class TVoxelUndoHistory {
+
+private:
+	std::vector<std::shared_ptr<const TVoxelSnapshot>> steps;
+	int position = -1;
+	int max_steps;
+
+	std::shared_ptr<const TVoxelSnapshot> restore(TVoxelData& data, int to);
+
+public:
+	explicit TVoxelUndoHistory(int maxSteps = 64) : max_steps(FMath::Max(maxSteps, 1)) { }
+
+	// starts over with snapshot as the only step
+	void reset(const std::shared_ptr<const TVoxelSnapshot>& snapshot);
+
+	// records the state after an edit, the steps that could have been redone are dropped
+	void push(const std::shared_ptr<const TVoxelSnapshot>& snapshot);
+
+	bool canUndo() const { return position > 0; }
+	bool canRedo() const { return position + 1 < (int)steps.size(); }
+
+	// both return the snapshot of the restored volume, null when there is no step to go to;
+	// edits made to data since the last push become a step of their own first, which leaves
+	// nothing to redo
+	std::shared_ptr<const TVoxelSnapshot> undo(TVoxelData& data);
+	std::shared_ptr<const TVoxelSnapshot> redo(TVoxelData& data);
+
+	int stepNum() const { return (int)steps.size(); }
+	int getPosition() const { return position; }
+
+	// sum of TVoxelSnapshot::getAllocatedSize over the steps, what they share counted once and
+	// what is in counted already not at all
+	size_t getAllocatedSize(std::unordered_set<const void*>* counted = nullptr) const;
+};
@@ -38,42 +38,79 @@
 //	glm::vec3 solvedPos;
 //	float error = qef_solve_from_points_3d(&positions[0].x, &normals[0].x, 2, &solvedPos.x);
 //
+// Every entry point takes an optional number of Jacobi sweeps, SVD_NUM_SWEEPS by default.
+// The functions are inline so that the header can be included from several source files.
+//
+// Deterministic mode:
+//
+// By default the Givens rotations use _mm_rsqrt_ps, whose approximation differs between CPU
+// vendors. Passing deterministic = true replaces it with a correctly rounded 1 / sqrt, which
+// leaves only IEEE exact operations (add, mul, div, sqrt, min, compare) executed as explicit
+// intrinsics in a fixed order. Results are then bit identical on every SSE2 machine, as long
+// as the compiler is not allowed to contract intrinsics into FMA.
+//
+// The double precision path (qef_solve_from_points_4d_double) is built the same way on SSE2
+// doubles and is always deterministic. It keeps its accuracy for hermite data far from the origin,
+// which has to reach it in double already: the mesher's float crossings are relative to the
+// volume center and gain nothing from it, so only callers with their own double data use it.
+//
 
 #include	<xmmintrin.h>
+#include	<emmintrin.h>
 #include	<immintrin.h>
 
 const int QEF_MAX_INPUT_COUNT = 12;
 
+#define SVD_NUM_SWEEPS 5
+
 // Ideally the data would already be in SSE registers & returned in a SEE register
-float qef_solve_from_points(
+inline float qef_solve_from_points(
 	const __m128* positions,
 	const __m128* normals,
 	const int count,
-	__m128* solved_position);
+	__m128* solved_position,
+	const int sweeps = SVD_NUM_SWEEPS,
+	const bool deterministic = false);
 
 // Expects 4d vectors contiguous in memory for the positions/normals
 // Addresses pointed to by positions, normals and solved_position MUST be 16 byte aligned
 // Writes result to 4d vector.
-float qef_solve_from_points_4d(
+inline float qef_solve_from_points_4d(
 	const float* positions,
 	const float* normals,
 	const int count,
-	float* solved_position);
+	float* solved_position,
+	const int sweeps = SVD_NUM_SWEEPS,
+	const bool deterministic = false);
 
-float qef_solve_from_points_4d_interleaved(
+inline float qef_solve_from_points_4d_interleaved(
 	const float* data,
 	const size_t stride,
 	const int count,
-	float* solved_position);
+	float* solved_position,
+	const int sweeps = SVD_NUM_SWEEPS,
+	const bool deterministic = false);
 
 // Expects 3d vectors contiguous in memory for the positions/normals
 // No alignment requirements.
 // Writes result to 3d vector.
-float qef_solve_from_points_3d(
+inline float qef_solve_from_points_3d(
 	const float* positions,
 	const float* normals,
 	const int count,
-	float* solved_position);
+	float* solved_position,
+	const int sweeps = SVD_NUM_SWEEPS,
+	const bool deterministic = false);
+
+// Expects 4d double vectors contiguous in memory for the positions/normals (w = 1 for positions)
+// No alignment requirements.
+// Writes result to 4d double vector.
+inline double qef_solve_from_points_4d_double(
+	const double* positions,
+	const double* normals,
+	const int count,
+	double* solved_position,
+	const int sweeps = SVD_NUM_SWEEPS);
 
 
 //#ifdef QEF_INCLUDE_IMPL
@@ -84,7 +121,6 @@ union Mat4x4
 	__m128	row[4];
 };
 
-#define SVD_NUM_SWEEPS 5
 const float PSUEDO_INVERSE_THRESHOLD = 0.001f;
 
 // ----------------------------------------------------------------------------
@@ -147,7 +183,7 @@ static void m4x4_mul_m4x4(Mat4x4& out, const Mat4x4& A, const Mat4x4& B)
 
 // ----------------------------------------------------------------------------
 
-static void givens_coeffs_sym(__m128& c_result, __m128& s_result, const Mat4x4& vtav, const int a, const int b)
+static void givens_coeffs_sym(__m128& c_result, __m128& s_result, const Mat4x4& vtav, const int a, const int b, const bool deterministic)
 {
 	__m128 simd_pp = _mm_set_ps(
 		0.f,
@@ -193,7 +229,7 @@ static void givens_coeffs_sym(__m128& c_result, __m128& s_result, const Mat4x4&
 	// c = rsqrt(1.f + tan * tan);
 	__m128 tan_sq = _mm_mul_ps(tan, tan);
 	__m128 tan_sq_1 = _mm_add_ps(ones, tan_sq);
-	__m128 c = _mm_rsqrt_ps(tan_sq_1);
+	__m128 c = deterministic ? _mm_div_ps(ones, _mm_sqrt_ps(tan_sq_1)) : _mm_rsqrt_ps(tan_sq_1);
 
 	// s = tan * c;
 	__m128 s = _mm_mul_ps(tan, c);
@@ -301,17 +337,17 @@ static void rotate_xy(Mat4x4& vtav, Mat4x4& v, float c, float s, const int& a, c
 
 // ----------------------------------------------------------------------------
 
-static __m128 svd_solve_sym(Mat4x4& v, const Mat4x4& a) 
+static __m128 svd_solve_sym(Mat4x4& v, const Mat4x4& a, const int sweeps, const bool deterministic) 
 {
 	Mat4x4 vtav = a;
 
-	for (int i = 0; i < SVD_NUM_SWEEPS; ++i) 
+	for (int i = 0; i < sweeps; ++i) 
 	{
 		__m128 c, s;
 
 		if (vtav.row[0].m128_f32[1] != 0.f)
 		{
-			givens_coeffs_sym(c, s, vtav, 0, 1);
+			givens_coeffs_sym(c, s, vtav, 0, 1, deterministic);
 			rotateq_xy(vtav, c, s, 0, 1);
 			rotate_xy(vtav, v, c.m128_f32[1], s.m128_f32[1], 0, 1);
 			vtav.row[0].m128_f32[1] = 0.f;
@@ -319,7 +355,7 @@ static __m128 svd_solve_sym(Mat4x4& v, const Mat4x4& a)
 
 		if (vtav.row[0].m128_f32[2] != 0.f)
 		{
-			givens_coeffs_sym(c, s, vtav, 0, 2);
+			givens_coeffs_sym(c, s, vtav, 0, 2, deterministic);
 			rotateq_xy(vtav, c, s, 0, 2);
 			rotate_xy(vtav, v, c.m128_f32[1], s.m128_f32[1], 0, 2);
 			vtav.row[0].m128_f32[2] = 0.f;
@@ -327,7 +363,7 @@ static __m128 svd_solve_sym(Mat4x4& v, const Mat4x4& a)
 
 		if (vtav.row[1].m128_f32[2] != 0.f)
 		{
-			givens_coeffs_sym(c, s, vtav, 1, 2);
+			givens_coeffs_sym(c, s, vtav, 1, 2, deterministic);
 			rotateq_xy(vtav, c, s, 1, 2);
 			rotate_xy(vtav, v, c.m128_f32[2], s.m128_f32[2], 1, 2);
 			vtav.row[1].m128_f32[2] = 0.f;
@@ -389,7 +425,7 @@ static void svd_pseudoinverse(Mat4x4& o, const __m128& sigma, const Mat4x4& v)
 // ----------------------------------------------------------------------------
 
 
-static void svd_solve_ATA_ATb(const Mat4x4& ATA, const __m128& ATb, __m128& x)
+static void svd_solve_ATA_ATb(const Mat4x4& ATA, const __m128& ATb, __m128& x, const int sweeps, const bool deterministic)
 {
 	Mat4x4 V;
 	V.row[0] = _mm_set_ps(0.f, 0.f, 0.f, 1.f);
@@ -397,7 +433,7 @@ static void svd_solve_ATA_ATb(const Mat4x4& ATA, const __m128& ATb, __m128& x)
 	V.row[2] = _mm_set_ps(0.f, 1.f, 0.f, 0.f);
 	V.row[3] = _mm_set_ps(0.f, 0.f, 0.f, 0.f);
 
-	const __m128 sigma = svd_solve_sym(V, ATA);
+	const __m128 sigma = svd_solve_sym(V, ATA, sweeps, deterministic);
 
 	// A = UEV^T; U = A / (E*V^T)
 	Mat4x4 Vinv;
@@ -408,7 +444,7 @@ static void svd_solve_ATA_ATb(const Mat4x4& ATA, const __m128& ATb, __m128& x)
 
 // ----------------------------------------------------------------------------
 
-void qef_simd_add(
+inline void qef_simd_add(
 	const __m128& p, const __m128& n,
 	Mat4x4& ATA, 
 	__m128& ATb,
@@ -431,7 +467,7 @@ void qef_simd_add(
 
 // ----------------------------------------------------------------------------
 
-float qef_simd_calc_error(const Mat4x4& A, const __m128& x, const __m128& b)
+inline float qef_simd_calc_error(const Mat4x4& A, const __m128& x, const __m128& b)
 {
 	__m128 tmp =  vec4_mul_m4x4(x, A);
 	tmp = _mm_sub_ps(b, tmp);
@@ -441,18 +477,20 @@ float qef_simd_calc_error(const Mat4x4& A, const __m128& x, const __m128& b)
 
 // ----------------------------------------------------------------------------
 
-float qef_simd_solve(
+inline float qef_simd_solve(
 	const Mat4x4& ATA, 
 	const __m128& ATb,
 	const __m128& pointaccum,
-	__m128& x)
+	__m128& x,
+	const int sweeps,
+	const bool deterministic)
 {
 	const __m128 masspoint = _mm_div_ps(pointaccum, _mm_set1_ps(pointaccum.m128_f32[3]));
 
 	__m128 p = vec4_mul_m4x4(masspoint, ATA);
 	p = _mm_sub_ps(ATb, p);
 
-	svd_solve_ATA_ATb(ATA, p, x);
+	svd_solve_ATA_ATb(ATA, p, x, sweeps, deterministic);
 
 	const float error = qef_simd_calc_error(ATA, x, ATb);
 	x = _mm_add_ps(x, masspoint);
@@ -462,11 +500,13 @@ float qef_simd_solve(
 
 // ----------------------------------------------------------------------------
 
-float qef_solve_from_points(
+inline float qef_solve_from_points(
 	const __m128* positions,
 	const __m128* normals,
 	const int count,
-	__m128* solved_position) 
+	__m128* solved_position,
+	const int sweeps,
+	const bool deterministic) 
 {
 	__m128 pointaccum = _mm_set1_ps(0.f);
 	__m128 ATb = _mm_set1_ps(0.f);
@@ -486,16 +526,18 @@ float qef_solve_from_points(
 	_mm_store_ps(x, ATb);
 	_mm_set_ps(0.f, x[2], x[1], x[0]);
 	
-	return qef_simd_solve(ATA, ATb, pointaccum, *solved_position);
+	return qef_simd_solve(ATA, ATb, pointaccum, *solved_position, sweeps, deterministic);
 }
 
 // ----------------------------------------------------------------------------
 
-float qef_solve_from_points_4d(
+inline float qef_solve_from_points_4d(
 	const float* positions,
 	const float* normals,
 	const int count,
-	float* solved_position)
+	float* solved_position,
+	const int sweeps,
+	const bool deterministic)
 {
 	if (count < 2 || count > QEF_MAX_INPUT_COUNT)
 	{
@@ -512,18 +554,20 @@ float qef_solve_from_points_4d(
 	}
 
 	__m128 solved;
-	const float error = qef_solve_from_points(p, n, count, &solved);
+	const float error = qef_solve_from_points(p, n, count, &solved, sweeps, deterministic);
 	_mm_store_ps(solved_position, solved);
 	return error;
 }
 
 // ----------------------------------------------------------------------------
 
-float qef_solve_from_points_4d_interleaved(
+inline float qef_solve_from_points_4d_interleaved(
 	const float* data,
 	const size_t stride,
 	const int count,
-	float* solved_position)
+	float* solved_position,
+	const int sweeps,
+	const bool deterministic)
 {
 	if (count < 2 || count > QEF_MAX_INPUT_COUNT)
 	{
@@ -540,22 +584,24 @@ float qef_solve_from_points_4d_interleaved(
 	}
 
 	__m128 solved;
-	const float error = qef_solve_from_points(p, n, count, &solved);
+	const float error = qef_solve_from_points(p, n, count, &solved, sweeps, deterministic);
 	_mm_store_ps(solved_position, solved);
 	return error;
 }
 
 // ----------------------------------------------------------------------------
 
-float qef_solve_from_points_3d(
+inline float qef_solve_from_points_3d(
 	const float* positions,
 	const float* normals,
 	const int count,
-	float* solved_position)
+	float* solved_position,
+	const int sweeps,
+	const bool deterministic)
 {
 	if (count < 2 || count > QEF_MAX_INPUT_COUNT)
 	{
-		solved_position[0] = solved_position[1] = solved_position[2] = solved_position[3] = 0.f;
+		solved_position[0] = solved_position[1] = solved_position[2] = 0.f;
 		return 0.f;
 	}
 
@@ -570,7 +616,7 @@ float qef_solve_from_points_3d(
 	}
 
 	__m128 solved;
-	const float error = qef_solve_from_points(p, n, count, &solved);
+	const float error = qef_solve_from_points(p, n, count, &solved, sweeps, deterministic);
 
 	solved_position[0] = solved.m128_f32[0];
 	solved_position[1] = solved.m128_f32[1];
@@ -580,6 +626,289 @@ float qef_solve_from_points_3d(
 
 
 
+// ----------------------------------------------------------------------------
+// Double precision, SSE2. A 4d vector is two registers: (x, y) and (z, w).
+// ----------------------------------------------------------------------------
+
+union Mat4x4d
+{
+	double	m[4][4];
+	__m128d	row[4][2];
+};
+
+// ----------------------------------------------------------------------------
+
+static inline double vec4d_dot(const __m128d* a, const __m128d* b)
+{
+	__m128d mul = _mm_add_pd(_mm_mul_pd(a[0], b[0]), _mm_mul_pd(a[1], b[1]));
+	return _mm_cvtsd_f64(_mm_add_sd(mul, _mm_unpackhi_pd(mul, mul)));
+}
+
+// ----------------------------------------------------------------------------
+
+static inline void vec4d_mul_m4x4d(__m128d* result, const __m128d* a, const Mat4x4d& B)
+{
+	const __m128d ax = _mm_unpacklo_pd(a[0], a[0]);
+	const __m128d ay = _mm_unpackhi_pd(a[0], a[0]);
+	const __m128d az = _mm_unpacklo_pd(a[1], a[1]);
+	const __m128d aw = _mm_unpackhi_pd(a[1], a[1]);
+
+	for (int h = 0; h < 2; h++)
+	{
+		__m128d r = _mm_mul_pd(ax, B.row[0][h]);
+		r = _mm_add_pd(r, _mm_mul_pd(ay, B.row[1][h]));
+		r = _mm_add_pd(r, _mm_mul_pd(az, B.row[2][h]));
+		r = _mm_add_pd(r, _mm_mul_pd(aw, B.row[3][h]));
+		result[h] = r;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void givens_coeffs_sym_d(double& c_result, double& s_result, const Mat4x4d& vtav, const int a, const int b)
+{
+	const __m128d pp = _mm_set_sd(vtav.m[a][a]);
+	const __m128d pq = _mm_set_sd(vtav.m[a][b]);
+	const __m128d qq = _mm_set_sd(vtav.m[b][b]);
+
+	const __m128d zeros = _mm_setzero_pd();
+	const __m128d ones = _mm_set_sd(1.0);
+	const __m128d twos = _mm_set_sd(2.0);
+
+	// tau = (a_qq - a_pp) / (2 * a_pq);
+	__m128d tau = _mm_div_sd(_mm_sub_sd(qq, pp), _mm_mul_sd(pq, twos));
+
+	// stt = sqrt(1 + tau * tau);
+	__m128d stt = _mm_sqrt_sd(zeros, _mm_add_sd(_mm_mul_sd(tau, tau), ones));
+
+	// tan = 1 / ((tau >= 0) ? (tau + stt) : (tau - stt));
+	__m128d tan_cmp = _mm_cmpge_sd(tau, zeros);
+	__m128d tan_inv = _mm_or_pd(_mm_and_pd(tan_cmp, _mm_add_sd(tau, stt)), _mm_andnot_pd(tan_cmp, _mm_sub_sd(tau, stt)));
+	__m128d tan = _mm_div_sd(ones, tan_inv);
+
+	// c = 1 / sqrt(1 + tan * tan);
+	__m128d c = _mm_div_sd(ones, _mm_sqrt_sd(zeros, _mm_add_sd(ones, _mm_mul_sd(tan, tan))));
+
+	// s = tan * c;
+	__m128d s = _mm_mul_sd(tan, c);
+
+	c_result = _mm_cvtsd_f64(c);
+	s_result = _mm_cvtsd_f64(s);
+}
+
+// ----------------------------------------------------------------------------
+
+static void rotateq_xy_d(Mat4x4d& vtav, const double c, const double s, const int a, const int b)
+{
+	const __m128d u = _mm_set_sd(vtav.m[a][a]);
+	const __m128d v = _mm_set_sd(vtav.m[b][b]);
+	const __m128d A = _mm_set_sd(vtav.m[a][b]);
+	const __m128d simd_c = _mm_set_sd(c);
+	const __m128d simd_s = _mm_set_sd(s);
+
+	__m128d cc = _mm_mul_sd(simd_c, simd_c);
+	__m128d ss = _mm_mul_sd(simd_s, simd_s);
+
+	// mx = 2 * c * s * A;
+	__m128d mx = _mm_mul_sd(_mm_mul_sd(_mm_mul_sd(_mm_set_sd(2.0), simd_c), simd_s), A);
+
+	// x = cc * u - mx + ss * v;
+	__m128d x = _mm_add_sd(_mm_sub_sd(_mm_mul_sd(cc, u), mx), _mm_mul_sd(ss, v));
+
+	// y = ss * u + mx + cc * v;
+	__m128d y = _mm_add_sd(_mm_add_sd(_mm_mul_sd(ss, u), mx), _mm_mul_sd(cc, v));
+
+	vtav.m[a][a] = _mm_cvtsd_f64(x);
+	vtav.m[b][b] = _mm_cvtsd_f64(y);
+}
+
+// ----------------------------------------------------------------------------
+
+static void rotate_xy_d(Mat4x4d& vtav, Mat4x4d& v, const double c, const double s, const int a, const int b)
+{
+	// rows 0 and 1 of columns a and b in one register, row 2 and the remaining off diagonal
+	// element of vtav in the other, like the 4 lanes of rotate_xy
+	const __m128d u0 = _mm_set_pd(v.m[1][a], v.m[0][a]);
+	const __m128d u1 = _mm_set_pd(vtav.m[0][3 - b], v.m[2][a]);
+	const __m128d v0 = _mm_set_pd(v.m[1][b], v.m[0][b]);
+	const __m128d v1 = _mm_set_pd(vtav.m[1 - a][2], v.m[2][b]);
+
+	const __m128d simd_c = _mm_set1_pd(c);
+	const __m128d simd_s = _mm_set1_pd(s);
+
+	const __m128d x0 = _mm_sub_pd(_mm_mul_pd(simd_c, u0), _mm_mul_pd(simd_s, v0));
+	const __m128d x1 = _mm_sub_pd(_mm_mul_pd(simd_c, u1), _mm_mul_pd(simd_s, v1));
+	const __m128d y0 = _mm_add_pd(_mm_mul_pd(simd_s, u0), _mm_mul_pd(simd_c, v0));
+	const __m128d y1 = _mm_add_pd(_mm_mul_pd(simd_s, u1), _mm_mul_pd(simd_c, v1));
+
+	v.m[0][a] = _mm_cvtsd_f64(x0);
+	v.m[1][a] = _mm_cvtsd_f64(_mm_unpackhi_pd(x0, x0));
+	v.m[2][a] = _mm_cvtsd_f64(x1);
+	vtav.m[0][3 - b] = _mm_cvtsd_f64(_mm_unpackhi_pd(x1, x1));
+
+	v.m[0][b] = _mm_cvtsd_f64(y0);
+	v.m[1][b] = _mm_cvtsd_f64(_mm_unpackhi_pd(y0, y0));
+	v.m[2][b] = _mm_cvtsd_f64(y1);
+	vtav.m[1 - a][2] = _mm_cvtsd_f64(_mm_unpackhi_pd(y1, y1));
+
+	vtav.m[a][b] = 0.0;
+}
+
+// ----------------------------------------------------------------------------
+
+static void svd_solve_sym_d(Mat4x4d& v, const Mat4x4d& a, const int sweeps, __m128d* sigma)
+{
+	Mat4x4d vtav = a;
+
+	static const int pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+
+	for (int i = 0; i < sweeps; ++i)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			const int p = pairs[k][0];
+			const int q = pairs[k][1];
+
+			if (vtav.m[p][q] != 0.0)
+			{
+				double c, s;
+				givens_coeffs_sym_d(c, s, vtav, p, q);
+				rotateq_xy_d(vtav, c, s, p, q);
+				rotate_xy_d(vtav, v, c, s, p, q);
+				vtav.m[p][q] = 0.0;
+			}
+		}
+	}
+
+	sigma[0] = _mm_set_pd(vtav.m[1][1], vtav.m[0][0]);
+	sigma[1] = _mm_set_pd(0.0, vtav.m[2][2]);
+}
+
+// ----------------------------------------------------------------------------
+
+static void svd_pseudoinverse_d(Mat4x4d& o, const __m128d* sigma, const Mat4x4d& v)
+{
+	const __m128d sign = _mm_set1_pd(-0.0);
+	const __m128d ones = _mm_set1_pd(1.0);
+	const __m128d tol = _mm_set1_pd(PSUEDO_INVERSE_THRESHOLD);
+
+	__m128d invdet[2];
+	for (int h = 0; h < 2; h++)
+	{
+		const __m128d one_over_x = _mm_div_pd(ones, sigma[h]);
+		const __m128d min_abs = _mm_min_pd(_mm_andnot_pd(sign, sigma[h]), _mm_andnot_pd(sign, one_over_x));
+		invdet[h] = _mm_and_pd(_mm_cmpge_pd(min_abs, tol), one_over_x);
+	}
+
+	Mat4x4d m;
+	for (int r = 0; r < 3; r++)
+	{
+		m.row[r][0] = _mm_mul_pd(v.row[r][0], invdet[0]);
+		m.row[r][1] = _mm_mul_pd(v.row[r][1], invdet[1]);
+	}
+
+	for (int r = 0; r < 3; r++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			o.m[r][c] = vec4d_dot(m.row[c], v.row[r]);
+		}
+
+		o.m[r][3] = 0.0;
+	}
+
+	o.row[3][0] = o.row[3][1] = _mm_setzero_pd();
+}
+
+// ----------------------------------------------------------------------------
+
+inline double qef_solve_from_points_4d_double(
+	const double* positions,
+	const double* normals,
+	const int count,
+	double* solved_position,
+	const int sweeps)
+{
+	if (count < 2 || count > QEF_MAX_INPUT_COUNT)
+	{
+		solved_position[0] = solved_position[1] = solved_position[2] = solved_position[3] = 0.0;
+		return 0.0;
+	}
+
+	Mat4x4d ATA;
+	__m128d ATb[2] = { _mm_setzero_pd(), _mm_setzero_pd() };
+	__m128d pointaccum[2] = { _mm_setzero_pd(), _mm_setzero_pd() };
+
+	for (int r = 0; r < 4; r++)
+	{
+		ATA.row[r][0] = ATA.row[r][1] = _mm_setzero_pd();
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		const __m128d p[2] = { _mm_loadu_pd(&positions[i * 4]), _mm_loadu_pd(&positions[i * 4 + 2]) };
+		const __m128d nz[2] = { _mm_loadu_pd(&normals[i * 4]), _mm_set_sd(normals[i * 4 + 2]) };
+
+		// ATA += n * n^T, rows x, y and z
+		const __m128d nx = _mm_unpacklo_pd(nz[0], nz[0]);
+		const __m128d ny = _mm_unpackhi_pd(nz[0], nz[0]);
+		const __m128d nzz = _mm_unpacklo_pd(nz[1], nz[1]);
+
+		ATA.row[0][0] = _mm_add_pd(ATA.row[0][0], _mm_mul_pd(nx, nz[0]));
+		ATA.row[0][1] = _mm_add_pd(ATA.row[0][1], _mm_mul_pd(nx, nz[1]));
+		ATA.row[1][0] = _mm_add_pd(ATA.row[1][0], _mm_mul_pd(ny, nz[0]));
+		ATA.row[1][1] = _mm_add_pd(ATA.row[1][1], _mm_mul_pd(ny, nz[1]));
+		ATA.row[2][0] = _mm_add_pd(ATA.row[2][0], _mm_mul_pd(nzz, nz[0]));
+		ATA.row[2][1] = _mm_add_pd(ATA.row[2][1], _mm_mul_pd(nzz, nz[1]));
+
+		// ATb += dot(p, n) * n, the normal's w is ignored
+		const __m128d d = _mm_set1_pd(vec4d_dot(p, nz));
+		ATb[0] = _mm_add_pd(ATb[0], _mm_mul_pd(d, nz[0]));
+		ATb[1] = _mm_add_pd(ATb[1], _mm_mul_pd(d, nz[1]));
+
+		pointaccum[0] = _mm_add_pd(pointaccum[0], p[0]);
+		pointaccum[1] = _mm_add_pd(pointaccum[1], p[1]);
+	}
+
+	const __m128d mass_w = _mm_unpackhi_pd(pointaccum[1], pointaccum[1]);
+	const __m128d masspoint[2] = { _mm_div_pd(pointaccum[0], mass_w), _mm_div_pd(pointaccum[1], mass_w) };
+
+	__m128d p[2];
+	vec4d_mul_m4x4d(p, masspoint, ATA);
+	p[0] = _mm_sub_pd(ATb[0], p[0]);
+	p[1] = _mm_sub_pd(ATb[1], p[1]);
+
+	Mat4x4d V;
+	for (int r = 0; r < 4; r++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			V.m[r][c] = r == c && r < 3 ? 1.0 : 0.0;
+		}
+	}
+
+	__m128d sigma[2];
+	svd_solve_sym_d(V, ATA, sweeps, sigma);
+
+	Mat4x4d Vinv;
+	svd_pseudoinverse_d(Vinv, sigma, V);
+
+	__m128d x[2];
+	vec4d_mul_m4x4d(x, p, Vinv);
+
+	// error as in qef_simd_calc_error
+	__m128d tmp[2];
+	vec4d_mul_m4x4d(tmp, x, ATA);
+	tmp[0] = _mm_sub_pd(ATb[0], tmp[0]);
+	tmp[1] = _mm_sub_pd(ATb[1], tmp[1]);
+	const double error = vec4d_dot(tmp, tmp);
+
+	_mm_storeu_pd(&solved_position[0], _mm_add_pd(x[0], masspoint[0]));
+	_mm_storeu_pd(&solved_position[2], _mm_add_pd(x[1], masspoint[1]));
+	return error;
+}
+
+
 //#endif // QEF_INCLUDE_IMPL
 
 